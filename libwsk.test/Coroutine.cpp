@@ -0,0 +1,117 @@
+﻿// unnecessary, fix ReSharper's code analysis.
+#pragma warning(suppress: 4117)
+#define _KERNEL_MODE 1
+
+#include <Veil.h>
+#include <libwsk/libwsk.h>
+#include <libwsk/berkeley.h>
+#include <libwsk/coroutine.h>
+
+#include "Test.h"
+
+//////////////////////////////////////////////////////
+// Smoke tests of the C++ layers
+
+#if defined(__cpp_impl_coroutine)
+
+static wsk::task WSKTestEchoOnce(
+    _In_ SOCKET Socket
+)
+{
+    UCHAR Buffer[16];
+    wsk::async_socket Stream(Socket);
+
+    const auto Received = co_await Stream.receive(Buffer);
+    if (!NT_SUCCESS(Received.Status))
+    {
+        co_return Received.Status;
+    }
+
+    const auto Sent = co_await Stream.send({ Buffer, Received.Bytes });
+    co_return Sent.Status;
+}
+
+static wsk::task WSKTestReceiveOnce(
+    _In_ SOCKET                  Socket,
+    _In_ wsk::completion_queue*  Queue,
+    _Out_ wsk::io_result*        Result
+)
+{
+    UCHAR Buffer[16];
+    wsk::async_socket Stream(Socket, Queue);
+
+    *Result = co_await Stream.receive(Buffer);
+    co_return Result->Status;
+}
+
+#endif
+
+// Resumes from a system worker thread, from a completion_queue, and without suspending on a failed issue.
+NTSTATUS TestWSKCoroutine(void)
+{
+#if defined(__cpp_impl_coroutine)
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        ULONG RecvTimeout = 5000u; // ms
+
+        Status = WSKSetSocketOpt(Client, SOL_SOCKET, SO_RCVTIMEO, &RecvTimeout, sizeof RecvTimeout);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        // The receive is pending when start() returns, the echo comes from the worker.
+        Status = WSKTestEchoOnce(Server).start();
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        CHAR   Buffer[16] = "echo";
+        SIZE_T Bytes = 0u;
+
+        Status = WSKSend(Client, Buffer, 4u, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u);
+
+        RtlZeroMemory(Buffer, sizeof Buffer);
+
+        Status = WSKReceive(Client, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 4u);
+        WSK_TEST_EXPECT(RtlCompareMemory(Buffer, "echo", 4u) == 4u);
+
+        // Nothing runs until the queue is drained on this thread.
+        wsk::completion_queue Queue;
+        wsk::io_result        Result = { STATUS_PENDING, 0u };
+
+        Status = WSKTestReceiveOnce(Server, &Queue, &Result).start();
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKSend(Client, Buffer, 3u, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 3u);
+
+        LARGE_INTEGER Timeout = { 0 };
+        Timeout.QuadPart = -5000ll * 10000;
+
+        Status = Queue.run(&Timeout);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS);
+        WSK_TEST_EXPECT(Result.Status == STATUS_SUCCESS && Result.Bytes == 3u);
+
+        // A request that is never issued completes the await at once with its status.
+        Status = WSKTestEchoOnce(WSK_INVALID_SOCKET).wait();
+        WSK_TEST_EXPECT(!NT_SUCCESS(Status));
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+#else
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
@@ -4,6 +4,9 @@
 
 #include <Veil.h>
 #include <libwsk/libwsk.h>
+#include <libwsk/berkeley.h>
+
+#include "Test.h"
 
 EXTERN_C_START
 DRIVER_INITIALIZE   DriverEntry;
@@ -31,6 +34,8 @@ NTSTATUS StartWSKClient(
 
 VOID CloseWSKClient(void);
 
+NTSTATUS RunWSKTests(void);
+
 //
 //////////////////////////////////////////////////////
 
@@ -53,6 +58,12 @@ NTSTATUS DriverEntry(_In_ DRIVER_OBJECT* DriverObject, _In_ PUNICODE_STRING Regi
             break;
         }
 
+        Status = RunWSKTests();
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
         Status = StartWSKServer(nullptr, L"20211", AF_INET, SOCK_STREAM);
         if (!NT_SUCCESS(Status))
         {
@@ -860,3 +871,1974 @@ VOID CloseWSKClient(void)
 
 //
 //////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////
+// Smoke tests, each one fails the driver load
+
+// Lookups issued while the first one is in flight join it and get the same, reference counted, result.
+NTSTATUS TestWSKAddrInfoCoalescing(void)
+{
+    NTSTATUS      Status = STATUS_SUCCESS;
+    WSKOVERLAPPED Overlapped[4];
+    BOOLEAN       Joined[4] = { FALSE };
+    size_t        Issued = 0u;
+
+    for (size_t i = 0u; i < ARRAYSIZE(Overlapped); ++i)
+    {
+        RtlZeroMemory(&Overlapped[i], sizeof Overlapped[i]);
+        WSKCreateEvent(&Overlapped[i].Event);
+    }
+
+    do
+    {
+        for (; Issued < ARRAYSIZE(Overlapped); ++Issued)
+        {
+            PADDRINFOEXW Result = nullptr;
+
+            Status = WSKGetAddrInfo(L"localhost", L"80", NS_ALL, nullptr, nullptr, &Result,
+                WSK_INFINITE_WAIT, &Overlapped[Issued], nullptr);
+            if (Status != STATUS_PENDING)
+            {
+                break;
+            }
+
+            // The first lookup was still pending when this one returned, so this one joined it.
+            Joined[Issued] = (Overlapped[0].Internal == STATUS_PENDING);
+        }
+        WSK_TEST_EXPECT(Status == STATUS_PENDING);
+
+        Status = STATUS_SUCCESS;
+
+        for (size_t i = 0u; i < Issued; ++i)
+        {
+            KeWaitForSingleObject(&Overlapped[i].Event, Executive, KernelMode, FALSE, nullptr);
+        }
+
+        for (size_t i = 0u; i < Issued; ++i)
+        {
+            WSK_TEST_EXPECT(NT_SUCCESS((NTSTATUS)Overlapped[i].Internal) && Overlapped[i].Pointer);
+            WSK_TEST_EXPECT(!Joined[i] || Overlapped[i].Pointer == Overlapped[0].Pointer);
+        }
+
+    } while (false);
+
+    for (size_t i = 0u; i < Issued; ++i)
+    {
+        KeWaitForSingleObject(&Overlapped[i].Event, Executive, KernelMode, FALSE, nullptr);
+
+        // A shared result is released once per caller.
+        if (Overlapped[i].Pointer)
+        {
+            WSKFreeAddrInfo((PADDRINFOEXW)Overlapped[i].Pointer);
+        }
+    }
+
+    return Status;
+}
+
+// Literal hosts are answered in place, synchronously or through the overlapped, and freed like any result.
+NTSTATUS TestWSKAddrInfoLiteral(void)
+{
+    NTSTATUS     Status = STATUS_SUCCESS;
+    PADDRINFOEXW Result = nullptr;
+    PADDRINFOEXW Scoped = nullptr;
+
+    WSKOVERLAPPED Overlapped = { 0 };
+    WSKCreateEvent(&Overlapped.Event);
+
+    do
+    {
+        Status = WSKGetAddrInfo(L"127.0.0.1", L"8080", NS_ALL, nullptr, nullptr, &Result,
+            WSK_INFINITE_WAIT, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Result && Result->ai_next == nullptr);
+        WSK_TEST_EXPECT(Result->ai_family == AF_INET && Result->ai_addrlen == sizeof(SOCKADDR_IN));
+
+        const SOCKADDR_IN* Ipv4 = (const SOCKADDR_IN*)Result->ai_addr;
+        WSK_TEST_EXPECT(Ipv4->sin_port == RtlUshortByteSwap(8080) &&
+            Ipv4->sin_addr.s_addr == RtlUlongByteSwap(INADDR_LOOPBACK));
+
+        ADDRINFOEXW Hints = { 0 };
+        Hints.ai_family   = AF_INET6;
+        Hints.ai_socktype = SOCK_STREAM;
+        Hints.ai_protocol = IPPROTO_TCP;
+
+        // Answered before the call returns, the event is already set.
+        Status = WSKGetAddrInfo(L"fe80::1%3", nullptr, NS_ALL, nullptr, &Hints, &Scoped,
+            WSK_INFINITE_WAIT, &Overlapped, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && KeReadStateEvent(&Overlapped.Event));
+
+        Scoped = (PADDRINFOEXW)Overlapped.Pointer;
+        WSK_TEST_EXPECT(NT_SUCCESS((NTSTATUS)Overlapped.Internal) && Scoped);
+        WSK_TEST_EXPECT(Scoped->ai_family == AF_INET6 && Scoped->ai_socktype == SOCK_STREAM);
+
+        const SOCKADDR_IN6* Ipv6 = (const SOCKADDR_IN6*)Scoped->ai_addr;
+        WSK_TEST_EXPECT(Ipv6->sin6_scope_id == 3u && Ipv6->sin6_port == 0u && Ipv6->sin6_addr.u.Byte[0] == 0xFE);
+
+    } while (false);
+
+    if (Scoped)
+    {
+        WSKFreeAddrInfo(Scoped);
+    }
+
+    if (Result)
+    {
+        WSKFreeAddrInfo(Result);
+    }
+
+    return Status;
+}
+
+// The converted list keeps every node, address and canonical name of the provider's list.
+NTSTATUS TestWSKAddrInfoConversion(void)
+{
+    NTSTATUS         Status = STATUS_SUCCESS;
+    struct addrinfo* Result = nullptr;
+
+    do
+    {
+        struct addrinfo Hints = { 0 };
+        Hints.ai_flags    = AI_CANONNAME;
+        Hints.ai_family   = AF_UNSPEC;
+        Hints.ai_socktype = SOCK_STREAM;
+
+        WSK_TEST_EXPECT(getaddrinfo("localhost", "443", &Hints, &Result) == 0 && Result);
+
+        for (const struct addrinfo* Node = Result; Node; Node = Node->ai_next)
+        {
+            WSK_TEST_EXPECT(Node->ai_addr && Node->ai_socktype == SOCK_STREAM);
+
+            if (Node->ai_family == AF_INET)
+            {
+                WSK_TEST_EXPECT(Node->ai_addrlen == sizeof(SOCKADDR_IN) &&
+                    ((const SOCKADDR_IN*)Node->ai_addr)->sin_port == RtlUshortByteSwap(443));
+            }
+            else
+            {
+                WSK_TEST_EXPECT(Node->ai_family == AF_INET6 && Node->ai_addrlen == sizeof(SOCKADDR_IN6) &&
+                    ((const SOCKADDR_IN6*)Node->ai_addr)->sin6_port == RtlUshortByteSwap(443));
+            }
+
+            WSK_TEST_EXPECT(Node->ai_canonname == nullptr || Node->ai_canonname[0] != '\0');
+        }
+
+    } while (false);
+
+    if (Result)
+    {
+        freeaddrinfo(Result);
+    }
+
+    return Status;
+}
+
+USHORT TestPort = 20300u;
+
+VOID CloseWSKPair(
+    _In_ SOCKET Server,
+    _In_ SOCKET Client
+)
+{
+    if (Server != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Server);
+    }
+
+    if (Client != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Client);
+    }
+}
+
+// Listens on a new loopback port each call.
+NTSTATUS CreateWSKListener(
+    _Out_ SOCKET*      Listener,
+    _Out_ SOCKADDR_IN* Address
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlZeroMemory(Address, sizeof *Address);
+    Address->sin_family      = AF_INET;
+    Address->sin_port        = RtlUshortByteSwap(TestPort++);
+    Address->sin_addr.s_addr = RtlUlongByteSwap(INADDR_LOOPBACK);
+
+    *Listener = WSK_INVALID_SOCKET;
+
+    do
+    {
+        Status = WSKSocket(Listener, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKBind(*Listener, (SOCKADDR*)Address, sizeof *Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKListen(*Listener, 8);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+    } while (false);
+
+    if (!NT_SUCCESS(Status) && *Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(*Listener);
+        *Listener = WSK_INVALID_SOCKET;
+    }
+
+    return Status;
+}
+
+// A connected loopback pair.
+NTSTATUS CreateWSKPair(
+    _Out_ SOCKET* Server,
+    _Out_ SOCKET* Client
+)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+
+    *Server = WSK_INVALID_SOCKET;
+    *Client = WSK_INVALID_SOCKET;
+
+    do
+    {
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKSocket(Client, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        // The stack completes the connection from the listen backlog.
+        Status = WSKConnect(*Client, (SOCKADDR*)&Address, sizeof Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKAccept(Listener, Server, nullptr, 0u, nullptr, 0u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+    } while (false);
+
+    if (Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Listener);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        CloseWSKPair(*Server, *Client);
+
+        *Server = WSK_INVALID_SOCKET;
+        *Client = WSK_INVALID_SOCKET;
+    }
+
+    return Status;
+}
+
+// Only IPv4 listens, so whatever IPv6 address localhost has is refused and IPv4 wins.
+NTSTATUS TestWSKConnectByName(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+    SOCKET   Client   = WSK_INVALID_SOCKET;
+
+    do
+    {
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WCHAR Service[8] = { 0 };
+
+        Status = RtlStringCchPrintfW(Service, ARRAYSIZE(Service), L"%hu", RtlUshortByteSwap(Address.sin_port));
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        SOCKADDR_STORAGE Remote = { 0 };
+
+        Status = WSKConnectByName(&Client, L"localhost", Service, (SOCKADDR*)&Remote, sizeof Remote, 5000u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Client != WSK_INVALID_SOCKET);
+        WSK_TEST_EXPECT(Remote.ss_family == AF_INET &&
+            ((SOCKADDR_IN*)&Remote)->sin_port == Address.sin_port);
+
+    } while (false);
+
+    if (Client != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Client);
+    }
+
+    if (Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Listener);
+    }
+
+    return Status;
+}
+
+// Literal addresses are parsed by the library, the result has to match Rtl.
+NTSTATUS TestWSKAddressParsing(void)
+{
+    static const LPCWSTR Ipv4Strings[] = {
+        L"127.0.0.1", L"0.0.0.0", L"255.255.255.255", L"1.2.3.4:80", L"10.0.0.1:65535",
+        L"1.2.3", L"256.1.1.1", L"01.2.3.4", L"1.2.3.4:", L"1.2.3.4:65536", L"1..2.3",
+    };
+    static const LPCWSTR Ipv6Strings[] = {
+        L"::", L"::1", L"1::", L"1::8", L"fe80::1%3", L"[fe80::1%3]:443", L"[::1]:80",
+        L"2001:db8::ffff:1.2.3.4", L"1:2:3:4:5:6:7:8", L"1:2:3:4:5:6:7::", L"::2:3:4:5:6:7:8",
+        L"1:2:3:4:5:6:7:8::", L"::1:2:3:4:5:6:7:8", L"1::2::3", L"12345::", L":1", L"1:2:3:4:5:6::7:8",
+    };
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    WCHAR Text[INET6_ADDRSTRLEN + 16];
+    WCHAR Expected[INET6_ADDRSTRLEN + 16];
+
+    for (size_t i = 0u; i < ARRAYSIZE(Ipv4Strings) && NT_SUCCESS(Status); ++i)
+    {
+        do
+        {
+            SOCKADDR_INET Address = { 0 };
+            Address.si_family = AF_INET;
+
+            UINT32   AddressLength = sizeof Address;
+            NTSTATUS Parsed = WSKStringToAddress(Ipv4Strings[i], (SOCKADDR*)&Address, &AddressLength);
+
+            IN_ADDR  RtlAddress = { 0 };
+            USHORT   RtlPort    = 0u;
+            NTSTATUS RtlParsed  = RtlIpv4StringToAddressExW(Ipv4Strings[i], TRUE, &RtlAddress, &RtlPort);
+
+            WSK_TEST_EXPECT(NT_SUCCESS(Parsed) == NT_SUCCESS(RtlParsed));
+            if (!NT_SUCCESS(Parsed))
+            {
+                break;
+            }
+
+            WSK_TEST_EXPECT(Address.Ipv4.sin_addr.s_addr == RtlAddress.s_addr);
+            WSK_TEST_EXPECT(Address.Ipv4.sin_port == RtlPort);
+
+            UINT32 TextLength     = ARRAYSIZE(Text);
+            ULONG  ExpectedLength = ARRAYSIZE(Expected);
+
+            WSK_TEST_EXPECT(NT_SUCCESS(WSKAddressToString((SOCKADDR*)&Address, sizeof Address.Ipv4, Text, &TextLength)));
+            WSK_TEST_EXPECT(NT_SUCCESS(RtlIpv4AddressToStringExW(&RtlAddress, RtlPort, Expected, &ExpectedLength)));
+            WSK_TEST_EXPECT(wcscmp(Text, Expected) == 0);
+
+        } while (false);
+    }
+
+    for (size_t i = 0u; i < ARRAYSIZE(Ipv6Strings) && NT_SUCCESS(Status); ++i)
+    {
+        do
+        {
+            SOCKADDR_INET Address = { 0 };
+            Address.si_family = AF_INET6;
+
+            UINT32   AddressLength = sizeof Address;
+            NTSTATUS Parsed = WSKStringToAddress(Ipv6Strings[i], (SOCKADDR*)&Address, &AddressLength);
+
+            IN6_ADDR RtlAddress = { 0 };
+            ULONG    RtlScopeId = 0u;
+            USHORT   RtlPort    = 0u;
+            NTSTATUS RtlParsed  = RtlIpv6StringToAddressExW(Ipv6Strings[i], &RtlAddress, &RtlScopeId, &RtlPort);
+
+            WSK_TEST_EXPECT(NT_SUCCESS(Parsed) == NT_SUCCESS(RtlParsed));
+            if (!NT_SUCCESS(Parsed))
+            {
+                break;
+            }
+
+            WSK_TEST_EXPECT(RtlEqualMemory(&Address.Ipv6.sin6_addr, &RtlAddress, sizeof RtlAddress));
+            WSK_TEST_EXPECT(Address.Ipv6.sin6_scope_id == RtlScopeId);
+            WSK_TEST_EXPECT(Address.Ipv6.sin6_port == RtlPort);
+
+            UINT32 TextLength     = ARRAYSIZE(Text);
+            ULONG  ExpectedLength = ARRAYSIZE(Expected);
+
+            WSK_TEST_EXPECT(NT_SUCCESS(WSKAddressToString((SOCKADDR*)&Address, sizeof Address.Ipv6, Text, &TextLength)));
+            WSK_TEST_EXPECT(NT_SUCCESS(RtlIpv6AddressToStringExW(&RtlAddress, RtlScopeId, RtlPort, Expected, &ExpectedLength)));
+            WSK_TEST_EXPECT(wcscmp(Text, Expected) == 0);
+
+        } while (false);
+    }
+
+    return Status;
+}
+
+// A batch converts the same way as one address at a time.
+NTSTATUS TestWSKAddressBatch(void)
+{
+    static const WCHAR Packed[] =
+        L"127.0.0.1\0" L"10.1.2.3:8080\0" L"::1\0" L"[fe80::1%4]:443\0" L"2001:db8::1\0" L"255.255.255.255\0";
+
+    NTSTATUS       Status  = STATUS_SUCCESS;
+    LPWSTR         Strings = nullptr;
+    SOCKADDR_INET* Many    = nullptr;
+
+    do
+    {
+        SOCKADDR_INET Addresses[6] = { 0 };
+        UINT32        Converted = 0u;
+
+        Status = WSKStringToAddressBatch(Packed, ARRAYSIZE(Packed) - 1, Addresses, ARRAYSIZE(Addresses), &Converted);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+        WSK_TEST_EXPECT(Converted == ARRAYSIZE(Addresses));
+
+        PCWSTR String = Packed;
+        for (size_t i = 0u; i < ARRAYSIZE(Addresses) && NT_SUCCESS(Status); ++i)
+        {
+            SOCKADDR_INET Address = { 0 };
+            Address.si_family = Addresses[i].si_family;
+
+            UINT32 AddressLength = sizeof Address;
+
+            WSK_TEST_EXPECT(NT_SUCCESS(WSKStringToAddress(String, (SOCKADDR*)&Address, &AddressLength)));
+            WSK_TEST_EXPECT(RtlEqualMemory(&Address, &Addresses[i], AddressLength));
+
+            String += wcslen(String) + 1;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        // Asking without a buffer returns the size.
+        UINT32 StringsLength = 0u;
+
+        Status = WSKAddressToStringBatch(Addresses, ARRAYSIZE(Addresses), nullptr, &StringsLength, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_BUFFER_TOO_SMALL);
+
+        Strings = (LPWSTR)ExAllocatePoolZero(PagedPool, StringsLength * sizeof(WCHAR), POOL_TAG);
+        WSK_TEST_EXPECT(Strings != nullptr);
+
+        UINT32 Offsets[6] = { 0 };
+
+        Status = WSKAddressToStringBatch(Addresses, ARRAYSIZE(Addresses), Strings, &StringsLength, Offsets);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        for (size_t i = 0u; i < ARRAYSIZE(Addresses) && NT_SUCCESS(Status); ++i)
+        {
+            WCHAR  Text[INET6_ADDRSTRLEN + 16];
+            UINT32 TextLength = ARRAYSIZE(Text);
+
+            WSK_TEST_EXPECT(NT_SUCCESS(WSKAddressToString((SOCKADDR*)&Addresses[i], sizeof Addresses[i], Text, &TextLength)));
+            WSK_TEST_EXPECT(wcscmp(&Strings[Offsets[i]], Text) == 0);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        // Enough strings to span several blocks in both directions.
+        const UINT32 ManyCount = 96u;
+
+        Many = (SOCKADDR_INET*)ExAllocatePoolZero(PagedPool, 2 * ManyCount * sizeof(SOCKADDR_INET), POOL_TAG);
+        WSK_TEST_EXPECT(Many != nullptr);
+
+        for (UINT32 i = 0u; i < ManyCount; ++i)
+        {
+            Many[i] = Addresses[i % ARRAYSIZE(Addresses)];
+            Many[i].Ipv4.sin_port = RtlUshortByteSwap((USHORT)(i * 677u));
+        }
+
+        ExFreePoolWithTag(Strings, POOL_TAG);
+        Strings       = nullptr;
+        StringsLength = 0u;
+
+        Status = WSKAddressToStringBatch(Many, ManyCount, nullptr, &StringsLength, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_BUFFER_TOO_SMALL);
+
+        Strings = (LPWSTR)ExAllocatePoolZero(PagedPool, StringsLength * sizeof(WCHAR), POOL_TAG);
+        WSK_TEST_EXPECT(Strings != nullptr);
+
+        Status = WSKAddressToStringBatch(Many, ManyCount, Strings, &StringsLength, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKStringToAddressBatch(Strings, StringsLength, &Many[ManyCount], ManyCount, &Converted);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+        WSK_TEST_EXPECT(Converted == ManyCount);
+        WSK_TEST_EXPECT(RtlEqualMemory(Many, &Many[ManyCount], ManyCount * sizeof(SOCKADDR_INET)));
+
+    } while (false);
+
+    if (Many)
+    {
+        ExFreePoolWithTag(Many, POOL_TAG);
+    }
+
+    if (Strings)
+    {
+        ExFreePoolWithTag(Strings, POOL_TAG);
+    }
+
+    return Status;
+}
+
+// The inline helpers, the exported functions and the bulk kernels agree.
+NTSTATUS TestWSKByteOrder(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        WSK_TEST_EXPECT(htons(0x1234u) == 0x3412u);
+        WSK_TEST_EXPECT(htonl(0x12345678ul) == 0x78563412ul);
+        WSK_TEST_EXPECT(ntohs(htons(0xBEEFu)) == 0xBEEFu);
+        WSK_TEST_EXPECT(ntohl(htonl(0xDEADBEEFul)) == 0xDEADBEEFul);
+        WSK_TEST_EXPECT((htons)(0x1234u) == 0x3412u);
+        WSK_TEST_EXPECT((htonl)(0x12345678ul) == 0x78563412ul);
+
+        // Odd counts leave a scalar tail after the vector loop.
+        unsigned short     Words[37]     = { 0 };
+        unsigned short     Swapped16[37] = { 0 };
+        unsigned long      Longs[23]     = { 0 };
+        unsigned long long Quads[11]     = { 0 };
+
+        for (size_t i = 0u; i < ARRAYSIZE(Words); ++i)
+        {
+            Words[i] = (unsigned short)(0x0102u * (i + 1));
+        }
+        for (size_t i = 0u; i < ARRAYSIZE(Longs); ++i)
+        {
+            Longs[i] = 0x01020304ul * (unsigned long)(i + 1);
+        }
+        for (size_t i = 0u; i < ARRAYSIZE(Quads); ++i)
+        {
+            Quads[i] = 0x0102030405060708ull * (i + 1);
+        }
+
+        WSKByteSwapArray16(Swapped16, Words, ARRAYSIZE(Words));
+        WSKByteSwapArray32(Longs, Longs, ARRAYSIZE(Longs));
+        WSKByteSwapArray64(Quads, Quads, ARRAYSIZE(Quads));
+
+        for (size_t i = 0u; i < ARRAYSIZE(Words) && NT_SUCCESS(Status); ++i)
+        {
+            WSK_TEST_EXPECT(Swapped16[i] == _byteswap_ushort((unsigned short)(0x0102u * (i + 1))));
+        }
+        for (size_t i = 0u; i < ARRAYSIZE(Longs) && NT_SUCCESS(Status); ++i)
+        {
+            WSK_TEST_EXPECT(Longs[i] == _byteswap_ulong(0x01020304ul * (unsigned long)(i + 1)));
+        }
+        for (size_t i = 0u; i < ARRAYSIZE(Quads) && NT_SUCCESS(Status); ++i)
+        {
+            WSK_TEST_EXPECT(Quads[i] == _byteswap_uint64(0x0102030405060708ull * (i + 1)));
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+typedef struct _WSK_TEST_SEND
+{
+    SOCKET  Socket;
+    ULONG   Delay;  // ms
+    KEVENT  Done;
+}WSK_TEST_SEND;
+
+VOID NTAPI WSKTestDelayedSend(
+    _In_ PVOID StartContext
+)
+{
+    WSK_TEST_SEND* Send = (WSK_TEST_SEND*)StartContext;
+
+    LARGE_INTEGER Delay = { 0 };
+    Delay.QuadPart = -(LONGLONG)Send->Delay * 10000;
+
+    KeDelayExecutionThread(KernelMode, FALSE, &Delay);
+
+    CHAR   Data  = 'x';
+    SIZE_T Bytes = 0u;
+    WSKSend(Send->Socket, &Data, sizeof Data, &Bytes, 0, nullptr, nullptr);
+
+    KeSetEvent(&Send->Done, IO_NO_INCREMENT, FALSE);
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+// A waiting poll wakes up on data, a receive that drains it makes the socket not readable again.
+NTSTATUS TestWSKPoll(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+    BOOLEAN  Queued = FALSE;
+
+    WSK_TEST_SEND Send = { 0 };
+    KeInitializeEvent(&Send.Done, NotificationEvent, FALSE);
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKPOLLFD Readable = { Server, WSK_POLLIN, 0 };
+        UINT32    Ready    = 0u;
+
+        Status = WSKPoll(&Readable, 1u, 0u, &Ready);
+        WSK_TEST_EXPECT(Status == STATUS_TIMEOUT && Ready == 0u);
+
+        Send.Socket = Client;
+        Send.Delay  = 50u;
+
+        HANDLE Thread = nullptr;
+
+        Status = PsCreateSystemThread(&Thread, THREAD_ALL_ACCESS, nullptr, nullptr, nullptr, WSKTestDelayedSend, &Send);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        ZwClose(Thread);
+        Queued = TRUE;
+
+        Status = WSKPoll(&Readable, 1u, 5000u, &Ready);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Ready == 1u);
+        WSK_TEST_EXPECT(Readable.ReturnedEvents & WSK_POLLIN);
+
+        CHAR   Buffer[16];
+        SIZE_T Bytes = 0u;
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 1u);
+
+        Status = WSKPoll(&Readable, 1u, 0u, &Ready);
+        WSK_TEST_EXPECT(Status == STATUS_TIMEOUT && Ready == 0u);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Queued)
+    {
+        KeWaitForSingleObject(&Send.Done, Executive, KernelMode, FALSE, nullptr);
+    }
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+
+// A nonblocking receive without data fails at once instead of waiting.
+NTSTATUS TestWSKNonBlocking(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        ULONG NonBlocking = 1u;
+
+        Status = WSKIoctl(Server, FIONBIO, &NonBlocking, sizeof NonBlocking, nullptr, 0, nullptr, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKIoctl(Client, FIONBIO, &NonBlocking, sizeof NonBlocking, nullptr, 0, nullptr, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        CHAR   Buffer[16] = "hello";
+        SIZE_T Bytes = 0u;
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_DEVICE_NOT_READY && Bytes == 0u);
+
+        Status = WSKSend(Client, Buffer, 5u, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 5u);
+
+        WSKPOLLFD Readable = { Server, WSK_POLLIN, 0 };
+
+        Status = WSKPoll(&Readable, 1u, 1000u, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS);
+
+        RtlZeroMemory(Buffer, sizeof Buffer);
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 5u);
+        WSK_TEST_EXPECT(RtlEqualMemory(Buffer, "hello", 5u));
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_DEVICE_NOT_READY);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+// SO_RCVTIMEO is kept by the timer wheel, the receive gives up after about that long.
+NTSTATUS TestWSKReceiveTimeout(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        ULONG RecvTimeout = 100u; // ms
+
+        Status = WSKSetSocketOpt(Server, SOL_SOCKET, SO_RCVTIMEO, &RecvTimeout, sizeof RecvTimeout);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        CHAR   Buffer[16] = "hello";
+        SIZE_T Bytes = 0u;
+
+        const ULONG64 Start = KeQueryInterruptTime();
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_TIMEOUT && Bytes == 0u);
+
+        const ULONG64 Elapsed = (KeQueryInterruptTime() - Start) / 10000u; // ms
+        WSK_TEST_EXPECT(Elapsed >= 50u && Elapsed < 2000u);
+
+        // The timed out request is gone, the next one gets the data.
+        Status = WSKSend(Client, Buffer, 5u, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 5u);
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 5u);
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+NTSTATUS WaitWSKOverlapped(
+    _In_ WSKOVERLAPPED* Overlapped,
+    _In_ ULONG Milliseconds
+)
+{
+    LARGE_INTEGER Timeout = { 0 };
+    Timeout.QuadPart = -(LONGLONG)Milliseconds * 10000;
+
+    return KeWaitForSingleObject(&Overlapped->Event, Executive, KernelMode, FALSE, &Timeout);
+}
+
+// WSKCancelIoEx cancels only the given request, WSKCancelIo the rest.
+NTSTATUS TestWSKCancelIo(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    WSKOVERLAPPED First  = { 0 };
+    WSKOVERLAPPED Second = { 0 };
+
+    WSKCreateEvent(&First.Event);
+    WSKCreateEvent(&Second.Event);
+
+    CHAR FirstBuffer[16];
+    CHAR SecondBuffer[16];
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKReceive(Server, FirstBuffer, sizeof FirstBuffer, nullptr, 0, &First, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_PENDING);
+
+        Status = WSKReceive(Server, SecondBuffer, sizeof SecondBuffer, nullptr, 0, &Second, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_PENDING);
+
+        Status = WSKCancelIoEx(Server, &First);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WaitWSKOverlapped(&First, 5000u);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS);
+        WSK_TEST_EXPECT((NTSTATUS)First.Internal == STATUS_CANCELLED);
+
+        Status = WaitWSKOverlapped(&Second, 50u);
+        WSK_TEST_EXPECT(Status == STATUS_TIMEOUT);
+
+        Status = WSKCancelIo(Server);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WaitWSKOverlapped(&Second, 5000u);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS);
+        WSK_TEST_EXPECT((NTSTATUS)Second.Internal == STATUS_CANCELLED);
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    // Closing cancels what is left, the buffers are on this stack.
+    WaitWSKOverlapped(&First, 5000u);
+    WaitWSKOverlapped(&Second, 5000u);
+
+    return Status;
+}
+
+// A bind before connect binds the connecting socket, an option set before it carries over, and the mode sticks.
+NTSTATUS TestWSKStreamMode(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+    SOCKET   Server   = WSK_INVALID_SOCKET;
+    SOCKET   Client   = WSK_INVALID_SOCKET;
+
+    do
+    {
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKSocket(&Client, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        SOCKADDR_IN Local = Address;
+        Local.sin_port = RtlUshortByteSwap(TestPort++);
+
+        Status = WSKBind(Client, (SOCKADDR*)&Local, sizeof Local);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        ULONG  KeepAlive = 1u;
+        SIZE_T Bytes     = sizeof KeepAlive;
+
+        Status = WSKSetSocketOpt(Client, SOL_SOCKET, SO_KEEPALIVE, &KeepAlive, sizeof KeepAlive);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKConnect(Client, (SOCKADDR*)&Address, sizeof Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        SOCKADDR_IN Remote = { 0 };
+
+        Status = WSKAccept(Listener, &Server, nullptr, 0u, (SOCKADDR*)&Remote, sizeof Remote);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+        WSK_TEST_EXPECT(Remote.sin_port == Local.sin_port);
+
+        KeepAlive = 0u;
+
+        Status = WSKGetSocketOpt(Client, SOL_SOCKET, SO_KEEPALIVE, &KeepAlive, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && KeepAlive != 0u);
+
+        // Connected, so it cannot become a listener any more.
+        Status = WSKListen(Client, 1);
+        WSK_TEST_EXPECT(!NT_SUCCESS(Status));
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Listener);
+    }
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+// A socket bound by WSKBind connects from that address, an unbound one from WSK_SO_CONNECT_SOURCE.
+NTSTATUS TestWSKConnectSource(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+    SOCKET   Bound    = WSK_INVALID_SOCKET;
+    SOCKET   Sourced  = WSK_INVALID_SOCKET;
+    SOCKET   Server   = WSK_INVALID_SOCKET;
+
+    do
+    {
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        SOCKADDR_IN Local  = Address;
+        SOCKADDR_IN Remote = { 0 };
+
+        Local.sin_port = RtlUshortByteSwap(TestPort++);
+
+        Status = WSKSocket(&Bound, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKBind(Bound, (SOCKADDR*)&Local, sizeof Local);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKConnect(Bound, (SOCKADDR*)&Address, sizeof Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKAccept(Listener, &Server, nullptr, 0u, (SOCKADDR*)&Remote, sizeof Remote);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Remote.sin_port == Local.sin_port);
+
+        WSKCloseSocket(Server);
+        Server = WSK_INVALID_SOCKET;
+
+        Status = WSKSocket(&Sourced, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        WSKCONNECTSOURCE Source = { 0 };
+        Source.Address.Ipv4.sin_family      = AF_INET;
+        Source.Address.Ipv4.sin_addr.s_addr = RtlUlongByteSwap(INADDR_LOOPBACK);
+        Source.PortLow  = 2u;
+        Source.PortHigh = 1u;
+
+        Status = WSKSetSocketOpt(Sourced, SOL_SOCKET, WSK_SO_CONNECT_SOURCE, &Source, sizeof Source);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_PARAMETER);
+
+        // A range of one port, so the bind can only land there.
+        Source.PortLow  = TestPort++;
+        Source.PortHigh = Source.PortLow;
+
+        Status = WSKSetSocketOpt(Sourced, SOL_SOCKET, WSK_SO_CONNECT_SOURCE, &Source, sizeof Source);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        WSKCONNECTSOURCE Current = { 0 };
+        SIZE_T           Bytes   = sizeof Current;
+
+        Status = WSKGetSocketOpt(Sourced, SOL_SOCKET, WSK_SO_CONNECT_SOURCE, &Current, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Current.PortLow == Source.PortLow && Current.PortHigh == Source.PortHigh);
+
+        Status = WSKConnect(Sourced, (SOCKADDR*)&Address, sizeof Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        RtlZeroMemory(&Remote, sizeof Remote);
+
+        Status = WSKAccept(Listener, &Server, nullptr, 0u, (SOCKADDR*)&Remote, sizeof Remote);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Remote.sin_port == RtlUshortByteSwap(Source.PortLow));
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Listener);
+    }
+
+    CloseWSKPair(Server, Sourced);
+    CloseWSKPair(WSK_INVALID_SOCKET, Bound);
+
+    return Status;
+}
+
+// Connects from the one port Port through the shared allocator.
+static NTSTATUS ConnectWSKShared(
+    _Out_ SOCKET*      Socket,
+    _In_  SOCKADDR_IN* Address,
+    _In_  USHORT       Port
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        Status = WSKSocket(Socket, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        ULONG Share = 1u;
+
+        Status = WSKSetSocketOpt(*Socket, SOL_SOCKET, WSK_SO_SHARE_SOURCE_PORT, &Share, sizeof Share);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKCONNECTSOURCE Source = { 0 };
+        Source.Address.Ipv4.sin_family      = AF_INET;
+        Source.Address.Ipv4.sin_addr.s_addr = RtlUlongByteSwap(INADDR_LOOPBACK);
+        Source.PortLow  = Port;
+        Source.PortHigh = Port;
+
+        Status = WSKSetSocketOpt(*Socket, SOL_SOCKET, WSK_SO_CONNECT_SOURCE, &Source, sizeof Source);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKConnect(*Socket, (SOCKADDR*)Address, sizeof *Address);
+
+    } while (false);
+
+    return Status;
+}
+
+// One local port serves two destinations, a third connect to the first one finds it used up,
+// and a port held outside the allocator is marked instead of handed out again.
+NTSTATUS TestWSKSharedSourcePort(void)
+{
+    NTSTATUS Status     = STATUS_SUCCESS;
+    SOCKET   First      = WSK_INVALID_SOCKET;
+    SOCKET   Second     = WSK_INVALID_SOCKET;
+    SOCKET   Holder     = WSK_INVALID_SOCKET;
+    SOCKET   Clients[4] = { WSK_INVALID_SOCKET, WSK_INVALID_SOCKET, WSK_INVALID_SOCKET, WSK_INVALID_SOCKET };
+
+    do
+    {
+        SOCKADDR_IN FirstAddress  = { 0 };
+        SOCKADDR_IN SecondAddress = { 0 };
+
+        Status = CreateWSKListener(&First, &FirstAddress);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = CreateWSKListener(&Second, &SecondAddress);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKSOURCEPORTSTATS Before = { 0 };
+        WSKSOURCEPORTSTATS After  = { 0 };
+
+        Status = WSKGetSourcePortStatistics(&Before);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        const USHORT Port = TestPort++;
+
+        Status = ConnectWSKShared(&Clients[0], &FirstAddress, Port);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ConnectWSKShared(&Clients[1], &SecondAddress, Port);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ConnectWSKShared(&Clients[2], &FirstAddress, Port);
+        WSK_TEST_EXPECT(Status == STATUS_TOO_MANY_ADDRESSES);
+
+        // Held exclusively, so the shared bind is refused and the port marked.
+        SOCKADDR_IN Held = FirstAddress;
+        Held.sin_port = RtlUshortByteSwap(TestPort++);
+
+        ULONG Exclusive = 1u;
+
+        Status = WSKSocket(&Holder, AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKSetSocketOpt(Holder, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, &Exclusive, sizeof Exclusive);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKBind(Holder, (SOCKADDR*)&Held, sizeof Held);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ConnectWSKShared(&Clients[3], &SecondAddress, RtlUshortByteSwap(Held.sin_port));
+        WSK_TEST_EXPECT(Status == STATUS_TOO_MANY_ADDRESSES);
+
+        Status = WSKGetSourcePortStatistics(&After);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        WSK_TEST_EXPECT(After.Allocations - Before.Allocations == 3u);
+        WSK_TEST_EXPECT(After.PortsInUse  - Before.PortsInUse  == 2u);
+        WSK_TEST_EXPECT(After.PortsMarked - Before.PortsMarked == 1u);
+        WSK_TEST_EXPECT(After.Conflicts   - Before.Conflicts   == 1u);
+        WSK_TEST_EXPECT(After.Exhausted   - Before.Exhausted   == 2u);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    for (ULONG Index = 0u; Index < ARRAYSIZE(Clients); ++Index)
+    {
+        CloseWSKPair(WSK_INVALID_SOCKET, Clients[Index]);
+    }
+
+    CloseWSKPair(Holder, WSK_INVALID_SOCKET);
+    CloseWSKPair(First, Second);
+
+    return Status;
+}
+
+// A released connection is handed out again, one released as not reusable is closed.
+NTSTATUS TestWSKConnectionPool(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+
+    PWSKCONNECTIONPOOL Pool = nullptr;
+    WSKPOOLEDSOCKET    Pooled = { 0 };
+
+    Pooled.Socket = WSK_INVALID_SOCKET;
+
+    do
+    {
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKCONNECTIONPOOLCONFIG Config = { 0 };
+        Config.MaxIdle = 2u;
+
+        Status = WSKCreateConnectionPool(&Pool, &Config);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKConnectionPoolAcquire(Pool, (SOCKADDR*)&Address, sizeof Address, &Pooled);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && !Pooled.Reused);
+
+        const SOCKET Socket = Pooled.Socket;
+
+        WSKConnectionPoolRelease(Pool, &Pooled, TRUE);
+        Pooled.Socket = WSK_INVALID_SOCKET;
+
+        Status = WSKConnectionPoolAcquire(Pool, (SOCKADDR*)&Address, sizeof Address, &Pooled);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Pooled.Reused && Pooled.Socket == Socket);
+
+        WSKConnectionPoolRelease(Pool, &Pooled, FALSE);
+        Pooled.Socket = WSK_INVALID_SOCKET;
+
+        Status = WSKConnectionPoolAcquire(Pool, (SOCKADDR*)&Address, sizeof Address, &Pooled);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && !Pooled.Reused);
+
+    } while (false);
+
+    if (Pooled.Socket != WSK_INVALID_SOCKET)
+    {
+        WSKConnectionPoolRelease(Pool, &Pooled, FALSE);
+    }
+
+    if (Pool)
+    {
+        WSKDeleteConnectionPool(Pool);
+    }
+
+    if (Listener != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Listener);
+    }
+
+    return Status;
+}
+
+// Reserved sockets work like fresh ones, and sockets beyond the reserve still come from the provider.
+NTSTATUS TestWSKSocketReserve(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Listener = WSK_INVALID_SOCKET;
+    SOCKET   Server   = WSK_INVALID_SOCKET;
+    SOCKET   Sockets[3] = { WSK_INVALID_SOCKET, WSK_INVALID_SOCKET, WSK_INVALID_SOCKET };
+
+    do
+    {
+        Status = WSKSetSocketReserve(AF_INET, SOCK_STREAM, IPPROTO_TCP, 2u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        for (size_t i = 0u; i < ARRAYSIZE(Sockets); ++i)
+        {
+            Status = WSKSocket(&Sockets[i], AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        SOCKADDR_IN Address = { 0 };
+
+        Status = CreateWSKListener(&Listener, &Address);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKConnect(Sockets[0], (SOCKADDR*)&Address, sizeof Address);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKAccept(Listener, &Server, nullptr, 0u, nullptr, 0u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+    } while (false);
+
+    for (size_t i = 0u; i < ARRAYSIZE(Sockets); ++i)
+    {
+        if (Sockets[i] != WSK_INVALID_SOCKET)
+        {
+            WSKCloseSocket(Sockets[i]);
+        }
+    }
+
+    CloseWSKPair(Server, Listener);
+
+    WSKSetSocketReserve(AF_INET, SOCK_STREAM, IPPROTO_TCP, 0u);
+
+    return Status;
+}
+
+// SD_RECEIVE fails later receives but not sends, WSKSendAndDisconnect delivers its data before the FIN.
+NTSTATUS TestWSKShutdown(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    CHAR   Ping[] = "ping";
+    CHAR   Bye[]  = "bye";
+    CHAR   Buffer[16] = { 0 };
+    SIZE_T Bytes = 0u;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKShutdown(Server, 7);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_PARAMETER);
+
+        Status = WSKShutdown(Server, WSK_SD_RECEIVE);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKSend(Client, Ping, 4u, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u);
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_PIPE_DISCONNECTED);
+
+        Status = WSKSendAndDisconnect(Server, Bye, 3u, &Bytes, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 3u);
+
+        Status = WSKReceive(Client, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 3u && RtlEqualMemory(Buffer, "bye", 3u));
+
+        Status = WSKReceive(Client, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 0u);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+// A lingering async close disconnects gracefully, the peer reads the end of the stream.
+NTSTATUS TestWSKCloseSocketAsync(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKCloseSocketAsync(Client, 1000u);
+        Client = WSK_INVALID_SOCKET;
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKWaitForPendingCloses(5000u);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && WSKGetPendingCloseCount() == 0u);
+
+        CHAR   Buffer[16] = { 0 };
+        SIZE_T Bytes = sizeof Buffer;
+
+        Status = WSKReceive(Server, Buffer, sizeof Buffer, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 0u);
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+// A range that starts and ends inside a page and spans several chunks, sent with a disconnect.
+// The second pass reads through an uncached handle, which sends from mapped windows.
+NTSTATUS TestWSKTransmitFile(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+    HANDLE   File   = nullptr;
+    HANDLE   Uncached = nullptr;
+    PUCHAR   Data   = nullptr;
+    PUCHAR   Buffer = nullptr;
+
+    const ULONG FileLength = 2u * 64u * 1024u + 3u * PAGE_SIZE + 123u;
+    const ULONG Offset     = 100u;
+
+    do
+    {
+        Data   = (PUCHAR)ExAllocatePoolZero(PagedPool, FileLength, POOL_TAG);
+        Buffer = (PUCHAR)ExAllocatePoolZero(PagedPool, FileLength, POOL_TAG);
+        WSK_TEST_EXPECT(Data && Buffer);
+
+        for (ULONG i = 0u; i < FileLength; ++i)
+        {
+            Data[i] = (UCHAR)(i * 7u + (i >> 8));
+        }
+
+        UNICODE_STRING    FileName = RTL_CONSTANT_STRING(L"\\SystemRoot\\Temp\\libwsk.test.tmp");
+        OBJECT_ATTRIBUTES Attributes = { 0 };
+        IO_STATUS_BLOCK   IoStatus = { 0 };
+
+        InitializeObjectAttributes(&Attributes, &FileName, OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, nullptr, nullptr);
+
+        Status = ZwCreateFile(&File, GENERIC_READ | GENERIC_WRITE | DELETE | SYNCHRONIZE, &Attributes, &IoStatus,
+            nullptr, FILE_ATTRIBUTE_TEMPORARY, FILE_SHARE_READ, FILE_OVERWRITE_IF,
+            FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE | FILE_DELETE_ON_CLOSE, nullptr, 0);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        LARGE_INTEGER Position = { 0 };
+
+        Status = ZwWriteFile(File, nullptr, nullptr, nullptr, &IoStatus, Data, FileLength, &Position, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && IoStatus.Information == FileLength);
+
+        Status = ZwFlushBuffersFile(File, &IoStatus);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ZwCreateFile(&Uncached, GENERIC_READ | SYNCHRONIZE, &Attributes, &IoStatus, nullptr, 0,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_OPEN,
+            FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE | FILE_NO_INTERMEDIATE_BUFFERING, nullptr, 0);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        HANDLE Files[] = { File, Uncached };
+
+        for (ULONG i = 0u; i < ARRAYSIZE(Files) && NT_SUCCESS(Status); ++i)
+        {
+            Status = CreateWSKPair(&Server, &Client);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            ULONG64 Sent = 0u;
+
+            Status = WSKTransmitFile(Client, Files[i], nullptr, Offset, 0u, &Sent, WSK_TF_DISCONNECT);
+            WSK_TEST_EXPECT(NT_SUCCESS(Status) && Sent == FileLength - Offset);
+
+            SIZE_T Received = 0u;
+            SIZE_T Bytes = 0u;
+
+            RtlZeroMemory(Buffer, FileLength);
+
+            do
+            {
+                Status = WSKReceive(Server, Buffer + Received, FileLength - Received, &Bytes, 0, nullptr, nullptr);
+                Received += Bytes;
+
+            } while (NT_SUCCESS(Status) && Bytes && Received < FileLength);
+            WSK_TEST_EXPECT(NT_SUCCESS(Status));
+            WSK_TEST_EXPECT(Received == FileLength - Offset);
+            WSK_TEST_EXPECT(RtlEqualMemory(Buffer, Data + Offset, Received));
+
+            CloseWSKPair(Server, Client);
+            Server = WSK_INVALID_SOCKET;
+            Client = WSK_INVALID_SOCKET;
+        }
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    if (Uncached)
+    {
+        ZwClose(Uncached);
+    }
+
+    if (File)
+    {
+        ZwClose(File);
+    }
+
+    if (Buffer)
+    {
+        ExFreePoolWithTag(Buffer, POOL_TAG);
+    }
+
+    if (Data)
+    {
+        ExFreePoolWithTag(Data, POOL_TAG);
+    }
+
+    return Status;
+}
+
+NTSTATUS ReceiveWSKExact(
+    _In_ SOCKET Socket,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ SIZE_T Length
+)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SIZE_T   Received = 0u;
+    SIZE_T   Bytes    = 0u;
+
+    while (Received < Length)
+    {
+        Status = WSKReceive(Socket, (PUCHAR)Buffer + Received, Length - Received, &Bytes, 0, nullptr, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        if (Bytes == 0u)
+        {
+            Status = STATUS_CONNECTION_DISCONNECTED;
+            break;
+        }
+
+        Received += Bytes;
+    }
+
+    return Status;
+}
+
+typedef struct _WSK_TEST_SPLICE
+{
+    SOCKET           Source;
+    SOCKET           Destination;
+    WSKSPLICEOPTIONS Options;
+    WSKSPLICESTATS   Statistics;
+    NTSTATUS         Status;
+}WSK_TEST_SPLICE;
+
+VOID WSKTestSpliceThread(
+    _In_ PVOID Context
+)
+{
+    WSK_TEST_SPLICE* Splice = (WSK_TEST_SPLICE*)Context;
+
+    Splice->Status = WSKSplice(Splice->Source, Splice->Destination, &Splice->Options, &Splice->Statistics);
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+// Data crosses the relay both ways, the cancel event stops it. A datagram socket is refused.
+NTSTATUS TestWSKSplice(void)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SOCKET   Left     = WSK_INVALID_SOCKET;
+    SOCKET   LeftEnd  = WSK_INVALID_SOCKET;
+    SOCKET   Right    = WSK_INVALID_SOCKET;
+    SOCKET   RightEnd = WSK_INVALID_SOCKET;
+    SOCKET   Datagram = WSK_INVALID_SOCKET;
+    PETHREAD Thread   = nullptr;
+    KEVENT   Cancel;
+
+    WSK_TEST_SPLICE Splice = { 0 };
+
+    KeInitializeEvent(&Cancel, NotificationEvent, FALSE);
+
+    do
+    {
+        Status = CreateWSKPair(&Left, &LeftEnd);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = CreateWSKPair(&RightEnd, &Right);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKSocket(&Datagram, AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKSplice(Left, Datagram, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_DEVICE_REQUEST);
+
+        // LeftEnd <-> Left == splice == Right <-> RightEnd
+        Splice.Source      = Left;
+        Splice.Destination = Right;
+        Splice.Options.BufferSize  = PAGE_SIZE;
+        Splice.Options.BufferCount = 2u;
+        Splice.Options.CancelEvent = &Cancel;
+
+        HANDLE ThreadHandle = nullptr;
+
+        Status = PsCreateSystemThread(&ThreadHandle, SYNCHRONIZE,
+            nullptr, nullptr, nullptr,
+            &WSKTestSpliceThread,
+            &Splice);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ObReferenceObjectByHandleWithTag(ThreadHandle, SYNCHRONIZE, *PsThreadType, KernelMode,
+            POOL_TAG, (PVOID*)&Thread, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            // The thread uses this frame, stop it before leaving.
+            KeSetEvent(&Cancel, IO_NO_INCREMENT, FALSE);
+            ZwWaitForSingleObject(ThreadHandle, FALSE, nullptr);
+        }
+
+        ZwClose(ThreadHandle);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        CHAR   Buffer[8] = { 0 };
+        CHAR   Ping[4] = { 'p', 'i', 'n', 'g' };
+        CHAR   Pong[4] = { 'p', 'o', 'n', 'g' };
+        SIZE_T Bytes = 0u;
+
+        Status = WSKSend(LeftEnd, Ping, sizeof Ping, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == sizeof Ping);
+
+        Status = ReceiveWSKExact(RightEnd, Buffer, sizeof Ping);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && RtlEqualMemory(Buffer, Ping, sizeof Ping));
+
+        Status = WSKSend(RightEnd, Pong, sizeof Pong, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == sizeof Pong);
+
+        Status = ReceiveWSKExact(LeftEnd, Buffer, sizeof Pong);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && RtlEqualMemory(Buffer, Pong, sizeof Pong));
+
+        KeSetEvent(&Cancel, IO_NO_INCREMENT, FALSE);
+        KeWaitForSingleObject(Thread, Executive, KernelMode, FALSE, nullptr);
+
+        Status = Splice.Status;
+        WSK_TEST_EXPECT(Status == STATUS_CANCELLED);
+        WSK_TEST_EXPECT(Splice.Statistics.SourceToDestination == sizeof Ping);
+        WSK_TEST_EXPECT(Splice.Statistics.DestinationToSource == sizeof Pong);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Thread)
+    {
+        KeSetEvent(&Cancel, IO_NO_INCREMENT, FALSE);
+        KeWaitForSingleObject(Thread, Executive, KernelMode, FALSE, nullptr);
+        ObDereferenceObjectWithTag(Thread, POOL_TAG);
+    }
+
+    if (Datagram != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Datagram);
+    }
+
+    CloseWSKPair(Left, LeftEnd);
+    CloseWSKPair(RightEnd, Right);
+
+    return Status;
+}
+
+NTSTATUS SendWSKString(
+    _In_ SOCKET Socket,
+    _In_z_ PCSTR String
+)
+{
+    const SIZE_T Length = strlen(String);
+    SIZE_T Bytes = 0u;
+
+    NTSTATUS Status = WSKSend(Socket, (PVOID)String, Length, &Bytes, 0, nullptr, nullptr);
+    if (NT_SUCCESS(Status) && Bytes != Length)
+    {
+        Status = STATUS_UNSUCCESSFUL;
+    }
+
+    return Status;
+}
+
+// A 16 byte ring, a delimiter split over two receives and another one split by the wrap.
+NTSTATUS TestWSKReader(void)
+{
+    NTSTATUS   Status = STATUS_SUCCESS;
+    SOCKET     Server = WSK_INVALID_SOCKET;
+    SOCKET     Client = WSK_INVALID_SOCKET;
+    PWSKREADER Reader = nullptr;
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKCreateReader(&Reader, Server, 16u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        CHAR   Line[64] = { 0 };
+        SIZE_T Bytes = 0u;
+
+        // A peek buffers what has arrived, the rest of the delimiter comes with the next receive.
+        Status = SendWSKString(Client, "ab\r");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderPeek(Reader, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 3u);
+
+        Status = SendWSKString(Client, "\ncd\r\n");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderReadUntil(Reader, "\r\n", 2u, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u && RtlEqualMemory(Line, "ab\r\n", 4u));
+
+        Status = WSKReaderReadUntil(Reader, "\r\n", 2u, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u && RtlEqualMemory(Line, "cd\r\n", 4u));
+
+        // The ring is empty and starts over at 0. Leave "ijklmn" at [4, 10) so the next
+        // line fills [10, 16) up to its "\r" and wraps to [0, 1) for the "\n".
+        Status = SendWSKString(Client, "efghijklmn");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderPeek(Reader, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 10u);
+
+        Status = WSKReaderReadExact(Reader, Line, 4u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && RtlEqualMemory(Line, "efgh", 4u));
+
+        Status = SendWSKString(Client, "opqrs\r\n");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderReadUntil(Reader, "\r\n", 2u, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 13u && RtlEqualMemory(Line, "ijklmnopqrs\r\n", 13u));
+
+        // Longer than the ring, part of it buffered.
+        Status = SendWSKString(Client, "0123456789abcdefghijklmnopqrstuvwxyz");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderPeek(Reader, Line, 1u, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 1u);
+
+        Status = WSKReaderReadExact(Reader, Line, 36u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && RtlEqualMemory(Line, "0123456789abcdefghijklmnopqrstuvwxyz", 36u));
+
+        // A partial line at the end of the stream.
+        Status = SendWSKString(Client, "tail");
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKShutdown(Client, WSK_SD_SEND);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKReaderReadUntil(Reader, "\r\n", 2u, Line, sizeof Line, &Bytes);
+        WSK_TEST_EXPECT(Status == STATUS_END_OF_FILE);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Reader)
+    {
+        WSKDeleteReader(Reader);
+    }
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+typedef struct _WSK_TEST_TRICKLE
+{
+    SOCKET       Socket;
+    const UCHAR* Data;
+    SIZE_T       Length;
+}WSK_TEST_TRICKLE;
+
+// One byte per send, 10ms apart, so the receiver sees every split of the message.
+VOID WSKTestTrickleThread(
+    _In_ PVOID Context
+)
+{
+    WSK_TEST_TRICKLE* Trickle = (WSK_TEST_TRICKLE*)Context;
+
+    LARGE_INTEGER Delay = { 0 };
+    Delay.QuadPart = -10 * 10000; // 10ms
+
+    for (SIZE_T i = 0u; i < Trickle->Length; ++i)
+    {
+        SIZE_T Bytes = 0u;
+        if (!NT_SUCCESS(WSKSend(Trickle->Socket, (PVOID)&Trickle->Data[i], 1u, &Bytes, 0, nullptr, nullptr)))
+        {
+            break;
+        }
+
+        KeDelayExecutionThread(KernelMode, FALSE, &Delay);
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+BOOLEAN EqualWSKFrame(
+    _In_ const WSKFRAME* Frame,
+    _In_reads_bytes_(Length) const VOID* Data,
+    _In_ SIZE_T Length
+)
+{
+    if (Frame->Length != Length)
+    {
+        return FALSE;
+    }
+
+    SIZE_T Offset = 0u;
+
+    for (ULONG i = 0u; i < Frame->SegmentCount; ++i)
+    {
+        if (!RtlEqualMemory(Frame->Segments[i].Buffer, (const UCHAR*)Data + Offset, Frame->Segments[i].Length))
+        {
+            return FALSE;
+        }
+
+        Offset += Frame->Segments[i].Length;
+    }
+
+    return Offset == Length;
+}
+
+// A message that arrives a byte at a time, one that wraps the 32 byte ring and a corrupted one.
+// On a nonblocking socket a gather list larger than the send buffer still goes out whole.
+NTSTATUS TestWSKFramer(void)
+{
+    NTSTATUS   Status   = STATUS_SUCCESS;
+    SOCKET     Server   = WSK_INVALID_SOCKET;
+    SOCKET     Client   = WSK_INVALID_SOCKET;
+    PWSKFRAMER Receiver = nullptr;
+    PWSKFRAMER Sender   = nullptr;
+    PETHREAD   Thread   = nullptr;
+    PUCHAR     Large    = nullptr;
+    PUCHAR     Echo     = nullptr;
+
+    const SIZE_T LargeLength = 80u * 1024u;
+
+    // Varint length 9, CRC32C("123456789") big endian, the payload.
+    static const UCHAR Check[] = {
+        0x09, 0xE3, 0x06, 0x92, 0x83, '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+    WSK_TEST_TRICKLE Trickle = { 0 };
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = WSKCreateFramer(&Receiver, Server, WSK_FRAME_VARINT | WSK_FRAME_CRC32C, 16u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKCreateFramer(&Sender, Client, WSK_FRAME_VARINT | WSK_FRAME_CRC32C, 16u);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        WSKFRAME Frame = { 0 };
+
+        Trickle.Socket = Client;
+        Trickle.Data   = Check;
+        Trickle.Length = sizeof Check;
+
+        HANDLE ThreadHandle = nullptr;
+
+        Status = PsCreateSystemThread(&ThreadHandle, SYNCHRONIZE,
+            nullptr, nullptr, nullptr,
+            &WSKTestTrickleThread,
+            &Trickle);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = ObReferenceObjectByHandleWithTag(ThreadHandle, SYNCHRONIZE, *PsThreadType, KernelMode,
+            POOL_TAG, (PVOID*)&Thread, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            // The thread uses this frame, let it finish before leaving.
+            ZwWaitForSingleObject(ThreadHandle, FALSE, nullptr);
+        }
+
+        ZwClose(ThreadHandle);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && EqualWSKFrame(&Frame, "123456789", 9u));
+
+        KeWaitForSingleObject(Thread, Executive, KernelMode, FALSE, nullptr);
+        ObDereferenceObjectWithTag(Thread, POOL_TAG);
+        Thread = nullptr;
+
+        // 21 bytes each, the first receive takes all of A and 11 bytes of B,
+        // so B's payload runs from 26 to the end of the ring and on from 0.
+        CHAR   A[16] = "AAAAAAAAAAAAAAA";
+        CHAR   B[16] = "BBBBBBBBBBBBBBb";
+        WSKBUF Piece = { 0 };
+        SIZE_T Bytes = 0u;
+
+        Piece.Buffer = A;
+        Piece.Length = sizeof A;
+
+        Status = WSKFramerSend(Sender, &Piece, 1u, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 21u);
+
+        Piece.Buffer = B;
+        Piece.Length = sizeof B;
+
+        Status = WSKFramerSend(Sender, &Piece, 1u, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 21u);
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Frame.SegmentCount == 1u && EqualWSKFrame(&Frame, A, sizeof A));
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Frame.SegmentCount == 2u && EqualWSKFrame(&Frame, B, sizeof B));
+
+        // A bad checksum drops only that message.
+        UCHAR Corrupt[sizeof Check];
+        RtlCopyMemory(Corrupt, Check, sizeof Check);
+        Corrupt[sizeof Corrupt - 1] ^= 0x01u;
+
+        Status = WSKSend(Client, Corrupt, sizeof Corrupt, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == sizeof Corrupt);
+
+        Status = WSKSend(Client, (PVOID)Check, sizeof Check, &Bytes, 0, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == sizeof Check);
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(Status == STATUS_CRC_ERROR);
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && EqualWSKFrame(&Frame, "123456789", 9u));
+
+        Large = (PUCHAR)ExAllocatePoolZero(NonPagedPool, LargeLength, POOL_TAG);
+        Echo  = (PUCHAR)ExAllocatePoolZero(NonPagedPool, LargeLength, POOL_TAG);
+        WSK_TEST_EXPECT(Large && Echo);
+
+        for (SIZE_T i = 0u; i < LargeLength; ++i)
+        {
+            Large[i] = (UCHAR)(i * 13u + (i >> 10));
+        }
+
+        ULONG NonBlocking = 1u;
+
+        Status = WSKIoctl(Client, FIONBIO, &NonBlocking, sizeof NonBlocking, nullptr, 0, nullptr, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        WSKBUF Pieces[2] = { { LargeLength / 2u, Large }, { LargeLength / 2u, Large + LargeLength / 2u } };
+
+        Status = WSKSendBuffers(Client, Pieces, 2u, &Bytes, WSK_SB_WHOLE, nullptr, nullptr);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == LargeLength);
+
+        Status = ReceiveWSKExact(Server, Echo, LargeLength);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && RtlEqualMemory(Echo, Large, LargeLength));
+
+        Status = WSKShutdown(Client, WSK_SD_SEND);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        Status = WSKFramerReceive(Receiver, &Frame);
+        WSK_TEST_EXPECT(Status == STATUS_END_OF_FILE);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    if (Thread)
+    {
+        KeWaitForSingleObject(Thread, Executive, KernelMode, FALSE, nullptr);
+        ObDereferenceObjectWithTag(Thread, POOL_TAG);
+    }
+
+    if (Sender)
+    {
+        WSKDeleteFramer(Sender);
+    }
+
+    if (Receiver)
+    {
+        WSKDeleteFramer(Receiver);
+    }
+
+    CloseWSKPair(Server, Client);
+
+    if (Echo)
+    {
+        ExFreePoolWithTag(Echo, POOL_TAG);
+    }
+
+    if (Large)
+    {
+        ExFreePoolWithTag(Large, POOL_TAG);
+    }
+
+    return Status;
+}
+
+typedef NTSTATUS (*WSK_TEST_ROUTINE)(void);
+
+static const struct
+{
+    const char*      Name;
+    WSK_TEST_ROUTINE Routine;
+} WSKTests[] = {
+    { "addrinfo coalescing", TestWSKAddrInfoCoalescing },
+    { "addrinfo literal",    TestWSKAddrInfoLiteral    },
+    { "addrinfo conversion", TestWSKAddrInfoConversion },
+    { "connect by name",     TestWSKConnectByName      },
+    { "address parsing",     TestWSKAddressParsing     },
+    { "address batch",       TestWSKAddressBatch       },
+    { "byte order",          TestWSKByteOrder          },
+    { "poll",                TestWSKPoll               },
+    { "nonblocking",         TestWSKNonBlocking        },
+    { "receive timeout",     TestWSKReceiveTimeout     },
+    { "cancel io",           TestWSKCancelIo           },
+    { "coroutine",           TestWSKCoroutine          },
+    { "raii socket",         TestWSKSocketDispatch     },
+    { "socket kind",         TestWSKSocketKind         },
+    { "stream mode",         TestWSKStreamMode         },
+    { "connect source",      TestWSKConnectSource      },
+    { "shared source port",  TestWSKSharedSourcePort   },
+    { "connection pool",     TestWSKConnectionPool     },
+    { "socket reserve",      TestWSKSocketReserve      },
+    { "shutdown",            TestWSKShutdown           },
+    { "async close",         TestWSKCloseSocketAsync   },
+    { "transmit file",       TestWSKTransmitFile       },
+    { "splice",              TestWSKSplice             },
+    { "reader",              TestWSKReader             },
+    { "framer",              TestWSKFramer             },
+};
+
+NTSTATUS RunWSKTests(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    for (size_t i = 0u; i < ARRAYSIZE(WSKTests); ++i)
+    {
+        Status = WSKTests[i].Routine();
+
+        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL,
+            "[WSK] [Test] %s: 0x%08X.\n",
+            WSKTests[i].Name, Status);
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+    }
+
+    return Status;
+}
+
+//
+//////////////////////////////////////////////////////
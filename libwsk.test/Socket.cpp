@@ -0,0 +1,160 @@
+﻿// unnecessary, fix ReSharper's code analysis.
+#pragma warning(suppress: 4117)
+#define _KERNEL_MODE 1
+
+#include <Veil.h>
+#include <libwsk/libwsk.h>
+#include <libwsk/berkeley.h>
+#include <libwsk/wsksocket.h>
+
+#include "Test.h"
+
+//////////////////////////////////////////////////////
+// Smoke tests of the C++ layers
+
+// Owns the handles, sends through the cached routines, and a close fails the dispatch calls after it.
+NTSTATUS TestWSKSocketDispatch(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    WSKOVERLAPPED Overlapped = { 0 };
+    WSKCreateEvent(&Overlapped.Event);
+
+    UCHAR Buffer[16] = "raii";
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        wsk::socket Accepted(Server);
+        wsk::socket Connected(Client);
+
+        Server = WSK_INVALID_SOCKET;
+        Client = WSK_INVALID_SOCKET;
+
+        SIZE_T Bytes = 0u;
+
+        Status = Connected.send({ Buffer, 4u }, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u);
+
+        RtlZeroMemory(Buffer, sizeof Buffer);
+
+        Status = Accepted.receive(Buffer, &Bytes);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 4u);
+        WSK_TEST_EXPECT(RtlCompareMemory(Buffer, "raii", 4u) == 4u);
+
+        // The resolved routines move with the handle.
+        wsk::socket Moved(std::move(Accepted));
+        WSK_TEST_EXPECT(!Accepted && Moved);
+
+        Status = Moved.receive(Buffer, nullptr, 0u, &Overlapped);
+        WSK_TEST_EXPECT(Status == STATUS_PENDING);
+
+        WSKSOCKETDISPATCH Dispatch = { 0 };
+
+        Status = WSKReferenceSocketDispatch(Moved.native_handle(), &Dispatch);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status));
+
+        // Close cancels the pending receive, a dispatch resolved before it is refused.
+        Status = Moved.close();
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && !Moved);
+
+        LARGE_INTEGER Timeout = { 0 };
+        Timeout.QuadPart = -5000ll * 10000;
+
+        Status = KeWaitForSingleObject(&Overlapped.Event, Executive, KernelMode, FALSE, &Timeout);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && !NT_SUCCESS((NTSTATUS)Overlapped.Internal));
+
+        Status = WSKSendDispatch(&Dispatch, Buffer, 4u, &Bytes, 0u, nullptr, nullptr);
+        WSKDereferenceSocketDispatch(&Dispatch);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_HANDLE);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
+
+template<typename Socket>
+constexpr bool WSKTestCanListen = requires (Socket& Handle) { Handle.listen(1); };
+
+template<typename Socket>
+constexpr bool WSKTestCanSend = requires (Socket& Handle) { Handle.send({}); };
+
+static_assert( WSKTestCanListen<wsk::stream_socket> &&  WSKTestCanSend<wsk::stream_socket>);
+static_assert(!WSKTestCanListen<wsk::datagram_socket> && !WSKTestCanSend<wsk::datagram_socket>);
+
+// Wrong-kind operations do not compile on a typed handle, and the runtime table refuses them on a raw one.
+
+NTSTATUS TestWSKSocketKind(void)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Server = WSK_INVALID_SOCKET;
+    SOCKET   Client = WSK_INVALID_SOCKET;
+
+    UCHAR Buffer[16] = "kind";
+
+    do
+    {
+        Status = CreateWSKPair(&Server, &Client);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        wsk::stream_socket Accepted(Server);
+        wsk::stream_socket Connected(Client);
+
+        Server = WSK_INVALID_SOCKET;
+        Client = WSK_INVALID_SOCKET;
+
+        SIZE_T Bytes = 0u;
+
+        Status = Connected.send({ Buffer, 4u }, &Bytes);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Bytes == 4u);
+
+        RtlZeroMemory(Buffer, sizeof Buffer);
+
+        Status = Accepted.receive(Buffer, &Bytes);
+        WSK_TEST_EXPECT(Status == STATUS_SUCCESS && Bytes == 4u);
+        WSK_TEST_EXPECT(RtlCompareMemory(Buffer, "kind", 4u) == 4u);
+
+        Status = WSKSendTo(Connected.native_handle(), Buffer, 4u, &Bytes, 0u, nullptr, 0u, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_DEVICE_REQUEST);
+
+        wsk::datagram_socket Datagram;
+
+        Status = wsk::datagram_socket::create(Datagram, AF_INET, IPPROTO_UDP);
+        WSK_TEST_EXPECT(NT_SUCCESS(Status) && Datagram);
+
+        Status = wsk::datagram_socket::create(Datagram, AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_PARAMETER);
+
+        Status = WSKListen(Datagram.native_handle(), 1);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_DEVICE_REQUEST);
+
+        SOCKET Refused = WSK_INVALID_SOCKET;
+
+        Status = WSKAccept(Datagram.native_handle(), &Refused, nullptr, 0u, nullptr, 0u);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_DEVICE_REQUEST && Refused == WSK_INVALID_SOCKET);
+
+        Status = WSKSend(Datagram.native_handle(), Buffer, 4u, &Bytes, 0u, nullptr, nullptr);
+        WSK_TEST_EXPECT(Status == STATUS_INVALID_DEVICE_REQUEST);
+
+        Status = STATUS_SUCCESS;
+
+    } while (false);
+
+    CloseWSKPair(Server, Client);
+
+    return Status;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Shared by the smoke tests in Program.c and the C++ ones.
+
+#define WSK_TEST_EXPECT(Condition)                                      \
+    if (!(Condition))                                                   \
+    {                                                                   \
+        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL,             \
+            "[WSK] [Test] %s(%d): %s failed.\n",                        \
+            __FUNCTION__, __LINE__, #Condition);                        \
+                                                                        \
+        Status = STATUS_UNSUCCESSFUL;                                   \
+        break;                                                          \
+    }
+
+EXTERN_C_START
+
+// A connected loopback pair.
+NTSTATUS CreateWSKPair(
+    _Out_ SOCKET* Server,
+    _Out_ SOCKET* Client
+);
+
+VOID CloseWSKPair(
+    _In_ SOCKET Server,
+    _In_ SOCKET Client
+);
+
+NTSTATUS TestWSKCoroutine(void);
+NTSTATUS TestWSKSocketDispatch(void);
+NTSTATUS TestWSKSocketKind(void);
+
+EXTERN_C_END
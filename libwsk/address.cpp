@@ -0,0 +1,1545 @@
+﻿#include "libwsk.h"
+#include "address.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+// A candidate address string narrowed to bytes, with per-character class masks.
+struct WSK_ADDRESS_CHARS
+{
+    DECLSPEC_ALIGN(16) UCHAR Bytes[64];
+
+    ULONG   Length;     // characters before the terminating NUL
+    ULONG64 Digits;     // 0-9
+    ULONG64 Hex;        // 0-9 a-f A-F
+    ULONG64 Dots;
+    ULONG64 Colons;
+};
+
+static const ULONG WSK_ADDRESS_STRING_MAX  = 80u;   // formatted string, its NUL and the formatter's slack
+static const ULONG WSK_ADDRESS_BLOCK_CHARS = 256u;
+static const ULONG WSK_ADDRESS_BLOCK_WORDS = WSK_ADDRESS_BLOCK_CHARS / 64u + 1u;
+
+// A block of packed strings narrowed to bytes, the masks hold one bit per character.
+// Both arrays are padded so any string starting in the block has a full window.
+struct WSK_ADDRESS_BLOCK
+{
+    DECLSPEC_ALIGN(16) UCHAR Bytes[WSK_ADDRESS_BLOCK_CHARS + 64u];
+
+    ULONG   Length;     // characters loaded
+    ULONG64 Digits[WSK_ADDRESS_BLOCK_WORDS];
+    ULONG64 Hex[WSK_ADDRESS_BLOCK_WORDS];
+    ULONG64 Dots[WSK_ADDRESS_BLOCK_WORDS];
+    ULONG64 Colons[WSK_ADDRESS_BLOCK_WORDS];
+    ULONG64 Nuls[WSK_ADDRESS_BLOCK_WORDS];
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+// Decimal text of every octet, the last byte is the text length.
+static const UCHAR WSKDecimalOctets[256][4] =
+{
+    {'0', 0, 0, 1}, {'1', 0, 0, 1}, {'2', 0, 0, 1}, {'3', 0, 0, 1}, {'4', 0, 0, 1}, {'5', 0, 0, 1}, {'6', 0, 0, 1}, {'7', 0, 0, 1},
+    {'8', 0, 0, 1}, {'9', 0, 0, 1}, {'1', '0', 0, 2}, {'1', '1', 0, 2}, {'1', '2', 0, 2}, {'1', '3', 0, 2}, {'1', '4', 0, 2}, {'1', '5', 0, 2},
+    {'1', '6', 0, 2}, {'1', '7', 0, 2}, {'1', '8', 0, 2}, {'1', '9', 0, 2}, {'2', '0', 0, 2}, {'2', '1', 0, 2}, {'2', '2', 0, 2}, {'2', '3', 0, 2},
+    {'2', '4', 0, 2}, {'2', '5', 0, 2}, {'2', '6', 0, 2}, {'2', '7', 0, 2}, {'2', '8', 0, 2}, {'2', '9', 0, 2}, {'3', '0', 0, 2}, {'3', '1', 0, 2},
+    {'3', '2', 0, 2}, {'3', '3', 0, 2}, {'3', '4', 0, 2}, {'3', '5', 0, 2}, {'3', '6', 0, 2}, {'3', '7', 0, 2}, {'3', '8', 0, 2}, {'3', '9', 0, 2},
+    {'4', '0', 0, 2}, {'4', '1', 0, 2}, {'4', '2', 0, 2}, {'4', '3', 0, 2}, {'4', '4', 0, 2}, {'4', '5', 0, 2}, {'4', '6', 0, 2}, {'4', '7', 0, 2},
+    {'4', '8', 0, 2}, {'4', '9', 0, 2}, {'5', '0', 0, 2}, {'5', '1', 0, 2}, {'5', '2', 0, 2}, {'5', '3', 0, 2}, {'5', '4', 0, 2}, {'5', '5', 0, 2},
+    {'5', '6', 0, 2}, {'5', '7', 0, 2}, {'5', '8', 0, 2}, {'5', '9', 0, 2}, {'6', '0', 0, 2}, {'6', '1', 0, 2}, {'6', '2', 0, 2}, {'6', '3', 0, 2},
+    {'6', '4', 0, 2}, {'6', '5', 0, 2}, {'6', '6', 0, 2}, {'6', '7', 0, 2}, {'6', '8', 0, 2}, {'6', '9', 0, 2}, {'7', '0', 0, 2}, {'7', '1', 0, 2},
+    {'7', '2', 0, 2}, {'7', '3', 0, 2}, {'7', '4', 0, 2}, {'7', '5', 0, 2}, {'7', '6', 0, 2}, {'7', '7', 0, 2}, {'7', '8', 0, 2}, {'7', '9', 0, 2},
+    {'8', '0', 0, 2}, {'8', '1', 0, 2}, {'8', '2', 0, 2}, {'8', '3', 0, 2}, {'8', '4', 0, 2}, {'8', '5', 0, 2}, {'8', '6', 0, 2}, {'8', '7', 0, 2},
+    {'8', '8', 0, 2}, {'8', '9', 0, 2}, {'9', '0', 0, 2}, {'9', '1', 0, 2}, {'9', '2', 0, 2}, {'9', '3', 0, 2}, {'9', '4', 0, 2}, {'9', '5', 0, 2},
+    {'9', '6', 0, 2}, {'9', '7', 0, 2}, {'9', '8', 0, 2}, {'9', '9', 0, 2}, {'1', '0', '0', 3}, {'1', '0', '1', 3}, {'1', '0', '2', 3}, {'1', '0', '3', 3},
+    {'1', '0', '4', 3}, {'1', '0', '5', 3}, {'1', '0', '6', 3}, {'1', '0', '7', 3}, {'1', '0', '8', 3}, {'1', '0', '9', 3}, {'1', '1', '0', 3}, {'1', '1', '1', 3},
+    {'1', '1', '2', 3}, {'1', '1', '3', 3}, {'1', '1', '4', 3}, {'1', '1', '5', 3}, {'1', '1', '6', 3}, {'1', '1', '7', 3}, {'1', '1', '8', 3}, {'1', '1', '9', 3},
+    {'1', '2', '0', 3}, {'1', '2', '1', 3}, {'1', '2', '2', 3}, {'1', '2', '3', 3}, {'1', '2', '4', 3}, {'1', '2', '5', 3}, {'1', '2', '6', 3}, {'1', '2', '7', 3},
+    {'1', '2', '8', 3}, {'1', '2', '9', 3}, {'1', '3', '0', 3}, {'1', '3', '1', 3}, {'1', '3', '2', 3}, {'1', '3', '3', 3}, {'1', '3', '4', 3}, {'1', '3', '5', 3},
+    {'1', '3', '6', 3}, {'1', '3', '7', 3}, {'1', '3', '8', 3}, {'1', '3', '9', 3}, {'1', '4', '0', 3}, {'1', '4', '1', 3}, {'1', '4', '2', 3}, {'1', '4', '3', 3},
+    {'1', '4', '4', 3}, {'1', '4', '5', 3}, {'1', '4', '6', 3}, {'1', '4', '7', 3}, {'1', '4', '8', 3}, {'1', '4', '9', 3}, {'1', '5', '0', 3}, {'1', '5', '1', 3},
+    {'1', '5', '2', 3}, {'1', '5', '3', 3}, {'1', '5', '4', 3}, {'1', '5', '5', 3}, {'1', '5', '6', 3}, {'1', '5', '7', 3}, {'1', '5', '8', 3}, {'1', '5', '9', 3},
+    {'1', '6', '0', 3}, {'1', '6', '1', 3}, {'1', '6', '2', 3}, {'1', '6', '3', 3}, {'1', '6', '4', 3}, {'1', '6', '5', 3}, {'1', '6', '6', 3}, {'1', '6', '7', 3},
+    {'1', '6', '8', 3}, {'1', '6', '9', 3}, {'1', '7', '0', 3}, {'1', '7', '1', 3}, {'1', '7', '2', 3}, {'1', '7', '3', 3}, {'1', '7', '4', 3}, {'1', '7', '5', 3},
+    {'1', '7', '6', 3}, {'1', '7', '7', 3}, {'1', '7', '8', 3}, {'1', '7', '9', 3}, {'1', '8', '0', 3}, {'1', '8', '1', 3}, {'1', '8', '2', 3}, {'1', '8', '3', 3},
+    {'1', '8', '4', 3}, {'1', '8', '5', 3}, {'1', '8', '6', 3}, {'1', '8', '7', 3}, {'1', '8', '8', 3}, {'1', '8', '9', 3}, {'1', '9', '0', 3}, {'1', '9', '1', 3},
+    {'1', '9', '2', 3}, {'1', '9', '3', 3}, {'1', '9', '4', 3}, {'1', '9', '5', 3}, {'1', '9', '6', 3}, {'1', '9', '7', 3}, {'1', '9', '8', 3}, {'1', '9', '9', 3},
+    {'2', '0', '0', 3}, {'2', '0', '1', 3}, {'2', '0', '2', 3}, {'2', '0', '3', 3}, {'2', '0', '4', 3}, {'2', '0', '5', 3}, {'2', '0', '6', 3}, {'2', '0', '7', 3},
+    {'2', '0', '8', 3}, {'2', '0', '9', 3}, {'2', '1', '0', 3}, {'2', '1', '1', 3}, {'2', '1', '2', 3}, {'2', '1', '3', 3}, {'2', '1', '4', 3}, {'2', '1', '5', 3},
+    {'2', '1', '6', 3}, {'2', '1', '7', 3}, {'2', '1', '8', 3}, {'2', '1', '9', 3}, {'2', '2', '0', 3}, {'2', '2', '1', 3}, {'2', '2', '2', 3}, {'2', '2', '3', 3},
+    {'2', '2', '4', 3}, {'2', '2', '5', 3}, {'2', '2', '6', 3}, {'2', '2', '7', 3}, {'2', '2', '8', 3}, {'2', '2', '9', 3}, {'2', '3', '0', 3}, {'2', '3', '1', 3},
+    {'2', '3', '2', 3}, {'2', '3', '3', 3}, {'2', '3', '4', 3}, {'2', '3', '5', 3}, {'2', '3', '6', 3}, {'2', '3', '7', 3}, {'2', '3', '8', 3}, {'2', '3', '9', 3},
+    {'2', '4', '0', 3}, {'2', '4', '1', 3}, {'2', '4', '2', 3}, {'2', '4', '3', 3}, {'2', '4', '4', 3}, {'2', '4', '5', 3}, {'2', '4', '6', 3}, {'2', '4', '7', 3},
+    {'2', '4', '8', 3}, {'2', '4', '9', 3}, {'2', '5', '0', 3}, {'2', '5', '1', 3}, {'2', '5', '2', 3}, {'2', '5', '3', 3}, {'2', '5', '4', 3}, {'2', '5', '5', 3},
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+#if defined(_M_X64) || defined(_M_IX86)
+
+using WSK_VECTOR = __m128i;
+
+static __forceinline WSK_VECTOR WSKVectorLoad(_In_ const VOID* Source)
+{
+    return _mm_loadu_si128(static_cast<const __m128i*>(Source));
+}
+
+static __forceinline VOID WSKVectorStore(_Out_ VOID* Target, _In_ WSK_VECTOR Value)
+{
+    _mm_storeu_si128(static_cast<__m128i*>(Target), Value);
+}
+
+static __forceinline WSK_VECTOR WSKVectorSet(_In_ UCHAR Value)
+{
+    return _mm_set1_epi8(static_cast<char>(Value));
+}
+
+static __forceinline WSK_VECTOR WSKVectorOr(_In_ WSK_VECTOR First, _In_ WSK_VECTOR Second)
+{
+    return _mm_or_si128(First, Second);
+}
+
+static __forceinline WSK_VECTOR WSKVectorEqual(_In_ WSK_VECTOR Value, _In_ UCHAR Char)
+{
+    return _mm_cmpeq_epi8(Value, WSKVectorSet(Char));
+}
+
+// First <= Value < First + Count
+static __forceinline WSK_VECTOR WSKVectorInRange(_In_ WSK_VECTOR Value, _In_ UCHAR First, _In_ UCHAR Count)
+{
+    const auto Offset = _mm_sub_epi8(Value, WSKVectorSet(First));
+    return _mm_cmpeq_epi8(_mm_min_epu8(Offset, WSKVectorSet(Count - 1)), Offset);
+}
+
+static __forceinline ULONG WSKVectorMask(_In_ WSK_VECTOR Value)
+{
+    return static_cast<ULONG>(_mm_movemask_epi8(Value));
+}
+
+// 16 UTF-16 units to bytes, anything above 0xFF becomes 0xFF.
+static __forceinline WSK_VECTOR WSKVectorNarrow(_In_ WSK_VECTOR Low, _In_ WSK_VECTOR High)
+{
+    const auto Zero = _mm_setzero_si128();
+    const auto Byte = _mm_set1_epi16(0x00FF);
+
+    Low  = _mm_or_si128(_mm_and_si128(Low, Byte),
+        _mm_andnot_si128(_mm_cmpeq_epi16(_mm_srli_epi16(Low, 8), Zero), Byte));
+    High = _mm_or_si128(_mm_and_si128(High, Byte),
+        _mm_andnot_si128(_mm_cmpeq_epi16(_mm_srli_epi16(High, 8), Zero), Byte));
+
+    return _mm_packus_epi16(Low, High);
+}
+
+static __forceinline WSK_VECTOR WSKVectorHexDigits(_In_ WSK_VECTOR Nibbles)
+{
+    const auto Letters = _mm_and_si128(_mm_cmpgt_epi8(Nibbles, WSKVectorSet(9)), WSKVectorSet('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(Nibbles, WSKVectorSet('0')), Letters);
+}
+
+// Lower-case hex text of 16 bytes, high nibble first.
+static __forceinline VOID WSKVectorToHex(_In_reads_bytes_(16) const VOID* Source, _Out_writes_(32) PUCHAR Hex)
+{
+    const auto Value = WSKVectorLoad(Source);
+    const auto High  = _mm_and_si128(_mm_srli_epi16(Value, 4), WSKVectorSet(0x0F));
+    const auto Low   = _mm_and_si128(Value, WSKVectorSet(0x0F));
+
+    WSKVectorStore(&Hex[0],  WSKVectorHexDigits(_mm_unpacklo_epi8(High, Low)));
+    WSKVectorStore(&Hex[16], WSKVectorHexDigits(_mm_unpackhi_epi8(High, Low)));
+}
+
+// 16 bytes to 16 UTF-16 units.
+static __forceinline VOID WSKVectorWiden(_Out_writes_bytes_(32) VOID* Target, _In_ WSK_VECTOR Value)
+{
+    WSKVectorStore(Target, _mm_unpacklo_epi8(Value, _mm_setzero_si128()));
+    WSKVectorStore(static_cast<PUCHAR>(Target) + 16, _mm_unpackhi_epi8(Value, _mm_setzero_si128()));
+}
+
+// Bit N is set when 16-bit word N is zero.
+static __forceinline ULONG WSKVectorZeroWords(_In_reads_bytes_(16) const VOID* Source)
+{
+    const auto Zero = _mm_cmpeq_epi16(WSKVectorLoad(Source), _mm_setzero_si128());
+    return WSKVectorMask(_mm_packs_epi16(Zero, _mm_setzero_si128()));
+}
+
+#elif defined(_M_ARM64)
+
+using WSK_VECTOR = uint8x16_t;
+
+static __forceinline WSK_VECTOR WSKVectorLoad(_In_ const VOID* Source)
+{
+    return vld1q_u8(static_cast<const UCHAR*>(Source));
+}
+
+static __forceinline VOID WSKVectorStore(_Out_ VOID* Target, _In_ WSK_VECTOR Value)
+{
+    vst1q_u8(static_cast<UCHAR*>(Target), Value);
+}
+
+static __forceinline WSK_VECTOR WSKVectorSet(_In_ UCHAR Value)
+{
+    return vdupq_n_u8(Value);
+}
+
+static __forceinline WSK_VECTOR WSKVectorOr(_In_ WSK_VECTOR First, _In_ WSK_VECTOR Second)
+{
+    return vorrq_u8(First, Second);
+}
+
+static __forceinline WSK_VECTOR WSKVectorEqual(_In_ WSK_VECTOR Value, _In_ UCHAR Char)
+{
+    return vceqq_u8(Value, WSKVectorSet(Char));
+}
+
+// First <= Value < First + Count
+static __forceinline WSK_VECTOR WSKVectorInRange(_In_ WSK_VECTOR Value, _In_ UCHAR First, _In_ UCHAR Count)
+{
+    return vcleq_u8(vsubq_u8(Value, WSKVectorSet(First)), WSKVectorSet(Count - 1));
+}
+
+static __forceinline ULONG WSKVectorMask(_In_ WSK_VECTOR Value)
+{
+    static const UCHAR Weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+    const auto Bits = vandq_u8(Value, vld1q_u8(Weights));
+    return vaddv_u8(vget_low_u8(Bits)) | (static_cast<ULONG>(vaddv_u8(vget_high_u8(Bits))) << 8);
+}
+
+// 16 UTF-16 units to bytes, anything above 0xFF becomes 0xFF.
+static __forceinline WSK_VECTOR WSKVectorNarrow(_In_ WSK_VECTOR Low, _In_ WSK_VECTOR High)
+{
+    return vcombine_u8(vqmovn_u16(vreinterpretq_u16_u8(Low)), vqmovn_u16(vreinterpretq_u16_u8(High)));
+}
+
+static __forceinline WSK_VECTOR WSKVectorHexDigits(_In_ WSK_VECTOR Nibbles)
+{
+    const auto Letters = vandq_u8(vcgtq_u8(Nibbles, WSKVectorSet(9)), WSKVectorSet('a' - '0' - 10));
+    return vaddq_u8(vaddq_u8(Nibbles, WSKVectorSet('0')), Letters);
+}
+
+// Lower-case hex text of 16 bytes, high nibble first.
+static __forceinline VOID WSKVectorToHex(_In_reads_bytes_(16) const VOID* Source, _Out_writes_(32) PUCHAR Hex)
+{
+    const auto Value = WSKVectorLoad(Source);
+    const auto High  = vshrq_n_u8(Value, 4);
+    const auto Low   = vandq_u8(Value, WSKVectorSet(0x0F));
+
+    WSKVectorStore(&Hex[0],  WSKVectorHexDigits(vzip1q_u8(High, Low)));
+    WSKVectorStore(&Hex[16], WSKVectorHexDigits(vzip2q_u8(High, Low)));
+}
+
+// 16 bytes to 16 UTF-16 units.
+static __forceinline VOID WSKVectorWiden(_Out_writes_bytes_(32) VOID* Target, _In_ WSK_VECTOR Value)
+{
+    WSKVectorStore(Target, vreinterpretq_u8_u16(vmovl_u8(vget_low_u8(Value))));
+    WSKVectorStore(static_cast<PUCHAR>(Target) + 16, vreinterpretq_u8_u16(vmovl_u8(vget_high_u8(Value))));
+}
+
+// Bit N is set when 16-bit word N is zero.
+static __forceinline ULONG WSKVectorZeroWords(_In_reads_bytes_(16) const VOID* Source)
+{
+    static const UCHAR Weights[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+
+    const auto Zero = vmovn_u16(vceqq_u16(vreinterpretq_u16_u8(WSKVectorLoad(Source)), vdupq_n_u16(0)));
+    return vaddv_u8(vand_u8(Zero, vld1_u8(Weights)));
+}
+
+#else
+#  error "Unsupported architecture."
+#endif
+
+static __forceinline ULONG WSKTrailingZeros(_In_ ULONG64 Mask)
+{
+    ULONG Index = 0;
+
+#if defined(_M_IX86)
+    if (_BitScanForward(&Index, static_cast<ULONG>(Mask)))
+    {
+        return Index;
+    }
+
+    _BitScanForward(&Index, static_cast<ULONG>(Mask >> 32));
+    return Index + 32;
+#else
+    _BitScanForward64(&Index, Mask);
+    return Index;
+#endif
+}
+
+// A full vector load must not cross into the next page.
+static __forceinline BOOLEAN WSKCanLoadVector(_In_ const VOID* Source)
+{
+    return (reinterpret_cast<ULONG_PTR>(Source) & (PAGE_SIZE - 1)) <= PAGE_SIZE - sizeof(WSK_VECTOR);
+}
+
+static __forceinline WSK_VECTOR WSKLoadChars(_In_ const CHAR* String)
+{
+    if (WSKCanLoadVector(String))
+    {
+        return WSKVectorLoad(String);
+    }
+
+    DECLSPEC_ALIGN(16) UCHAR Bytes[16]{};
+    for (ULONG Index = 0; Index < _countof(Bytes) && String[Index]; ++Index)
+    {
+        Bytes[Index] = static_cast<UCHAR>(String[Index]);
+    }
+
+    return WSKVectorLoad(Bytes);
+}
+
+static __forceinline WSK_VECTOR WSKLoadChars(_In_ const WCHAR* String)
+{
+    if (WSKCanLoadVector(String) && WSKCanLoadVector(String + 8))
+    {
+        return WSKVectorNarrow(WSKVectorLoad(String), WSKVectorLoad(String + 8));
+    }
+
+    DECLSPEC_ALIGN(16) UCHAR Bytes[16]{};
+    for (ULONG Index = 0; Index < _countof(Bytes) && String[Index]; ++Index)
+    {
+        Bytes[Index] = String[Index] > 0xFF ? 0xFF : static_cast<UCHAR>(String[Index]);
+    }
+
+    return WSKVectorLoad(Bytes);
+}
+
+// Returns false when the string is longer than any address we parse.
+template<typename CharT>
+static BOOLEAN WSKScanChars(
+    _In_  const CharT*       String,
+    _Out_ WSK_ADDRESS_CHARS* Chars
+)
+{
+    Chars->Digits = 0u;
+    Chars->Hex    = 0u;
+    Chars->Dots   = 0u;
+    Chars->Colons = 0u;
+
+    for (ULONG Offset = 0u; Offset < sizeof Chars->Bytes; Offset += sizeof(WSK_VECTOR))
+    {
+        const auto Value  = WSKLoadChars(String + Offset);
+        const auto Digits = WSKVectorInRange(Value, '0', 10);
+        const auto Hex    = WSKVectorOr(Digits, WSKVectorInRange(WSKVectorOr(Value, WSKVectorSet(0x20)), 'a', 6));
+
+        WSKVectorStore(&Chars->Bytes[Offset], Value);
+
+        Chars->Digits |= static_cast<ULONG64>(WSKVectorMask(Digits)) << Offset;
+        Chars->Hex    |= static_cast<ULONG64>(WSKVectorMask(Hex)) << Offset;
+        Chars->Dots   |= static_cast<ULONG64>(WSKVectorMask(WSKVectorEqual(Value, '.'))) << Offset;
+        Chars->Colons |= static_cast<ULONG64>(WSKVectorMask(WSKVectorEqual(Value, ':'))) << Offset;
+
+        const auto Nul = WSKVectorMask(WSKVectorEqual(Value, '\0'));
+        if (Nul)
+        {
+            Chars->Length = Offset + WSKTrailingZeros(Nul);
+
+            const auto Valid = (1ull << Chars->Length) - 1u;
+            Chars->Digits &= Valid;
+            Chars->Hex    &= Valid;
+            Chars->Dots   &= Valid;
+            Chars->Colons &= Valid;
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static __forceinline BOOLEAN WSKCharIs(_In_ ULONG64 Mask, _In_ ULONG Position)
+{
+    return Position < 64u && ((Mask >> Position) & 1u);
+}
+
+// Number of consecutive characters of one class starting at Position.
+static __forceinline ULONG WSKCharRun(_In_ ULONG64 Mask, _In_ ULONG Position)
+{
+    return Position < 64u ? WSKTrailingZeros(~(Mask >> Position)) : 0u;
+}
+
+// Characters Rtl also stops at, so a fast parse ends where Rtl would.
+static __forceinline BOOLEAN WSKIsIpv4End(_In_ UCHAR Char)
+{
+    return Char == '\0' || Char == ':' || Char == '%' || Char == '/' || Char == ']' || Char == ' ';
+}
+
+static __forceinline BOOLEAN WSKIsIpv6End(_In_ UCHAR Char)
+{
+    return Char == '\0' || Char == '%' || Char == '/' || Char == ']' || Char == ' ';
+}
+
+// Canonical decimal: no sign, no leading zero, at most MaxDigits digits.
+static ULONG WSKParseDecimal(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _In_  ULONG  Position,
+    _In_  ULONG  MaxDigits,
+    _Out_ PULONG Value
+)
+{
+    const auto Count = WSKCharRun(Chars->Digits, Position);
+    if (Count == 0u || Count > MaxDigits || (Count > 1u && Chars->Bytes[Position] == '0'))
+    {
+        return 0u;
+    }
+
+    *Value = 0u;
+    for (ULONG Index = 0u; Index < Count; ++Index)
+    {
+        *Value = *Value * 10u + (Chars->Bytes[Position + Index] - '0');
+    }
+
+    return Count;
+}
+
+static ULONG WSKParsePort(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _In_  ULONG   Position,
+    _Out_ PUSHORT Port
+)
+{
+    ULONG Value = 0u;
+
+    const auto Count = WSKParseDecimal(Chars, Position, 5u, &Value);
+    if (Count == 0u || Value > MAXUSHORT)
+    {
+        return 0u;
+    }
+
+    *Port = RtlUshortByteSwap(static_cast<USHORT>(Value));
+    return Count;
+}
+
+// Strict dotted decimal only, anything else returns 0 and is left to Rtl.
+static ULONG WSKParseIpv4(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _In_  ULONG    Offset,
+    _Out_ IN_ADDR* Address
+)
+{
+    auto Position = Offset;
+
+    for (ULONG Index = 0u; Index < 4u; ++Index)
+    {
+        if (Index != 0u)
+        {
+            if (!WSKCharIs(Chars->Dots, Position))
+            {
+                return 0u;
+            }
+
+            ++Position;
+        }
+
+        ULONG Value = 0u;
+
+        const auto Count = WSKParseDecimal(Chars, Position, 3u, &Value);
+        if (Count == 0u || Value > MAXUCHAR || (Chars->Bytes[Position + Count] | 0x20) == 'x')
+        {
+            return 0u;
+        }
+
+        reinterpret_cast<PUCHAR>(Address)[Index] = static_cast<UCHAR>(Value);
+        Position += Count;
+    }
+
+    return Position - Offset;
+}
+
+// Hex groups with at most one "::", embedded IPv4 is left to Rtl.
+static ULONG WSKParseIpv6(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _In_  ULONG     Offset,
+    _Out_ IN6_ADDR* Address
+)
+{
+    USHORT  Words[8]{};
+    ULONG   Count    = 0u;
+    ULONG   Gap      = 0u;
+    BOOLEAN HasGap   = FALSE;
+    BOOLEAN AfterGap = FALSE;
+    auto    Position = Offset;
+
+    if (WSKCharIs(Chars->Colons, Position))
+    {
+        if (!WSKCharIs(Chars->Colons, Position + 1))
+        {
+            return 0u;
+        }
+
+        HasGap   = TRUE;
+        AfterGap = TRUE;
+        Position += 2;
+    }
+
+    for (;;)
+    {
+        const auto Length = WSKCharRun(Chars->Hex, Position);
+        if (Length == 0u)
+        {
+            if (!AfterGap)
+            {
+                return 0u;
+            }
+
+            break;
+        }
+
+        if (Length > 4u || Count == _countof(Words))
+        {
+            return 0u;
+        }
+
+        USHORT Word = 0u;
+        for (ULONG Index = 0u; Index < Length; ++Index)
+        {
+            const auto Char = Chars->Bytes[Position + Index];
+            Word = static_cast<USHORT>((Word << 4) | (Char <= '9' ? Char - '0' : (Char | 0x20) - 'a' + 10));
+        }
+
+        Words[Count++] = Word;
+        Position += Length;
+        AfterGap  = FALSE;
+
+        if (WSKCharIs(Chars->Dots, Position))
+        {
+            return 0u;
+        }
+
+        if (!WSKCharIs(Chars->Colons, Position))
+        {
+            break;
+        }
+
+        if (WSKCharIs(Chars->Colons, Position + 1))
+        {
+            if (HasGap)
+            {
+                return 0u;
+            }
+
+            Gap      = Count;
+            HasGap   = TRUE;
+            AfterGap = TRUE;
+            Position += 2;
+        }
+        else
+        {
+            Position += 1;
+        }
+    }
+
+    // "::" stands for at least one zero group.
+    if (HasGap ? Count == _countof(Words) : Count != _countof(Words))
+    {
+        return 0u;
+    }
+
+    const auto Head = HasGap ? Gap : Count;
+
+    RtlZeroMemory(Address, sizeof(*Address));
+    for (ULONG Index = 0u; Index < Head; ++Index)
+    {
+        Address->u.Word[Index] = RtlUshortByteSwap(Words[Index]);
+    }
+    for (ULONG Index = Head; Index < Count; ++Index)
+    {
+        Address->u.Word[_countof(Words) - Count + Index] = RtlUshortByteSwap(Words[Index]);
+    }
+
+    return Position - Offset;
+}
+
+static ULONG WSKFormatDecimal(_In_ ULONG Value, _Out_writes_(10) PUCHAR Buffer)
+{
+    UCHAR Digits[10];
+    ULONG Count = 0u;
+
+    do
+    {
+        Digits[Count++] = static_cast<UCHAR>('0' + Value % 10u);
+        Value /= 10u;
+    } while (Value);
+
+    for (ULONG Index = 0u; Index < Count; ++Index)
+    {
+        Buffer[Index] = Digits[Count - Index - 1];
+    }
+
+    return Count;
+}
+
+// Buffer needs room for 4 bytes past the text.
+static ULONG WSKFormatIpv4(_In_ const IN_ADDR* Address, _Out_writes_(20) PUCHAR Buffer)
+{
+    auto  Octets = reinterpret_cast<const UCHAR*>(Address);
+    ULONG Length = 0u;
+
+    for (ULONG Index = 0u; Index < 4u; ++Index)
+    {
+        const auto Text = WSKDecimalOctets[Octets[Index]];
+
+        if (Index != 0u)
+        {
+            Buffer[Length++] = '.';
+        }
+
+        RtlCopyMemory(&Buffer[Length], Text, sizeof(WSKDecimalOctets[0]));
+        Length += Text[3];
+    }
+
+    return Length;
+}
+
+// Returns 0 for the forms Rtl prints specially (embedded IPv4, ISATAP) and for
+// zero runs where the choice of "::" is not the obvious one; Rtl formats those.
+static ULONG WSKFormatIpv6(_In_ const IN6_ADDR* Address, _Out_writes_(40) PUCHAR Buffer)
+{
+    DECLSPEC_ALIGN(16) UCHAR Hex[32];
+
+    WSKVectorToHex(Address, Hex);
+    const auto Zeros = WSKVectorZeroWords(Address);
+
+    if ((Zeros & 0x0Fu) == 0x0Fu)
+    {
+        if (Zeros == 0xFFu)
+        {
+            Buffer[0] = ':';
+            Buffer[1] = ':';
+            return 2u;
+        }
+
+        if (Zeros == 0x7Fu && Address->u.Word[7] == RtlUshortByteSwap(1))
+        {
+            Buffer[0] = ':';
+            Buffer[1] = ':';
+            Buffer[2] = '1';
+            return 3u;
+        }
+
+        return 0u;
+    }
+
+    if (Address->u.Word[5] == RtlUshortByteSwap(0x5EFE))
+    {
+        return 0u;
+    }
+
+    ULONG   Start = _countof(Address->u.Word);
+    ULONG   Count = 0u;
+    BOOLEAN Tie   = FALSE;
+
+    for (ULONG Index = 0u; Index < _countof(Address->u.Word);)
+    {
+        if (!(Zeros & (1u << Index)))
+        {
+            ++Index;
+            continue;
+        }
+
+        const auto Run = WSKTrailingZeros(~(static_cast<ULONG64>(Zeros) >> Index));
+        if (Run > Count)
+        {
+            Start = Index;
+            Count = Run;
+            Tie   = FALSE;
+        }
+        else if (Run == Count)
+        {
+            Tie = TRUE;
+        }
+
+        Index += Run;
+    }
+
+    if (Count == 1u || Tie)
+    {
+        return 0u;
+    }
+
+    ULONG Length = 0u;
+
+    for (ULONG Index = 0u; Index < _countof(Address->u.Word); ++Index)
+    {
+        if (Index == Start)
+        {
+            Buffer[Length++] = ':';
+            Buffer[Length++] = ':';
+
+            Index += Count - 1;
+            continue;
+        }
+
+        if (Index != 0u && Index != Start + Count)
+        {
+            Buffer[Length++] = ':';
+        }
+
+        const auto Digits = &Hex[Index * 4];
+
+        ULONG Skip = 0u;
+        while (Skip < 3u && Digits[Skip] == '0')
+        {
+            ++Skip;
+        }
+
+        for (; Skip < 4u; ++Skip)
+        {
+            Buffer[Length++] = Digits[Skip];
+        }
+    }
+
+    return Length;
+}
+
+static ULONG WSKFormatIpv4Ex(
+    _In_ const IN_ADDR* Address,
+    _In_ USHORT         Port,
+    _Out_writes_(64) PUCHAR Buffer
+)
+{
+    auto Length = WSKFormatIpv4(Address, Buffer);
+    if (Port)
+    {
+        Buffer[Length++] = ':';
+        Length += WSKFormatDecimal(RtlUshortByteSwap(Port), &Buffer[Length]);
+    }
+
+    return Length;
+}
+
+// Returns 0 when Rtl has to format the address.
+static ULONG WSKFormatIpv6Ex(
+    _In_ const IN6_ADDR* Address,
+    _In_ ULONG          ScopeId,
+    _In_ USHORT         Port,
+    _Out_writes_(64) PUCHAR Buffer
+)
+{
+    ULONG Length = 0u;
+    if (Port)
+    {
+        Buffer[Length++] = '[';
+    }
+
+    const auto Count = WSKFormatIpv6(Address, &Buffer[Length]);
+    if (Count == 0u)
+    {
+        return 0u;
+    }
+
+    Length += Count;
+
+    if (ScopeId)
+    {
+        Buffer[Length++] = '%';
+        Length += WSKFormatDecimal(ScopeId, &Buffer[Length]);
+    }
+
+    if (Port)
+    {
+        Buffer[Length++] = ']';
+        Buffer[Length++] = ':';
+        Length += WSKFormatDecimal(RtlUshortByteSwap(Port), &Buffer[Length]);
+    }
+
+    return Length;
+}
+
+// The Ex parsers must consume the whole string.
+static BOOLEAN WSKParseIpv4Ex(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _Out_ IN_ADDR* Address,
+    _Out_ PUSHORT  Port
+)
+{
+    *Port = 0u;
+
+    auto Length = WSKParseIpv4(Chars, 0u, Address);
+    if (Length && WSKCharIs(Chars->Colons, Length))
+    {
+        const auto Count = WSKParsePort(Chars, Length + 1, Port);
+        Length = Count ? Length + 1 + Count : 0u;
+    }
+
+    return Length != 0u && Length == Chars->Length;
+}
+
+static BOOLEAN WSKParseIpv6Ex(
+    _In_  const WSK_ADDRESS_CHARS* Chars,
+    _Out_ IN6_ADDR* Address,
+    _Out_ PULONG    ScopeId,
+    _Out_ PUSHORT   Port
+)
+{
+    const BOOLEAN Bracket  = Chars->Bytes[0] == '[';
+    ULONG         Position = Bracket ? 1u : 0u;
+
+    *ScopeId = 0u;
+    *Port    = 0u;
+
+    auto Count = WSKParseIpv6(Chars, Position, Address);
+    if (Count == 0u)
+    {
+        return FALSE;
+    }
+
+    Position += Count;
+
+    if (Chars->Bytes[Position] == '%')
+    {
+        Count = WSKParseDecimal(Chars, Position + 1, 9u, ScopeId);
+        if (Count == 0u)
+        {
+            return FALSE;
+        }
+
+        Position += 1 + Count;
+    }
+
+    if (Bracket)
+    {
+        if (Chars->Bytes[Position] != ']')
+        {
+            return FALSE;
+        }
+
+        Position += 1;
+
+        if (WSKCharIs(Chars->Colons, Position))
+        {
+            Count = WSKParsePort(Chars, Position + 1, Port);
+            if (Count == 0u)
+            {
+                return FALSE;
+            }
+
+            Position += 1 + Count;
+        }
+    }
+
+    return Position == Chars->Length;
+}
+
+static CHAR* WSKCopyChars(
+    _Out_writes_(Length + 1) CHAR* Target,
+    _In_reads_(Length) const UCHAR* Source,
+    _In_ ULONG Length
+)
+{
+    RtlCopyMemory(Target, Source, Length);
+
+    Target[Length] = '\0';
+    return Target + Length;
+}
+
+static WCHAR* WSKCopyChars(
+    _Out_writes_(Length + 1) WCHAR* Target,
+    _In_reads_(Length) const UCHAR* Source,
+    _In_ ULONG Length
+)
+{
+    ULONG Index = 0u;
+
+    for (; Index + sizeof(WSK_VECTOR) <= Length; Index += sizeof(WSK_VECTOR))
+    {
+        WSKVectorWiden(&Target[Index], WSKVectorLoad(&Source[Index]));
+    }
+
+    for (; Index < Length; ++Index)
+    {
+        Target[Index] = Source[Index];
+    }
+
+    Target[Length] = L'\0';
+    return Target + Length;
+}
+
+template<typename CharT>
+static NTSTATUS WSKCopyCharsEx(
+    _Out_writes_to_(*TargetLength, *TargetLength) CharT* Target,
+    _Inout_ PULONG TargetLength,
+    _In_reads_(Length) const UCHAR* Source,
+    _In_ ULONG Length
+)
+{
+    if (Target == nullptr || *TargetLength <= Length)
+    {
+        *TargetLength = Length + 1;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    WSKCopyChars(Target, Source, Length);
+
+    *TargetLength = Length + 1;
+    return STATUS_SUCCESS;
+}
+
+static __forceinline PSTR WSKRtlIpv4AddressToString(const IN_ADDR* Address, PSTR String)
+{
+    return RtlIpv4AddressToStringA(Address, String);
+}
+
+static __forceinline PWSTR WSKRtlIpv4AddressToString(const IN_ADDR* Address, PWSTR String)
+{
+    return RtlIpv4AddressToStringW(Address, String);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4AddressToStringEx(const IN_ADDR* Address, USHORT Port, PSTR String, PULONG Length)
+{
+    return RtlIpv4AddressToStringExA(Address, Port, String, Length);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4AddressToStringEx(const IN_ADDR* Address, USHORT Port, PWSTR String, PULONG Length)
+{
+    return RtlIpv4AddressToStringExW(Address, Port, String, Length);
+}
+
+static __forceinline PSTR WSKRtlIpv6AddressToString(const IN6_ADDR* Address, PSTR String)
+{
+    return RtlIpv6AddressToStringA(Address, String);
+}
+
+static __forceinline PWSTR WSKRtlIpv6AddressToString(const IN6_ADDR* Address, PWSTR String)
+{
+    return RtlIpv6AddressToStringW(Address, String);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6AddressToStringEx(const IN6_ADDR* Address, ULONG ScopeId, USHORT Port, PSTR String, PULONG Length)
+{
+    return RtlIpv6AddressToStringExA(Address, ScopeId, Port, String, Length);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6AddressToStringEx(const IN6_ADDR* Address, ULONG ScopeId, USHORT Port, PWSTR String, PULONG Length)
+{
+    return RtlIpv6AddressToStringExW(Address, ScopeId, Port, String, Length);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4StringToAddress(PCSTR String, BOOLEAN Strict, PCSTR* Terminator, IN_ADDR* Address)
+{
+    return RtlIpv4StringToAddressA(String, Strict, Terminator, Address);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4StringToAddress(PCWSTR String, BOOLEAN Strict, PCWSTR* Terminator, IN_ADDR* Address)
+{
+    return RtlIpv4StringToAddressW(String, Strict, Terminator, Address);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4StringToAddressEx(PCSTR String, BOOLEAN Strict, IN_ADDR* Address, PUSHORT Port)
+{
+    return RtlIpv4StringToAddressExA(String, Strict, Address, Port);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv4StringToAddressEx(PCWSTR String, BOOLEAN Strict, IN_ADDR* Address, PUSHORT Port)
+{
+    return RtlIpv4StringToAddressExW(String, Strict, Address, Port);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6StringToAddress(PCSTR String, PCSTR* Terminator, IN6_ADDR* Address)
+{
+    return RtlIpv6StringToAddressA(String, Terminator, Address);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6StringToAddress(PCWSTR String, PCWSTR* Terminator, IN6_ADDR* Address)
+{
+    return RtlIpv6StringToAddressW(String, Terminator, Address);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6StringToAddressEx(PCSTR String, IN6_ADDR* Address, PULONG ScopeId, PUSHORT Port)
+{
+    return RtlIpv6StringToAddressExA(String, Address, ScopeId, Port);
+}
+
+static __forceinline NTSTATUS WSKRtlIpv6StringToAddressEx(PCWSTR String, IN6_ADDR* Address, PULONG ScopeId, PUSHORT Port)
+{
+    return RtlIpv6StringToAddressExW(String, Address, ScopeId, Port);
+}
+
+#if DBG
+// Checked builds compare every fast result with Rtl.
+template<typename CharT>
+static BOOLEAN WSKEqualChars(_In_ const CharT* First, _In_ const CharT* Second)
+{
+    while (*First && *First == *Second)
+    {
+        ++First;
+        ++Second;
+    }
+
+    return *First == *Second;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Public  Function
+
+template<typename CharT>
+CharT* WSKAPI WSKIpv4AddressToString(
+    _In_ const IN_ADDR* Address,
+    _Out_writes_(16) CharT* AddressString
+)
+{
+    DECLSPEC_ALIGN(16) UCHAR Buffer[64];
+
+    const auto Length = WSKFormatIpv4(Address, Buffer);
+    const auto Result = WSKCopyChars(AddressString, Buffer, Length);
+
+#if DBG
+    CharT Expected[16];
+    WSKRtlIpv4AddressToString(Address, Expected);
+    NT_ASSERT(WSKEqualChars(AddressString, Expected));
+#endif
+
+    return Result;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4AddressToStringEx(
+    _In_ const IN_ADDR* Address,
+    _In_ USHORT         Port,
+    _Out_writes_to_(*AddressStringLength, *AddressStringLength) CharT* AddressString,
+    _Inout_ PULONG      AddressStringLength
+)
+{
+    DECLSPEC_ALIGN(16) UCHAR Buffer[64];
+
+    if (Address == nullptr || AddressStringLength == nullptr)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const auto Length = WSKFormatIpv4Ex(Address, Port, Buffer);
+    const auto Status = WSKCopyCharsEx(AddressString, AddressStringLength, Buffer, Length);
+
+#if DBG
+    if (NT_SUCCESS(Status))
+    {
+        CharT Expected[64];
+        ULONG ExpectedLength = _countof(Expected);
+
+        NT_ASSERT(NT_SUCCESS(WSKRtlIpv4AddressToStringEx(Address, Port, Expected, &ExpectedLength)));
+        NT_ASSERT(ExpectedLength == *AddressStringLength && WSKEqualChars(AddressString, Expected));
+    }
+#endif
+
+    return Status;
+}
+
+template<typename CharT>
+CharT* WSKAPI WSKIpv6AddressToString(
+    _In_ const IN6_ADDR* Address,
+    _Out_writes_(46) CharT* AddressString
+)
+{
+    DECLSPEC_ALIGN(16) UCHAR Buffer[64];
+
+    const auto Length = WSKFormatIpv6(Address, Buffer);
+    if (Length == 0u)
+    {
+        return WSKRtlIpv6AddressToString(Address, AddressString);
+    }
+
+    const auto Result = WSKCopyChars(AddressString, Buffer, Length);
+
+#if DBG
+    CharT Expected[46];
+    WSKRtlIpv6AddressToString(Address, Expected);
+    NT_ASSERT(WSKEqualChars(AddressString, Expected));
+#endif
+
+    return Result;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6AddressToStringEx(
+    _In_ const IN6_ADDR* Address,
+    _In_ ULONG          ScopeId,
+    _In_ USHORT         Port,
+    _Out_writes_to_(*AddressStringLength, *AddressStringLength) CharT* AddressString,
+    _Inout_ PULONG      AddressStringLength
+)
+{
+    DECLSPEC_ALIGN(16) UCHAR Buffer[64];
+
+    if (Address == nullptr || AddressStringLength == nullptr)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const auto Length = WSKFormatIpv6Ex(Address, ScopeId, Port, Buffer);
+    if (Length == 0u)
+    {
+        return WSKRtlIpv6AddressToStringEx(Address, ScopeId, Port, AddressString, AddressStringLength);
+    }
+
+    const auto Status = WSKCopyCharsEx(AddressString, AddressStringLength, Buffer, Length);
+
+#if DBG
+    if (NT_SUCCESS(Status))
+    {
+        CharT Expected[64];
+        ULONG ExpectedLength = _countof(Expected);
+
+        NT_ASSERT(NT_SUCCESS(WSKRtlIpv6AddressToStringEx(Address, ScopeId, Port, Expected, &ExpectedLength)));
+        NT_ASSERT(ExpectedLength == *AddressStringLength && WSKEqualChars(AddressString, Expected));
+    }
+#endif
+
+    return Status;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4StringToAddress(
+    _In_  const CharT*  AddressString,
+    _In_  BOOLEAN       Strict,
+    _Out_ const CharT** Terminator,
+    _Out_ IN_ADDR*      Address
+)
+{
+    WSK_ADDRESS_CHARS Chars;
+    IN_ADDR Result{};
+    ULONG   Length = 0u;
+
+    if (Strict && WSKScanChars(AddressString, &Chars))
+    {
+        Length = WSKParseIpv4(&Chars, 0u, &Result);
+        if (!WSKIsIpv4End(Chars.Bytes[Length]))
+        {
+            Length = 0u;
+        }
+    }
+
+    if (Length == 0u)
+    {
+        return WSKRtlIpv4StringToAddress(AddressString, Strict, Terminator, Address);
+    }
+
+#if DBG
+    IN_ADDR      Expected{};
+    const CharT* ExpectedTerminator = nullptr;
+
+    NT_ASSERT(NT_SUCCESS(WSKRtlIpv4StringToAddress(AddressString, Strict, &ExpectedTerminator, &Expected)));
+    NT_ASSERT(ExpectedTerminator == AddressString + Length && Expected.s_addr == Result.s_addr);
+#endif
+
+    *Address    = Result;
+    *Terminator = AddressString + Length;
+
+    return STATUS_SUCCESS;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4StringToAddressEx(
+    _In_  const CharT*  AddressString,
+    _In_  BOOLEAN       Strict,
+    _Out_ IN_ADDR*      Address,
+    _Out_ PUSHORT       Port
+)
+{
+    WSK_ADDRESS_CHARS Chars;
+    IN_ADDR Result{};
+    USHORT  ResultPort = 0u;
+
+    if (!Strict || !WSKScanChars(AddressString, &Chars) || !WSKParseIpv4Ex(&Chars, &Result, &ResultPort))
+    {
+        return WSKRtlIpv4StringToAddressEx(AddressString, Strict, Address, Port);
+    }
+
+#if DBG
+    IN_ADDR Expected{};
+    USHORT  ExpectedPort = 0u;
+
+    NT_ASSERT(NT_SUCCESS(WSKRtlIpv4StringToAddressEx(AddressString, Strict, &Expected, &ExpectedPort)));
+    NT_ASSERT(Expected.s_addr == Result.s_addr && ExpectedPort == ResultPort);
+#endif
+
+    *Address = Result;
+    *Port    = ResultPort;
+
+    return STATUS_SUCCESS;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6StringToAddress(
+    _In_  const CharT*  AddressString,
+    _Out_ const CharT** Terminator,
+    _Out_ IN6_ADDR*     Address
+)
+{
+    WSK_ADDRESS_CHARS Chars;
+    IN6_ADDR Result{};
+    ULONG    Length = 0u;
+
+    if (WSKScanChars(AddressString, &Chars))
+    {
+        Length = WSKParseIpv6(&Chars, 0u, &Result);
+        if (!WSKIsIpv6End(Chars.Bytes[Length]))
+        {
+            Length = 0u;
+        }
+    }
+
+    if (Length == 0u)
+    {
+        return WSKRtlIpv6StringToAddress(AddressString, Terminator, Address);
+    }
+
+#if DBG
+    IN6_ADDR     Expected{};
+    const CharT* ExpectedTerminator = nullptr;
+
+    NT_ASSERT(NT_SUCCESS(WSKRtlIpv6StringToAddress(AddressString, &ExpectedTerminator, &Expected)));
+    NT_ASSERT(ExpectedTerminator == AddressString + Length && RtlEqualMemory(&Expected, &Result, sizeof Result));
+#endif
+
+    *Address    = Result;
+    *Terminator = AddressString + Length;
+
+    return STATUS_SUCCESS;
+}
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6StringToAddressEx(
+    _In_  const CharT*  AddressString,
+    _Out_ IN6_ADDR*     Address,
+    _Out_ PULONG        ScopeId,
+    _Out_ PUSHORT       Port
+)
+{
+    WSK_ADDRESS_CHARS Chars;
+    IN6_ADDR Result{};
+    ULONG    ResultScopeId = 0u;
+    USHORT   ResultPort    = 0u;
+
+    if (!WSKScanChars(AddressString, &Chars) || !WSKParseIpv6Ex(&Chars, &Result, &ResultScopeId, &ResultPort))
+    {
+        return WSKRtlIpv6StringToAddressEx(AddressString, Address, ScopeId, Port);
+    }
+
+#if DBG
+    IN6_ADDR Expected{};
+    ULONG    ExpectedScopeId = 0u;
+    USHORT   ExpectedPort    = 0u;
+
+    NT_ASSERT(NT_SUCCESS(WSKRtlIpv6StringToAddressEx(AddressString, &Expected, &ExpectedScopeId, &ExpectedPort)));
+    NT_ASSERT(RtlEqualMemory(&Expected, &Result, sizeof Result) &&
+        ExpectedScopeId == ResultScopeId && ExpectedPort == ResultPort);
+#endif
+
+    *Address = Result;
+    *ScopeId = ResultScopeId;
+    *Port    = ResultPort;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WSKAPI WSKAddressToStringBatch(
+    _In_reads_(AddressCount) const SOCKADDR_INET* Addresses,
+    _In_    UINT32  AddressCount,
+    _Out_writes_to_opt_(*AddressStringsLength, *AddressStringsLength) LPWSTR AddressStrings,
+    _Inout_ UINT32* AddressStringsLength,
+    _Out_writes_opt_(AddressCount) UINT32* AddressStringOffsets
+)
+{
+    DECLSPEC_ALIGN(16) UCHAR Staged[512];
+
+    NTSTATUS Status  = STATUS_SUCCESS;
+    ULONG    Used    = 0u;
+    ULONG    Flushed = 0u;  // characters of the caller's buffer already written
+    ULONG    Pending = 0u;  // bytes in Staged not yet widened
+
+    if ((Addresses == nullptr && AddressCount) || AddressStringsLength == nullptr)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Strings are formatted back to back into Staged and widened a block at a time,
+    // most of them are shorter than one vector and would otherwise widen a character at a time.
+    for (UINT32 Index = 0u; Index < AddressCount; ++Index)
+    {
+        if (Pending + WSK_ADDRESS_STRING_MAX > sizeof Staged)
+        {
+            WSKCopyChars(&AddressStrings[Flushed], Staged, Pending - 1);
+            Flushed += Pending;
+            Pending  = 0u;
+        }
+
+        const auto Address = &Addresses[Index];
+        const auto Buffer  = &Staged[Pending];
+        ULONG      Length  = 0u;
+
+        if (Address->si_family == AF_INET)
+        {
+            Length = WSKFormatIpv4Ex(&Address->Ipv4.sin_addr, Address->Ipv4.sin_port, Buffer);
+        }
+        else if (Address->si_family == AF_INET6)
+        {
+            Length = WSKFormatIpv6Ex(&Address->Ipv6.sin6_addr, Address->Ipv6.sin6_scope_id,
+                Address->Ipv6.sin6_port, Buffer);
+            if (Length == 0u)
+            {
+                Length = WSK_ADDRESS_STRING_MAX;
+                Status = RtlIpv6AddressToStringExA(&Address->Ipv6.sin6_addr, Address->Ipv6.sin6_scope_id,
+                    Address->Ipv6.sin6_port, reinterpret_cast<PSTR>(Buffer), &Length);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                Length -= 1;
+            }
+        }
+        else
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (AddressStringOffsets)
+        {
+            AddressStringOffsets[Index] = Used;
+        }
+
+        // Keep counting once the buffer is full so the caller learns the size it needs.
+        if (AddressStrings && Used + Length < *AddressStringsLength)
+        {
+            Buffer[Length] = '\0';
+            Pending += Length + 1;
+        }
+        else
+        {
+            Status = STATUS_BUFFER_TOO_SMALL;
+        }
+
+        Used += Length + 1;
+    }
+
+    if (Pending)
+    {
+        WSKCopyChars(&AddressStrings[Flushed], Staged, Pending - 1);
+    }
+
+    if (NT_SUCCESS(Status) || Status == STATUS_BUFFER_TOO_SMALL)
+    {
+        *AddressStringsLength = Used;
+    }
+
+    return Status;
+}
+
+// Narrows the next block of packed strings and classifies every character once,
+// each string in the block then takes its masks from the block instead of scanning again.
+static VOID WSKScanBlock(
+    _In_reads_(Remaining) PCWSTR AddressStrings,
+    _In_  ULONG               Remaining,
+    _Out_ WSK_ADDRESS_BLOCK*  Block
+)
+{
+    const ULONG Count = Remaining < WSK_ADDRESS_BLOCK_CHARS ? Remaining : WSK_ADDRESS_BLOCK_CHARS;
+
+    RtlZeroMemory(Block, sizeof(*Block));
+    Block->Length = Count;
+
+    for (ULONG Offset = 0u; Offset < Count; Offset += sizeof(WSK_VECTOR))
+    {
+        WSK_VECTOR Value;
+
+        // Only whole vectors come from the caller's buffer, a short tail is copied first.
+        if (Offset + sizeof(WSK_VECTOR) <= Count)
+        {
+            Value = WSKVectorNarrow(WSKVectorLoad(&AddressStrings[Offset]), WSKVectorLoad(&AddressStrings[Offset + 8]));
+        }
+        else
+        {
+            DECLSPEC_ALIGN(16) WCHAR Tail[sizeof(WSK_VECTOR)]{};
+            RtlCopyMemory(Tail, &AddressStrings[Offset], (Count - Offset) * sizeof(WCHAR));
+
+            Value = WSKVectorNarrow(WSKVectorLoad(&Tail[0]), WSKVectorLoad(&Tail[8]));
+        }
+
+        const auto Digits = WSKVectorInRange(Value, '0', 10);
+        const auto Hex    = WSKVectorOr(Digits, WSKVectorInRange(WSKVectorOr(Value, WSKVectorSet(0x20)), 'a', 6));
+        const auto Word   = Offset / 64u;
+        const auto Shift  = Offset % 64u;
+
+        WSKVectorStore(&Block->Bytes[Offset], Value);
+
+        Block->Digits[Word] |= static_cast<ULONG64>(WSKVectorMask(Digits)) << Shift;
+        Block->Hex[Word]    |= static_cast<ULONG64>(WSKVectorMask(Hex)) << Shift;
+        Block->Dots[Word]   |= static_cast<ULONG64>(WSKVectorMask(WSKVectorEqual(Value, '.'))) << Shift;
+        Block->Colons[Word] |= static_cast<ULONG64>(WSKVectorMask(WSKVectorEqual(Value, ':'))) << Shift;
+        Block->Nuls[Word]   |= static_cast<ULONG64>(WSKVectorMask(WSKVectorEqual(Value, '\0'))) << Shift;
+    }
+
+    // The zero padding past Count is not a terminator.
+    for (ULONG Index = Count; Index < WSK_ADDRESS_BLOCK_CHARS; ++Index)
+    {
+        Block->Nuls[Index / 64u] &= ~(1ull << (Index % 64u));
+    }
+}
+
+// 64 mask bits starting at Position.
+static __forceinline ULONG64 WSKBlockBits(_In_reads_(WSK_ADDRESS_BLOCK_WORDS) const ULONG64* Bits, _In_ ULONG Position)
+{
+    const auto Word  = Position / 64u;
+    const auto Shift = Position % 64u;
+
+    return Shift ? (Bits[Word] >> Shift) | (Bits[Word + 1] << (64u - Shift)) : Bits[Word];
+}
+
+// Position of the first NUL at or after Position, Block->Length when there is none.
+static ULONG WSKBlockFindNul(_In_ const WSK_ADDRESS_BLOCK* Block, _In_ ULONG Position)
+{
+    for (ULONG Word = Position / 64u; Word * 64u < Block->Length; ++Word)
+    {
+        auto Nuls = Block->Nuls[Word];
+        if (Word == Position / 64u)
+        {
+            Nuls &= ~0ull << (Position % 64u);
+        }
+
+        if (Nuls)
+        {
+            return Word * 64u + WSKTrailingZeros(Nuls);
+        }
+    }
+
+    return Block->Length;
+}
+
+NTSTATUS WSKAPI WSKStringToAddressBatch(
+    _In_reads_(AddressStringsLength) PCWSTR AddressStrings,
+    _In_    UINT32  AddressStringsLength,
+    _Out_writes_(AddressCount) SOCKADDR_INET* Addresses,
+    _In_    UINT32  AddressCount,
+    _Out_opt_ UINT32* AddressesConverted
+)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    UINT32   Index    = 0u;
+    ULONG    Position = 0u;     // of the current string in AddressStrings
+    ULONG    Base     = 0u;     // of the block in AddressStrings
+    BOOLEAN  Loaded   = FALSE;
+
+    WSK_ADDRESS_BLOCK Block;
+
+    if ((AddressStrings == nullptr && AddressStringsLength) || (Addresses == nullptr && AddressCount))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (; Index < AddressCount; ++Index)
+    {
+        if (Position >= AddressStringsLength)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        const auto String    = &AddressStrings[Position];
+        const auto Remaining = AddressStringsLength - Position;
+        const auto Address   = &Addresses[Index];
+        ULONG      Length    = 0u;
+
+        RtlZeroMemory(Address, sizeof(*Address));
+
+        // Refill when the string may run past the block, a full block always holds one fast path string.
+        if (!Loaded || Position - Base + sizeof(WSK_ADDRESS_CHARS::Bytes) > Block.Length)
+        {
+            WSKScanBlock(String, Remaining, &Block);
+
+            Base   = Position;
+            Loaded = TRUE;
+        }
+
+        const auto Offset = Position - Base;
+        const auto Nul    = WSKBlockFindNul(&Block, Offset);
+
+        if (Nul < Block.Length && Nul - Offset < sizeof(WSK_ADDRESS_CHARS::Bytes))
+        {
+            WSK_ADDRESS_CHARS Chars;
+
+            Length = Nul - Offset;
+
+            const auto Valid = (1ull << Length) - 1u;
+            Chars.Length = Length;
+            Chars.Digits = WSKBlockBits(Block.Digits, Offset) & Valid;
+            Chars.Hex    = WSKBlockBits(Block.Hex, Offset) & Valid;
+            Chars.Dots   = WSKBlockBits(Block.Dots, Offset) & Valid;
+            Chars.Colons = WSKBlockBits(Block.Colons, Offset) & Valid;
+            RtlCopyMemory(Chars.Bytes, &Block.Bytes[Offset], sizeof Chars.Bytes);
+
+            if (Chars.Dots && WSKParseIpv4Ex(&Chars, &Address->Ipv4.sin_addr, &Address->Ipv4.sin_port))
+            {
+                Address->si_family = AF_INET;
+                Position += Length + 1;
+                continue;
+            }
+
+            if (WSKParseIpv6Ex(&Chars, &Address->Ipv6.sin6_addr, &Address->Ipv6.sin6_scope_id, &Address->Ipv6.sin6_port))
+            {
+                Address->si_family = AF_INET6;
+                Position += Length + 1;
+                continue;
+            }
+        }
+        else
+        {
+            while (Length < Remaining && String[Length])
+            {
+                ++Length;
+            }
+
+            if (Length == Remaining)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+        }
+
+        Status = RtlIpv4StringToAddressExW(String, TRUE, &Address->Ipv4.sin_addr, &Address->Ipv4.sin_port);
+        if (NT_SUCCESS(Status))
+        {
+            Address->si_family = AF_INET;
+            Position += Length + 1;
+            continue;
+        }
+
+        Status = RtlIpv6StringToAddressExW(String, &Address->Ipv6.sin6_addr,
+            &Address->Ipv6.sin6_scope_id, &Address->Ipv6.sin6_port);
+        if (NT_SUCCESS(Status))
+        {
+            Address->si_family = AF_INET6;
+            Position += Length + 1;
+            continue;
+        }
+
+        break;
+    }
+
+    if (AddressesConverted)
+    {
+        *AddressesConverted = Index;
+    }
+
+    return Status;
+}
+
+template CHAR*  WSKAPI WSKIpv4AddressToString<CHAR>(const IN_ADDR*, CHAR*);
+template WCHAR* WSKAPI WSKIpv4AddressToString<WCHAR>(const IN_ADDR*, WCHAR*);
+template NTSTATUS WSKAPI WSKIpv4AddressToStringEx<CHAR>(const IN_ADDR*, USHORT, CHAR*, PULONG);
+template NTSTATUS WSKAPI WSKIpv4AddressToStringEx<WCHAR>(const IN_ADDR*, USHORT, WCHAR*, PULONG);
+template CHAR*  WSKAPI WSKIpv6AddressToString<CHAR>(const IN6_ADDR*, CHAR*);
+template WCHAR* WSKAPI WSKIpv6AddressToString<WCHAR>(const IN6_ADDR*, WCHAR*);
+template NTSTATUS WSKAPI WSKIpv6AddressToStringEx<CHAR>(const IN6_ADDR*, ULONG, USHORT, CHAR*, PULONG);
+template NTSTATUS WSKAPI WSKIpv6AddressToStringEx<WCHAR>(const IN6_ADDR*, ULONG, USHORT, WCHAR*, PULONG);
+template NTSTATUS WSKAPI WSKIpv4StringToAddress<CHAR>(const CHAR*, BOOLEAN, const CHAR**, IN_ADDR*);
+template NTSTATUS WSKAPI WSKIpv4StringToAddress<WCHAR>(const WCHAR*, BOOLEAN, const WCHAR**, IN_ADDR*);
+template NTSTATUS WSKAPI WSKIpv4StringToAddressEx<CHAR>(const CHAR*, BOOLEAN, IN_ADDR*, PUSHORT);
+template NTSTATUS WSKAPI WSKIpv4StringToAddressEx<WCHAR>(const WCHAR*, BOOLEAN, IN_ADDR*, PUSHORT);
+template NTSTATUS WSKAPI WSKIpv6StringToAddress<CHAR>(const CHAR*, const CHAR**, IN6_ADDR*);
+template NTSTATUS WSKAPI WSKIpv6StringToAddress<WCHAR>(const WCHAR*, const WCHAR**, IN6_ADDR*);
+template NTSTATUS WSKAPI WSKIpv6StringToAddressEx<CHAR>(const CHAR*, IN6_ADDR*, PULONG, PUSHORT);
+template NTSTATUS WSKAPI WSKIpv6StringToAddressEx<WCHAR>(const WCHAR*, IN6_ADDR*, PULONG, PUSHORT);
@@ -0,0 +1,67 @@
+#pragma once
+
+// Drop-in replacements for the Rtl ip2string routines.
+// Canonical text is handled with vector code, anything else falls back to Rtl.
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+template<typename CharT>
+CharT* WSKAPI WSKIpv4AddressToString(
+    _In_ const IN_ADDR* Address,
+    _Out_writes_(16) CharT* AddressString
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4AddressToStringEx(
+    _In_ const IN_ADDR* Address,
+    _In_ USHORT         Port,
+    _Out_writes_to_(*AddressStringLength, *AddressStringLength) CharT* AddressString,
+    _Inout_ PULONG      AddressStringLength
+);
+
+template<typename CharT>
+CharT* WSKAPI WSKIpv6AddressToString(
+    _In_ const IN6_ADDR* Address,
+    _Out_writes_(46) CharT* AddressString
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6AddressToStringEx(
+    _In_ const IN6_ADDR* Address,
+    _In_ ULONG          ScopeId,
+    _In_ USHORT         Port,
+    _Out_writes_to_(*AddressStringLength, *AddressStringLength) CharT* AddressString,
+    _Inout_ PULONG      AddressStringLength
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4StringToAddress(
+    _In_  const CharT*  AddressString,
+    _In_  BOOLEAN       Strict,
+    _Out_ const CharT** Terminator,
+    _Out_ IN_ADDR*      Address
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv4StringToAddressEx(
+    _In_  const CharT*  AddressString,
+    _In_  BOOLEAN       Strict,
+    _Out_ IN_ADDR*      Address,
+    _Out_ PUSHORT       Port
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6StringToAddress(
+    _In_  const CharT*  AddressString,
+    _Out_ const CharT** Terminator,
+    _Out_ IN6_ADDR*     Address
+);
+
+template<typename CharT>
+NTSTATUS WSKAPI WSKIpv6StringToAddressEx(
+    _In_  const CharT*  AddressString,
+    _Out_ IN6_ADDR*     Address,
+    _Out_ PULONG        ScopeId,
+    _Out_ PUSHORT       Port
+);
@@ -1,5 +1,6 @@
 ﻿#include "berkeley.h"
 #include "libwsk.h"
+#include "address.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,9 +62,7 @@ int WSKAPI shutdown(
     _In_ int how
 )
 {
-    UNREFERENCED_PARAMETER(how);
-
-    NTSTATUS Status = WSKDisconnect(s, 0);
+    NTSTATUS Status = WSKShutdown(s, how);
     return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : SOCKET_SUCCESS);
 }
 
@@ -91,6 +90,48 @@ int WSKAPI send(
     return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : static_cast<int>(NumberOfBytesSent));
 }
 
+SSIZE_T WSKAPI sendfile(
+    _In_ SOCKET out_fd,
+    _In_ HANDLE in_fd,
+    _Inout_opt_ LONG64* offset,
+    _In_ SIZE_T count
+)
+{
+    ULONG64 NumberOfBytesSent = 0u;
+
+    // WSKTransmitFile takes 0 as the rest of the file.
+    if (count == 0)
+    {
+        return WSKSetLastError(STATUS_SUCCESS), 0;
+    }
+
+    if (offset)
+    {
+        NTSTATUS Status = WSKTransmitFile(out_fd, in_fd, nullptr, static_cast<ULONG64>(*offset),
+            count, &NumberOfBytesSent, 0u);
+
+        *offset += NumberOfBytesSent;
+        return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : static_cast<SSIZE_T>(NumberOfBytesSent));
+    }
+
+    // Without an offset, send from the file position and move it past what was sent.
+    PFILE_OBJECT File = nullptr;
+
+    NTSTATUS Status = ObReferenceObjectByHandle(in_fd, FILE_READ_DATA, *IoFileObjectType, KernelMode,
+        reinterpret_cast<PVOID*>(&File), nullptr);
+    if (NT_SUCCESS(Status))
+    {
+        Status = WSKTransmitFile(out_fd, in_fd, nullptr, static_cast<ULONG64>(File->CurrentByteOffset.QuadPart),
+            count, &NumberOfBytesSent, 0u);
+
+        File->CurrentByteOffset.QuadPart += NumberOfBytesSent;
+
+        ObDereferenceObject(File);
+    }
+
+    return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : static_cast<SSIZE_T>(NumberOfBytesSent));
+}
+
 int WSKAPI recv(
     _In_ SOCKET s,
     _Out_writes_bytes_to_(len, return) __out_data_source(NETWORK) char* buf,
@@ -173,67 +214,245 @@ int WSKAPI getsockopt(
     return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : SOCKET_SUCCESS);
 }
 
+int WSKAPI ioctlsocket(
+    _In_ SOCKET s,
+    _In_ long cmd,
+    _Inout_ unsigned long* argp
+)
+{
+    NTSTATUS Status = WSKIoctl(s, static_cast<ULONG>(cmd), argp, sizeof(*argp), argp, sizeof(*argp),
+        nullptr, nullptr, nullptr);
+    return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : SOCKET_SUCCESS);
+}
+
+static_assert(sizeof(struct pollfd) == sizeof(WSKPOLLFD) &&
+    offsetof(struct pollfd, revents) == offsetof(WSKPOLLFD, ReturnedEvents), "pollfd must match WSKPOLLFD");
+static_assert(POLLIN == WSK_POLLIN && POLLOUT == WSK_POLLOUT && POLLERR == WSK_POLLERR &&
+    POLLHUP == WSK_POLLHUP && POLLNVAL == WSK_POLLNVAL, "POLLxxx must match WSK_POLLxxx");
+
+int WSKAPI poll(
+    _Inout_updates_(nfds) struct pollfd* fds,
+    _In_ nfds_t nfds,
+    _In_ int timeout
+)
+{
+    UINT32 ReadyCount = 0u;
+
+    NTSTATUS Status = WSKPoll(reinterpret_cast<WSKPOLLFD*>(fds), static_cast<UINT32>(nfds),
+        timeout < 0 ? WSK_INFINITE_WAIT : static_cast<UINT32>(timeout), &ReadyCount);
+    return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : static_cast<int>(ReadyCount));
+}
+
+int WSKAPI select(
+    _In_ int nfds,
+    _Inout_opt_ fd_set* readfds,
+    _Inout_opt_ fd_set* writefds,
+    _Inout_opt_ fd_set* exceptfds,
+    _In_opt_ const struct timeval* timeout
+)
+{
+    UNREFERENCED_PARAMETER(nfds);
+
+    NTSTATUS   Status  = STATUS_SUCCESS;
+    WSKPOLLFD* Sockets = nullptr;
+    int        Result  = 0;
+
+    fd_set*     Sets[]   = { readfds, writefds, exceptfds };
+    const SHORT Events[] = { WSK_POLLIN, WSK_POLLOUT, WSK_POLLPRI };
+    const SHORT Ready[]  = { WSK_POLLIN | WSK_POLLHUP | WSK_POLLERR, WSK_POLLOUT, WSK_POLLPRI | WSK_POLLERR };
+
+    do
+    {
+        UINT32 Timeout = WSK_INFINITE_WAIT;
+
+        if (timeout)
+        {
+            if (timeout->tv_sec < 0 || timeout->tv_usec < 0)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            const ULONG64 Milliseconds = static_cast<ULONG64>(timeout->tv_sec) * 1000u +
+                (static_cast<ULONG64>(timeout->tv_usec) + 999u) / 1000u;
+
+            Timeout = static_cast<UINT32>(min(Milliseconds, static_cast<ULONG64>(WSK_INFINITE_WAIT - 1)));
+        }
+
+        UINT32 Count = 0u;
+
+        for (auto Set : Sets)
+        {
+            if (Set)
+            {
+                Set->fd_count = min(Set->fd_count, static_cast<unsigned int>(FD_SETSIZE));
+                Count += Set->fd_count;
+            }
+        }
+
+        if (Count)
+        {
+            Sockets = static_cast<WSKPOLLFD*>(ExAllocatePoolZero(PagedPool,
+                Count * sizeof(WSKPOLLFD), WSK_POOL_TAG));
+            if (Sockets == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+        Count = 0u;
+
+        for (ULONG Idx = 0; Idx < _countof(Sets); ++Idx)
+        {
+            for (unsigned int Fd = 0; Sets[Idx] && Fd < Sets[Idx]->fd_count; ++Fd)
+            {
+                Sockets[Count].Socket = Sets[Idx]->fd_array[Fd];
+                Sockets[Count].Events = Events[Idx];
+                Count += 1;
+            }
+        }
+
+        Status = WSKPoll(Sockets, Count, Timeout, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        // Rewrite every set in place with its ready sockets.
+
+        Count = 0u;
+
+        for (ULONG Idx = 0; Idx < _countof(Sets); ++Idx)
+        {
+            unsigned int Found = 0u;
+
+            for (unsigned int Fd = 0; Sets[Idx] && Fd < Sets[Idx]->fd_count; ++Fd)
+            {
+                const auto ReturnedEvents = Sockets[Count++].ReturnedEvents;
+
+                if (ReturnedEvents & WSK_POLLNVAL)
+                {
+                    Status = STATUS_INVALID_HANDLE;
+                }
+
+                if (ReturnedEvents & Ready[Idx])
+                {
+                    Sets[Idx]->fd_array[Found++] = Sets[Idx]->fd_array[Fd];
+                }
+            }
+
+            if (Sets[Idx])
+            {
+                Sets[Idx]->fd_count = Found;
+                Result += static_cast<int>(Found);
+            }
+        }
+
+    } while (false);
+
+    if (Sockets)
+    {
+        ExFreePoolWithTag(Sockets, WSK_POOL_TAG);
+    }
+
+    return WSKSetLastError(Status), (!NT_SUCCESS(Status) ? SOCKET_ERROR : Result);
+}
+
 static NTSTATUS WSKAPI convert_addrinfo_to_addrinfoex(
     _In_ addrinfoexW** target,
     _In_opt_ const addrinfo* source
 )
 {
-    NTSTATUS     Status  = STATUS_SUCCESS;
-    addrinfoexW* Result  = nullptr;
-    sockaddr*    Address = nullptr;
-
-    ANSI_STRING     CanonicalNameA{};
-    UNICODE_STRING  CanonicalNameW{};
+    NTSTATUS     Status      = STATUS_SUCCESS;
+    addrinfoexW* Result      = nullptr;
+    SIZE_T       Count       = 0u;
+    SIZE_T       AddressSize = 0u;
+    SIZE_T       NameSize    = 0u;
 
     do
     {
         *target = nullptr;
 
-        if (source == nullptr)
+        // Size the whole list first, the nodes, addresses and names share one allocation.
+
+        for (auto Node = source; Node; Node = Node->ai_next)
+        {
+            Count += 1;
+
+            if (Node->ai_addr)
+            {
+                AddressSize += ALIGN_UP_BY(Node->ai_addrlen, MEMORY_ALLOCATION_ALIGNMENT);
+            }
+
+            if (Node->ai_canonname)
+            {
+                ANSI_STRING CanonicalNameA{};
+
+                Status = RtlInitAnsiStringEx(&CanonicalNameA, Node->ai_canonname);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                NameSize += RtlAnsiStringToUnicodeSize(&CanonicalNameA);
+            }
+        }
+
+        if (!NT_SUCCESS(Status) || Count == 0)
         {
             break;
         }
 
-        Result = (addrinfoexW*)ExAllocatePoolZero(PagedPool, sizeof addrinfoexW, WSK_POOL_TAG);
+        Result = (addrinfoexW*)ExAllocatePoolZero(PagedPool,
+            Count * sizeof addrinfoexW + AddressSize + NameSize, WSK_POOL_TAG);
         if (Result == nullptr)
         {
             Status = STATUS_INSUFFICIENT_RESOURCES;
             break;
         }
 
-        Result->ai_flags    = (source->ai_flags & ~AI_EXTENDED);
-        Result->ai_family   = source->ai_family;
-        Result->ai_socktype = source->ai_socktype;
-        Result->ai_protocol = source->ai_protocol;
-        Result->ai_addrlen  = source->ai_addrlen;
+        auto Address = reinterpret_cast<PUCHAR>(Result + Count);
+        auto Name    = reinterpret_cast<PUCHAR>(Address + AddressSize);
+        auto Target  = Result;
 
-        if (source->ai_canonname)
+        for (auto Node = source; Node; Node = Node->ai_next, ++Target)
         {
-            RtlInitAnsiString(&CanonicalNameA, source->ai_canonname);
+            Target->ai_flags    = (Node->ai_flags & ~AI_EXTENDED);
+            Target->ai_family   = Node->ai_family;
+            Target->ai_socktype = Node->ai_socktype;
+            Target->ai_protocol = Node->ai_protocol;
+            Target->ai_addrlen  = Node->ai_addrlen;
+            Target->ai_next     = Node->ai_next ? (Target + 1) : nullptr;
 
-            Status = RtlAnsiStringToUnicodeString(&CanonicalNameW, &CanonicalNameA, TRUE);
-            if (!NT_SUCCESS(Status))
+            if (Node->ai_canonname)
             {
-                break;
-            }
+                ANSI_STRING     CanonicalNameA{};
+                UNICODE_STRING  CanonicalNameW{};
 
-            Result->ai_canonname = CanonicalNameW.Buffer;
-        }
+                RtlInitAnsiString(&CanonicalNameA, Node->ai_canonname);
+                RtlInitEmptyUnicodeString(&CanonicalNameW, reinterpret_cast<PWCH>(Name),
+                    static_cast<USHORT>(RtlAnsiStringToUnicodeSize(&CanonicalNameA)));
 
-        if (source->ai_addr)
-        {
-            Address = (sockaddr*)ExAllocatePoolZero(PagedPool, source->ai_addrlen, WSK_POOL_TAG);
-            if (Address == nullptr)
-            {
-                Status = STATUS_INSUFFICIENT_RESOURCES;
-                break;
+                Status = RtlAnsiStringToUnicodeString(&CanonicalNameW, &CanonicalNameA, FALSE);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                Target->ai_canonname = CanonicalNameW.Buffer;
+                Name += CanonicalNameW.MaximumLength;
             }
-            memcpy(Address, source->ai_addr, source->ai_addrlen);
 
-            Result->ai_addr = Address;
+            if (Node->ai_addr)
+            {
+                memcpy(Address, Node->ai_addr, Node->ai_addrlen);
+
+                Target->ai_addr = reinterpret_cast<sockaddr*>(Address);
+                Address += ALIGN_UP_BY(Node->ai_addrlen, MEMORY_ALLOCATION_ALIGNMENT);
+            }
         }
 
-        Status = convert_addrinfo_to_addrinfoex(&Result->ai_next, source->ai_next);
         if (!NT_SUCCESS(Status))
         {
             break;
@@ -245,13 +464,6 @@ static NTSTATUS WSKAPI convert_addrinfo_to_addrinfoex(
 
     if (!NT_SUCCESS(Status))
     {
-        RtlFreeUnicodeString(&CanonicalNameW);
-
-        if (Address)
-        {
-            ExFreePoolWithTag(Address, WSK_POOL_TAG);
-        }
-
         if (Result)
         {
             ExFreePoolWithTag(Result, WSK_POOL_TAG);
@@ -266,62 +478,96 @@ static NTSTATUS WSKAPI convert_addrinfoex_to_addrinfo(
     _In_opt_ const addrinfoexW* source
 )
 {
-    NTSTATUS        Status  = STATUS_SUCCESS;
-    addrinfo*       Result  = nullptr;
-    sockaddr*       Address = nullptr;
-
-    ANSI_STRING     CanonicalNameA{};
-    UNICODE_STRING  CanonicalNameW{};
+    NTSTATUS     Status      = STATUS_SUCCESS;
+    addrinfo*    Result      = nullptr;
+    SIZE_T       Count       = 0u;
+    SIZE_T       AddressSize = 0u;
+    SIZE_T       NameSize    = 0u;
 
     do
     {
         *target = nullptr;
 
-        if (source == nullptr)
+        // Size the whole list first, the nodes, addresses and names share one allocation,
+        // so freeaddrinfo is a single ExFreePoolWithTag.
+
+        for (auto Node = source; Node; Node = Node->ai_next)
+        {
+            Count += 1;
+
+            if (Node->ai_addr)
+            {
+                AddressSize += ALIGN_UP_BY(Node->ai_addrlen, MEMORY_ALLOCATION_ALIGNMENT);
+            }
+
+            if (Node->ai_canonname)
+            {
+                UNICODE_STRING CanonicalNameW{};
+
+                Status = RtlInitUnicodeStringEx(&CanonicalNameW, Node->ai_canonname);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                NameSize += RtlUnicodeStringToAnsiSize(&CanonicalNameW);
+            }
+        }
+
+        if (!NT_SUCCESS(Status) || Count == 0)
         {
             break;
         }
 
-        Result = (addrinfo*)ExAllocatePoolZero(PagedPool, sizeof addrinfo, WSK_POOL_TAG);
+        Result = (addrinfo*)ExAllocatePoolZero(PagedPool,
+            Count * sizeof addrinfo + AddressSize + NameSize, WSK_POOL_TAG);
         if (Result == nullptr)
         {
             Status = STATUS_INSUFFICIENT_RESOURCES;
             break;
         }
 
-        Result->ai_flags    = (source->ai_flags & ~AI_EXTENDED);
-        Result->ai_family   = source->ai_family;
-        Result->ai_socktype = source->ai_socktype;
-        Result->ai_protocol = source->ai_protocol;
-        Result->ai_addrlen  = source->ai_addrlen;
+        auto Address = reinterpret_cast<PUCHAR>(Result + Count);
+        auto Name    = reinterpret_cast<PUCHAR>(Address + AddressSize);
+        auto Target  = Result;
 
-        if (source->ai_canonname)
+        for (auto Node = source; Node; Node = Node->ai_next, ++Target)
         {
-            RtlInitUnicodeString(&CanonicalNameW, source->ai_canonname);
+            Target->ai_flags    = (Node->ai_flags & ~AI_EXTENDED);
+            Target->ai_family   = Node->ai_family;
+            Target->ai_socktype = Node->ai_socktype;
+            Target->ai_protocol = Node->ai_protocol;
+            Target->ai_addrlen  = Node->ai_addrlen;
+            Target->ai_next     = Node->ai_next ? (Target + 1) : nullptr;
 
-            Status = RtlUnicodeStringToAnsiString(&CanonicalNameA, &CanonicalNameW, TRUE);
-            if (!NT_SUCCESS(Status))
+            if (Node->ai_canonname)
             {
-                break;
-            }
+                ANSI_STRING     CanonicalNameA{};
+                UNICODE_STRING  CanonicalNameW{};
 
-            Result->ai_canonname = CanonicalNameA.Buffer;
-        }
+                RtlInitUnicodeString(&CanonicalNameW, Node->ai_canonname);
+                RtlInitEmptyAnsiString(&CanonicalNameA, reinterpret_cast<PCHAR>(Name),
+                    static_cast<USHORT>(RtlUnicodeStringToAnsiSize(&CanonicalNameW)));
 
-        if (source->ai_addr)
-        {
-            Address = (sockaddr*)ExAllocatePoolZero(PagedPool, source->ai_addrlen, WSK_POOL_TAG);
-            if (Address == nullptr)
-            {
-                Status = STATUS_INSUFFICIENT_RESOURCES;
-                break;
+                Status = RtlUnicodeStringToAnsiString(&CanonicalNameA, &CanonicalNameW, FALSE);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                Target->ai_canonname = CanonicalNameA.Buffer;
+                Name += CanonicalNameA.MaximumLength;
             }
-            memcpy(Address, source->ai_addr, source->ai_addrlen);
 
-            Result->ai_addr = Address;
+            if (Node->ai_addr)
+            {
+                memcpy(Address, Node->ai_addr, Node->ai_addrlen);
+
+                Target->ai_addr = reinterpret_cast<sockaddr*>(Address);
+                Address += ALIGN_UP_BY(Node->ai_addrlen, MEMORY_ALLOCATION_ALIGNMENT);
+            }
         }
 
-        Status = convert_addrinfoex_to_addrinfo(&Result->ai_next, source->ai_next);
         if (!NT_SUCCESS(Status))
         {
             break;
@@ -333,13 +579,6 @@ static NTSTATUS WSKAPI convert_addrinfoex_to_addrinfo(
 
     if (!NT_SUCCESS(Status))
     {
-        RtlFreeAnsiString(&CanonicalNameA);
-
-        if (Address)
-        {
-            ExFreePoolWithTag(Address, WSK_POOL_TAG);
-        }
-
         if (Result)
         {
             ExFreePoolWithTag(Result, WSK_POOL_TAG);
@@ -415,7 +654,11 @@ int WSKAPI getaddrinfo(
     RtlFreeUnicodeString(&HostNameW);
     RtlFreeUnicodeString(&ServNameW);
 
-    WSKFreeAddrInfo(Hints);
+    if (Hints)
+    {
+        ExFreePoolWithTag(Hints, WSK_POOL_TAG);
+    }
+
     WSKFreeAddrInfo(Result);
 
     return Status;
@@ -425,23 +668,10 @@ void WSKAPI freeaddrinfo(
     _In_  struct addrinfo* ai
 )
 {
+    // The whole list lives in one allocation, see convert_addrinfoex_to_addrinfo.
+
     if (ai)
     {
-        if (ai->ai_next)
-        {
-            freeaddrinfo(ai->ai_next);
-        }
-
-        if (ai->ai_canonname)
-        {
-            ExFreePool(ai->ai_canonname);
-        }
-
-        if (ai->ai_addr)
-        {
-            ExFreePoolWithTag(ai->ai_addr, WSK_POOL_TAG);
-        }
-
         ExFreePoolWithTag(ai, WSK_POOL_TAG);
     }
 }
@@ -547,12 +777,12 @@ int WSKAPI inet_pton(
         break;
 
     case AF_INET:
-        Status = RtlIpv4StringToAddressA(AddressString, true, &Terminator,
+        Status = WSKIpv4StringToAddress(AddressString, true, &Terminator,
             static_cast<in_addr*>(Address));
         break;
 
     case AF_INET6:
-        Status = RtlIpv6StringToAddressA(AddressString, &Terminator,
+        Status = WSKIpv6StringToAddress(AddressString, &Terminator,
             static_cast<in6_addr*>(Address));
         break;
     }
@@ -599,7 +829,7 @@ PCSTR WSKAPI inet_ntop(
             break;
         }
 
-        Result = RtlIpv4AddressToStringA(static_cast<const in_addr*>(Address), AddressString);
+        Result = WSKIpv4AddressToString(static_cast<const in_addr*>(Address), AddressString);
         break;
     }
     case AF_INET6:
@@ -610,7 +840,7 @@ PCSTR WSKAPI inet_ntop(
             break;
         }
 
-        Result = RtlIpv6AddressToStringA(static_cast<const in6_addr*>(Address), AddressString);
+        Result = WSKIpv6AddressToString(static_cast<const in6_addr*>(Address), AddressString);
         break;
     }
     }
@@ -620,34 +850,135 @@ PCSTR WSKAPI inet_ntop(
     return Result;
 }
 
-unsigned long WSKAPI htonl(
+unsigned long WSKAPI (htonl)(
     _In_ unsigned long hostlong
 )
 {
     return RtlUlongByteSwap(hostlong);
 }
 
-unsigned long WSKAPI ntohl(
+unsigned long WSKAPI (ntohl)(
     _In_ unsigned long netlong
 )
 {
     return RtlUlongByteSwap(netlong);
 }
 
-unsigned short WSKAPI htons(
+unsigned short WSKAPI (htons)(
     _In_ unsigned short hostshort
 )
 {
     return RtlUshortByteSwap(hostshort);
 }
 
-unsigned short WSKAPI ntohs(
+unsigned short WSKAPI (ntohs)(
     _In_ unsigned short netshort
 )
 {
     return RtlUshortByteSwap(netshort);
 }
 
+#if defined(_M_X64) || defined(_M_IX86)
+static __forceinline __m128i WSKByteSwapVector16(__m128i Value)
+{
+    return _mm_or_si128(_mm_slli_epi16(Value, 8), _mm_srli_epi16(Value, 8));
+}
+#endif
+
+void WSKAPI WSKByteSwapArray16(
+    _Out_writes_(Count) unsigned short* Destination,
+    _In_reads_(Count) const unsigned short* Source,
+    _In_ size_t Count
+)
+{
+    size_t Index = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        const auto Value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&Source[Index]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&Destination[Index]), WSKByteSwapVector16(Value));
+    }
+#elif defined(_M_ARM64)
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        const auto Value = vld1q_u8(reinterpret_cast<const UCHAR*>(&Source[Index]));
+        vst1q_u8(reinterpret_cast<UCHAR*>(&Destination[Index]), vrev16q_u8(Value));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        Destination[Index] = RtlUshortByteSwap(Source[Index]);
+    }
+}
+
+void WSKAPI WSKByteSwapArray32(
+    _Out_writes_(Count) unsigned long* Destination,
+    _In_reads_(Count) const unsigned long* Source,
+    _In_ size_t Count
+)
+{
+    size_t Index = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        auto Value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&Source[Index]));
+
+        Value = WSKByteSwapVector16(Value);
+        Value = _mm_shufflelo_epi16(Value, _MM_SHUFFLE(2, 3, 0, 1));
+        Value = _mm_shufflehi_epi16(Value, _MM_SHUFFLE(2, 3, 0, 1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&Destination[Index]), Value);
+    }
+#elif defined(_M_ARM64)
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        const auto Value = vld1q_u8(reinterpret_cast<const UCHAR*>(&Source[Index]));
+        vst1q_u8(reinterpret_cast<UCHAR*>(&Destination[Index]), vrev32q_u8(Value));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        Destination[Index] = RtlUlongByteSwap(Source[Index]);
+    }
+}
+
+void WSKAPI WSKByteSwapArray64(
+    _Out_writes_(Count) unsigned long long* Destination,
+    _In_reads_(Count) const unsigned long long* Source,
+    _In_ size_t Count
+)
+{
+    size_t Index = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    for (; Index + 2 <= Count; Index += 2)
+    {
+        auto Value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&Source[Index]));
+
+        Value = WSKByteSwapVector16(Value);
+        Value = _mm_shufflelo_epi16(Value, _MM_SHUFFLE(0, 1, 2, 3));
+        Value = _mm_shufflehi_epi16(Value, _MM_SHUFFLE(0, 1, 2, 3));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&Destination[Index]), Value);
+    }
+#elif defined(_M_ARM64)
+    for (; Index + 2 <= Count; Index += 2)
+    {
+        const auto Value = vld1q_u8(reinterpret_cast<const UCHAR*>(&Source[Index]));
+        vst1q_u8(reinterpret_cast<UCHAR*>(&Destination[Index]), vrev64q_u8(Value));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        Destination[Index] = RtlUlonglongByteSwap(Source[Index]);
+    }
+}
+
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <wsk.h>
+#include <stdlib.h>
 
 /*
  * This is used instead of -1, since the
@@ -25,6 +26,98 @@
 typedef int         socklen_t;
 typedef UINT_PTR    SOCKET;
 
+#ifndef _WINSOCK2API_
+
+#define POLLRDNORM  0x0100
+#define POLLRDBAND  0x0200
+#define POLLIN      (POLLRDNORM | POLLRDBAND)
+#define POLLPRI     0x0400
+
+#define POLLWRNORM  0x0010
+#define POLLOUT     (POLLWRNORM)
+#define POLLWRBAND  0x0020
+
+#define POLLERR     0x0001
+#define POLLHUP     0x0002
+#define POLLNVAL    0x0004
+
+#define SD_RECEIVE  0x00
+#define SD_SEND     0x01
+#define SD_BOTH     0x02
+
+struct pollfd
+{
+    SOCKET  fd;
+    short   events;
+    short   revents;
+};
+
+/*
+ * Winsock style fd_set, a list of sockets rather than a bitmap,
+ * so any SOCKET value fits and nfds is ignored.
+ */
+
+#ifndef FD_SETSIZE
+#define FD_SETSIZE  64
+#endif
+
+typedef struct fd_set
+{
+    unsigned int fd_count;
+    SOCKET       fd_array[FD_SETSIZE];
+} fd_set;
+
+struct timeval
+{
+    long tv_sec;
+    long tv_usec;
+};
+
+#define FD_ZERO(set) (((fd_set*)(set))->fd_count = 0)
+
+#define FD_SET(fd, set) do {                                            \
+    unsigned int __i;                                                   \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; ++__i) {            \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) break;     \
+    }                                                                   \
+    if (__i == ((fd_set*)(set))->fd_count &&                            \
+        ((fd_set*)(set))->fd_count < FD_SETSIZE) {                      \
+        ((fd_set*)(set))->fd_array[__i] = (SOCKET)(fd);                 \
+        ((fd_set*)(set))->fd_count += 1;                                \
+    }                                                                   \
+} while (0)
+
+#define FD_CLR(fd, set) do {                                            \
+    unsigned int __i;                                                   \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; ++__i) {            \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) {          \
+            ((fd_set*)(set))->fd_count -= 1;                            \
+            ((fd_set*)(set))->fd_array[__i] =                           \
+                ((fd_set*)(set))->fd_array[((fd_set*)(set))->fd_count]; \
+            break;                                                      \
+        }                                                               \
+    }                                                                   \
+} while (0)
+
+#define FD_ISSET(fd, set) wsk_fd_isset((SOCKET)(fd), (const fd_set*)(set))
+
+static __inline int wsk_fd_isset(_In_ SOCKET fd, _In_ const fd_set* set)
+{
+    unsigned int i;
+    for (i = 0; i < set->fd_count; ++i)
+    {
+        if (set->fd_array[i] == fd)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif // #ifndef _WINSOCK2API_
+
+typedef unsigned long nfds_t;
+
 /* Socket function prototypes */
 
 #ifdef __cplusplus
@@ -76,6 +169,15 @@ int WSKAPI send(
     _In_ int flags
 );
 
+// Linux sendfile() with a file handle for in_fd. A null offset sends from the file position
+// and advances it, otherwise the file position is left alone.
+SSIZE_T WSKAPI sendfile(
+    _In_ SOCKET out_fd,
+    _In_ HANDLE in_fd,
+    _Inout_opt_ LONG64* offset,
+    _In_ SIZE_T count
+);
+
 int WSKAPI recv(
     _In_ SOCKET s,
     _Out_writes_bytes_to_(len, return) __out_data_source(NETWORK) char* buf,
@@ -117,6 +219,26 @@ int WSKAPI getsockopt(
     _Inout_ int* optlen
 );
 
+int WSKAPI ioctlsocket(
+    _In_ SOCKET s,
+    _In_ long cmd,
+    _Inout_ unsigned long* argp
+);
+
+int WSKAPI poll(
+    _Inout_updates_(nfds) struct pollfd* fds,
+    _In_ nfds_t nfds,
+    _In_ int timeout    // milliseconds, negative waits forever
+);
+
+int WSKAPI select(
+    _In_ int nfds,      // ignored
+    _Inout_opt_ fd_set* readfds,
+    _Inout_opt_ fd_set* writefds,
+    _Inout_opt_ fd_set* exceptfds,
+    _In_opt_ const struct timeval* timeout
+);
+
 int WSKAPI getaddrinfo(
     _In_opt_ const char* nodename,
     _In_opt_ const char* servname,
@@ -169,6 +291,75 @@ unsigned short WSKAPI ntohs(
     _In_ unsigned short netshort
 );
 
+/*
+ * Bulk byte swap for serializing header fields.
+ * Destination may equal Source, other overlaps are not allowed.
+ */
+
+void WSKAPI WSKByteSwapArray16(
+    _Out_writes_(Count) unsigned short* Destination,
+    _In_reads_(Count) const unsigned short* Source,
+    _In_ size_t Count
+);
+
+void WSKAPI WSKByteSwapArray32(
+    _Out_writes_(Count) unsigned long* Destination,
+    _In_reads_(Count) const unsigned long* Source,
+    _In_ size_t Count
+);
+
+void WSKAPI WSKByteSwapArray64(
+    _Out_writes_(Count) unsigned long long* Destination,
+    _In_reads_(Count) const unsigned long long* Source,
+    _In_ size_t Count
+);
+
 #ifdef __cplusplus
 }
 #endif
+
+/*
+ * Inline byte order helpers, constants fold at compile time.
+ * The exported functions above stay for callers that take their address,
+ * define WSK_NO_INLINE_BYTEORDER to call them instead.
+ */
+
+#ifdef __cplusplus
+#  if defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+#    define WSK_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  else
+#    define WSK_CONSTANT_EVALUATED() true
+#  endif
+
+constexpr unsigned short wsk_bswap16(_In_ unsigned short Value) noexcept
+{
+    return WSK_CONSTANT_EVALUATED()
+        ? static_cast<unsigned short>((Value << 8) | (Value >> 8))
+        : _byteswap_ushort(Value);
+}
+
+constexpr unsigned long wsk_bswap32(_In_ unsigned long Value) noexcept
+{
+    return WSK_CONSTANT_EVALUATED()
+        ? ((Value & 0x000000FFul) << 24) | ((Value & 0x0000FF00ul) << 8) |
+          ((Value & 0x00FF0000ul) >> 8)  | ((Value & 0xFF000000ul) >> 24)
+        : _byteswap_ulong(Value);
+}
+#else
+static __forceinline unsigned short wsk_bswap16(_In_ unsigned short Value)
+{
+    return _byteswap_ushort(Value);
+}
+
+static __forceinline unsigned long wsk_bswap32(_In_ unsigned long Value)
+{
+    return _byteswap_ulong(Value);
+}
+#endif
+
+#ifndef WSK_NO_INLINE_BYTEORDER
+#  define htonl(hostlong)   wsk_bswap32(hostlong)
+#  define ntohl(netlong)    wsk_bswap32(netlong)
+#  define htons(hostshort)  wsk_bswap16(hostshort)
+#  define ntohs(netshort)   wsk_bswap16(netshort)
+#endif
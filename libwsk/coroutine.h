@@ -0,0 +1,542 @@
+#pragma once
+#include "libwsk.h"
+
+// Optional C++20 coroutine layer over the WSKOVERLAPPED operations, header only.
+//
+//     wsk::task Echo(SOCKET Socket)
+//     {
+//         UCHAR Buffer[512];
+//         wsk::async_socket Stream(Socket);
+//
+//         for (;;)
+//         {
+//             auto Result = co_await Stream.receive(Buffer);
+//             if (!NT_SUCCESS(Result.Status) || Result.Bytes == 0)
+//             {
+//                 co_return Result.Status;
+//             }
+//
+//             co_await Stream.send({ Buffer, Result.Bytes });
+//         }
+//     }
+//
+// Awaiters live in the coroutine frame and embed their WSKOVERLAPPED, an await does not allocate.
+// Only the task frame itself comes from nonpaged pool.
+//
+// The coroutine always resumes at PASSIVE_LEVEL, so its body may call any WSK function.
+// A completion resumes it on a system worker thread, never inside WSKCompletionRoutine.
+// Hand a wsk::completion_queue to the socket to resume on the thread that drains it instead,
+// a body that blocks for long should not hold up the system worker.
+
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <span>
+
+namespace wsk
+{
+    inline constexpr ULONG TASK_POOL_TAG = 'TKSW'; // 'WSKT'
+
+    struct io_result
+    {
+        NTSTATUS Status;
+        SIZE_T   Bytes;
+    };
+
+    class completion_queue;
+
+    namespace details
+    {
+        enum : LONG
+        {
+            io_idle,
+            io_suspended,
+            io_completed,
+        };
+
+        // Overlapped stays the first member, the completion routine casts back from it.
+        struct io_operation
+        {
+            WSKOVERLAPPED           Overlapped;
+            LIST_ENTRY              Link;       // completion_queue
+            WORK_QUEUE_ITEM         Work;       // Resumes on a system worker thread
+            std::coroutine_handle<> Handle;
+            completion_queue*       Queue;
+            volatile LONG           State;
+            bool                    Routed;     // Completion ran, the library sets the event after it
+            io_result               Result;
+
+            explicit io_operation(_In_opt_ completion_queue* Queue) noexcept
+                : Overlapped{}, Link{}, Work{}, Handle{}, Queue(Queue), State(io_idle), Routed(false), Result{ STATUS_PENDING, 0u }
+            {
+                Overlapped.Internal = STATUS_PENDING;
+                WSKCreateEvent(&Overlapped.Event);
+                ExInitializeWorkItem(&Work, &io_operation::Resume, this);
+            }
+
+            io_operation(const io_operation&) = delete;
+            io_operation& operator=(const io_operation&) = delete;
+
+            inline void resume() noexcept;
+
+            static VOID WSKAPI Resume(
+                _In_ PVOID Context
+            )
+            {
+                static_cast<io_operation*>(Context)->Handle.resume();
+            }
+
+            static VOID WSKAPI Completion(
+                _In_ NTSTATUS       Status,
+                _In_ ULONG_PTR      Bytes,
+                _In_ WSKOVERLAPPED* Overlapped
+            )
+            {
+                auto Operation = CONTAINING_RECORD(Overlapped, io_operation, Overlapped);
+
+                Operation->Result = { Status, Bytes };
+                Operation->Routed = true;
+
+                // Before await_suspend gave up the thread, that thread carries on instead.
+                if (InterlockedExchange(&Operation->State, io_completed) == io_suspended)
+                {
+                    Operation->resume();
+                }
+            }
+
+            // A status other than STATUS_PENDING means the IRP already completed, or was never
+            // issued and the routine will not run. Either way there is nothing to wait for.
+            bool suspend(_In_ std::coroutine_handle<> Awaiting, _In_ NTSTATUS Status) noexcept
+            {
+                if (Status != STATUS_PENDING)
+                {
+                    if (InterlockedCompareExchange(&State, io_completed, io_idle) == io_idle)
+                    {
+                        Result = { Status, 0u };
+                    }
+                    return false;
+                }
+
+                Handle = Awaiting;
+
+                return InterlockedCompareExchange(&State, io_suspended, io_idle) == io_idle;
+            }
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            // The awaiter, and the overlapped in it, may go away once this returns.
+            io_result await_resume() noexcept
+            {
+                if (Routed)
+                {
+                    KeWaitForSingleObject(&Overlapped.Event, Executive, KernelMode, FALSE, nullptr);
+                }
+
+                return Result;
+            }
+        };
+
+        template<typename Issue>
+        class io_awaiter : public io_operation
+        {
+            Issue Start;
+
+        public:
+            io_awaiter(_In_opt_ completion_queue* Queue, _In_ Issue Start) noexcept
+                : io_operation(Queue), Start(Start)
+            {
+            }
+
+            bool await_suspend(_In_ std::coroutine_handle<> Awaiting) noexcept
+            {
+                return suspend(Awaiting, Start(&Overlapped, &io_operation::Completion));
+            }
+        };
+    }
+
+    // Coroutines completed by WSKCompletionRoutine wait here until the owner drains the queue,
+    // so protocol code runs at PASSIVE_LEVEL on a thread of its choosing.
+    class completion_queue
+    {
+        KSPIN_LOCK Lock;
+        LIST_ENTRY Ready;
+        KEVENT     Event;
+
+    public:
+        completion_queue() noexcept
+        {
+            KeInitializeSpinLock(&Lock);
+            InitializeListHead(&Ready);
+            KeInitializeEvent(&Event, SynchronizationEvent, FALSE);
+        }
+
+        completion_queue(const completion_queue&) = delete;
+        completion_queue& operator=(const completion_queue&) = delete;
+
+        void push(_In_ details::io_operation* Operation) noexcept
+        {
+            KIRQL Irql;
+            KeAcquireSpinLock(&Lock, &Irql);
+            {
+                InsertTailList(&Ready, &Operation->Link);
+            }
+            KeReleaseSpinLock(&Lock, Irql);
+
+            KeSetEvent(&Event, IO_NO_INCREMENT, FALSE);
+        }
+
+        // Resumes every coroutine that is ready, returns how many ran.
+        ULONG poll() noexcept
+        {
+            ULONG Count = 0u;
+
+            for (;;)
+            {
+                details::io_operation* Operation = nullptr;
+
+                KIRQL Irql;
+                KeAcquireSpinLock(&Lock, &Irql);
+                {
+                    if (!IsListEmpty(&Ready))
+                    {
+                        Operation = CONTAINING_RECORD(RemoveHeadList(&Ready), details::io_operation, Link);
+                    }
+                }
+                KeReleaseSpinLock(&Lock, Irql);
+
+                if (Operation == nullptr)
+                {
+                    break;
+                }
+
+                Operation->Handle.resume();
+                Count += 1;
+            }
+
+            return Count;
+        }
+
+        // Waits until something is ready, then polls. STATUS_TIMEOUT if nothing arrived.
+        NTSTATUS run(_In_opt_ PLARGE_INTEGER Timeout = nullptr) noexcept
+        {
+            if (poll())
+            {
+                return STATUS_SUCCESS;
+            }
+
+            const NTSTATUS Status = KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, Timeout);
+            if (Status != STATUS_SUCCESS)
+            {
+                return Status;
+            }
+
+            poll();
+            return STATUS_SUCCESS;
+        }
+    };
+
+    inline void details::io_operation::resume() noexcept
+    {
+        // Never inline: the routine may run at DISPATCH_LEVEL, and the event is set after it returns.
+        if (Queue)
+        {
+            Queue->push(this);
+        }
+        else
+        {
+            // Cannot fail, so even after WSKCleanup the body runs and sees the failed status.
+            ExQueueWorkItem(&Work, DelayedWorkQueue);
+        }
+    }
+
+    // Lazily started coroutine returning an NTSTATUS.
+    // co_await it from another task, start() it detached, or wait() for it at PASSIVE_LEVEL.
+    // A task whose frame could not be allocated is empty and reports STATUS_INSUFFICIENT_RESOURCES.
+    class task
+    {
+    public:
+        struct promise_type;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(_In_ handle_type Handle) noexcept
+            {
+                auto& Promise = Handle.promise();
+
+                if (Promise.Continuation)
+                {
+                    return Promise.Continuation;
+                }
+
+                if (Promise.Done)
+                {
+                    // The waiter destroys the frame, do not touch it afterwards.
+                    KeSetEvent(Promise.Done, IO_NO_INCREMENT, FALSE);
+                }
+                else if (Promise.Detached)
+                {
+                    Handle.destroy();
+                }
+
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        struct promise_type
+        {
+            NTSTATUS                Status       = STATUS_SUCCESS;
+            std::coroutine_handle<> Continuation = nullptr;
+            KEVENT*                 Done         = nullptr;
+            bool                    Detached     = false;
+
+            static void* operator new(_In_ size_t Size) noexcept
+            {
+                return ExAllocatePoolZero(NonPagedPoolNx, Size, TASK_POOL_TAG);
+            }
+
+            static void operator delete(_In_ void* Frame) noexcept
+            {
+                ExFreePoolWithTag(Frame, TASK_POOL_TAG);
+            }
+
+            static task get_return_object_on_allocation_failure() noexcept
+            {
+                return task{};
+            }
+
+            task get_return_object() noexcept
+            {
+                return task{ handle_type::from_promise(*this) };
+            }
+
+            std::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+
+            final_awaiter final_suspend() const noexcept
+            {
+                return {};
+            }
+
+            void return_value(_In_ NTSTATUS Value) noexcept
+            {
+                Status = Value;
+            }
+
+            void unhandled_exception() noexcept
+            {
+                Status = STATUS_UNHANDLED_EXCEPTION;
+            }
+        };
+
+        task() noexcept = default;
+
+        task(task&& Other) noexcept
+            : Handle(Other.Handle)
+        {
+            Other.Handle = nullptr;
+        }
+
+        task& operator=(task&& Other) noexcept
+        {
+            if (this != &Other)
+            {
+                if (Handle)
+                {
+                    Handle.destroy();
+                }
+
+                Handle       = Other.Handle;
+                Other.Handle = nullptr;
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task()
+        {
+            if (Handle)
+            {
+                Handle.destroy();
+            }
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return static_cast<bool>(Handle);
+        }
+
+        // Runs until the first pending await, the frame frees itself when the body returns.
+        NTSTATUS start() noexcept
+        {
+            if (!Handle)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            const auto Started = Handle;
+            Handle = nullptr;
+
+            Started.promise().Detached = true;
+            Started.resume();
+
+            return STATUS_SUCCESS;
+        }
+
+        // PASSIVE_LEVEL only, runs the task to completion and returns its status.
+        NTSTATUS wait() noexcept
+        {
+            if (!Handle)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            KEVENT Done;
+            KeInitializeEvent(&Done, NotificationEvent, FALSE);
+
+            Handle.promise().Done = &Done;
+            Handle.resume();
+
+            KeWaitForSingleObject(&Done, Executive, KernelMode, FALSE, nullptr);
+
+            const NTSTATUS Status = Handle.promise().Status;
+
+            Handle.destroy();
+            Handle = nullptr;
+
+            return Status;
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                handle_type Handle;
+
+                bool await_ready() const noexcept
+                {
+                    return !Handle;
+                }
+
+                std::coroutine_handle<> await_suspend(_In_ std::coroutine_handle<> Awaiting) noexcept
+                {
+                    Handle.promise().Continuation = Awaiting;
+                    return Handle;
+                }
+
+                NTSTATUS await_resume() const noexcept
+                {
+                    return Handle ? Handle.promise().Status : STATUS_INSUFFICIENT_RESOURCES;
+                }
+            };
+
+            return awaiter{ Handle };
+        }
+
+    private:
+        explicit task(_In_ handle_type Handle) noexcept
+            : Handle(Handle)
+        {
+        }
+
+        handle_type Handle = nullptr;
+    };
+
+    // Non-owning view of a SOCKET whose operations are awaitable.
+    // Buffers must stay valid until the await returns.
+    class async_socket
+    {
+        SOCKET            Socket;
+        completion_queue* Queue;
+
+    public:
+        explicit async_socket(_In_ SOCKET Socket, _In_opt_ completion_queue* Queue = nullptr) noexcept
+            : Socket(Socket), Queue(Queue)
+        {
+        }
+
+        SOCKET native_handle() const noexcept
+        {
+            return Socket;
+        }
+
+        auto receive(_In_ std::span<UCHAR> Buffer, _In_ ULONG Flags = 0u) const noexcept
+        {
+            return details::io_awaiter(Queue,
+                [Socket = Socket, Buffer, Flags](WSKOVERLAPPED* Overlapped, LPWSKOVERLAPPED_COMPLETION_ROUTINE Routine)
+                {
+                    return WSKReceive(Socket, Buffer.data(), Buffer.size(), nullptr, Flags, Overlapped, Routine);
+                });
+        }
+
+        auto send(_In_ std::span<const UCHAR> Buffer, _In_ ULONG Flags = 0u) const noexcept
+        {
+            return details::io_awaiter(Queue,
+                [Socket = Socket, Buffer, Flags](WSKOVERLAPPED* Overlapped, LPWSKOVERLAPPED_COMPLETION_ROUTINE Routine)
+                {
+                    return WSKSend(Socket, const_cast<UCHAR*>(Buffer.data()), Buffer.size(), nullptr, Flags,
+                        Overlapped, Routine);
+                });
+        }
+
+        auto receive_from(
+            _In_ std::span<UCHAR> Buffer,
+            _Out_opt_ PSOCKADDR   RemoteAddress,
+            _In_ SIZE_T           RemoteAddressLength
+        ) const noexcept
+        {
+            return details::io_awaiter(Queue,
+                [=, Socket = Socket](WSKOVERLAPPED* Overlapped, LPWSKOVERLAPPED_COMPLETION_ROUTINE Routine)
+                {
+                    return WSKReceiveFrom(Socket, Buffer.data(), Buffer.size(), nullptr, 0u,
+                        RemoteAddress, RemoteAddressLength, Overlapped, Routine);
+                });
+        }
+
+        auto send_to(
+            _In_ std::span<const UCHAR> Buffer,
+            _In_opt_ PSOCKADDR          RemoteAddress,
+            _In_ SIZE_T                 RemoteAddressLength
+        ) const noexcept
+        {
+            return details::io_awaiter(Queue,
+                [=, Socket = Socket](WSKOVERLAPPED* Overlapped, LPWSKOVERLAPPED_COMPLETION_ROUTINE Routine)
+                {
+                    return WSKSendTo(Socket, const_cast<UCHAR*>(Buffer.data()), Buffer.size(), nullptr, 0u,
+                        RemoteAddress, RemoteAddressLength, Overlapped, Routine);
+                });
+        }
+
+        auto ioctl(
+            _In_ ULONG              ControlCode,
+            _In_ std::span<const UCHAR> Input,
+            _In_ std::span<UCHAR>   Output
+        ) const noexcept
+        {
+            return details::io_awaiter(Queue,
+                [=, Socket = Socket](WSKOVERLAPPED* Overlapped, LPWSKOVERLAPPED_COMPLETION_ROUTINE Routine)
+                {
+                    return WSKIoctl(Socket, ControlCode, const_cast<UCHAR*>(Input.data()), Input.size(),
+                        Output.data(), Output.size(), nullptr, Overlapped, Routine);
+                });
+        }
+    };
+}
+
+#endif // #if defined(__cplusplus) && defined(__cpp_impl_coroutine)
@@ -0,0 +1,592 @@
+﻿#include "libwsk.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+// Same ring as the reader, a message is handed out where it was received.
+struct _WSKFRAMER
+{
+    SOCKET  Socket;
+    PUCHAR  Buffer;
+    SIZE_T  Capacity;       // Power of two
+    SIZE_T  Head;           // Next byte to parse
+    SIZE_T  Tail;           // Next byte to receive into
+    SIZE_T  Delivered;      // Payload of the last frame, released by the next receive
+    ULONG   Format;
+    ULONG   MaximumLength;
+    NTSTATUS Error;         // Sticky once the stream is out of sync
+    BOOLEAN Eof;
+    BOOLEAN Hardware;       // CRC32C instructions are available
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+static const ULONG WSK_FRAME_FORMAT_MASK        = 0xFFu;
+static const ULONG WSK_FRAME_VARINT_BYTES       = 5u;   // 32 bits in groups of 7
+static const ULONG WSK_FRAME_MAX_PREFIX         = WSK_FRAME_VARINT_BYTES + sizeof(ULONG);
+static const ULONG WSK_FRAMER_DEFAULT_MAXIMUM   = 16u * 1024u;
+
+// Reflected Castagnoli polynomial, for CPUs without the CRC32C instructions.
+struct WSK_CRC32C_TABLE
+{
+    ULONG Entries[256];
+
+    constexpr WSK_CRC32C_TABLE()
+        : Entries()
+    {
+        for (ULONG Index = 0; Index < 256; ++Index)
+        {
+            ULONG Crc = Index;
+            for (ULONG Bit = 0; Bit < 8; ++Bit)
+            {
+                Crc = (Crc >> 1) ^ ((Crc & 1u) ? 0x82F63B78u : 0u);
+            }
+            Entries[Index] = Crc;
+        }
+    }
+};
+
+static constexpr WSK_CRC32C_TABLE WSKCrc32cTable;
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+static BOOLEAN WSKAPI WSKCrc32cHardware()
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    int Info[4]{};
+    __cpuid(Info, 1);
+
+    return (Info[2] & (1 << 20)) != 0;  // SSE4.2
+#elif defined(_M_ARM64)
+    return ExIsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+#else
+    return FALSE;
+#endif
+}
+
+// Continues Crc over Data, the caller inverts before the first and after the last piece.
+static ULONG WSKAPI WSKCrc32c(
+    _In_ BOOLEAN Hardware,
+    _In_ ULONG   Crc,
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ SIZE_T  Length
+)
+{
+    SIZE_T Index = 0;
+
+    if (Hardware)
+    {
+#if defined(_M_X64)
+        ULONG64 Value = Crc;
+        for (; Index + 8 <= Length; Index += 8)
+        {
+            Value = _mm_crc32_u64(Value, *reinterpret_cast<const UNALIGNED ULONG64*>(&Data[Index]));
+        }
+        Crc = static_cast<ULONG>(Value);
+
+        for (; Index < Length; ++Index)
+        {
+            Crc = _mm_crc32_u8(Crc, Data[Index]);
+        }
+#elif defined(_M_IX86)
+        for (; Index + 4 <= Length; Index += 4)
+        {
+            Crc = _mm_crc32_u32(Crc, *reinterpret_cast<const UNALIGNED ULONG*>(&Data[Index]));
+        }
+
+        for (; Index < Length; ++Index)
+        {
+            Crc = _mm_crc32_u8(Crc, Data[Index]);
+        }
+#elif defined(_M_ARM64)
+        for (; Index + 8 <= Length; Index += 8)
+        {
+            Crc = __crc32cd(Crc, *reinterpret_cast<const UNALIGNED ULONG64*>(&Data[Index]));
+        }
+
+        for (; Index < Length; ++Index)
+        {
+            Crc = __crc32cb(Crc, Data[Index]);
+        }
+#endif
+    }
+
+    for (; Index < Length; ++Index)
+    {
+        Crc = WSKCrc32cTable.Entries[(Crc ^ Data[Index]) & 0xFFu] ^ (Crc >> 8);
+    }
+
+    return Crc;
+}
+
+static SIZE_T WSKAPI WSKFramerCount(
+    _In_ const _WSKFRAMER* Framer
+)
+{
+    return Framer->Tail - Framer->Head;
+}
+
+static UCHAR WSKAPI WSKFramerByte(
+    _In_ const _WSKFRAMER* Framer,
+    _In_ SIZE_T Offset  // From Head
+)
+{
+    return Framer->Buffer[(Framer->Head + Offset) & (Framer->Capacity - 1)];
+}
+
+static ULONG WSKAPI WSKFramerBigEndian(
+    _In_ const _WSKFRAMER* Framer,
+    _In_ SIZE_T Offset,
+    _In_ ULONG  Size
+)
+{
+    ULONG Value = 0u;
+    for (ULONG Index = 0; Index < Size; ++Index)
+    {
+        Value = (Value << 8) | WSKFramerByte(Framer, Offset + Index);
+    }
+    return Value;
+}
+
+// One receive into the free space that follows Tail without wrapping.
+static NTSTATUS WSKAPI WSKFramerFill(
+    _In_ _WSKFRAMER* Framer
+)
+{
+    if (Framer->Eof)
+    {
+        return STATUS_END_OF_FILE;
+    }
+
+    const SIZE_T Start = Framer->Tail & (Framer->Capacity - 1);
+    const SIZE_T Free  = min(Framer->Capacity - WSKFramerCount(Framer), Framer->Capacity - Start);
+
+    SIZE_T Received = 0u;
+
+    const NTSTATUS Status = WSKReceive(Framer->Socket, &Framer->Buffer[Start], Free, &Received, 0u, nullptr, nullptr);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    if (Received == 0)
+    {
+        Framer->Eof = TRUE;
+        return STATUS_END_OF_FILE;
+    }
+
+    Framer->Tail += Received;
+
+    return STATUS_SUCCESS;
+}
+
+// Decodes the prefix at Head, STATUS_MORE_PROCESSING_REQUIRED while part of it is still to come.
+static NTSTATUS WSKAPI WSKFramerParse(
+    _In_  const _WSKFRAMER* Framer,
+    _Out_ SIZE_T* PrefixLength,
+    _Out_ ULONG*  Length,
+    _Out_ ULONG*  Checksum
+)
+{
+    const SIZE_T Count = WSKFramerCount(Framer);
+
+    SIZE_T  Size  = 0u;
+    ULONG64 Value = 0u;
+
+    switch (Framer->Format & WSK_FRAME_FORMAT_MASK)
+    {
+    case WSK_FRAME_U16BE:
+    case WSK_FRAME_U32BE:
+    {
+        Size = ((Framer->Format & WSK_FRAME_FORMAT_MASK) == WSK_FRAME_U16BE) ? sizeof(USHORT) : sizeof(ULONG);
+        if (Count < Size)
+        {
+            return STATUS_MORE_PROCESSING_REQUIRED;
+        }
+
+        Value = WSKFramerBigEndian(Framer, 0u, static_cast<ULONG>(Size));
+        break;
+    }
+    case WSK_FRAME_VARINT:
+    {
+        for (;;)
+        {
+            if (Size == WSK_FRAME_VARINT_BYTES)
+            {
+                return STATUS_INVALID_NETWORK_RESPONSE;
+            }
+
+            if (Size == Count)
+            {
+                return STATUS_MORE_PROCESSING_REQUIRED;
+            }
+
+            const UCHAR Byte = WSKFramerByte(Framer, Size);
+
+            Value |= static_cast<ULONG64>(Byte & 0x7Fu) << (7u * Size);
+            Size  += 1;
+
+            if ((Byte & 0x80u) == 0)
+            {
+                break;
+            }
+        }
+        break;
+    }
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Value > Framer->MaximumLength)
+    {
+        return STATUS_INVALID_NETWORK_RESPONSE;
+    }
+
+    *Checksum = 0u;
+
+    if (Framer->Format & WSK_FRAME_CRC32C)
+    {
+        if (Count < Size + sizeof(ULONG))
+        {
+            return STATUS_MORE_PROCESSING_REQUIRED;
+        }
+
+        *Checksum = WSKFramerBigEndian(Framer, Size, sizeof(ULONG));
+        Size += sizeof(ULONG);
+    }
+
+    *PrefixLength = Size;
+    *Length       = static_cast<ULONG>(Value);
+
+    return STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public  Function
+
+NTSTATUS WSKAPI WSKCreateFramer(
+    _Out_ PWSKFRAMER* Framer,
+    _In_  SOCKET      Socket,
+    _In_  ULONG       Format,
+    _In_  ULONG       MaximumLength
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (Framer == nullptr || Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        *Framer = nullptr;
+
+        ULONG Limit = MAXULONG;
+
+        switch (Format & WSK_FRAME_FORMAT_MASK)
+        {
+        case WSK_FRAME_U16BE:
+            Limit = MAXUSHORT;
+            break;
+        case WSK_FRAME_U32BE:
+        case WSK_FRAME_VARINT:
+            break;
+        default:
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (!NT_SUCCESS(Status) || (Format & ~(WSK_FRAME_FORMAT_MASK | WSK_FRAME_CRC32C)))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (MaximumLength == 0)
+        {
+            MaximumLength = WSK_FRAMER_DEFAULT_MAXIMUM;
+        }
+        MaximumLength = min(MaximumLength, Limit);
+
+        // The largest message and its prefix always fit, so a message never needs a second buffer.
+        const SIZE_T Needed = static_cast<SIZE_T>(MaximumLength) + WSK_FRAME_MAX_PREFIX;
+        if (Needed < MaximumLength)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SIZE_T Size = 16u;
+        while (Size < Needed && Size <= (MAXSIZE_T >> 1))
+        {
+            Size <<= 1;
+        }
+
+        if (Size < Needed)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        auto Framer_ = static_cast<PWSKFRAMER>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(_WSKFRAMER), WSK_POOL_TAG));
+        if (Framer_ == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Framer_->Buffer = static_cast<PUCHAR>(ExAllocatePoolZero(NonPagedPool, Size, WSK_POOL_TAG));
+        if (Framer_->Buffer == nullptr)
+        {
+            ExFreePoolWithTag(Framer_, WSK_POOL_TAG);
+
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Framer_->Socket        = Socket;
+        Framer_->Capacity      = Size;
+        Framer_->Format        = Format;
+        Framer_->MaximumLength = MaximumLength;
+        Framer_->Hardware      = WSKCrc32cHardware();
+
+        *Framer = Framer_;
+
+    } while (false);
+
+    return Status;
+}
+
+VOID WSKAPI WSKDeleteFramer(
+    _In_ PWSKFRAMER Framer
+)
+{
+    if (Framer)
+    {
+        ExFreePoolWithTag(Framer->Buffer, WSK_POOL_TAG);
+        ExFreePoolWithTag(Framer, WSK_POOL_TAG);
+    }
+}
+
+NTSTATUS WSKAPI WSKFramerReceive(
+    _In_  PWSKFRAMER Framer,
+    _Out_ WSKFRAME*  Frame
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (Frame)
+        {
+            RtlZeroMemory(Frame, sizeof(WSKFRAME));
+        }
+
+        if (Framer == nullptr || Frame == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        Framer->Head     += Framer->Delivered;
+        Framer->Delivered = 0u;
+
+        // Starting over at the front of the ring keeps the next messages contiguous.
+        if (Framer->Head == Framer->Tail)
+        {
+            Framer->Head = 0u;
+            Framer->Tail = 0u;
+        }
+
+        if (!NT_SUCCESS(Framer->Error))
+        {
+            Status = Framer->Error;
+            break;
+        }
+
+        SIZE_T PrefixLength = 0u;
+        ULONG  Length       = 0u;
+        ULONG  Checksum     = 0u;
+
+        for (;;)
+        {
+            Status = WSKFramerParse(Framer, &PrefixLength, &Length, &Checksum);
+            if (Status != STATUS_MORE_PROCESSING_REQUIRED)
+            {
+                break;
+            }
+
+            Status = WSKFramerFill(Framer);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (Status == STATUS_INVALID_NETWORK_RESPONSE)
+        {
+            Framer->Error = Status;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        while (WSKFramerCount(Framer) < PrefixLength + Length)
+        {
+            Status = WSKFramerFill(Framer);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        const SIZE_T Start = (Framer->Head + PrefixLength) & (Framer->Capacity - 1);
+        const SIZE_T First = min(static_cast<SIZE_T>(Length), Framer->Capacity - Start);
+
+        Frame->Length = Length;
+
+        if (First)
+        {
+            Frame->Segments[Frame->SegmentCount].Buffer = &Framer->Buffer[Start];
+            Frame->Segments[Frame->SegmentCount].Length = First;
+            Frame->SegmentCount += 1;
+        }
+
+        if (Length - First)
+        {
+            Frame->Segments[Frame->SegmentCount].Buffer = Framer->Buffer;
+            Frame->Segments[Frame->SegmentCount].Length = Length - First;
+            Frame->SegmentCount += 1;
+        }
+
+        Framer->Head += PrefixLength;
+        Framer->Delivered = Length;
+
+        if (Framer->Format & WSK_FRAME_CRC32C)
+        {
+            ULONG Crc = MAXULONG;
+            for (ULONG Index = 0; Index < Frame->SegmentCount; ++Index)
+            {
+                Crc = WSKCrc32c(Framer->Hardware, Crc,
+                    static_cast<const UCHAR*>(Frame->Segments[Index].Buffer), Frame->Segments[Index].Length);
+            }
+
+            // The message is dropped, the next one is still in sync.
+            if (~Crc != Checksum)
+            {
+                RtlZeroMemory(Frame, sizeof(WSKFRAME));
+
+                Status = STATUS_CRC_ERROR;
+                break;
+            }
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKFramerSend(
+    _In_ PWSKFRAMER Framer,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG      BufferCount,
+    _Out_opt_ SIZE_T* NumberOfBytesSent
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (NumberOfBytesSent)
+        {
+            *NumberOfBytesSent = 0u;
+        }
+
+        if (Framer == nullptr || (Buffers == nullptr && BufferCount) || BufferCount > WSK_FRAME_MAX_BUFFERS)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SIZE_T Length = 0u;
+        for (ULONG Index = 0; Index < BufferCount; ++Index)
+        {
+            Length += Buffers[Index].Length;
+        }
+
+        if (Length > Framer->MaximumLength)
+        {
+            Status = STATUS_INVALID_BUFFER_SIZE;
+            break;
+        }
+
+        UCHAR  Prefix[WSK_FRAME_MAX_PREFIX]{};
+        SIZE_T PrefixLength = 0u;
+
+        switch (Framer->Format & WSK_FRAME_FORMAT_MASK)
+        {
+        case WSK_FRAME_U16BE:
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length >> 8);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length);
+            break;
+        case WSK_FRAME_U32BE:
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length >> 24);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length >> 16);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length >> 8);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Length);
+            break;
+        case WSK_FRAME_VARINT:
+            do
+            {
+                Prefix[PrefixLength++] = static_cast<UCHAR>((Length & 0x7Fu) | ((Length >> 7) ? 0x80u : 0u));
+                Length >>= 7;
+            } while (Length);
+            break;
+        }
+
+        if (Framer->Format & WSK_FRAME_CRC32C)
+        {
+            ULONG Crc = MAXULONG;
+            for (ULONG Index = 0; Index < BufferCount; ++Index)
+            {
+                Crc = WSKCrc32c(Framer->Hardware, Crc,
+                    static_cast<const UCHAR*>(Buffers[Index].Buffer), Buffers[Index].Length);
+            }
+            Crc = ~Crc;
+
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Crc >> 24);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Crc >> 16);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Crc >> 8);
+            Prefix[PrefixLength++] = static_cast<UCHAR>(Crc);
+        }
+
+        WSKBUF Gather[1 + WSK_FRAME_MAX_BUFFERS];
+
+        Gather[0].Buffer = Prefix;
+        Gather[0].Length = PrefixLength;
+
+        for (ULONG Index = 0; Index < BufferCount; ++Index)
+        {
+            Gather[1 + Index] = Buffers[Index];
+        }
+
+        // Part of a frame on the wire would leave the peer out of sync.
+        Status = WSKSendBuffers(Framer->Socket, Gather, 1 + BufferCount, NumberOfBytesSent, WSK_SB_WHOLE, nullptr, nullptr);
+
+    } while (false);
+
+    return Status;
+}
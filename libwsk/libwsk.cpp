@@ -1,5 +1,9 @@
 ﻿#include "libwsk.h"
 #include "socket.h"
+#include "timer.h"
+#include "address.h"
+#include "port.h"
+#include "worker.h"
 
 #pragma comment(lib, "Netio.lib")
 
@@ -17,6 +21,14 @@ struct WSK_CONTEXT_IRP
     PIRP    Irp;
     KEVENT  Event;
     PVOID   Context;
+    volatile LONG   RefCount;   // Owner, the armed timeout and WSKCancelIo
+    WSK_TIMER_ENTRY Timer;
+
+    LIST_ENTRY      Link;       // SOCKET_CONTEXT::Requests
+    PSOCKET_CONTEXT SocketContext;
+    BOOLEAN         Cancelled;
+    BOOLEAN         Receive;    // Updates READABLE on completion
+    ULONG           Indications;// SOCKET_CONTEXT::Indications when tracked
     union {
         PVOID   CompletionRoutine;  // WSK_COMPLETION_ROUTINE
         PVOID   Pointer;            // Other
@@ -27,19 +39,298 @@ struct WSK_CONTEXT_IRP
 };
 
 #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+// A socket option set before the stream picked its mode, replayed on the provider socket.
+struct WSK_STREAM_OPTION_WIN7
+{
+    ULONG   OptionLevel;
+    ULONG   OptionName;
+    ULONG   Size;
+    UCHAR   Value[16];
+};
+
+typedef enum _WSK_STREAM_MODE_WIN7 {
+    WskStreamModeNone,
+    WskStreamModeListen,
+    WskStreamModeConnect,
+} WSK_STREAM_MODE_WIN7;
+
+// The provider socket is created once WSKListen or WSKConnect picks the mode,
+// until then bind and socket options are only recorded.
 typedef struct _WSK_STREAM_SOCKET_WIN7 {
-    BOOLEAN     Mode;   // 0:unknown, 1:listen, 2:connect
-    PWSK_SOCKET Listen;
-    PWSK_SOCKET Connect;
+    WSK_STREAM_MODE_WIN7    Mode;
+    PWSK_SOCKET             Listen;
+    PWSK_SOCKET             Connect;
+
+    ADDRESS_FAMILY          AddressFamily;
+    USHORT                  SocketType;
+    ULONG                   Protocol;
+    PSECURITY_DESCRIPTOR    SecurityDescriptor; // Self-relative copy
+    PSOCKET_CONTEXT         Context;
+
+    BOOLEAN                 Bound;
+    SOCKADDR_STORAGE        LocalAddress;
+
+    ULONG                   OptionCount;
+    WSK_STREAM_OPTION_WIN7  Options[8];
 } WSK_STREAM_SOCKET_WIN7, * PWSK_STREAM_SOCKET_WIN7;
 #endif // if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
 
+// Socket kinds that send and receive. Each names its provider dispatch tables and how to reach
+// the provider socket doing the work, so the per-kind code is picked at compile time.
+struct WSK_CONNECTION_KIND
+{
+    using Connection = WSK_PROVIDER_CONNECTION_DISPATCH;
+
+    static PWSK_SOCKET Connected(_In_ PWSK_SOCKET Socket)
+    {
+        return Socket;
+    }
+};
+
+#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+struct WSK_STREAM_KIND
+{
+    using Connection = WSK_PROVIDER_STREAM_DISPATCH;
+    using Listener   = WSK_PROVIDER_STREAM_DISPATCH;
+
+    static PWSK_SOCKET Connected(_In_ PWSK_SOCKET Socket)
+    {
+        return Socket;
+    }
+
+    static PWSK_SOCKET Listening(_In_ PWSK_SOCKET Socket)
+    {
+        return Socket;
+    }
+};
+#else
+// Emulated, a connection once WSKConnect ran and a listener once WSKListen ran.
+struct WSK_STREAM_KIND
+{
+    using Connection = WSK_PROVIDER_CONNECTION_DISPATCH;
+    using Listener   = WSK_PROVIDER_LISTEN_DISPATCH;
+
+    static PWSK_SOCKET Connected(_In_ PWSK_SOCKET Socket)
+    {
+        const auto Stream = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket);
+        return Stream->Mode == WskStreamModeConnect ? Stream->Connect : nullptr;
+    }
+
+    static PWSK_SOCKET Listening(_In_ PWSK_SOCKET Socket)
+    {
+        const auto Stream = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket);
+        return Stream->Mode == WskStreamModeListen ? Stream->Listen : nullptr;
+    }
+};
+#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+
+// A result handed to more than one caller, released by the last WSKFreeAddrInfo.
+// Local results are built by the library and live in the same allocation as the record.
+// Every result the library owns has a record, anything else came from the provider.
+struct WSK_ADDRINFO_SHARED
+{
+    LIST_ENTRY      Link;
+    PADDRINFOEXW    Result;
+    LONG            RefCount;
+    BOOLEAN         Local;
+};
+
+struct WSK_ADDRINFO_LOCAL
+{
+    WSK_ADDRINFO_SHARED Record;
+    ADDRINFOEXW         Info;
+    SOCKADDR_INET       Address;
+};
+
+// One racing connection of WSKConnectByName.
+struct WSK_CONNECT_ATTEMPT
+{
+    PADDRINFOEXW     Address;
+    PWSK_SOCKET      Socket;
+    PSOCKET_CONTEXT  Context;
+    WSK_CONTEXT_IRP* WSKContext;
+    BOOLEAN          Done;
+};
+
+struct WSK_ADDRINFO_WAITER
+{
+    LIST_ENTRY      Link;
+    WSKOVERLAPPED*  Overlapped;
+    LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine;
+};
+
+// One in-flight WskGetAddressInfo request, shared by every caller with the same key.
+struct WSK_ADDRINFO_FLIGHT
+{
+    LIST_ENTRY      Link;
+    volatile LONG   RefCount;
+    LONG            Waiters;    // Callers still interested in the result
+    BOOLEAN         Completed;
+
+    UNICODE_STRING  NodeName;
+    UNICODE_STRING  ServiceName;
+    UINT32          Namespace;
+    BOOLEAN         HasProvider;
+    BOOLEAN         HasHints;
+    GUID            Provider;
+    INT             HintsFlags;
+    INT             HintsFamily;
+    INT             HintsSocketType;
+    INT             HintsProtocol;
+
+    NTSTATUS        Status;
+    PADDRINFOEXW    Result;
+    KEVENT          Event;
+    LIST_ENTRY      OverlappedWaiters;
+
+    WSK_ADDRINFO_SHARED* Shared;
+    WSK_CONTEXT_IRP*     WSKContext;
+};
+
+// A connection taken by WskAcceptEvent, handed out by the next WSKAccept.
+struct WSK_ACCEPT_ENTRY
+{
+    LIST_ENTRY      Link;
+    PWSK_SOCKET     Socket;
+    PSOCKET_CONTEXT Context;
+    SOCKADDR_INET   LocalAddress;
+    SOCKADDR_INET   RemoteAddress;
+};
+
+// One socket of a WSKPoll call.
+struct WSK_POLL_WAITER
+{
+    LIST_ENTRY      Link;
+    PKEVENT         Event;
+};
+
+// A send or connect issued for a nonblocking socket, finished in the background.
+// Sends carry a copy of the caller's data so the call can return at once.
+struct WSK_NONBLOCKING_REQUEST
+{
+    WSKOVERLAPPED   Overlapped;
+    volatile LONG   RefCount;   // Issuer and completion
+    BOOLEAN         Completed;
+    BOOLEAN         Connect;
+    PSOCKET_CONTEXT Context;
+    SIZE_T          Length;
+    UCHAR           Data[ANYSIZE_ARRAY];
+};
+
+// A provider socket created ahead of time by the reserve worker.
+struct WSK_RESERVED_SOCKET
+{
+    LIST_ENTRY      Link;
+    PWSK_SOCKET     Socket;
+    ULONG           WskSocketType;
+    PSOCKET_CONTEXT Context;
+};
+
+// Sockets of one (family, type, protocol) kept ready for WSKSocket.
+struct WSK_SOCKET_RESERVE
+{
+    ADDRESS_FAMILY  AddressFamily;
+    USHORT          SocketType;
+    ULONG           Protocol;
+    ULONG           Target;     // 0 if the slot is free
+    ULONG           Count;
+    BOOLEAN         Busy;       // Refill queued or running
+    LIST_ENTRY      Sockets;    // WSK_RESERVED_SOCKET
+    WSK_WORK_ITEM   Refill;
+};
+
+// One chunk of a WSKTransmitFile call on the wire.
+struct WSK_TRANSMIT_CHUNK
+{
+    WSK_CONTEXT_IRP* Context;
+    NTSTATUS         Status;    // As returned by the provider
+    WSK_BUF          Buffer;
+    PMDL             MdlChain;  // From the cache manager, nullptr for a mapped view
+    PVOID            View;      // The mapped window, nullptr for an MDL read
+};
+
+// A WSKSplice buffer with its own IRP, received into and sent from in turn.
+// The buffer is nonpaged and its MDL built once, nothing is locked per transfer.
+struct WSK_SPLICE_REQUEST
+{
+    PIRP            Irp;
+    WSK_BUF         Buffer;
+    PVOID           Data;
+    PKEVENT         Progress;
+    ULONG           State;      // WSK_SPLICE_xxx
+    volatile LONG   Done;       // The IRP has completed
+};
+
+static const ULONG WSK_SPLICE_IDLE      = 0u;
+static const ULONG WSK_SPLICE_RECEIVING = 1u;
+static const ULONG WSK_SPLICE_SENDING   = 2u;
+
+static const ULONG WSK_SPLICE_MAX_BUFFERS = 16u;
+
+struct WSK_SPLICE_DIRECTION
+{
+    PWSK_SOCKET         From;       // Connected provider sockets
+    PFN_WSK_RECEIVE     ReceiveRoutine;
+    PSOCKET_CONTEXT     FromContext;
+    PWSK_SOCKET         To;
+    PFN_WSK_SEND        SendRoutine;
+    PFN_WSK_DISCONNECT  DisconnectRoutine;
+    PSOCKET_CONTEXT     ToContext;
+
+    ULONG               Receive;    // Next buffer to receive into
+    ULONG               Forward;    // Oldest buffer receiving, data is sent on in this order
+    BOOLEAN             Eof;        // No more receives
+    BOOLEAN             Finished;   // Nothing outstanding, the FIN is passed on
+    ULONG64             Bytes;
+
+    WSK_SPLICE_REQUEST Disconnect;
+    WSK_SPLICE_REQUEST Buffers[WSK_SPLICE_MAX_BUFFERS];
+};
+
+struct WSK_SPLICE
+{
+    KEVENT          Progress;   // Any request completed
+    ULONG           BufferSize;
+    ULONG           BufferCount;
+    NTSTATUS        Status;     // The first failure
+    WSK_SPLICE_DIRECTION Directions[2];
+};
+
+// A socket handed to WSKCloseSocketAsync, its handle is already gone.
+struct WSK_PENDING_CLOSE
+{
+    WSKOVERLAPPED   Overlapped;     // The lingering disconnect
+    WSK_WORK_ITEM   Close;
+    PWSK_SOCKET     Socket;
+    ULONG           WskSocketType;
+    PSOCKET_CONTEXT Context;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // Global  Data
 
+// Buckets of WSKAddrInfoShared, a power of two.
+static const ULONG WSK_ADDRINFO_BUCKETS = 64u;
+
+// RFC 8305 Connection Attempt Delay, in 100ns units.
+static const ULONG64 WSK_CONNECTION_ATTEMPT_DELAY = 250u * 10000u;
+
+// Connections queued by WskAcceptEvent per listening socket.
+static const ULONG WSK_MAX_BACKLOG = 200u;
+
+// Bytes a nonblocking socket may have in flight before send reports STATUS_DEVICE_NOT_READY.
+static const SIZE_T WSK_NONBLOCKING_SEND_BUFFER = 64u * 1024u;
+
+// WSKTransmitFile sends in chunks of this size, with at most WSK_TRANSMIT_DEPTH on the wire.
+static const ULONG WSK_TRANSMIT_CHUNK_SIZE = 64u * 1024u;
+static const ULONG WSK_TRANSMIT_DEPTH = 8u;
+static const ULONG WSK_TRANSMIT_VIEW_ALIGNMENT = 64u * 1024u;
+
 static volatile long _Initialized  = false;
 static volatile long _LastNtStatus = STATUS_SUCCESS;
 
+static EX_RUNDOWN_REF WSKTeardownRundown;  // Socket contexts queued for teardown
+
 static WSK_CLIENT_DISPATCH WSKClientDispatch = {
     MAKE_WSK_VERSION(1, 0), // This default uses WSK version 1.0
     0,                      // Reserved
@@ -49,6 +340,18 @@ static WSK_CLIENT_DISPATCH WSKClientDispatch = {
 static WSK_REGISTRATION WSKRegistration;
 static WSK_PROVIDER_NPI WSKNPIProvider;
 
+static KSPIN_LOCK WSKAddrInfoLock;
+static LIST_ENTRY WSKAddrInfoFlights;   // WSK_ADDRINFO_FLIGHT
+static LIST_ENTRY WSKAddrInfoShared[WSK_ADDRINFO_BUCKETS]; // WSK_ADDRINFO_SHARED, hashed by Result
+static LIST_ENTRY WSKAddrInfoOrphans;   // WSK_ADDRINFO_SHARED, nobody waited for the result
+
+static KSPIN_LOCK         WSKSocketReserveLock;
+static WSK_SOCKET_RESERVE WSKSocketReserves[8];
+
+static KSPIN_LOCK WSKPendingCloseLock;
+static ULONG      WSKPendingCloseCount;
+static KEVENT     WSKPendingCloseIdle;      // Signaled while no close is pending
+
 //////////////////////////////////////////////////////////////////////////
 // Private Function
 
@@ -105,6 +408,52 @@ static NTSTATUS WSKAPI WSKLockBuffer(
     return Status;
 }
 
+// Locks each buffer into its own MDL and chains them, so a single WSK_BUF describes them all.
+// Empty buffers are skipped, on failure the MDLs locked so far stay on the chain.
+static NTSTATUS WSKAPI WSKLockBuffers(
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_  ULONG    BufferCount,
+    _Out_ PWSK_BUF WSKBuffer
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    WSKBuffer->Mdl    = nullptr;
+    WSKBuffer->Offset = 0;
+    WSKBuffer->Length = 0;
+
+    PMDL* Link = &WSKBuffer->Mdl;
+
+    for (ULONG Index = 0; Index < BufferCount; ++Index)
+    {
+        if (Buffers[Index].Length == 0)
+        {
+            continue;
+        }
+
+        if (Buffers[Index].Buffer == nullptr || Buffers[Index].Length > MAXULONG)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        WSK_BUF Locked{};
+
+        Status = WSKLockBuffer(Buffers[Index].Buffer, Buffers[Index].Length, &Locked, true);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        *Link = Locked.Mdl;
+        Link  = &Locked.Mdl->Next;
+
+        WSKBuffer->Length += Buffers[Index].Length;
+    }
+
+    return Status;
+}
+
 //NTSTATUS WSKAPI WSKLockBuffer(
 //    _In_  PNET_BUFFER_LIST NetBufferList,
 //    _In_  ULONG BufferOffset,
@@ -154,11 +503,14 @@ static VOID WSKAPI WSKUnlockBuffer(
 {
     if (WSKBuffer)
     {
-        if (WSKBuffer->Mdl)
+        // WSKLockBuffers chains one MDL per buffer.
+        while (WSKBuffer->Mdl)
         {
+            const PMDL Next = WSKBuffer->Mdl->Next;
+
             MmUnlockPages(WSKBuffer->Mdl);
             IoFreeMdl(WSKBuffer->Mdl);
-            WSKBuffer->Mdl = nullptr;
+            WSKBuffer->Mdl = Next;
         }
     }
 }
@@ -169,12 +521,41 @@ static NTSTATUS WSKCompletionRoutine(
     _In_reads_opt_(_Inexpressible_("varies")) PVOID Context
 );
 
+static VOID WSKAPI WSKReleaseSocketContext(
+    _In_opt_ PSOCKET_CONTEXT Context
+);
+
 static VOID WSKAPI WSKFreeContextIRP(
     _In_ WSK_CONTEXT_IRP* WSKContext
 )
 {
     if (WSKContext)
     {
+        if (WSKTimerCancel(&WSKContext->Timer))
+        {
+            InterlockedDecrement(&WSKContext->RefCount);
+        }
+
+        // A firing timeout still uses the IRP, the routine frees it.
+        if (InterlockedDecrement(&WSKContext->RefCount) != 0)
+        {
+            return;
+        }
+
+        if (WSKContext->SocketContext)
+        {
+            auto SocketContext = WSKContext->SocketContext;
+
+            KIRQL Irql;
+            KeAcquireSpinLock(&SocketContext->Lock, &Irql);
+            {
+                RemoveEntryList(&WSKContext->Link);
+            }
+            KeReleaseSpinLock(&SocketContext->Lock, Irql);
+
+            WSKReleaseSocketContext(SocketContext);
+        }
+
         if (WSKContext->Irp)
         {
             IoFreeIrp(WSKContext->Irp);
@@ -187,6 +568,91 @@ static VOID WSKAPI WSKFreeContextIRP(
     }
 }
 
+static VOID WSKAPI WSKContextIRPTimeout(
+    _In_ PVOID Context
+)
+{
+    auto WSKContext = static_cast<WSK_CONTEXT_IRP*>(Context);
+
+    IoCancelIrp(WSKContext->Irp);
+    WSKFreeContextIRP(WSKContext);
+}
+
+// The timeout is kept by the timer wheel, for synchronous and overlapped requests alike.
+// Must be armed before the IRP is handed to the provider.
+static VOID WSKAPI WSKArmContextIRP(
+    _In_ WSK_CONTEXT_IRP* WSKContext,
+    _In_ ULONG TimeoutMilliseconds
+)
+{
+    if (TimeoutMilliseconds != WSK_INFINITE_WAIT && TimeoutMilliseconds != 0)
+    {
+        InterlockedIncrement(&WSKContext->RefCount);
+        WSKTimerArm(&WSKContext->Timer, TimeoutMilliseconds);
+    }
+}
+
+// Outstanding requests are listed on their socket so WSKCancelIo can find them.
+static VOID WSKAPI WSKTrackContextIRP(
+    _In_ WSK_CONTEXT_IRP* WSKContext,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
+{
+    if (SocketContext)
+    {
+        InterlockedIncrement(&SocketContext->RefCount);
+
+        WSKContext->SocketContext = SocketContext;
+
+        BOOLEAN Closed = FALSE;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&SocketContext->Lock, &Irql);
+        {
+            InsertTailList(&SocketContext->Requests, &WSKContext->Link);
+
+            WSKContext->Indications = SocketContext->Indications;
+
+            Closed = (SocketContext->State & WSK_SOCKET_STATE_CLOSED) != 0;
+        }
+        KeReleaseSpinLock(&SocketContext->Lock, Irql);
+
+        // Close has already cancelled what was listed, this one is not issued yet and fails at once.
+        if (Closed)
+        {
+            WSKContext->Cancelled = TRUE;
+            IoCancelIrp(WSKContext->Irp);
+        }
+    }
+}
+
+static NTSTATUS WSKAPI WSKWaitContextIRP(
+    _In_ WSK_CONTEXT_IRP* WSKContext,
+    _In_ NTSTATUS Status,
+    _In_ ULONG TimeoutMilliseconds
+)
+{
+    if (Status == STATUS_PENDING)
+    {
+        // A zero timeout only takes what the provider completes at once.
+        if (TimeoutMilliseconds == 0)
+        {
+            IoCancelIrp(WSKContext->Irp);
+        }
+
+        KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
+
+        Status = WSKContext->Irp->IoStatus.Status;
+
+        if (Status == STATUS_CANCELLED && WSKContext->Irp->Cancel && !WSKContext->Cancelled)
+        {
+            Status = STATUS_TIMEOUT;
+        }
+    }
+
+    return Status;
+}
+
 static WSK_CONTEXT_IRP* WSKAPI WSKAllocContextIRP(
     _In_opt_ PVOID CompletionRoutine,
     _In_opt_ PVOID Context,
@@ -210,6 +676,9 @@ static WSK_CONTEXT_IRP* WSKAPI WSKAllocContextIRP(
             break;
         }
 
+        WSKContext->RefCount = 1;
+        WSKTimerInitialize(&WSKContext->Timer, &WSKContextIRPTimeout, WSKContext);
+
         WSKContext->CompletionRoutine = CompletionRoutine;
         WSKContext->Context = Context;
 
@@ -259,6 +728,67 @@ static WSK_CONTEXT_IRP* WSKAPI WSKAllocContextIRP(
     return WSKContext;
 }
 
+// Data indicated after the receive was issued may still be with the provider, READABLE stays set.
+static VOID WSKAPI WSKReceivedContextIRP(
+    _In_ WSK_CONTEXT_IRP* WSKContext,
+    _In_ PIRP Irp
+)
+{
+    auto Context = WSKContext->SocketContext;
+
+    const auto Status = Irp->IoStatus.Status;
+    const auto Bytes  = Irp->IoStatus.Information;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        BOOLEAN Drained = FALSE;
+
+        if (Context->State & WSK_SOCKET_STATE_DATAGRAM)
+        {
+            if (NT_SUCCESS(Status) && Context->Datagrams)
+            {
+                Context->Datagrams -= 1;
+            }
+
+            Drained = (Context->Datagrams == 0) &&
+                (NT_SUCCESS(Status) || (Status == STATUS_CANCELLED && Bytes == 0));
+        }
+        else
+        {
+            Drained = (NT_SUCCESS(Status) && Bytes < WSKContext->OutputBuffer.Length) ||
+                (Status == STATUS_CANCELLED && Bytes == 0);
+        }
+
+        if (Drained && Context->Indications == WSKContext->Indications)
+        {
+            Context->State &= ~WSK_SOCKET_STATE_READABLE;
+        }
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+}
+
+static VOID WSKAPI WSKNonBlockingCompletion(
+    _In_ NTSTATUS       Status,
+    _In_ ULONG_PTR      Bytes,
+    _In_ WSKOVERLAPPED* Overlapped
+);
+
+static VOID WSKAPI WSKPendingCloseDisconnected(
+    _In_ NTSTATUS       Status,
+    _In_ ULONG_PTR      Bytes,
+    _In_ WSKOVERLAPPED* Overlapped
+);
+
+// Requests of the library itself free their overlapped in the routine.
+static BOOLEAN WSKAPI WSKIsDetachedCompletion(
+    _In_opt_ PVOID CompletionRoutine
+)
+{
+    return CompletionRoutine == (PVOID)&WSKNonBlockingCompletion ||
+        CompletionRoutine == (PVOID)&WSKPendingCloseDisconnected;
+}
+
 static NTSTATUS WSKCompletionRoutine(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp,
@@ -274,6 +804,12 @@ static NTSTATUS WSKCompletionRoutine(
         return STATUS_INVALID_ADDRESS;
     }
 
+    // Before anyone is signaled, so a poll after the receive sees the new state.
+    if (WSKContext->Receive)
+    {
+        WSKReceivedContextIRP(WSKContext, Irp);
+    }
+
     auto Overlapped = static_cast<WSKOVERLAPPED*>(WSKContext->Context);
     if (Overlapped)
     {
@@ -281,20 +817,35 @@ static NTSTATUS WSKCompletionRoutine(
         Overlapped->InternalHigh = Irp->IoStatus.Information;
 
         auto Routine = static_cast<WSK_COMPLETION_ROUTINE>(WSKContext->CompletionRoutine);
-        if (Routine)
+
+        if (WSKIsDetachedCompletion(WSKContext->CompletionRoutine))
         {
-            __try
-            {
-                Routine(Irp->IoStatus.Status, Irp->IoStatus.Information, WSKContext->Context);
-            }
-            __except (EXCEPTION_EXECUTE_HANDLER)
+            const auto Status = Irp->IoStatus.Status;
+            const auto Bytes  = Irp->IoStatus.Information;
+
+            // Nothing waits on the event, the overlapped is not touched after the routine.
+            WSKFreeContextIRP(WSKContext);
+
+            Routine(Status, Bytes, Overlapped);
+        }
+        else
+        {
+            if (Routine)
             {
-                __nop();
+                __try
+                {
+                    Routine(Irp->IoStatus.Status, Irp->IoStatus.Information, Overlapped);
+                }
+                __except (EXCEPTION_EXECUTE_HANDLER)
+                {
+                    __nop();
+                }
             }
-        }
 
-        KeSetEvent(&Overlapped->Event, IO_NO_INCREMENT, FALSE);
-        WSKFreeContextIRP(WSKContext);
+            // The caller may free the overlapped once the event is set.
+            KeSetEvent(&Overlapped->Event, IO_NO_INCREMENT, FALSE);
+            WSKFreeContextIRP(WSKContext);
+        }
     }
     else
     {
@@ -331,33 +882,413 @@ static NTSTATUS WSKAPI WSKCloseSocketUnsafe(
     _In_ ULONG          WskSocketType
 );
 
-static NTSTATUS WSKAPI WSKSocketUnsafeDownlevel(
-    _Out_ PWSK_SOCKET* Socket,
-    _In_  ADDRESS_FAMILY    AddressFamily,
-    _In_  USHORT            SocketType,
-    _In_  ULONG             Protocol,
-    _In_  ULONG             Flags,
-    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
-)
-{
-    NTSTATUS Status = STATUS_SUCCESS;
+static VOID WSKAPI WSKSocketIdleTimeout(
+    _In_ PVOID Context
+);
 
-    do
+static VOID WSKAPI WSKTeardownSocketContext(
+    _In_ PVOID SocketContext
+);
+
+static PSOCKET_CONTEXT WSKAPI WSKAllocSocketContext()
+{
+    auto Context = static_cast<PSOCKET_CONTEXT>(ExAllocatePoolZero(NonPagedPool,
+        sizeof(SOCKET_CONTEXT), WSK_POOL_TAG));
+    if (Context)
     {
-        const auto WSKContext = WSKAllocContextIRP(nullptr, nullptr);
-        if (WSKContext == nullptr)
-        {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+        Context->RefCount = 1;
+        Context->Backlog  = WSK_MAX_BACKLOG;
 
-        if (Protocol == 0)
-        {
-            switch (SocketType)
-            {
-            case SOCK_STREAM:
-                Protocol = IPPROTO_TCP;
-                break;
+        KeInitializeSpinLock(&Context->Lock);
+        ExInitializeRundownProtection(&Context->Rundown);
+        InitializeListHead(&Context->AcceptQueue);
+        InitializeListHead(&Context->Waiters);
+        InitializeListHead(&Context->Requests);
+
+        WSKTimerInitialize(&Context->IdleTimer, &WSKSocketIdleTimeout, Context);
+
+        ExInitializeWorkItem(&Context->Teardown, &WSKTeardownSocketContext, Context);
+    }
+
+    return Context;
+}
+
+static VOID WSKAPI WSKFreeSocketContext(
+    _In_ PSOCKET_CONTEXT Context
+)
+{
+    // Connections accepted by WskAcceptEvent that nobody asked for.
+    while (!IsListEmpty(&Context->AcceptQueue))
+    {
+        auto Entry = CONTAINING_RECORD(RemoveHeadList(&Context->AcceptQueue), WSK_ACCEPT_ENTRY, Link);
+
+        WSKCloseSocketUnsafe(Entry->Socket, WSK_FLAG_CONNECTION_SOCKET);
+        WSKReleaseSocketContext(Entry->Context);
+
+        ExFreePoolWithTag(Entry, WSK_POOL_TAG);
+    }
+
+    ExFreePoolWithTag(Context, WSK_POOL_TAG);
+}
+
+static VOID WSKAPI WSKTeardownSocketContext(
+    _In_ PVOID SocketContext
+)
+{
+    WSKFreeSocketContext(static_cast<PSOCKET_CONTEXT>(SocketContext));
+
+    ExReleaseRundownProtection(&WSKTeardownRundown);
+}
+
+static VOID WSKAPI WSKReleaseSocketContext(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context == nullptr || InterlockedDecrement(&Context->RefCount) != 0)
+    {
+        return;
+    }
+
+    // The last reference may go in a completion routine or a timer routine,
+    // closing the queued connections has to wait for PASSIVE_LEVEL.
+    if (!IsListEmpty(&Context->AcceptQueue) && KeGetCurrentIrql() > PASSIVE_LEVEL &&
+        ExAcquireRundownProtection(&WSKTeardownRundown))
+    {
+        ExQueueWorkItem(&Context->Teardown, DelayedWorkQueue);
+        return;
+    }
+
+    WSKFreeSocketContext(Context);
+}
+
+// Context->Lock must be held.
+static VOID WSKAPI WSKWakeSocketWaiters(
+    _In_ PSOCKET_CONTEXT Context
+)
+{
+    for (auto Link = Context->Waiters.Flink; Link != &Context->Waiters; Link = Link->Flink)
+    {
+        KeSetEvent(CONTAINING_RECORD(Link, WSK_POLL_WAITER, Link)->Event, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+static VOID WSKAPI WSKSetSocketState(
+    _In_ PSOCKET_CONTEXT Context,
+    _In_ ULONG SetState,
+    _In_ ULONG ClearState
+)
+{
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        Context->State = (Context->State & ~ClearState) | SetState;
+
+        if (SetState)
+        {
+            WSKWakeSocketWaiters(Context);
+        }
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+}
+
+static VOID WSKAPI WSKSocketIdleTimeout(
+    _In_ PVOID Context
+)
+{
+    auto SocketContext = static_cast<PSOCKET_CONTEXT>(Context);
+
+    WSKSetSocketState(SocketContext, WSK_SOCKET_STATE_IDLE | WSK_SOCKET_STATE_ABORTED, 0);
+    WSKReleaseSocketContext(SocketContext);
+}
+
+// Pushes the idle deadline back, called for every transfer.
+static VOID WSKAPI WSKTouchSocketContext(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context == nullptr || Context->IdleTimeout == 0 ||
+        (Context->State & (WSK_SOCKET_STATE_LISTENING | WSK_SOCKET_STATE_IDLE | WSK_SOCKET_STATE_CLOSED)))
+    {
+        return;
+    }
+
+    InterlockedIncrement(&Context->RefCount);
+
+    if (WSKTimerArm(&Context->IdleTimer, Context->IdleTimeout))
+    {
+        // Moved, the armed timer already holds its reference.
+        InterlockedDecrement(&Context->RefCount);
+    }
+}
+
+static VOID WSKAPI WSKCancelSocketIdle(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context && WSKTimerCancel(&Context->IdleTimer))
+    {
+        WSKReleaseSocketContext(Context);
+    }
+}
+
+static BOOLEAN WSKAPI WSKSocketIdleExpired(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    return Context && (Context->State & WSK_SOCKET_STATE_IDLE);
+}
+
+static BOOLEAN WSKAPI WSKSocketReceiveShut(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    return Context && (Context->State & WSK_SOCKET_STATE_RECVSHUT);
+}
+
+static NTSTATUS WSKAPI WSKReceiveEvent(
+    _In_opt_ PVOID SocketContext,
+    _In_ ULONG     Flags,
+    _In_opt_ PWSK_DATA_INDICATION DataIndication,
+    _In_ SIZE_T    BytesIndicated,
+    _Inout_ SIZE_T* BytesAccepted
+)
+{
+    UNREFERENCED_PARAMETER(Flags);
+    UNREFERENCED_PARAMETER(BytesIndicated);
+    UNREFERENCED_PARAMETER(BytesAccepted);
+
+    auto Context = static_cast<PSOCKET_CONTEXT>(SocketContext);
+
+    if (DataIndication == nullptr)
+    {
+        // The socket is no longer functional.
+        WSKSetSocketState(Context, WSK_SOCKET_STATE_ABORTED, 0);
+        return STATUS_SUCCESS;
+    }
+
+    WSKTouchSocketContext(Context);
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        // Leave the data with the provider, the next WskReceive picks it up.
+        Context->Indications += 1;
+        Context->State       |= WSK_SOCKET_STATE_READABLE;
+
+        WSKWakeSocketWaiters(Context);
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return STATUS_DATA_NOT_ACCEPTED;
+}
+
+static NTSTATUS WSKAPI WSKDisconnectEvent(
+    _In_opt_ PVOID SocketContext,
+    _In_ ULONG     Flags
+)
+{
+    auto Context = static_cast<PSOCKET_CONTEXT>(SocketContext);
+
+    WSKSetSocketState(Context, (Flags & WSK_FLAG_ABORTIVE) ?
+        WSK_SOCKET_STATE_ABORTED : WSK_SOCKET_STATE_PEERCLOSED, 0);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS WSKAPI WSKReceiveFromEvent(
+    _In_opt_ PVOID SocketContext,
+    _In_ ULONG     Flags,
+    _In_opt_ PWSK_DATAGRAM_INDICATION DataIndication
+)
+{
+    UNREFERENCED_PARAMETER(Flags);
+
+    auto Context = static_cast<PSOCKET_CONTEXT>(SocketContext);
+
+    if (DataIndication == nullptr)
+    {
+        WSKSetSocketState(Context, WSK_SOCKET_STATE_ABORTED, 0);
+        return STATUS_SUCCESS;
+    }
+
+    ULONG Datagrams = 0u;
+
+    for (auto Datagram = DataIndication; Datagram; Datagram = Datagram->Next)
+    {
+        Datagrams += 1;
+    }
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        Context->Datagrams   += Datagrams;
+        Context->Indications += 1;
+        Context->State       |= WSK_SOCKET_STATE_READABLE;
+
+        WSKWakeSocketWaiters(Context);
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    WSKTouchSocketContext(Context);
+
+    return STATUS_DATA_NOT_ACCEPTED;
+}
+
+static const WSK_CLIENT_CONNECTION_DISPATCH WSKClientConnectionDispatch = {
+    WSKReceiveEvent,
+    WSKDisconnectEvent,
+    nullptr             // WskSendBacklogEvent
+};
+
+static NTSTATUS WSKAPI WSKAcceptEvent(
+    _In_opt_ PVOID      SocketContext,
+    _In_ ULONG          Flags,
+    _In_ PSOCKADDR      LocalAddress,
+    _In_ PSOCKADDR      RemoteAddress,
+    _In_opt_ PWSK_SOCKET AcceptSocket,
+    _Outptr_result_maybenull_ PVOID* AcceptSocketContext,
+    _Outptr_result_maybenull_ const WSK_CLIENT_CONNECTION_DISPATCH** AcceptSocketDispatch
+)
+{
+    UNREFERENCED_PARAMETER(Flags);
+
+    auto Context = static_cast<PSOCKET_CONTEXT>(SocketContext);
+
+    if (AcceptSocket == nullptr)
+    {
+        // The listening socket is no longer functional.
+        WSKSetSocketState(Context, WSK_SOCKET_STATE_ABORTED, 0);
+        return STATUS_REQUEST_NOT_ACCEPTED;
+    }
+
+    auto Entry = static_cast<WSK_ACCEPT_ENTRY*>(ExAllocatePoolZero(NonPagedPool,
+        sizeof(WSK_ACCEPT_ENTRY), WSK_POOL_TAG));
+    auto AcceptContext = WSKAllocSocketContext();
+
+    BOOLEAN Queued = FALSE;
+
+    if (Entry && AcceptContext)
+    {
+        AcceptContext->State = WSK_SOCKET_STATE_CONNECTED;
+
+        Entry->Socket  = AcceptSocket;
+        Entry->Context = AcceptContext;
+
+        if (LocalAddress)
+        {
+            RtlCopyMemory(&Entry->LocalAddress, LocalAddress,
+                LocalAddress->sa_family == AF_INET6 ? sizeof(SOCKADDR_IN6) : sizeof(SOCKADDR_IN));
+        }
+
+        if (RemoteAddress)
+        {
+            RtlCopyMemory(&Entry->RemoteAddress, RemoteAddress,
+                RemoteAddress->sa_family == AF_INET6 ? sizeof(SOCKADDR_IN6) : sizeof(SOCKADDR_IN));
+        }
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            if (Context->AcceptCount < Context->Backlog && !(Context->State & WSK_SOCKET_STATE_CLOSED))
+            {
+                InsertTailList(&Context->AcceptQueue, &Entry->Link);
+                Context->AcceptCount += 1;
+
+                WSKWakeSocketWaiters(Context);
+                Queued = TRUE;
+            }
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+    }
+
+    if (!Queued)
+    {
+        WSKReleaseSocketContext(AcceptContext);
+
+        if (Entry)
+        {
+            ExFreePoolWithTag(Entry, WSK_POOL_TAG);
+        }
+
+        return STATUS_REQUEST_NOT_ACCEPTED;
+    }
+
+    *AcceptSocketContext  = AcceptContext;
+    *AcceptSocketDispatch = &WSKClientConnectionDispatch;
+
+    return STATUS_SUCCESS;
+}
+
+static const WSK_CLIENT_LISTEN_DISPATCH WSKClientListenDispatch = {
+    WSKAcceptEvent,
+    nullptr,            // WskInspectEvent
+    nullptr             // WskAbortEvent
+};
+
+static const WSK_CLIENT_DATAGRAM_DISPATCH WSKClientDatagramDispatch = {
+    WSKReceiveFromEvent
+};
+
+#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+static const WSK_CLIENT_STREAM_DISPATCH WSKClientStreamDispatch = {
+    WSKAcceptEvent,
+    nullptr,            // WskInspectEvent
+    nullptr,            // WskAbortEvent
+    WSKReceiveEvent,
+    WSKDisconnectEvent,
+    nullptr             // WskSendBacklogEvent
+};
+#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+
+static const VOID* WSKAPI WSKClientSocketDispatch(
+    _In_ ULONG Flags
+)
+{
+    switch (Flags)
+    {
+    case WSK_FLAG_LISTEN_SOCKET:
+        return &WSKClientListenDispatch;
+    case WSK_FLAG_DATAGRAM_SOCKET:
+        return &WSKClientDatagramDispatch;
+    case WSK_FLAG_CONNECTION_SOCKET:
+        return &WSKClientConnectionDispatch;
+#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+    case WSK_FLAG_STREAM_SOCKET:
+        return &WSKClientStreamDispatch;
+#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
+    default:
+        return nullptr;
+    }
+}
+
+static NTSTATUS WSKAPI WSKSocketUnsafeDownlevel(
+    _Out_ PWSK_SOCKET* Socket,
+    _In_  ADDRESS_FAMILY    AddressFamily,
+    _In_  USHORT            SocketType,
+    _In_  ULONG             Protocol,
+    _In_  ULONG             Flags,
+    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        const auto WSKContext = WSKAllocContextIRP(nullptr, nullptr);
+        if (WSKContext == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (Protocol == 0)
+        {
+            switch (SocketType)
+            {
+            case SOCK_STREAM:
+                Protocol = IPPROTO_TCP;
+                break;
 
             case SOCK_DGRAM:
                 Protocol = IPPROTO_UDP;
@@ -381,8 +1312,8 @@ static NTSTATUS WSKAPI WSKSocketUnsafeDownlevel(
             SocketType,
             Protocol,
             Flags,
-            nullptr,
-            nullptr,
+            SocketContext,
+            SocketContext ? WSKClientSocketDispatch(Flags) : nullptr,
             nullptr,
             nullptr,
             SecurityDescriptor,
@@ -413,13 +1344,80 @@ static NTSTATUS WSKAPI WSKSocketUnsafeDownlevel(
     return Status;
 }
 
+#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+static NTSTATUS WSKAPI WSKCopySecurityDescriptor(
+    _In_  PSECURITY_DESCRIPTOR  SecurityDescriptor,
+    _Out_ PSECURITY_DESCRIPTOR* Copy
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        *Copy = nullptr;
+
+        SECURITY_DESCRIPTOR_CONTROL Control = 0;
+        ULONG Revision = 0;
+
+        Status = RtlGetControlSecurityDescriptor(SecurityDescriptor, &Control, &Revision);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        ULONG Length = 0;
+
+        if (Control & SE_SELF_RELATIVE)
+        {
+            Length = RtlLengthSecurityDescriptor(SecurityDescriptor);
+        }
+        else
+        {
+            Status = RtlAbsoluteToSelfRelativeSD(SecurityDescriptor, nullptr, &Length);
+            if (Status != STATUS_BUFFER_TOO_SMALL)
+            {
+                break;
+            }
+        }
+
+        const auto Buffer = static_cast<PSECURITY_DESCRIPTOR>(ExAllocatePoolZero(NonPagedPool, Length, WSK_POOL_TAG));
+        if (Buffer == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (Control & SE_SELF_RELATIVE)
+        {
+            RtlCopyMemory(Buffer, SecurityDescriptor, Length);
+            Status = STATUS_SUCCESS;
+        }
+        else
+        {
+            Status = RtlAbsoluteToSelfRelativeSD(SecurityDescriptor, Buffer, &Length);
+            if (!NT_SUCCESS(Status))
+            {
+                ExFreePoolWithTag(Buffer, WSK_POOL_TAG);
+                break;
+            }
+        }
+
+        *Copy = Buffer;
+
+    } while (false);
+
+    return Status;
+}
+#endif // if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+
 static NTSTATUS WSKAPI WSKSocketUnsafe(
     _Out_ PWSK_SOCKET*      Socket,
     _In_  ADDRESS_FAMILY    AddressFamily,
     _In_  USHORT            SocketType,
     _In_  ULONG             Protocol,
     _In_  ULONG             Flags,
-    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
+    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -433,21 +1431,19 @@ static NTSTATUS WSKAPI WSKSocketUnsafe(
     }
 
 #if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-    Status = WSKSocketUnsafeDownlevel(Socket, AddressFamily, SocketType, Protocol, Flags, SecurityDescriptor);
+    Status = WSKSocketUnsafeDownlevel(Socket, AddressFamily, SocketType, Protocol, Flags, SecurityDescriptor, SocketContext);
 #else
-    WSK_SOCKET* Stream  = nullptr;
-    WSK_SOCKET* Listen  = nullptr;
-    WSK_SOCKET* Connect = nullptr;
+    WSK_STREAM_SOCKET_WIN7* Stream = nullptr;
 
     do
     {
         if (Flags != WSK_FLAG_STREAM_SOCKET)
         {
-            Status = WSKSocketUnsafeDownlevel(Socket, AddressFamily, SocketType, Protocol, Flags, SecurityDescriptor);
+            Status = WSKSocketUnsafeDownlevel(Socket, AddressFamily, SocketType, Protocol, Flags, SecurityDescriptor, SocketContext);
             break;
         }
 
-        Stream = static_cast<PWSK_SOCKET>(ExAllocatePoolZero(NonPagedPool,
+        Stream = static_cast<WSK_STREAM_SOCKET_WIN7*>(ExAllocatePoolZero(NonPagedPool,
             sizeof(WSK_STREAM_SOCKET_WIN7), WSK_POOL_TAG));
         if (Stream == nullptr)
         {
@@ -455,43 +1451,29 @@ static NTSTATUS WSKAPI WSKSocketUnsafe(
             break;
         }
 
-        Status = WSKSocketUnsafeDownlevel(&Listen, AddressFamily, SocketType, Protocol, WSK_FLAG_LISTEN_SOCKET, SecurityDescriptor);
-        if (!NT_SUCCESS(Status))
+        // The caller's descriptor may be gone by the time the provider socket is created.
+        if (SecurityDescriptor)
         {
-            break;
+            Status = WSKCopySecurityDescriptor(SecurityDescriptor, &Stream->SecurityDescriptor);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
         }
 
-        Status = WSKSocketUnsafeDownlevel(&Connect, AddressFamily, SocketType, Protocol, WSK_FLAG_CONNECTION_SOCKET, SecurityDescriptor);
-        if (!NT_SUCCESS(Status))
-        {
-            break;
-        }
-
-        auto StreamImpl = reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Stream);
-        StreamImpl->Mode    = 0;
-        StreamImpl->Listen  = Listen;
-        StreamImpl->Connect = Connect;
+        Stream->Mode          = WskStreamModeNone;
+        Stream->AddressFamily = AddressFamily;
+        Stream->SocketType    = SocketType;
+        Stream->Protocol      = Protocol;
+        Stream->Context       = SocketContext;
 
-        *Socket = Stream;
+        *Socket = reinterpret_cast<PWSK_SOCKET>(Stream);
 
     } while (false);
 
-    if (!NT_SUCCESS(Status))
+    if (!NT_SUCCESS(Status) && Stream)
     {
-        if (Listen)
-        {
-            WSKCloseSocketUnsafe(Listen, WSK_FLAG_LISTEN_SOCKET);
-        }
-
-        if (Connect)
-        {
-            WSKCloseSocketUnsafe(Connect, WSK_FLAG_CONNECTION_SOCKET);
-        }
-
-        if (Stream)
-        {
-            ExFreePoolWithTag(Stream, WSK_POOL_TAG);
-        }
+        ExFreePoolWithTag(Stream, WSK_POOL_TAG);
     }
 #endif
 
@@ -567,18 +1549,28 @@ NTSTATUS WSKAPI WSKCloseSocketUnsafe(
             break;
         }
 
-        Status = WSKCloseSocketUnsafeDownlevel(reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Listen);
-        if (!NT_SUCCESS(Status))
+        const auto Stream = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket);
+
+        // At most one of them was created.
+        if (Stream->Listen)
         {
-            break;
+            Status = WSKCloseSocketUnsafeDownlevel(Stream->Listen);
+        }
+        else if (Stream->Connect)
+        {
+            Status = WSKCloseSocketUnsafeDownlevel(Stream->Connect);
         }
 
-        Status = WSKCloseSocketUnsafeDownlevel(reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect);
         if (!NT_SUCCESS(Status))
         {
             break;
         }
 
+        if (Stream->SecurityDescriptor)
+        {
+            ExFreePoolWithTag(Stream->SecurityDescriptor, WSK_POOL_TAG);
+        }
+
         ExFreePoolWithTag(Socket, WSK_POOL_TAG);
 
     } while (false);
@@ -587,13 +1579,6 @@ NTSTATUS WSKAPI WSKCloseSocketUnsafe(
     return Status;
 }
 
-NTSTATUS WSKAPI WSKBindUnsafe(
-    _In_ PWSK_SOCKET Socket,
-    _In_ ULONG       WskSocketType,
-    _In_ PSOCKADDR   LocalAddress,
-    _In_ SIZE_T      LocalAddressLength
-);
-
 static NTSTATUS WSKAPI WSKControlSocketUnsafeDownlevel(
     _In_ PWSK_SOCKET    Socket,
     _In_ ULONG          WskSocketType,
@@ -640,36 +1625,6 @@ static NTSTATUS WSKAPI WSKControlSocketUnsafeDownlevel(
             break;
         }
 
-        if (RequestType == WskIoctl)
-        {
-            if (ControlCode == SIO_WSK_SET_REMOTE_ADDRESS ||
-                ControlCode == SIO_WSK_SET_SENDTO_ADDRESS)
-            {
-                if (WskSocketType != WSK_FLAG_DATAGRAM_SOCKET)
-                {
-                    Status = STATUS_INVALID_DEVICE_REQUEST;
-                    break;
-                }
-
-                auto RemoteAddress = static_cast<PSOCKADDR>(InputBuffer);
-                if (RemoteAddress == nullptr || InputSize < sizeof SOCKADDR)
-                {
-                    Status = STATUS_INVALID_PARAMETER;
-                    break;
-                }
-
-                SOCKADDR_STORAGE LocalAddress{};
-                LocalAddress.ss_family = RemoteAddress->sa_family;
-
-                Status = WSKBindUnsafe(Socket, WskSocketType, reinterpret_cast<PSOCKADDR>(&LocalAddress), sizeof LocalAddress);
-                if (!NT_SUCCESS(Status))
-                {
-                    break;
-                }
-
-                // Not break;
-            }
-        }
 
         WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped);
         if (WSKContext == nullptr)
@@ -714,6 +1669,118 @@ static NTSTATUS WSKAPI WSKControlSocketUnsafeDownlevel(
     return Status;
 }
 
+#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+// No provider socket yet. Options are kept for WSKCreateStreamSocketWin7 and read back from there.
+static NTSTATUS WSKAPI WSKControlStreamSocketPendingWin7(
+    _Inout_ WSK_STREAM_SOCKET_WIN7* Stream,
+    _In_ WSK_CONTROL_SOCKET_TYPE RequestType,
+    _In_ ULONG          ControlCode,
+    _In_ ULONG          OptionLevel,
+    _In_reads_bytes_opt_(InputSize)     PVOID InputBuffer,
+    _In_ SIZE_T         InputSize,
+    _Out_writes_bytes_opt_(OutputSize)  PVOID OutputBuffer,
+    _In_ SIZE_T         OutputSize,
+    _Out_opt_ SIZE_T*   OutputSizeReturned,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+)
+{
+    NTSTATUS Status   = STATUS_SUCCESS;
+    SIZE_T   Returned = 0u;
+
+    do
+    {
+        if (RequestType == WskGetOption && OptionLevel == SOL_SOCKET && ControlCode == SO_TYPE)
+        {
+            // Answered without touching the provider socket.
+            return WSKControlSocketUnsafeDownlevel(nullptr, WSK_FLAG_STREAM_SOCKET, RequestType, ControlCode,
+                OptionLevel, InputBuffer, InputSize, OutputBuffer, OutputSize, OutputSizeReturned,
+                Overlapped, CompletionRoutine);
+        }
+
+        if (RequestType == WskIoctl)
+        {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            break;
+        }
+
+        WSK_STREAM_OPTION_WIN7* Option = nullptr;
+
+        for (ULONG Idx = 0; Idx < Stream->OptionCount; ++Idx)
+        {
+            if (Stream->Options[Idx].OptionLevel == OptionLevel && Stream->Options[Idx].OptionName == ControlCode)
+            {
+                Option = &Stream->Options[Idx];
+                break;
+            }
+        }
+
+        if (RequestType == WskGetOption)
+        {
+            if (Option == nullptr)
+            {
+                Status = STATUS_INVALID_DEVICE_STATE;
+                break;
+            }
+
+            if (OutputBuffer == nullptr || OutputSize < Option->Size)
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            RtlCopyMemory(OutputBuffer, Option->Value, Option->Size);
+            Returned = Option->Size;
+            break;
+        }
+
+        if (InputBuffer == nullptr || InputSize > sizeof Option->Value)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (Option == nullptr)
+        {
+            if (Stream->OptionCount == _countof(Stream->Options))
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            Option = &Stream->Options[Stream->OptionCount++];
+            Option->OptionLevel = OptionLevel;
+            Option->OptionName  = ControlCode;
+        }
+
+        Option->Size = static_cast<ULONG>(InputSize);
+        RtlCopyMemory(Option->Value, InputBuffer, InputSize);
+
+    } while (false);
+
+    if (OutputSizeReturned)
+    {
+        *OutputSizeReturned = Returned;
+    }
+
+    // Finished inline, still reported the way a completed IRP would be.
+    if (Overlapped)
+    {
+        Overlapped->Internal     = Status;
+        Overlapped->InternalHigh = Returned;
+
+        KeSetEvent(&Overlapped->Event, IO_NO_INCREMENT, FALSE);
+
+        if (CompletionRoutine)
+        {
+            CompletionRoutine(Status, Returned, Overlapped);
+        }
+    }
+
+    return Status;
+}
+#endif // if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+
 NTSTATUS WSKAPI WSKControlSocketUnsafe(
     _In_ PWSK_SOCKET    Socket,
     _In_ ULONG          WskSocketType,
@@ -756,14 +1823,23 @@ NTSTATUS WSKAPI WSKControlSocketUnsafe(
             break;
         }
 
-        if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode == 2)
+        const auto Stream = reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Socket);
+
+        if (Stream->Mode == WskStreamModeNone)
+        {
+            Status = WSKControlStreamSocketPendingWin7(Stream, RequestType, ControlCode, OptionLevel,
+                InputBuffer, InputSize, OutputBuffer, OutputSize, OutputSizeReturned, Overlapped, CompletionRoutine);
+            break;
+        }
+
+        if (Stream->Mode == WskStreamModeConnect)
         {
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect;
+            Socket        = Stream->Connect;
             WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
         }
         else
         {
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Listen;
+            Socket        = Stream->Listen;
             WskSocketType = WSK_FLAG_LISTEN_SOCKET;
         }
 
@@ -883,8 +1959,30 @@ NTSTATUS WSKAPI WSKBindUnsafe(
 #else
     if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
     {
-        Socket        = reinterpret_cast<PWSK_STREAM_SOCKET_WIN7>(Socket)->Listen;
-        WskSocketType = WSK_FLAG_LISTEN_SOCKET;
+        const auto Stream = reinterpret_cast<PWSK_STREAM_SOCKET_WIN7>(Socket);
+
+        switch (Stream->Mode)
+        {
+        case WskStreamModeNone:
+            if (Stream->Bound)
+            {
+                return STATUS_ADDRESS_ALREADY_ASSOCIATED;
+            }
+
+            RtlCopyMemory(&Stream->LocalAddress, LocalAddress, min(LocalAddressLength, sizeof Stream->LocalAddress));
+            Stream->Bound = TRUE;
+            return STATUS_SUCCESS;
+
+        case WskStreamModeListen:
+            Socket        = Stream->Listen;
+            WskSocketType = WSK_FLAG_LISTEN_SOCKET;
+            break;
+
+        default:
+            Socket        = Stream->Connect;
+            WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
+            break;
+        }
     }
 
     Status = WSKBindUnsafeDownlevel(Socket, WskSocketType, LocalAddress, LocalAddressLength);
@@ -893,14 +1991,79 @@ NTSTATUS WSKAPI WSKBindUnsafe(
     return Status;
 }
 
+#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+// Creates the one provider socket the mode needs and applies what was recorded so far.
+// A listen socket starts listening once bound, so a recorded bind is applied here.
+static NTSTATUS WSKAPI WSKCreateStreamSocketWin7(
+    _Inout_ WSK_STREAM_SOCKET_WIN7* Stream,
+    _In_    WSK_STREAM_MODE_WIN7    Mode
+)
+{
+    NTSTATUS    Status        = STATUS_SUCCESS;
+    PWSK_SOCKET Socket        = nullptr;
+    const ULONG WskSocketType = (Mode == WskStreamModeListen) ? WSK_FLAG_LISTEN_SOCKET : WSK_FLAG_CONNECTION_SOCKET;
+
+    do
+    {
+        if (Stream->Mode != WskStreamModeNone)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        Status = WSKSocketUnsafeDownlevel(&Socket, Stream->AddressFamily, Stream->SocketType, Stream->Protocol,
+            WskSocketType, Stream->SecurityDescriptor, Stream->Context);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        for (ULONG Idx = 0; Idx < Stream->OptionCount && NT_SUCCESS(Status); ++Idx)
+        {
+            const auto Option = &Stream->Options[Idx];
+
+            Status = WSKControlSocketUnsafeDownlevel(Socket, WskSocketType, WskSetOption, Option->OptionName,
+                Option->OptionLevel, Option->Value, Option->Size, nullptr, 0u, nullptr, nullptr, nullptr);
+        }
+
+        if (NT_SUCCESS(Status) && Stream->Bound)
+        {
+            Status = WSKBindUnsafeDownlevel(Socket, WskSocketType,
+                reinterpret_cast<PSOCKADDR>(&Stream->LocalAddress), sizeof Stream->LocalAddress);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            WSKCloseSocketUnsafeDownlevel(Socket);
+            break;
+        }
+
+        if (Mode == WskStreamModeListen)
+        {
+            Stream->Listen = Socket;
+        }
+        else
+        {
+            Stream->Connect = Socket;
+        }
+
+        Stream->Mode = Mode;
+
+    } while (false);
+
+    return Status;
+}
+#endif // if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+
+// Stream sockets only, anything else has no accept in its kind.
 NTSTATUS WSKAPI WSKAcceptUnsafe(
     _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType,
     _Out_ PWSK_SOCKET*  SocketClient,
     _Out_opt_ PSOCKADDR LocalAddress,
     _In_ SIZE_T         LocalAddressLength,
     _Out_opt_ PSOCKADDR RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength
+    _In_ SIZE_T         RemoteAddressLength,
+    _In_opt_ PSOCKET_CONTEXT SocketClientContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -929,37 +2092,8 @@ NTSTATUS WSKAPI WSKAcceptUnsafe(
             break;
         }
 
-#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
-        {
-            if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 1)
-            {
-                Status = STATUS_INVALID_DEVICE_REQUEST;
-                break;
-            }
-
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Listen;
-            WskSocketType = WSK_FLAG_LISTEN_SOCKET;
-        }
-#endif // #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-
-        PFN_WSK_ACCEPT WSKAcceptRoutine = nullptr;
-
-        switch (WskSocketType)
-        {
-        case WSK_FLAG_LISTEN_SOCKET:
-            WSKAcceptRoutine = static_cast<const WSK_PROVIDER_LISTEN_DISPATCH*>(Socket->Dispatch)->WskAccept;
-            break;
-#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        case WSK_FLAG_STREAM_SOCKET:
-            WSKAcceptRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskAccept;
-            break;
-#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        default:
-            break;
-        }
-
-        if (WSKAcceptRoutine == nullptr)
+        const auto Listening = WSK_STREAM_KIND::Listening(Socket);
+        if (Listening == nullptr)
         {
             Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
@@ -972,11 +2106,11 @@ NTSTATUS WSKAPI WSKAcceptUnsafe(
             break;
         }
 
-        Status = WSKAcceptRoutine(
-            Socket,
+        Status = static_cast<const WSK_STREAM_KIND::Listener*>(Listening->Dispatch)->WskAccept(
+            Listening,
             0,
-            nullptr,
-            nullptr,
+            SocketClientContext,
+            SocketClientContext ? &WSKClientConnectionDispatch : nullptr,
             LocalAddress,
             RemoteAddress,
             WSKContext->Irp);
@@ -1007,8 +2141,7 @@ NTSTATUS WSKAPI WSKAcceptUnsafe(
 
 #if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
 static NTSTATUS WSKAPI WSKListenUnsafeDownlevel(
-    _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType
+    _In_ PWSK_SOCKET    Socket
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -1016,23 +2149,6 @@ static NTSTATUS WSKAPI WSKListenUnsafeDownlevel(
 
     do
     {
-        PFN_WSK_LISTEN WSKListenRoutine = nullptr;
-
-        switch (WskSocketType)
-        {
-        case WSK_FLAG_STREAM_SOCKET:
-            WSKListenRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskListen;
-            break;
-        default:
-            break;
-        }
-
-        if (WSKListenRoutine == nullptr)
-        {
-            Status = STATUS_INVALID_DEVICE_REQUEST;
-            break;
-        }
-
         WSKContext = WSKAllocContextIRP(nullptr, nullptr);
         if (WSKContext == nullptr)
         {
@@ -1040,7 +2156,7 @@ static NTSTATUS WSKAPI WSKListenUnsafeDownlevel(
             break;
         }
 
-        Status = WSKListenRoutine(
+        Status = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskListen(
             Socket,
             WSKContext->Irp);
 
@@ -1064,9 +2180,9 @@ static NTSTATUS WSKAPI WSKListenUnsafeDownlevel(
 }
 #endif
 
+// Stream sockets only, anything else has no listen in its kind.
 NTSTATUS WSKAPI WSKListenUnsafe(
-    _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType
+    _In_ PWSK_SOCKET    Socket
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -1084,242 +2200,171 @@ NTSTATUS WSKAPI WSKListenUnsafe(
     }
 
 #if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-    Status = WSKListenUnsafeDownlevel(Socket, WskSocketType);
+    Status = WSKListenUnsafeDownlevel(Socket);
 #else
-    UNREFERENCED_PARAMETER(Socket);
-    UNREFERENCED_PARAMETER(WskSocketType);
-
-    if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
-    {
-        if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 0)
-        {
-            Status = STATUS_INVALID_DEVICE_REQUEST;
-            return Status;
-        }
-        else
-        {
-            reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode = 1;
-        }
-    }
+    Status = WSKCreateStreamSocketWin7(reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Socket), WskStreamModeListen);
 #endif
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKConnectUnsafe(
+// Ports refused by the stack are marked by the allocator, so they are not handed out again for a while.
+static NTSTATUS WSKAPI WSKBindSharedPortUnsafe(
     _In_ PWSK_SOCKET    Socket,
     _In_ ULONG          WskSocketType,
+    _In_ PSOCKADDR      LocalAddress,
     _In_ PSOCKADDR      RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength
+    _In_ USHORT         PortLow,
+    _In_ USHORT         PortHigh,
+    _In_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
     do
     {
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        ULONG ReuseAddress = 1u;
+
+        Status = WSKControlSocketUnsafe(Socket, WskSocketType, WskSetOption, SO_REUSEADDR, SOL_SOCKET,
+            &ReuseAddress, sizeof ReuseAddress, nullptr, 0u, nullptr, nullptr, nullptr);
+        if (!NT_SUCCESS(Status))
         {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Socket == nullptr || RemoteAddress == nullptr || (RemoteAddressLength < sizeof SOCKADDR))
+        for (ULONG Attempt = 1u; ; ++Attempt)
         {
-            Status = STATUS_INVALID_PARAMETER;
-            break;
-        }
+            WSK_PORT_ENTRY* Entry = nullptr;
+            USHORT          Port  = 0u;
 
-        if ((RemoteAddress->sa_family == AF_INET  && RemoteAddressLength < sizeof SOCKADDR_IN) ||
-            (RemoteAddress->sa_family == AF_INET6 && RemoteAddressLength < sizeof SOCKADDR_IN6))
-        {
-            Status = STATUS_INVALID_PARAMETER;
-            break;
-        }
-
-#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
-        {
-            if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 0)
+            Status = WSKPortAllocate(LocalAddress, RemoteAddress, PortLow, PortHigh, &Entry, &Port);
+            if (!NT_SUCCESS(Status))
             {
-                Status = STATUS_INVALID_DEVICE_REQUEST;
                 break;
             }
-            else
-            {
-                reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode = 2;
-            }
-
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect;
-            WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
-        }
-#endif // #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-
-        SOCKADDR_STORAGE LocalAddress{};
-        LocalAddress.ss_family = RemoteAddress->sa_family;
-
-        Status = WSKBindUnsafe(Socket, WskSocketType, reinterpret_cast<PSOCKADDR>(&LocalAddress), sizeof LocalAddress);
-        if (!NT_SUCCESS(Status))
-        {
-            break;
-        }
-
-        PFN_WSK_CONNECT WSKConnectRoutine = nullptr;
-
-        switch (WskSocketType)
-        {
-        case WSK_FLAG_CONNECTION_SOCKET:
-            WSKConnectRoutine = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Socket->Dispatch)->WskConnect;
-            break;
-#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        case WSK_FLAG_STREAM_SOCKET:
-            WSKConnectRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskConnect;
-            break;
-#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        default:
-            break;
-        }
 
-        if (WSKConnectRoutine == nullptr)
-        {
-            Status = STATUS_INVALID_DEVICE_REQUEST;
-            break;
-        }
+            // sin_port and sin6_port are at the same offset.
+            reinterpret_cast<PSOCKADDR_IN>(LocalAddress)->sin_port = RtlUshortByteSwap(Port);
 
-        WSKContext = WSKAllocContextIRP(nullptr, nullptr);
-        if (WSKContext == nullptr)
-        {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+            Status = WSKBindUnsafe(Socket, WskSocketType, LocalAddress, sizeof SOCKADDR_STORAGE);
+            if (NT_SUCCESS(Status))
+            {
+                SocketContext->SourcePort      = Port;
+                SocketContext->SourcePortEntry = Entry;
+                break;
+            }
 
-        Status = WSKConnectRoutine(
-            Socket,
-            RemoteAddress,
-            0,
-            WSKContext->Irp);
+            const BOOLEAN Conflict = (Status == STATUS_ADDRESS_ALREADY_EXISTS || Status == STATUS_SHARING_VIOLATION);
 
-        if (Status == STATUS_PENDING)
-        {
-            LARGE_INTEGER Timeout{};
+            // A refused port stays marked, so neither the next attempt nor the next connect gets it.
+            WSKPortRelease(Entry, Port, Conflict);
 
-            Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                FALSE, WSKTimeoutToLargeInteger(WSK_INFINITE_WAIT, &Timeout));
-            if (Status == STATUS_SUCCESS)
+            if (!Conflict || Attempt == 16u)
             {
-                Status = WSKContext->Irp->IoStatus.Status;
+                break;
             }
         }
 
-        WSKFreeContextIRP(WSKContext);
-
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKDisconnectUnsafe(
+// The bind a connect needs when the socket was not bound by WSKBind.
+// Takes the WSK_SO_CONNECT_SOURCE address and port range if set, the wildcard address otherwise.
+static NTSTATUS WSKAPI WSKAutoBindUnsafe(
     _In_ PWSK_SOCKET    Socket,
     _In_ ULONG          WskSocketType,
-    _In_opt_ PWSK_BUF   Buffer,
-    _In_ ULONG          Flags
+    _In_ PSOCKADDR      RemoteAddress,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
     do
     {
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
-        {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
-            break;
-        }
+        SOCKADDR_STORAGE LocalAddress{};
+        LocalAddress.ss_family = RemoteAddress->sa_family;
 
-        if (Socket == nullptr)
-        {
-            Status = STATUS_INVALID_PARAMETER;
-            break;
-        }
+        USHORT  PortLow  = 0u;
+        USHORT  PortHigh = 0u;
+        BOOLEAN Shared   = FALSE;
 
-#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
+        if (SocketContext)
         {
-            if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 2)
+            KIRQL Irql;
+            KeAcquireSpinLock(&SocketContext->Lock, &Irql);
             {
-                Status = STATUS_INVALID_DEVICE_REQUEST;
-                break;
-            }
+                if (SocketContext->SourceAddress.ss_family != AF_UNSPEC)
+                {
+                    LocalAddress = SocketContext->SourceAddress;
+                }
 
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect;
-            WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
+                PortLow  = SocketContext->SourcePortLow;
+                PortHigh = SocketContext->SourcePortHigh;
+                Shared   = SocketContext->SourcePortShared;
+            }
+            KeReleaseSpinLock(&SocketContext->Lock, Irql);
         }
-#endif // #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
 
-        PFN_WSK_DISCONNECT WSKDisconnectRoutine = nullptr;
-
-        switch (WskSocketType)
+        if (LocalAddress.ss_family != RemoteAddress->sa_family)
         {
-        case WSK_FLAG_CONNECTION_SOCKET:
-            WSKDisconnectRoutine = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Socket->Dispatch)->WskDisconnect;
-            break;
-#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        case WSK_FLAG_STREAM_SOCKET:
-            WSKDisconnectRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskDisconnect;
-            break;
-#endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        default:
+            Status = STATUS_INVALID_ADDRESS_COMPONENT;
             break;
         }
 
-        if (WSKDisconnectRoutine == nullptr)
+        if (Shared && WskSocketType != WSK_FLAG_DATAGRAM_SOCKET)
         {
-            Status = STATUS_INVALID_DEVICE_REQUEST;
+            if (PortLow == 0u)
+            {
+                PortLow  = 49152u;
+                PortHigh = 65535u;
+            }
+
+            Status = WSKBindSharedPortUnsafe(Socket, WskSocketType, reinterpret_cast<PSOCKADDR>(&LocalAddress),
+                RemoteAddress, PortLow, PortHigh, SocketContext);
             break;
         }
 
-        WSKContext = WSKAllocContextIRP(nullptr, nullptr);
-        if (WSKContext == nullptr)
+        if (PortLow == 0u)
         {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+            Status = WSKBindUnsafe(Socket, WskSocketType, reinterpret_cast<PSOCKADDR>(&LocalAddress), sizeof LocalAddress);
             break;
         }
 
-        Status = WSKDisconnectRoutine(
-            Socket,
-            Buffer,
-            Flags,
-            WSKContext->Irp);
+        // Starting at a random port keeps sockets sharing a range from probing the same ports in turn.
+        ULONG Seed  = static_cast<ULONG>(KeQueryInterruptTime());
+        ULONG Range = static_cast<ULONG>(PortHigh - PortLow) + 1u;
+        ULONG Start = RtlRandomEx(&Seed) % Range;
 
-        if (Status == STATUS_PENDING)
+        for (ULONG Index = 0u; Index < Range; ++Index)
         {
-            LARGE_INTEGER Timeout{};
+            // sin_port and sin6_port are at the same offset.
+            reinterpret_cast<PSOCKADDR_IN>(&LocalAddress)->sin_port =
+                RtlUshortByteSwap(static_cast<USHORT>(PortLow + (Start + Index) % Range));
 
-            Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                FALSE, WSKTimeoutToLargeInteger(WSK_INFINITE_WAIT, &Timeout));
-            if (Status == STATUS_SUCCESS)
+            Status = WSKBindUnsafe(Socket, WskSocketType, reinterpret_cast<PSOCKADDR>(&LocalAddress), sizeof LocalAddress);
+            if (Status != STATUS_ADDRESS_ALREADY_EXISTS && Status != STATUS_SHARING_VIOLATION)
             {
-                Status = WSKContext->Irp->IoStatus.Status;
+                break;
             }
         }
 
-        WSKFreeContextIRP(WSKContext);
-
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSendUnsafe(
+// *Bound is TRUE if the socket is bound already, and set once the implicit bind succeeds.
+NTSTATUS WSKAPI WSKConnectUnsafe(
     _In_ PWSK_SOCKET    Socket,
     _In_ ULONG          WskSocketType,
-    _In_ PVOID          Buffer,
-    _In_ SIZE_T         BufferLength,
-    _Out_opt_ SIZE_T*   NumberOfBytesSent,
-    _In_ ULONG          Flags,
-    _In_opt_ ULONG     TimeoutMilliseconds,
+    _In_ PSOCKADDR      RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength,
+    _Inout_opt_ PBOOLEAN Bound,
     _In_opt_ WSKOVERLAPPED* Overlapped,
-    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -1327,70 +2372,93 @@ NTSTATUS WSKAPI WSKSendUnsafe(
 
     do
     {
-        if (NumberOfBytesSent)
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
-            *NumberOfBytesSent = 0u;
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
         }
 
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        if (Socket == nullptr || RemoteAddress == nullptr || (RemoteAddressLength < sizeof SOCKADDR))
         {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (Socket == nullptr)
+        if ((RemoteAddress->sa_family == AF_INET  && RemoteAddressLength < sizeof SOCKADDR_IN) ||
+            (RemoteAddress->sa_family == AF_INET6 && RemoteAddressLength < sizeof SOCKADDR_IN6))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
+        BOOLEAN Bound_ = (Bound != nullptr) && *Bound;
+
 #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
         if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
         {
-            if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 2)
+            const auto Stream = reinterpret_cast<WSK_STREAM_SOCKET_WIN7*>(Socket);
+
+            Status = WSKCreateStreamSocketWin7(Stream, WskStreamModeConnect);
+            if (!NT_SUCCESS(Status))
             {
-                Status = STATUS_INVALID_DEVICE_REQUEST;
                 break;
             }
 
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect;
+            Bound_        = Bound_ || Stream->Bound;
+            Socket        = Stream->Connect;
             WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
         }
 #endif // #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
 
-        PFN_WSK_SEND WSKSendRoutine = nullptr;
+        if (!Bound_)
+        {
+            Status = WSKAutoBindUnsafe(Socket, WskSocketType, RemoteAddress, SocketContext);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            if (Bound)
+            {
+                *Bound = TRUE;
+            }
+        }
+
+        PFN_WSK_CONNECT WSKConnectRoutine = nullptr;
 
         switch (WskSocketType)
         {
         case WSK_FLAG_CONNECTION_SOCKET:
-            WSKSendRoutine = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Socket->Dispatch)->WskSend;
+            WSKConnectRoutine = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Socket->Dispatch)->WskConnect;
             break;
 #if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
         case WSK_FLAG_STREAM_SOCKET:
-            WSKSendRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskSend;
+            WSKConnectRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskConnect;
             break;
 #endif // if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
         default:
             break;
         }
 
-        if (WSKSendRoutine == nullptr)
+        if (WSKConnectRoutine == nullptr)
         {
             Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, Buffer, BufferLength);
+        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped);
         if (WSKContext == nullptr)
         {
             Status = STATUS_INSUFFICIENT_RESOURCES;
             break;
         }
 
-        Status = WSKSendRoutine(
+        WSKTrackContextIRP(WSKContext, SocketContext);
+
+        Status = WSKConnectRoutine(
             Socket,
-            &WSKContext->InputBuffer,
-            Flags,
+            RemoteAddress,
+            0,
             WSKContext->Irp);
 
         if (Overlapped == nullptr)
@@ -1400,25 +2468,13 @@ NTSTATUS WSKAPI WSKSendUnsafe(
                 LARGE_INTEGER Timeout{};
 
                 Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                    FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
-
-                if (Status == STATUS_TIMEOUT)
-                {
-                    IoCancelIrp(WSKContext->Irp);
-                    KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
-                }
-
+                    FALSE, WSKTimeoutToLargeInteger(WSK_INFINITE_WAIT, &Timeout));
                 if (Status == STATUS_SUCCESS)
                 {
                     Status = WSKContext->Irp->IoStatus.Status;
                 }
             }
 
-            if (NumberOfBytesSent)
-            {
-                *NumberOfBytesSent = WSKContext->Irp->IoStatus.Information;
-            }
-
             WSKFreeContextIRP(WSKContext);
         }
 
@@ -1427,18 +2483,18 @@ NTSTATUS WSKAPI WSKSendUnsafe(
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSendToUnsafe(
+// Buffer is sent ahead of the FIN in the same request, graceful disconnects only.
+template<typename Kind>
+static NTSTATUS WSKAPI WSKDisconnectUnsafe(
     _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType,
-    _In_ PVOID          Buffer,
+    _In_reads_bytes_opt_(BufferLength) PVOID Buffer,
     _In_ SIZE_T         BufferLength,
     _Out_opt_ SIZE_T*   NumberOfBytesSent,
-    _Reserved_ ULONG    Flags,
-    _In_opt_ PSOCKADDR  RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength,
-    _In_opt_ ULONG      /*TimeoutMilliseconds*/,
+    _In_ ULONG          Flags,
+    _In_opt_ ULONG      TimeoutMilliseconds,
     _In_opt_ WSKOVERLAPPED* Overlapped,
-    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -1457,48 +2513,22 @@ NTSTATUS WSKAPI WSKSendToUnsafe(
             break;
         }
 
-        if (Socket == nullptr)
+        if (Socket == nullptr || (BufferLength && (Buffer == nullptr || (Flags & WSK_FLAG_ABORTIVE))))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (RemoteAddress)
-        {
-            if (RemoteAddressLength < sizeof SOCKADDR)
-            {
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
-
-            if ((RemoteAddress->sa_family == AF_INET  && RemoteAddressLength < sizeof SOCKADDR_IN) ||
-                (RemoteAddress->sa_family == AF_INET6 && RemoteAddressLength < sizeof SOCKADDR_IN6))
-            {
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
-        }
-
-        PFN_WSK_SEND_TO WSKSendToRoutine = nullptr;
-
-        switch (WskSocketType)
-        {
-        case WSK_FLAG_DATAGRAM_SOCKET:
-            WSKSendToRoutine = static_cast<const WSK_PROVIDER_DATAGRAM_DISPATCH*>(Socket->Dispatch)->WskSendTo;
-            break;
-        default:
-            break;
-        }
-
-        if (WSKSendToRoutine == nullptr)
+        const auto Connected = Kind::Connected(Socket);
+        if (Connected == nullptr)
         {
             Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        if (Overlapped == nullptr)
+        if (BufferLength == 0)
         {
-            Overlapped = &WSKEmptyOverlapped;
+            Buffer = nullptr;
         }
 
         WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, Buffer, BufferLength);
@@ -1508,25 +2538,22 @@ NTSTATUS WSKAPI WSKSendToUnsafe(
             break;
         }
 
-        Status = WSKSendToRoutine(
-            Socket,
-            &WSKContext->InputBuffer,
-            Flags,
-            RemoteAddress,
-            0,
-            nullptr,
-            WSKContext->Irp);
+        WSKTrackContextIRP(WSKContext, SocketContext);
+        WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
 
-        if (NumberOfBytesSent)
+        Status = static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskDisconnect(
+            Connected, Buffer ? &WSKContext->InputBuffer : nullptr, Flags, WSKContext->Irp);
+
+        if (Overlapped == nullptr)
         {
-            if (Status == STATUS_SUCCESS)
+            Status = WSKWaitContextIRP(WSKContext, Status, TimeoutMilliseconds);
+
+            if (NumberOfBytesSent)
             {
                 *NumberOfBytesSent = WSKContext->Irp->IoStatus.Information;
             }
-            else
-            {
-                *NumberOfBytesSent = BufferLength;
-            }
+
+            WSKFreeContextIRP(WSKContext);
         }
 
     } while (false);
@@ -1534,145 +2561,125 @@ NTSTATUS WSKAPI WSKSendToUnsafe(
     return Status;
 }
 
-NTSTATUS WSKAPI WSKReceiveUnsafe(
+// The provider routine is already resolved, the rest of a send is the same for every socket kind.
+static NTSTATUS WSKAPI WSKSendDirect(
+    _In_ PFN_WSK_SEND   SendRoutine,
     _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType,
     _In_ PVOID          Buffer,
     _In_ SIZE_T         BufferLength,
-    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
     _In_ ULONG          Flags,
     _In_opt_ ULONG      TimeoutMilliseconds,
     _In_opt_ WSKOVERLAPPED* Overlapped,
-    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
+    if (NumberOfBytesSent)
+    {
+        *NumberOfBytesSent = 0u;
+    }
 
-    do
+    auto WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, Buffer, BufferLength);
+    if (WSKContext == nullptr)
     {
-        if (NumberOfBytesRecvd)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    WSKTrackContextIRP(WSKContext, SocketContext);
+    WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
+
+    NTSTATUS Status = SendRoutine(
+        Socket,
+        &WSKContext->InputBuffer,
+        Flags,
+        WSKContext->Irp);
+
+    if (Overlapped == nullptr)
+    {
+        Status = WSKWaitContextIRP(WSKContext, Status, TimeoutMilliseconds);
+
+        if (NumberOfBytesSent)
         {
-            *NumberOfBytesRecvd = 0;
+            *NumberOfBytesSent = WSKContext->Irp->IoStatus.Information;
         }
 
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
-        {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
-            break;
-        }
-
-        if (Socket == nullptr)
-        {
-            Status = STATUS_INVALID_PARAMETER;
-            break;
-        }
+        WSKFreeContextIRP(WSKContext);
+    }
 
-#if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        if (WskSocketType == WSK_FLAG_STREAM_SOCKET)
-        {
-            if (reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Mode != 2)
-            {
-                Status = STATUS_INVALID_DEVICE_REQUEST;
-                break;
-            }
+    return Status;
+}
 
-            Socket        = reinterpret_cast<const WSK_STREAM_SOCKET_WIN7*>(Socket)->Connect;
-            WskSocketType = WSK_FLAG_CONNECTION_SOCKET;
-        }
-#endif // #if !(NTDDI_VERSION >= NTDDI_WIN10_RS2)
+static NTSTATUS WSKAPI WSKReceiveDirect(
+    _In_ PFN_WSK_RECEIVE ReceiveRoutine,
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _In_ ULONG          Flags,
+    _In_opt_ ULONG      TimeoutMilliseconds,
+    _In_opt_ WSKOVERLAPPED* Overlapped,
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
+{
+    if (NumberOfBytesRecvd)
+    {
+        *NumberOfBytesRecvd = 0u;
+    }
 
-        PFN_WSK_RECEIVE WSKReceiveRoutine = nullptr;
+    auto WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, nullptr, 0, Buffer, BufferLength);
+    if (WSKContext == nullptr)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-        switch (WskSocketType)
-        {
-        case WSK_FLAG_CONNECTION_SOCKET:
-            WSKReceiveRoutine = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Socket->Dispatch)->WskReceive;
-            break;
-#if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        case WSK_FLAG_STREAM_SOCKET:
-            WSKReceiveRoutine = static_cast<const WSK_PROVIDER_STREAM_DISPATCH*>(Socket->Dispatch)->WskReceive;
-            break;
-#endif // #if (NTDDI_VERSION >= NTDDI_WIN10_RS2)
-        default:
-            break;
-        }
+    WSKContext->Receive = TRUE;
 
-        if (WSKReceiveRoutine == nullptr)
-        {
-            Status = STATUS_INVALID_DEVICE_REQUEST;
-            break;
-        }
+    WSKTrackContextIRP(WSKContext, SocketContext);
+    WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
 
-        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, nullptr, 0, Buffer, BufferLength);
-        if (WSKContext == nullptr)
-        {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+    NTSTATUS Status = ReceiveRoutine(
+        Socket,
+        &WSKContext->OutputBuffer,
+        Flags,
+        WSKContext->Irp);
 
-        Status = WSKReceiveRoutine(
-            Socket,
-            &WSKContext->OutputBuffer,
-            Flags,
-            WSKContext->Irp);
+    if (Overlapped == nullptr)
+    {
+        Status = WSKWaitContextIRP(WSKContext, Status, TimeoutMilliseconds);
 
-        if (Overlapped == nullptr)
+        if (NumberOfBytesRecvd)
         {
-            if (Status == STATUS_PENDING)
-            {
-                LARGE_INTEGER Timeout{};
-
-                Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                    FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
-
-                if (Status == STATUS_TIMEOUT)
-                {
-                    IoCancelIrp(WSKContext->Irp);
-                    KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
-                }
-
-                if (Status == STATUS_SUCCESS)
-                {
-                    Status = WSKContext->Irp->IoStatus.Status;
-                }
-            }
-
-            if (NumberOfBytesRecvd)
-            {
-                *NumberOfBytesRecvd = WSKContext->Irp->IoStatus.Information;
-            }
-
-            WSKFreeContextIRP(WSKContext);
+            *NumberOfBytesRecvd = WSKContext->Irp->IoStatus.Information;
         }
 
-    } while (false);
+        WSKFreeContextIRP(WSKContext);
+    }
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKReceiveFromUnsafe(
+template<typename Kind>
+static NTSTATUS WSKAPI WSKSendUnsafe(
     _In_ PWSK_SOCKET    Socket,
-    _In_ ULONG          WskSocketType,
     _In_ PVOID          Buffer,
     _In_ SIZE_T         BufferLength,
-    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
-    _Reserved_ ULONG    Flags,
-    _Out_opt_ PSOCKADDR RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength,
-    _In_opt_ ULONG      TimeoutMilliseconds,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _In_ ULONG          Flags,
+    _In_opt_ ULONG     TimeoutMilliseconds,
     _In_opt_ WSKOVERLAPPED* Overlapped,
-    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
     do
     {
-        if (NumberOfBytesRecvd)
+        if (NumberOfBytesSent)
         {
-            *NumberOfBytesRecvd = 0;
+            *NumberOfBytesSent = 0u;
         }
 
         if (!InterlockedCompareExchange(&_Initialized, true, true))
@@ -1687,76 +2694,87 @@ NTSTATUS WSKAPI WSKReceiveFromUnsafe(
             break;
         }
 
-        if (RemoteAddress)
+        const auto Connected = Kind::Connected(Socket);
+        if (Connected == nullptr)
         {
-            if (RemoteAddressLength < sizeof SOCKADDR)
-            {
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
         }
 
-        PFN_WSK_RECEIVE_FROM WSKReceiveFromRoutine = nullptr;
+        Status = WSKSendDirect(static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskSend, Connected,
+            Buffer, BufferLength, NumberOfBytesSent, Flags, TimeoutMilliseconds, Overlapped, CompletionRoutine, SocketContext);
 
-        switch (WskSocketType)
+    } while (false);
+
+    return Status;
+}
+
+// Header and payload go out as one MDL chain in a single send IRP.
+template<typename Kind>
+static NTSTATUS WSKAPI WSKSendBuffersUnsafe(
+    _In_ PWSK_SOCKET    Socket,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG          BufferCount,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _In_ ULONG          Flags,
+    _In_opt_ ULONG      TimeoutMilliseconds,
+    _In_opt_ WSKOVERLAPPED* Overlapped,
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (NumberOfBytesSent)
         {
-        case WSK_FLAG_DATAGRAM_SOCKET:
-            WSKReceiveFromRoutine = static_cast<const WSK_PROVIDER_DATAGRAM_DISPATCH*>(Socket->Dispatch)->WskReceiveFrom;
-            break;
-        default:
+            *NumberOfBytesSent = 0u;
+        }
+
+        if (Socket == nullptr || (Buffers == nullptr && BufferCount))
+        {
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (WSKReceiveFromRoutine == nullptr)
+        const auto Connected = Kind::Connected(Socket);
+        if (Connected == nullptr)
         {
             Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, nullptr, 0, Buffer, BufferLength);
+        auto WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped);
         if (WSKContext == nullptr)
         {
             Status = STATUS_INSUFFICIENT_RESOURCES;
             break;
         }
 
-        ULONG ControlFlags  = 0;
-        ULONG ControlLength = 0;
+        Status = WSKLockBuffers(Buffers, BufferCount, &WSKContext->InputBuffer);
+        if (!NT_SUCCESS(Status))
+        {
+            WSKFreeContextIRP(WSKContext);
+            break;
+        }
 
-        Status = WSKReceiveFromRoutine(
-            Socket,
-            &WSKContext->OutputBuffer,
+        WSKTrackContextIRP(WSKContext, SocketContext);
+        WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
+
+        Status = static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskSend(
+            Connected,
+            &WSKContext->InputBuffer,
             Flags,
-            RemoteAddress,
-            &ControlLength,
-            nullptr,
-            &ControlFlags,
             WSKContext->Irp);
 
         if (Overlapped == nullptr)
         {
-            if (Status == STATUS_PENDING)
-            {
-                LARGE_INTEGER Timeout{};
-
-                Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                    FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
-
-                if (Status == STATUS_TIMEOUT)
-                {
-                    IoCancelIrp(WSKContext->Irp);
-                    KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
-                }
-
-                if (Status == STATUS_SUCCESS)
-                {
-                    Status = WSKContext->Irp->IoStatus.Status;
-                }
-            }
+            Status = WSKWaitContextIRP(WSKContext, Status, TimeoutMilliseconds);
 
-            if (NumberOfBytesRecvd)
+            if (NumberOfBytesSent)
             {
-                *NumberOfBytesRecvd = WSKContext->Irp->IoStatus.Information;
+                *NumberOfBytesSent = WSKContext->Irp->IoStatus.Information;
             }
 
             WSKFreeContextIRP(WSKContext);
@@ -1767,152 +2785,459 @@ NTSTATUS WSKAPI WSKReceiveFromUnsafe(
     return Status;
 }
 
-//////////////////////////////////////////////////////////////////////////
-// Public  Function
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-VOID WSKAPI WSKSetLastError(
-    _In_ NTSTATUS Status
+// A section over [0, End) of the file, for files the cache manager cannot MDL read.
+// Chunks map their own window of it, so system space stays bounded by the chunks on the wire.
+static NTSTATUS WSKAPI WSKCreateTransmitSection(
+    _In_  PFILE_OBJECT FileObject,
+    _In_  ULONG64      End,
+    _Out_ PVOID*       Section
 )
 {
-    _LastNtStatus = Status;
-}
+    NTSTATUS Status = STATUS_SUCCESS;
 
-NTSTATUS WSKAPI WSKGetLastError()
-{
-    return _LastNtStatus;
-}
+    HANDLE FileHandle    = nullptr;
+    HANDLE SectionHandle = nullptr;
 
-NTSTATUS WSKAPI WSKStartup(_In_ UINT16 Version, _Out_ WSKDATA* WSKData)
-{
-    NTSTATUS Status = STATUS_SUCCESS;
+    *Section = nullptr;
 
-    do 
+    do
     {
-        *WSKData = {};
-
-        if (InterlockedCompareExchange(&_Initialized, true, true))
+        Status = ObOpenObjectByPointer(FileObject, OBJ_KERNEL_HANDLE, nullptr, FILE_READ_DATA,
+            *IoFileObjectType, KernelMode, &FileHandle);
+        if (!NT_SUCCESS(Status))
         {
-            WSK_PROVIDER_CHARACTERISTICS Caps;
-            Status = WskQueryProviderCharacteristics(&WSKRegistration, &Caps);
-            if (!NT_SUCCESS(Status))
-            {
-                break;
-            }
-
-            WSKData->HighestVersion = Caps.HighestVersion;
-            WSKData->LowestVersion  = Caps.LowestVersion;
-
             break;
         }
 
-        ExInitializeDriverRuntime(DrvRtPoolNxOptIn);
-
-        WSKSocketsAVLTableInitialize();
-
-        WSK_CLIENT_NPI NPIClient{};
-        NPIClient.ClientContext = nullptr;
-        NPIClient.Dispatch = &WSKClientDispatch;
+        OBJECT_ATTRIBUTES ObjectAttributes{};
+        InitializeObjectAttributes(&ObjectAttributes, nullptr, OBJ_KERNEL_HANDLE, nullptr, nullptr);
 
-        WSKClientDispatch.Version = Version;
+        LARGE_INTEGER MaximumSize{};
+        MaximumSize.QuadPart = static_cast<LONGLONG>(End);
 
-        Status = WskRegister(&NPIClient, &WSKRegistration);
+        Status = ZwCreateSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes, &MaximumSize,
+            PAGE_READONLY, SEC_COMMIT, FileHandle);
         if (!NT_SUCCESS(Status))
         {
             break;
         }
 
-        WSK_PROVIDER_CHARACTERISTICS Caps;
-        Status = WskQueryProviderCharacteristics(&WSKRegistration, &Caps);
+        Status = ObReferenceObjectByHandle(SectionHandle, SECTION_MAP_READ, nullptr, KernelMode, Section, nullptr);
         if (!NT_SUCCESS(Status))
         {
+            *Section = nullptr;
             break;
         }
 
-        WSKData->HighestVersion = Caps.HighestVersion;
-        WSKData->LowestVersion  = Caps.LowestVersion;
+    } while (false);
 
-        Status = WskCaptureProviderNPI(&WSKRegistration, WSK_INFINITE_WAIT, &WSKNPIProvider);
-        if (!NT_SUCCESS(Status))
+    if (SectionHandle)
+    {
+        ZwClose(SectionHandle);
+    }
+
+    if (FileHandle)
+    {
+        ZwClose(FileHandle);
+    }
+
+    return Status;
+}
+
+// Maps the window of one chunk, from the allocation boundary below Offset. Before Windows 8
+// a system space view cannot start past the beginning of the section, the window does not either.
+static NTSTATUS WSKAPI WSKMapTransmitWindow(
+    _In_  PVOID   Section,
+    _In_  ULONG64 Offset,
+    _In_  ULONG   Length,
+    _Out_ PVOID*  View,
+    _Out_ PUCHAR* Data
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *View = nullptr;
+    *Data = nullptr;
+
+    do
+    {
+        LARGE_INTEGER SectionOffset{};
+#if (NTDDI_VERSION >= NTDDI_WIN8)
+        SectionOffset.QuadPart = static_cast<LONGLONG>(Offset & ~static_cast<ULONG64>(WSK_TRANSMIT_VIEW_ALIGNMENT - 1));
+#endif
+
+        const ULONG64 End = Offset + Length - static_cast<ULONG64>(SectionOffset.QuadPart);
+        if (End > MAXSIZE_T)
         {
-            WskDeregister(&WSKRegistration);
+            Status = STATUS_SECTION_TOO_BIG;
             break;
         }
 
-        WSKCreateEvent(&WSKEmptyOverlapped.Event);
+        SIZE_T ViewSize = static_cast<SIZE_T>(End);
 
-        InterlockedCompareExchange(&_Initialized, true, false);
+#if (NTDDI_VERSION >= NTDDI_WIN8)
+        Status = MmMapViewInSystemSpaceEx(Section, View, &ViewSize, &SectionOffset, 0u);
+#else
+        Status = MmMapViewInSystemSpace(Section, View, &ViewSize);
+#endif
+        if (!NT_SUCCESS(Status))
+        {
+            *View = nullptr;
+            break;
+        }
+
+        *Data = static_cast<PUCHAR>(*View) + (Offset - static_cast<ULONG64>(SectionOffset.QuadPart));
 
     } while (false);
 
     return Status;
 }
 
-VOID WSKAPI WSKCleanup()
+// Builds the MDLs of one chunk and hands them to the provider. A send the provider fails
+// is still a chunk on the wire, its status is picked up with the others.
+static NTSTATUS WSKAPI WSKTransmitFileChunk(
+    _In_ PFN_WSK_SEND   SendRoutine,
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PFILE_OBJECT   FileObject,
+    _In_opt_ PVOID      Section,
+    _In_ ULONG64        Offset,
+    _In_ ULONG          Length,
+    _In_ ULONG          TimeoutMilliseconds,
+    _In_opt_ PSOCKET_CONTEXT SocketContext,
+    _Out_ WSK_TRANSMIT_CHUNK* Chunk
+)
 {
-    if (InterlockedCompareExchange(&_Initialized, false, true))
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *Chunk = {};
+
+    do
     {
-        WSKSocketsAVLTableCleanup();
+        if (Section)
+        {
+            PUCHAR Data = nullptr;
 
-        WskReleaseProviderNPI(&WSKRegistration);
-        WskDeregister(&WSKRegistration);
+            Status = WSKMapTransmitWindow(Section, Offset, Length, &Chunk->View, &Data);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
 
-        WSKNPIProvider = {};
+            Chunk->Context = WSKAllocContextIRP(nullptr, nullptr, true, Data, Length);
+            if (Chunk->Context == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            Chunk->Buffer = Chunk->Context->InputBuffer;
+        }
+        else
+        {
+            LARGE_INTEGER   FileOffset{};
+            IO_STATUS_BLOCK IoStatus{};
+
+            FileOffset.QuadPart = static_cast<LONGLONG>(Offset);
+
+            Status = FsRtlMdlReadEx(FileObject, &FileOffset, Length, 0u, &Chunk->MdlChain, &IoStatus);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            if (Chunk->MdlChain == nullptr || IoStatus.Information == 0)
+            {
+                Status = STATUS_END_OF_FILE;
+                break;
+            }
+
+            Chunk->Buffer.Mdl    = Chunk->MdlChain;
+            Chunk->Buffer.Offset = 0u;
+            Chunk->Buffer.Length = IoStatus.Information;
+
+            Chunk->Context = WSKAllocContextIRP(nullptr, nullptr);
+            if (Chunk->Context == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+        WSKTrackContextIRP(Chunk->Context, SocketContext);
+        WSKArmContextIRP(Chunk->Context, TimeoutMilliseconds);
+
+        Chunk->Status = SendRoutine(Socket, &Chunk->Buffer, 0u, Chunk->Context->Irp);
+
+    } while (false);
+
+    if (!NT_SUCCESS(Status))
+    {
+        if (Chunk->MdlChain)
+        {
+            CcMdlReadComplete(FileObject, Chunk->MdlChain);
+        }
+
+        WSKFreeContextIRP(Chunk->Context);
+
+        if (Chunk->View)
+        {
+            MmUnmapViewInSystemSpace(Chunk->View);
+        }
+
+        *Chunk = {};
     }
+
+    return Status;
 }
 
-VOID WSKAPI WSKCreateEvent(_Out_ KEVENT* Event)
+template<typename Kind>
+static NTSTATUS WSKAPI WSKTransmitFileUnsafe(
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PFILE_OBJECT   FileObject,
+    _In_ ULONG64        Offset,
+    _In_ ULONG64        Length,
+    _Out_opt_ ULONG64*  NumberOfBytesSent,
+    _In_opt_ ULONG      TimeoutMilliseconds,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
 {
-    KeInitializeEvent(Event, NotificationEvent, FALSE);
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    WSK_TRANSMIT_CHUNK Chunks[WSK_TRANSMIT_DEPTH]{};
+
+    ULONG   Head     = 0u;  // Oldest chunk on the wire
+    ULONG   InFlight = 0u;
+    ULONG64 Issued   = 0u;
+    ULONG64 Sent     = 0u;
+
+    PVOID   Section  = nullptr;
+    BOOLEAN MdlRead  = (FileObject->Flags & FO_CACHE_SUPPORTED) != 0;
+
+    do
+    {
+        if (NumberOfBytesSent)
+        {
+            *NumberOfBytesSent = 0u;
+        }
+
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        const auto Connected = Kind::Connected(Socket);
+        if (Connected == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        const auto SendRoutine = static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskSend;
+
+        LARGE_INTEGER FileSize{};
+
+        Status = FsRtlGetFileSize(FileObject, &FileSize);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        if (Offset > static_cast<ULONG64>(FileSize.QuadPart))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (Length == 0 || Length > FileSize.QuadPart - Offset)
+        {
+            Length = FileSize.QuadPart - Offset;
+        }
+
+        if (!MdlRead && Length)
+        {
+            Status = WSKCreateTransmitSection(FileObject, Offset + Length, &Section);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        // Up to WSK_TRANSMIT_DEPTH sends stay outstanding, a new chunk goes out as the oldest one completes.
+        while (InFlight || (NT_SUCCESS(Status) && Issued < Length))
+        {
+            if (NT_SUCCESS(Status) && Issued < Length && InFlight < WSK_TRANSMIT_DEPTH)
+            {
+                const ULONG ChunkLength = static_cast<ULONG>(min(Length - Issued, WSK_TRANSMIT_CHUNK_SIZE));
+
+                auto Chunk = &Chunks[(Head + InFlight) % WSK_TRANSMIT_DEPTH];
+
+                Status = WSKTransmitFileChunk(SendRoutine, Connected, FileObject, Section, Offset + Issued,
+                    ChunkLength, TimeoutMilliseconds, SocketContext, Chunk);
+
+                // Not cached and not cacheable, send from a mapped view instead.
+                if (!NT_SUCCESS(Status) && MdlRead && Issued == 0 && Status != STATUS_INSUFFICIENT_RESOURCES)
+                {
+                    MdlRead = FALSE;
+
+                    Status = WSKCreateTransmitSection(FileObject, Offset + Length, &Section);
+                    continue;
+                }
+
+                if (NT_SUCCESS(Status))
+                {
+                    Issued   += Chunk->Buffer.Length;
+                    InFlight += 1;
+                }
+                continue;
+            }
+
+            auto Chunk = &Chunks[Head];
+
+            // After a failure the rest is of no use to the peer.
+            if (!NT_SUCCESS(Status) && Chunk->Status == STATUS_PENDING)
+            {
+                IoCancelIrp(Chunk->Context->Irp);
+            }
+
+            const NTSTATUS Result = WSKWaitContextIRP(Chunk->Context, Chunk->Status, TimeoutMilliseconds);
+
+            if (NT_SUCCESS(Status))
+            {
+                Status = Result;
+
+                if (NT_SUCCESS(Result))
+                {
+                    Sent += Chunk->Context->Irp->IoStatus.Information;
+                }
+            }
+
+            WSKFreeContextIRP(Chunk->Context);
+
+            if (Chunk->MdlChain)
+            {
+                CcMdlReadComplete(FileObject, Chunk->MdlChain);
+            }
+
+            if (Chunk->View)
+            {
+                MmUnmapViewInSystemSpace(Chunk->View);
+            }
+
+            *Chunk = {};
+
+            Head      = (Head + 1) % WSK_TRANSMIT_DEPTH;
+            InFlight -= 1;
+        }
+
+        if (NumberOfBytesSent)
+        {
+            *NumberOfBytesSent = Sent;
+        }
+
+    } while (false);
+
+    if (Section)
+    {
+        ObDereferenceObject(Section);
+    }
+
+    return Status;
 }
 
-NTSTATUS WSKAPI WSKGetOverlappedResult(
-    _In_  SOCKET         Socket,
-    _In_  WSKOVERLAPPED* Overlapped,
-    _Out_opt_ SIZE_T*    TransferBytes,
-    _In_  BOOLEAN        Wait
+// Datagram sockets only, anything else has no sendto in its kind.
+NTSTATUS WSKAPI WSKSendToUnsafe(
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _Reserved_ ULONG    Flags,
+    _In_opt_ PSOCKADDR  RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength,
+    _In_opt_ ULONG      TimeoutMilliseconds,
+    _In_opt_ WSKOVERLAPPED* Overlapped,
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
-    UNREFERENCED_PARAMETER(Socket);
-
     NTSTATUS Status = STATUS_SUCCESS;
+    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
-    do 
+    do
     {
-        if (TransferBytes)
+        if (NumberOfBytesSent)
         {
-            *TransferBytes = 0u;
+            *NumberOfBytesSent = 0u;
         }
 
-        if (Overlapped->Internal == STATUS_PENDING)
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
-            if (!Wait)
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (RemoteAddress)
+        {
+            if (RemoteAddressLength < sizeof SOCKADDR)
             {
-                Status = STATUS_TIMEOUT;
+                Status = STATUS_INVALID_PARAMETER;
                 break;
             }
 
-            Status = KeWaitForSingleObject(&Overlapped->Event, Executive, KernelMode, FALSE, nullptr);
-            if (!NT_SUCCESS(Status))
+            if ((RemoteAddress->sa_family == AF_INET  && RemoteAddressLength < sizeof SOCKADDR_IN) ||
+                (RemoteAddress->sa_family == AF_INET6 && RemoteAddressLength < sizeof SOCKADDR_IN6))
             {
+                Status = STATUS_INVALID_PARAMETER;
                 break;
             }
         }
 
-        if (TransferBytes)
+        if (Overlapped == nullptr)
         {
-            /* Return bytes transferred */
-            *TransferBytes = Overlapped->InternalHigh;
+            Overlapped = &WSKEmptyOverlapped;
         }
 
-        /* Check for failure during I/O */
-        if (!NT_SUCCESS(Overlapped->Internal))
+        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, Buffer, BufferLength);
+        if (WSKContext == nullptr)
         {
-            /* Set the error and fail */
-            Status = static_cast<NTSTATUS>(Overlapped->Internal);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        WSKTrackContextIRP(WSKContext, SocketContext);
+        WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
+
+        Status = static_cast<const WSK_PROVIDER_DATAGRAM_DISPATCH*>(Socket->Dispatch)->WskSendTo(
+            Socket,
+            &WSKContext->InputBuffer,
+            Flags,
+            RemoteAddress,
+            0,
+            nullptr,
+            WSKContext->Irp);
+
+        if (NumberOfBytesSent)
+        {
+            if (Status == STATUS_SUCCESS)
+            {
+                *NumberOfBytesSent = WSKContext->Irp->IoStatus.Information;
+            }
+            else
+            {
+                *NumberOfBytesSent = BufferLength;
+            }
         }
 
     } while (false);
@@ -1920,87 +3245,3647 @@ NTSTATUS WSKAPI WSKGetOverlappedResult(
     return Status;
 }
 
-NTSTATUS WSKAPI WSKGetAddrInfo(
-    _In_opt_ LPCWSTR        NodeName,
-    _In_opt_ LPCWSTR        ServiceName,
-    _In_     UINT32         Namespace,
-    _In_opt_ GUID*          Provider,
-    _In_opt_ PADDRINFOEXW   Hints,
-    _Outptr_result_maybenull_ PADDRINFOEXW* Result,
-    _In_opt_ UINT32         TimeoutMilliseconds,
+template<typename Kind>
+static NTSTATUS WSKAPI WSKReceiveUnsafe(
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _In_ ULONG          Flags,
+    _In_opt_ ULONG      TimeoutMilliseconds,
     _In_opt_ WSKOVERLAPPED* Overlapped,
-    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
     do
     {
-        *Result = nullptr;
+        if (NumberOfBytesRecvd)
+        {
+            *NumberOfBytesRecvd = 0;
+        }
 
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        const auto Connected = Kind::Connected(Socket);
+        if (Connected == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        Status = WSKReceiveDirect(static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskReceive, Connected,
+            Buffer, BufferLength, NumberOfBytesRecvd, Flags, TimeoutMilliseconds, Overlapped, CompletionRoutine, SocketContext);
+
+    } while (false);
+
+    return Status;
+}
+
+// Datagram sockets only, anything else has no receivefrom in its kind.
+NTSTATUS WSKAPI WSKReceiveFromUnsafe(
+    _In_ PWSK_SOCKET    Socket,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _Reserved_ ULONG    Flags,
+    _Out_opt_ PSOCKADDR RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength,
+    _In_opt_ ULONG      TimeoutMilliseconds,
+    _In_opt_ WSKOVERLAPPED* Overlapped,
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ PSOCKET_CONTEXT SocketContext
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    WSK_CONTEXT_IRP* WSKContext = nullptr;
+
+    do
+    {
+        if (NumberOfBytesRecvd)
+        {
+            *NumberOfBytesRecvd = 0;
+        }
+
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (RemoteAddress)
+        {
+            if (RemoteAddressLength < sizeof SOCKADDR)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+        }
+
+        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped, true, nullptr, 0, Buffer, BufferLength);
+        if (WSKContext == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        ULONG ControlFlags  = 0;
+        ULONG ControlLength = 0;
+
+        WSKContext->Receive = TRUE;
+
+        WSKTrackContextIRP(WSKContext, SocketContext);
+        WSKArmContextIRP(WSKContext, TimeoutMilliseconds);
+
+        Status = static_cast<const WSK_PROVIDER_DATAGRAM_DISPATCH*>(Socket->Dispatch)->WskReceiveFrom(
+            Socket,
+            &WSKContext->OutputBuffer,
+            Flags,
+            RemoteAddress,
+            &ControlLength,
+            nullptr,
+            &ControlFlags,
+            WSKContext->Irp);
+
+        if (Overlapped == nullptr)
+        {
+            Status = WSKWaitContextIRP(WSKContext, Status, TimeoutMilliseconds);
+
+            if (NumberOfBytesRecvd)
+            {
+                *NumberOfBytesRecvd = WSKContext->Irp->IoStatus.Information;
+            }
+
+            WSKFreeContextIRP(WSKContext);
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+template<typename Kind>
+static VOID WSKAPI WSKResolveDispatchUnsafe(
+    _In_ PWSK_SOCKET        Socket,
+    _Out_ WSKSOCKETDISPATCH* Dispatch
+)
+{
+    const auto Connected = Kind::Connected(Socket);
+    if (Connected)
+    {
+        Dispatch->Socket  = Connected;
+        Dispatch->Send    = static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskSend;
+        Dispatch->Receive = static_cast<const typename Kind::Connection*>(Connected->Dispatch)->WskReceive;
+    }
+}
+
+// What a socket can do, picked once when it enters the table. nullptr is not supported by the kind.
+struct WSK_SOCKET_KIND
+{
+    decltype(&WSKAcceptUnsafe)                               Accept;
+    decltype(&WSKListenUnsafe)                               Listen;
+    decltype(&WSKDisconnectUnsafe<WSK_CONNECTION_KIND>)      Disconnect;
+    decltype(&WSKSendUnsafe<WSK_CONNECTION_KIND>)            Send;
+    decltype(&WSKSendBuffersUnsafe<WSK_CONNECTION_KIND>)     SendBuffers;
+    decltype(&WSKTransmitFileUnsafe<WSK_CONNECTION_KIND>)    TransmitFile;
+    decltype(&WSKSendToUnsafe)                               SendTo;
+    decltype(&WSKReceiveUnsafe<WSK_CONNECTION_KIND>)         Receive;
+    decltype(&WSKReceiveFromUnsafe)                          ReceiveFrom;
+    decltype(&WSKResolveDispatchUnsafe<WSK_CONNECTION_KIND>) Resolve;
+};
+
+static const WSK_SOCKET_KIND WSKStreamKind =
+{
+    WSKAcceptUnsafe,
+    WSKListenUnsafe,
+    WSKDisconnectUnsafe<WSK_STREAM_KIND>,
+    WSKSendUnsafe<WSK_STREAM_KIND>,
+    WSKSendBuffersUnsafe<WSK_STREAM_KIND>,
+    WSKTransmitFileUnsafe<WSK_STREAM_KIND>,
+    nullptr,
+    WSKReceiveUnsafe<WSK_STREAM_KIND>,
+    nullptr,
+    WSKResolveDispatchUnsafe<WSK_STREAM_KIND>,
+};
+
+static const WSK_SOCKET_KIND WSKConnectionKind =
+{
+    nullptr,
+    nullptr,
+    WSKDisconnectUnsafe<WSK_CONNECTION_KIND>,
+    WSKSendUnsafe<WSK_CONNECTION_KIND>,
+    WSKSendBuffersUnsafe<WSK_CONNECTION_KIND>,
+    WSKTransmitFileUnsafe<WSK_CONNECTION_KIND>,
+    nullptr,
+    WSKReceiveUnsafe<WSK_CONNECTION_KIND>,
+    nullptr,
+    WSKResolveDispatchUnsafe<WSK_CONNECTION_KIND>,
+};
+
+static const WSK_SOCKET_KIND WSKDatagramKind =
+{
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    WSKSendToUnsafe,
+    nullptr,
+    WSKReceiveFromUnsafe,
+    nullptr,
+};
+
+static const WSK_SOCKET_KIND WSKBasicKind = {};
+
+static const WSK_SOCKET_KIND* WSKAPI WSKSocketKind(
+    _In_ ULONG WskSocketType
+)
+{
+    switch (WskSocketType)
+    {
+    case WSK_FLAG_STREAM_SOCKET:
+        return &WSKStreamKind;
+    case WSK_FLAG_CONNECTION_SOCKET:
+        return &WSKConnectionKind;
+    case WSK_FLAG_DATAGRAM_SOCKET:
+        return &WSKDatagramKind;
+    default:
+        return &WSKBasicKind;
+    }
+}
+
+template<typename Kind>
+static PFN_WSK_DISCONNECT WSKDisconnectRoutine(
+    _In_  PWSK_SOCKET  Socket,
+    _Out_ PWSK_SOCKET* Connected
+)
+{
+    *Connected = Kind::Connected(Socket);
+    if (*Connected == nullptr)
+    {
+        return nullptr;
+    }
+
+    return static_cast<const typename Kind::Connection*>((*Connected)->Dispatch)->WskDisconnect;
+}
+
+// For the requests the library issues on its own IRPs. These run once per socket or per call,
+// the kind is picked from the socket type. nullptr if the socket is not connected.
+static PFN_WSK_DISCONNECT WSKAPI WSKResolveDisconnect(
+    _In_  PWSK_SOCKET  Socket,
+    _In_  ULONG        WskSocketType,
+    _Out_ PWSK_SOCKET* Connected
+)
+{
+    *Connected = nullptr;
+
+    switch (WskSocketType)
+    {
+    case WSK_FLAG_CONNECTION_SOCKET:
+        return WSKDisconnectRoutine<WSK_CONNECTION_KIND>(Socket, Connected);
+    case WSK_FLAG_STREAM_SOCKET:
+        return WSKDisconnectRoutine<WSK_STREAM_KIND>(Socket, Connected);
+    default:
+        return nullptr;
+    }
+}
+
+static NTSTATUS WSKSpliceCompletion(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_reads_opt_(_Inexpressible_("varies")) PVOID Context
+)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    auto Request = static_cast<WSK_SPLICE_REQUEST*>(Context);
+
+    InterlockedExchange(&Request->Done, TRUE);
+    KeSetEvent(Request->Progress, IO_NO_INCREMENT, FALSE);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static VOID WSKAPI WSKSpliceReuse(
+    _In_ WSK_SPLICE_REQUEST* Request,
+    _In_ ULONG State
+)
+{
+    IoReuseIrp(Request->Irp, STATUS_UNSUCCESSFUL);
+    IoSetCompletionRoutine(Request->Irp, &WSKSpliceCompletion, Request, TRUE, TRUE, TRUE);
+
+    Request->State = State;
+    Request->Done  = FALSE;
+}
+
+static VOID WSKAPI WSKSpliceFail(
+    _In_ WSK_SPLICE* Splice,
+    _In_ NTSTATUS    Status
+)
+{
+    if (!NT_SUCCESS(Splice->Status))
+    {
+        return;
+    }
+
+    Splice->Status = Status;
+
+    for (auto& Direction : Splice->Directions)
+    {
+        if (Direction.Disconnect.State != WSK_SPLICE_IDLE)
+        {
+            IoCancelIrp(Direction.Disconnect.Irp);
+        }
+
+        for (ULONG Index = 0; Index < Splice->BufferCount; ++Index)
+        {
+            if (Direction.Buffers[Index].State != WSK_SPLICE_IDLE)
+            {
+                IoCancelIrp(Direction.Buffers[Index].Irp);
+            }
+        }
+    }
+}
+
+// Moves every finished request of the direction on, returns FALSE if none was.
+static BOOLEAN WSKAPI WSKSpliceStep(
+    _In_ WSK_SPLICE* Splice,
+    _In_ WSK_SPLICE_DIRECTION* Direction
+)
+{
+    BOOLEAN Progress = FALSE;
+    BOOLEAN Busy     = FALSE;
+
+    if (Direction->Finished)
+    {
+        return FALSE;
+    }
+
+    // Sends done, the buffers can take the next receive.
+    for (ULONG Index = 0; Index < Splice->BufferCount; ++Index)
+    {
+        auto Request = &Direction->Buffers[Index];
+
+        if (Request->State == WSK_SPLICE_SENDING && Request->Done)
+        {
+            Request->State = WSK_SPLICE_IDLE;
+            Progress = TRUE;
+
+            if (!NT_SUCCESS(Request->Irp->IoStatus.Status))
+            {
+                WSKSpliceFail(Splice, Request->Irp->IoStatus.Status);
+                continue;
+            }
+
+            Direction->Bytes += Request->Irp->IoStatus.Information;
+            WSKTouchSocketContext(Direction->ToContext);
+        }
+    }
+
+    // Receives done, sent on in the order they were issued.
+    for (;;)
+    {
+        auto Request = &Direction->Buffers[Direction->Forward];
+
+        if (Request->State != WSK_SPLICE_RECEIVING || !Request->Done)
+        {
+            break;
+        }
+
+        Direction->Forward = (Direction->Forward + 1) % Splice->BufferCount;
+        Progress = TRUE;
+
+        const NTSTATUS  Status = Request->Irp->IoStatus.Status;
+        const ULONG_PTR Bytes  = Request->Irp->IoStatus.Information;
+
+        if (!NT_SUCCESS(Status))
+        {
+            WSKSpliceFail(Splice, Status);
+        }
+
+        // A zero-byte receive is the FIN of the peer, the receives behind it complete the same way.
+        if (!NT_SUCCESS(Status) || Bytes == 0 || Direction->Eof || !NT_SUCCESS(Splice->Status))
+        {
+            Direction->Eof = TRUE;
+            Request->State = WSK_SPLICE_IDLE;
+            continue;
+        }
+
+        WSKTouchSocketContext(Direction->FromContext);
+
+        Request->Buffer.Length = Bytes;
+
+        WSKSpliceReuse(Request, WSK_SPLICE_SENDING);
+        Direction->SendRoutine(Direction->To, &Request->Buffer, 0u, Request->Irp);
+    }
+
+    // Keeps every idle buffer receiving, in ring order.
+    while (!Direction->Eof && NT_SUCCESS(Splice->Status))
+    {
+        auto Request = &Direction->Buffers[Direction->Receive];
+
+        if (Request->State != WSK_SPLICE_IDLE)
+        {
+            break;
+        }
+
+        Direction->Receive = (Direction->Receive + 1) % Splice->BufferCount;
+        Progress = TRUE;
+
+        Request->Buffer.Length = Splice->BufferSize;
+
+        WSKSpliceReuse(Request, WSK_SPLICE_RECEIVING);
+        Direction->ReceiveRoutine(Direction->From, &Request->Buffer, 0u, Request->Irp);
+    }
+
+    for (ULONG Index = 0; Index < Splice->BufferCount; ++Index)
+    {
+        Busy |= (Direction->Buffers[Index].State != WSK_SPLICE_IDLE);
+    }
+
+    if (Busy)
+    {
+        return Progress;
+    }
+
+    auto Disconnect = &Direction->Disconnect;
+
+    if (Disconnect->State == WSK_SPLICE_SENDING)
+    {
+        if (Disconnect->Done)
+        {
+            Disconnect->State   = WSK_SPLICE_IDLE;
+            Direction->Finished = TRUE;
+            Progress = TRUE;
+
+            if (!NT_SUCCESS(Disconnect->Irp->IoStatus.Status))
+            {
+                WSKSpliceFail(Splice, Disconnect->Irp->IoStatus.Status);
+            }
+        }
+    }
+    else if (!NT_SUCCESS(Splice->Status))
+    {
+        Direction->Finished = TRUE;
+        Progress = TRUE;
+    }
+    else if (Direction->Eof)
+    {
+        // Everything received is sent, pass the half-close on.
+        Progress = TRUE;
+
+        WSKSpliceReuse(Disconnect, WSK_SPLICE_SENDING);
+        Direction->DisconnectRoutine(Direction->To, nullptr, 0u, Disconnect->Irp);
+    }
+
+    return Progress;
+}
+
+static VOID WSKAPI WSKFreeSplice(
+    _In_ WSK_SPLICE* Splice
+)
+{
+    for (auto& Direction : Splice->Directions)
+    {
+        if (Direction.Disconnect.Irp)
+        {
+            IoFreeIrp(Direction.Disconnect.Irp);
+        }
+
+        for (auto& Request : Direction.Buffers)
+        {
+            if (Request.Irp)
+            {
+                IoFreeIrp(Request.Irp);
+            }
+
+            if (Request.Buffer.Mdl)
+            {
+                IoFreeMdl(Request.Buffer.Mdl);
+            }
+
+            if (Request.Data)
+            {
+                ExFreePoolWithTag(Request.Data, WSK_POOL_TAG);
+            }
+        }
+    }
+
+    ExFreePoolWithTag(Splice, WSK_POOL_TAG);
+}
+
+static WSK_SPLICE* WSKAPI WSKAllocSplice(
+    _In_ ULONG BufferSize,
+    _In_ ULONG BufferCount
+)
+{
+    auto Splice = static_cast<WSK_SPLICE*>(ExAllocatePoolZero(NonPagedPool, sizeof(WSK_SPLICE), WSK_POOL_TAG));
+    if (Splice == nullptr)
+    {
+        return nullptr;
+    }
+
+    KeInitializeEvent(&Splice->Progress, SynchronizationEvent, FALSE);
+
+    Splice->BufferSize  = BufferSize;
+    Splice->BufferCount = BufferCount;
+    Splice->Status      = STATUS_SUCCESS;
+
+    for (auto& Direction : Splice->Directions)
+    {
+        Direction.Disconnect.Progress = &Splice->Progress;
+        Direction.Disconnect.Irp = IoAllocateIrp(1, FALSE);
+        if (Direction.Disconnect.Irp == nullptr)
+        {
+            WSKFreeSplice(Splice);
+            return nullptr;
+        }
+
+        for (ULONG Index = 0; Index < BufferCount; ++Index)
+        {
+            auto Request = &Direction.Buffers[Index];
+
+            Request->Progress = &Splice->Progress;
+            Request->Irp  = IoAllocateIrp(1, FALSE);
+            Request->Data = ExAllocatePoolZero(NonPagedPool, BufferSize, WSK_POOL_TAG);
+            if (Request->Irp == nullptr || Request->Data == nullptr)
+            {
+                WSKFreeSplice(Splice);
+                return nullptr;
+            }
+
+            Request->Buffer.Mdl = IoAllocateMdl(Request->Data, BufferSize, FALSE, FALSE, nullptr);
+            if (Request->Buffer.Mdl == nullptr)
+            {
+                WSKFreeSplice(Splice);
+                return nullptr;
+            }
+
+            MmBuildMdlForNonPagedPool(Request->Buffer.Mdl);
+        }
+    }
+
+    return Splice;
+}
+
+static NTSTATUS WSKAPI WSKSpliceUnsafe(
+    _In_ const SOCKET_OBJECT* Source,
+    _In_ const SOCKET_OBJECT* Destination,
+    _In_ const WSKSPLICEOPTIONS* Options,
+    _Out_opt_ WSKSPLICESTATS* Statistics
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        // Both ends are resolved to their connected provider sockets once, up front.
+        WSKSOCKETDISPATCH  Ends[2]{};
+        PFN_WSK_DISCONNECT Disconnects[2]{};
+
+        Source->Kind->Resolve(Source->Socket, &Ends[0]);
+        Destination->Kind->Resolve(Destination->Socket, &Ends[1]);
+
+        PWSK_SOCKET Connected = nullptr;
+
+        Disconnects[0] = WSKResolveDisconnect(Source->Socket, Source->SocketType, &Connected);
+        Disconnects[1] = WSKResolveDisconnect(Destination->Socket, Destination->SocketType, &Connected);
+
+        if (Ends[0].Socket == nullptr || Ends[1].Socket == nullptr ||
+            Disconnects[0] == nullptr || Disconnects[1] == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        Ends[0].Context = Source->Context;
+        Ends[1].Context = Destination->Context;
+
+        const ULONG BufferSize  = Options->BufferSize  ? Options->BufferSize  : 64u * 1024u;
+        const ULONG BufferCount = Options->BufferCount ? Options->BufferCount : 4u;
+
+        if (BufferCount > WSK_SPLICE_MAX_BUFFERS)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        auto Splice = WSKAllocSplice(BufferSize, BufferCount);
+        if (Splice == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        for (ULONG Index = 0; Index < _countof(Splice->Directions); ++Index)
+        {
+            auto Direction = &Splice->Directions[Index];
+            auto From      = &Ends[Index];
+            auto To        = &Ends[1 - Index];
+
+            Direction->From              = From->Socket;
+            Direction->ReceiveRoutine    = From->Receive;
+            Direction->FromContext       = static_cast<PSOCKET_CONTEXT>(From->Context);
+            Direction->To                = To->Socket;
+            Direction->SendRoutine       = To->Send;
+            Direction->DisconnectRoutine = Disconnects[1 - Index];
+            Direction->ToContext         = static_cast<PSOCKET_CONTEXT>(To->Context);
+        }
+
+        if (Options->Flags & WSK_SPLICE_ONE_WAY)
+        {
+            Splice->Directions[1].Finished = TRUE;
+        }
+
+        PKEVENT CancelEvent = Options->CancelEvent;
+
+        for (;;)
+        {
+            BOOLEAN Progress = FALSE;
+
+            for (auto& Direction : Splice->Directions)
+            {
+                Progress |= WSKSpliceStep(Splice, &Direction);
+            }
+
+            if (Splice->Directions[0].Finished && Splice->Directions[1].Finished)
+            {
+                break;
+            }
+
+            if (Progress)
+            {
+                continue;
+            }
+
+            PVOID Objects[] = { &Splice->Progress, CancelEvent };
+
+            const NTSTATUS WaitStatus = KeWaitForMultipleObjects(CancelEvent ? 2u : 1u, Objects, WaitAny,
+                Executive, KernelMode, FALSE, nullptr, nullptr);
+            if (WaitStatus == STATUS_WAIT_1)
+            {
+                WSKSpliceFail(Splice, STATUS_CANCELLED);
+                CancelEvent = nullptr;
+            }
+        }
+
+        Status = Splice->Status;
+
+        if (Statistics)
+        {
+            Statistics->SourceToDestination = Splice->Directions[0].Bytes;
+            Statistics->DestinationToSource = Splice->Directions[1].Bytes;
+        }
+
+        WSKFreeSplice(Splice);
+
+    } while (false);
+
+    return Status;
+}
+
+static BOOLEAN WSKAPI WSKAddrInfoNameEqual(
+    _In_ const UNICODE_STRING* Name1,
+    _In_ const UNICODE_STRING* Name2
+)
+{
+    // Host names are compared ASCII case-insensitively, this is safe at DISPATCH_LEVEL.
+
+    if (Name1->Length != Name2->Length)
+    {
+        return FALSE;
+    }
+
+    for (USHORT Idx = 0; Idx < Name1->Length / sizeof(WCHAR); ++Idx)
+    {
+        WCHAR Char1 = Name1->Buffer[Idx];
+        WCHAR Char2 = Name2->Buffer[Idx];
+
+        if (Char1 >= L'A' && Char1 <= L'Z') Char1 += (L'a' - L'A');
+        if (Char2 >= L'A' && Char2 <= L'Z') Char2 += (L'a' - L'A');
+
+        if (Char1 != Char2)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN WSKAPI WSKAddrInfoFlightEqual(
+    _In_ const WSK_ADDRINFO_FLIGHT* Flight1,
+    _In_ const WSK_ADDRINFO_FLIGHT* Flight2
+)
+{
+    if (Flight1->Namespace   != Flight2->Namespace   ||
+        Flight1->HasProvider != Flight2->HasProvider ||
+        Flight1->HasHints    != Flight2->HasHints)
+    {
+        return FALSE;
+    }
+
+    if (Flight1->HasProvider && !IsEqualGUID(Flight1->Provider, Flight2->Provider))
+    {
+        return FALSE;
+    }
+
+    if (Flight1->HasHints)
+    {
+        if (Flight1->HintsFlags      != Flight2->HintsFlags      ||
+            Flight1->HintsFamily     != Flight2->HintsFamily     ||
+            Flight1->HintsSocketType != Flight2->HintsSocketType ||
+            Flight1->HintsProtocol   != Flight2->HintsProtocol)
+        {
+            return FALSE;
+        }
+    }
+
+    if ((Flight1->NodeName.Buffer    == nullptr) != (Flight2->NodeName.Buffer    == nullptr) ||
+        (Flight1->ServiceName.Buffer == nullptr) != (Flight2->ServiceName.Buffer == nullptr))
+    {
+        return FALSE;
+    }
+
+    return WSKAddrInfoNameEqual(&Flight1->NodeName, &Flight2->NodeName) &&
+        WSKAddrInfoNameEqual(&Flight1->ServiceName, &Flight2->ServiceName);
+}
+
+static WSK_ADDRINFO_FLIGHT* WSKAPI WSKAllocAddrInfoFlight(
+    _In_opt_ LPCWSTR        NodeName,
+    _In_opt_ LPCWSTR        ServiceName,
+    _In_     UINT32         Namespace,
+    _In_opt_ GUID*          Provider,
+    _In_opt_ PADDRINFOEXW   Hints
+)
+{
+    // The key is copied to NonPagedPool, the flight table is searched under a spin lock.
+
+    const SIZE_T NodeNameLength    = NodeName    ? wcslen(NodeName)    : 0u;
+    const SIZE_T ServiceNameLength = ServiceName ? wcslen(ServiceName) : 0u;
+
+    if (NodeNameLength >= UNICODE_STRING_MAX_CHARS || ServiceNameLength >= UNICODE_STRING_MAX_CHARS)
+    {
+        return nullptr;
+    }
+
+    auto Flight = static_cast<WSK_ADDRINFO_FLIGHT*>(ExAllocatePoolZero(NonPagedPool,
+        sizeof(WSK_ADDRINFO_FLIGHT) + (NodeNameLength + ServiceNameLength + 2) * sizeof(WCHAR), WSK_POOL_TAG));
+    if (Flight == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto Names = reinterpret_cast<PWCH>(Flight + 1);
+
+    if (NodeName)
+    {
+        RtlCopyMemory(Names, NodeName, NodeNameLength * sizeof(WCHAR));
+        RtlInitEmptyUnicodeString(&Flight->NodeName, Names, static_cast<USHORT>((NodeNameLength + 1) * sizeof(WCHAR)));
+        Flight->NodeName.Length = static_cast<USHORT>(NodeNameLength * sizeof(WCHAR));
+
+        Names += NodeNameLength + 1;
+    }
+
+    if (ServiceName)
+    {
+        RtlCopyMemory(Names, ServiceName, ServiceNameLength * sizeof(WCHAR));
+        RtlInitEmptyUnicodeString(&Flight->ServiceName, Names, static_cast<USHORT>((ServiceNameLength + 1) * sizeof(WCHAR)));
+        Flight->ServiceName.Length = static_cast<USHORT>(ServiceNameLength * sizeof(WCHAR));
+    }
+
+    Flight->Namespace = Namespace;
+
+    if (Provider)
+    {
+        Flight->HasProvider = TRUE;
+        Flight->Provider    = *Provider;
+    }
+
+    if (Hints)
+    {
+        Flight->HasHints        = TRUE;
+        Flight->HintsFlags      = Hints->ai_flags;
+        Flight->HintsFamily     = Hints->ai_family;
+        Flight->HintsSocketType = Hints->ai_socktype;
+        Flight->HintsProtocol   = Hints->ai_protocol;
+    }
+
+    Flight->RefCount = 1; // The lookup itself, released when it completes.
+    Flight->Status   = STATUS_PENDING;
+
+    InitializeListHead(&Flight->Link);
+    InitializeListHead(&Flight->OverlappedWaiters);
+
+    KeInitializeEvent(&Flight->Event, NotificationEvent, FALSE);
+
+    return Flight;
+}
+
+static LIST_ENTRY* WSKAPI WSKAddrInfoBucket(
+    _In_ const ADDRINFOEXW* Result
+)
+{
+    // Pool blocks are at least 16 byte aligned, the low bits carry nothing.
+    auto Hash = static_cast<ULONG64>(reinterpret_cast<ULONG_PTR>(Result) >> 4) * 0x9E3779B97F4A7C15ull;
+
+    return &WSKAddrInfoShared[(Hash >> 32) & (WSK_ADDRINFO_BUCKETS - 1)];
+}
+
+static VOID WSKAPI WSKReleaseAddrInfoFlight(
+    _In_ WSK_ADDRINFO_FLIGHT* Flight
+)
+{
+    if (InterlockedDecrement(&Flight->RefCount) == 0)
+    {
+        WSKFreeContextIRP(Flight->WSKContext);
+
+        if (Flight->Shared)
+        {
+            ExFreePoolWithTag(Flight->Shared, WSK_POOL_TAG);
+        }
+
+        ExFreePoolWithTag(Flight, WSK_POOL_TAG);
+    }
+}
+
+static VOID WSKAPI WSKCompleteAddrInfoFlight(
+    _In_ WSK_ADDRINFO_FLIGHT* Flight,
+    _In_ NTSTATUS Status
+)
+{
+    // May run at DISPATCH_LEVEL, from the completion routine.
+
+    LIST_ENTRY Waiters;
+    InitializeListHead(&Waiters);
+
+    KIRQL Irql = PASSIVE_LEVEL;
+    KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+    {
+        Flight->Completed = TRUE;
+        Flight->Status    = Status;
+
+        if (!IsListEmpty(&Flight->Link))
+        {
+            RemoveEntryList(&Flight->Link);
+            InitializeListHead(&Flight->Link);
+        }
+
+        if (Flight->Result && Flight->Waiters != 1)
+        {
+            auto Shared = Flight->Shared;
+            Flight->Shared = nullptr;
+
+            Shared->Result   = Flight->Result;
+            Shared->RefCount = Flight->Waiters;
+
+            if (Flight->Waiters == 0)
+            {
+                // WskFreeAddressInfo requires PASSIVE_LEVEL, the next caller frees it.
+                InsertTailList(&WSKAddrInfoOrphans, &Shared->Link);
+                Flight->Result = nullptr;
+            }
+            else
+            {
+                InsertTailList(WSKAddrInfoBucket(Shared->Result), &Shared->Link);
+            }
+        }
+
+        while (!IsListEmpty(&Flight->OverlappedWaiters))
+        {
+            InsertTailList(&Waiters, RemoveHeadList(&Flight->OverlappedWaiters));
+        }
+    }
+    KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+    while (!IsListEmpty(&Waiters))
+    {
+        auto Waiter = CONTAINING_RECORD(RemoveHeadList(&Waiters), WSK_ADDRINFO_WAITER, Link);
+        auto Overlapped = Waiter->Overlapped;
+
+        Overlapped->Pointer      = Flight->Result;
+        Overlapped->InternalHigh = 0u;
+        Overlapped->Internal     = Status;
+
+        if (Waiter->CompletionRoutine)
+        {
+            __try
+            {
+                Waiter->CompletionRoutine(Status, 0u, Overlapped);
+            }
+            __except (EXCEPTION_EXECUTE_HANDLER)
+            {
+                __nop();
+            }
+        }
+
+        KeSetEvent(&Overlapped->Event, IO_NO_INCREMENT, FALSE);
+        ExFreePoolWithTag(Waiter, WSK_POOL_TAG);
+    }
+
+    KeSetEvent(&Flight->Event, IO_NO_INCREMENT, FALSE);
+    WSKReleaseAddrInfoFlight(Flight);
+}
+
+static NTSTATUS WSKAddrInfoFlightCompletionRoutine(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_reads_opt_(_Inexpressible_("varies")) PVOID Context
+)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    auto Flight = static_cast<WSK_ADDRINFO_FLIGHT*>(Context);
+    if (Flight == nullptr)
+    {
+        __debugbreak();
+        return STATUS_INVALID_ADDRESS;
+    }
+
+    WSKCompleteAddrInfoFlight(Flight, Irp->IoStatus.Status);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static VOID WSKAPI WSKFreeAddrInfoList(
+    _In_ LIST_ENTRY* List
+)
+{
+    PAGED_CODE();
+
+    LIST_ENTRY Entries;
+    InitializeListHead(&Entries);
+
+    KIRQL Irql = PASSIVE_LEVEL;
+    KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+    {
+        while (!IsListEmpty(List))
+        {
+            InsertTailList(&Entries, RemoveHeadList(List));
+        }
+    }
+    KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+    while (!IsListEmpty(&Entries))
+    {
+        auto Shared = CONTAINING_RECORD(RemoveHeadList(&Entries), WSK_ADDRINFO_SHARED, Link);
+        if (!Shared->Local)
+        {
+            WSKNPIProvider.Dispatch->WskFreeAddressInfo(WSKNPIProvider.Client, Shared->Result);
+        }
+
+        ExFreePoolWithTag(Shared, WSK_POOL_TAG);
+    }
+}
+
+static BOOLEAN WSKAPI WSKParseNumericService(
+    _In_opt_ LPCWSTR ServiceName,
+    _Out_    USHORT* Port
+)
+{
+    ULONG Value = 0u;
+
+    *Port = 0u;
+
+    if (ServiceName == nullptr)
+    {
+        return TRUE;
+    }
+
+    if (ServiceName[0] == L'\0')
+    {
+        return FALSE;
+    }
+
+    for (auto Char = ServiceName; *Char; ++Char)
+    {
+        if (*Char < L'0' || *Char > L'9')
+        {
+            return FALSE;
+        }
+
+        Value = Value * 10u + (*Char - L'0');
+        if (Value > MAXUSHORT)
+        {
+            return FALSE;
+        }
+    }
+
+    *Port = RtlUshortByteSwap(static_cast<USHORT>(Value));
+    return TRUE;
+}
+
+static NTSTATUS WSKAPI WSKGetAddrInfoNumeric(
+    _In_opt_ LPCWSTR        NodeName,
+    _In_opt_ LPCWSTR        ServiceName,
+    _In_     UINT32         Namespace,
+    _In_opt_ GUID*          Provider,
+    _In_opt_ PADDRINFOEXW   Hints,
+    _Outptr_result_maybenull_ PADDRINFOEXW* Result
+)
+{
+    // Literal hosts with a numeric (or no) service are answered without a provider request.
+    // STATUS_NOT_SUPPORTED means the query has to go to the provider.
+
+    constexpr INT NumericFlags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+    *Result = nullptr;
+
+    if (NodeName == nullptr || Provider != nullptr || (Namespace != NS_ALL && Namespace != NS_DNS))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (Hints && (Hints->ai_flags & ~NumericFlags) != 0)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    USHORT Port = 0u;
+    if (!WSKParseNumericService(ServiceName, &Port))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    SOCKADDR_INET Address{};
+    PCWSTR Terminator = nullptr;
+
+    if (NT_SUCCESS(WSKIpv4StringToAddress(NodeName, TRUE, &Terminator, &Address.Ipv4.sin_addr)) &&
+        *Terminator == L'\0')
+    {
+        Address.Ipv4.sin_family = AF_INET;
+        Address.Ipv4.sin_port   = Port;
+    }
+    else if (NT_SUCCESS(WSKIpv6StringToAddress(NodeName, &Terminator, &Address.Ipv6.sin6_addr)) &&
+        (*Terminator == L'\0' || *Terminator == L'%'))
+    {
+        Address.Ipv6.sin6_family = AF_INET6;
+        Address.Ipv6.sin6_port   = Port;
+
+        if (*Terminator == L'%')
+        {
+            ULONG ScopeId = 0u;
+
+            if (Terminator[1] == L'\0')
+            {
+                return STATUS_NOT_SUPPORTED;
+            }
+
+            for (auto Char = Terminator + 1; *Char; ++Char)
+            {
+                if (*Char < L'0' || *Char > L'9' || ScopeId > (MAXULONG - 9u) / 10u)
+                {
+                    return STATUS_NOT_SUPPORTED;
+                }
+
+                ScopeId = ScopeId * 10u + (*Char - L'0');
+            }
+
+            Address.Ipv6.sin6_scope_id = ScopeId;
+        }
+    }
+    else
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (Hints && Hints->ai_family != AF_UNSPEC && Hints->ai_family != Address.si_family)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    auto Local = static_cast<WSK_ADDRINFO_LOCAL*>(ExAllocatePoolZero(NonPagedPool,
+        sizeof(WSK_ADDRINFO_LOCAL), WSK_POOL_TAG));
+    if (Local == nullptr)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Local->Address = Address;
+
+    Local->Info.ai_family   = Address.si_family;
+    Local->Info.ai_socktype = Hints ? Hints->ai_socktype : 0;
+    Local->Info.ai_protocol = Hints ? Hints->ai_protocol : 0;
+    Local->Info.ai_addr     = reinterpret_cast<PSOCKADDR>(&Local->Address);
+    Local->Info.ai_addrlen  = (Address.si_family == AF_INET) ? sizeof Address.Ipv4 : sizeof Address.Ipv6;
+
+    Local->Record.Result    = &Local->Info;
+    Local->Record.RefCount  = 1;
+    Local->Record.Local     = TRUE;
+
+    KIRQL Irql = PASSIVE_LEVEL;
+    KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+    {
+        InsertTailList(WSKAddrInfoBucket(&Local->Info), &Local->Record.Link);
+    }
+    KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+    *Result = &Local->Info;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS WSKAPI WSKStartConnectAttempt(
+    _In_ WSK_CONNECT_ATTEMPT* Attempt
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        auto RemoteAddress = Attempt->Address->ai_addr;
+
+        Attempt->Context = WSKAllocSocketContext();
+        if (Attempt->Context == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Status = WSKSocketUnsafe(&Attempt->Socket, static_cast<ADDRESS_FAMILY>(RemoteAddress->sa_family),
+            SOCK_STREAM, IPPROTO_TCP, WSK_FLAG_CONNECTION_SOCKET, nullptr, Attempt->Context);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        SOCKADDR_STORAGE LocalAddress{};
+        LocalAddress.ss_family = RemoteAddress->sa_family;
+
+        Status = WSKBindUnsafe(Attempt->Socket, WSK_FLAG_CONNECTION_SOCKET,
+            reinterpret_cast<PSOCKADDR>(&LocalAddress), sizeof LocalAddress);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Attempt->WSKContext = WSKAllocContextIRP(nullptr, nullptr);
+        if (Attempt->WSKContext == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        auto Dispatch = static_cast<const WSK_PROVIDER_CONNECTION_DISPATCH*>(Attempt->Socket->Dispatch);
+
+        // Completion is observed through WSKContext->Event.
+        Dispatch->WskConnect(Attempt->Socket, RemoteAddress, 0, Attempt->WSKContext->Irp);
+
+    } while (false);
+
+    return Status;
+}
+
+static VOID WSKAPI WSKFinishConnectAttempt(
+    _In_ WSK_CONNECT_ATTEMPT* Attempt,
+    _In_ BOOLEAN Close
+)
+{
+    if (Attempt->WSKContext)
+    {
+        if (!Attempt->Done)
+        {
+            IoCancelIrp(Attempt->WSKContext->Irp);
+            KeWaitForSingleObject(&Attempt->WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
+        }
+
+        WSKFreeContextIRP(Attempt->WSKContext);
+        Attempt->WSKContext = nullptr;
+    }
+
+    if (Close && Attempt->Socket)
+    {
+        WSKCloseSocketUnsafe(Attempt->Socket, WSK_FLAG_CONNECTION_SOCKET);
+        Attempt->Socket = nullptr;
+    }
+
+    if (Close && Attempt->Context)
+    {
+        WSKReleaseSocketContext(Attempt->Context);
+        Attempt->Context = nullptr;
+    }
+
+    Attempt->Done = TRUE;
+}
+
+// Event callbacks are turned on the first time a socket is polled,
+// sockets that are never polled keep the plain IRP behavior.
+static NTSTATUS WSKAPI WSKEnableSocketEvents(
+    _In_ const SOCKET_OBJECT* SocketObject
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    auto     Context = SocketObject->Context;
+
+    do
+    {
+        ULONG EventMask = 0u;
+        ULONG State     = 0u;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            State = Context->State;
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        if (State & WSK_SOCKET_STATE_CLOSED)
+        {
+            break;
+        }
+
+        if (State & WSK_SOCKET_STATE_LISTENING)
+        {
+            EventMask = WSK_EVENT_ACCEPT;
+        }
+        else if (State & WSK_SOCKET_STATE_DATAGRAM)
+        {
+            EventMask = WSK_EVENT_RECEIVE_FROM;
+        }
+        else if (State & WSK_SOCKET_STATE_CONNECTED)
+        {
+            EventMask = WSK_EVENT_RECEIVE | WSK_EVENT_DISCONNECT;
+        }
+
+        if ((Context->EventMask & EventMask) == EventMask)
+        {
+            break;
+        }
+
+        WSK_EVENT_CALLBACK_CONTROL Control{};
+        Control.NpiId     = &NPI_WSK_INTERFACE_ID;
+        Control.EventMask = EventMask;
+
+        Status = WSKControlSocketUnsafe(SocketObject->Socket, SocketObject->SocketType, WskSetOption,
+            SO_WSK_EVENT_CALLBACK, SOL_SOCKET, &Control, sizeof Control, nullptr, 0, nullptr, nullptr, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        InterlockedOr(reinterpret_cast<volatile LONG*>(&Context->EventMask), static_cast<LONG>(EventMask));
+
+    } while (false);
+
+    return Status;
+}
+
+static SHORT WSKAPI WSKPollSocketContext(
+    _In_ PSOCKET_CONTEXT Context,
+    _In_ SHORT Events
+)
+{
+    SHORT ReturnedEvents = 0;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        const auto State = Context->State;
+
+        if (State & WSK_SOCKET_STATE_CLOSED)
+        {
+            ReturnedEvents |= WSK_POLLNVAL;
+        }
+        else if (State & WSK_SOCKET_STATE_LISTENING)
+        {
+            if (Context->AcceptCount)
+            {
+                ReturnedEvents |= WSK_POLLRDNORM;
+            }
+        }
+        else if (State & (WSK_SOCKET_STATE_DATAGRAM | WSK_SOCKET_STATE_CONNECTED))
+        {
+            if (State & (WSK_SOCKET_STATE_READABLE | WSK_SOCKET_STATE_PEERCLOSED | WSK_SOCKET_STATE_ABORTED))
+            {
+                ReturnedEvents |= WSK_POLLRDNORM;
+            }
+
+            // Sends are queued by the provider, only nonblocking sends are bounded.
+            if (!(State & (WSK_SOCKET_STATE_ABORTED | WSK_SOCKET_STATE_CONNECTING)) &&
+                Context->SendBuffered < WSK_NONBLOCKING_SEND_BUFFER)
+            {
+                ReturnedEvents |= WSK_POLLWRNORM;
+            }
+        }
+
+        if (State & (WSK_SOCKET_STATE_PEERCLOSED | WSK_SOCKET_STATE_ABORTED))
+        {
+            ReturnedEvents |= WSK_POLLHUP;
+        }
+
+        if (State & WSK_SOCKET_STATE_ABORTED)
+        {
+            ReturnedEvents |= WSK_POLLERR;
+        }
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    // Errors are reported whether asked for or not.
+    return ReturnedEvents & (Events | WSK_POLLERR | WSK_POLLHUP | WSK_POLLNVAL);
+}
+
+static WSK_ACCEPT_ENTRY* WSKAPI WSKRemoveAcceptEntry(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    WSK_ACCEPT_ENTRY* Entry = nullptr;
+
+    if (Context)
+    {
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            if (!IsListEmpty(&Context->AcceptQueue))
+            {
+                Entry = CONTAINING_RECORD(RemoveHeadList(&Context->AcceptQueue), WSK_ACCEPT_ENTRY, Link);
+                Context->AcceptCount -= 1;
+            }
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+    }
+
+    return Entry;
+}
+
+static VOID WSKAPI WSKReleaseNonBlockingRequest(
+    _In_ WSK_NONBLOCKING_REQUEST* Request
+)
+{
+    if (InterlockedDecrement(&Request->RefCount) == 0)
+    {
+        WSKReleaseSocketContext(Request->Context);
+        ExFreePoolWithTag(Request, WSK_POOL_TAG);
+    }
+}
+
+static VOID WSKAPI WSKNonBlockingCompletion(
+    _In_ NTSTATUS       Status,
+    _In_ ULONG_PTR      Bytes,
+    _In_ WSKOVERLAPPED* Overlapped
+)
+{
+    UNREFERENCED_PARAMETER(Bytes);
+
+    auto Request = CONTAINING_RECORD(Overlapped, WSK_NONBLOCKING_REQUEST, Overlapped);
+    auto Context = Request->Context;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    {
+        if (Request->Connect)
+        {
+            Context->State &= ~WSK_SOCKET_STATE_CONNECTING;
+            Context->State |= NT_SUCCESS(Status) ? WSK_SOCKET_STATE_CONNECTED : WSK_SOCKET_STATE_ABORTED;
+        }
+        else
+        {
+            Context->SendBuffered -= Request->Length;
+
+            if (!NT_SUCCESS(Status))
+            {
+                Context->State |= WSK_SOCKET_STATE_ABORTED;
+            }
+        }
+
+        WSKWakeSocketWaiters(Context);
+    }
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    Request->Completed = TRUE;
+    WSKReleaseNonBlockingRequest(Request);
+}
+
+static WSK_NONBLOCKING_REQUEST* WSKAPI WSKAllocNonBlockingRequest(
+    _In_ PSOCKET_CONTEXT Context,
+    _In_ SIZE_T Length
+)
+{
+    auto Request = static_cast<WSK_NONBLOCKING_REQUEST*>(ExAllocatePoolZero(NonPagedPool,
+        FIELD_OFFSET(WSK_NONBLOCKING_REQUEST, Data) + Length, WSK_POOL_TAG));
+    if (Request)
+    {
+        WSKCreateEvent(&Request->Overlapped.Event);
+
+        InterlockedIncrement(&Context->RefCount);
+
+        Request->RefCount = 2;
+        Request->Context  = Context;
+        Request->Length   = Length;
+    }
+
+    return Request;
+}
+
+// A request the provider never saw is not completed, undo it here.
+static VOID WSKAPI WSKFinishNonBlockingRequest(
+    _In_ WSK_NONBLOCKING_REQUEST* Request,
+    _In_ NTSTATUS Status
+)
+{
+    if (!NT_SUCCESS(Status) && !Request->Completed)
+    {
+        auto Context = Request->Context;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            if (Request->Connect)
+            {
+                Context->State &= ~WSK_SOCKET_STATE_CONNECTING;
+            }
+            else
+            {
+                Context->SendBuffered -= Request->Length;
+            }
+
+            WSKWakeSocketWaiters(Context);
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        WSKReleaseNonBlockingRequest(Request);
+    }
+
+    WSKReleaseNonBlockingRequest(Request);
+}
+
+// Nonblocking calls only reach the provider when the event state says they will not wait.
+// Right after the events are enabled nothing has been indicated yet, so the call is let through.
+static BOOLEAN WSKAPI WSKSocketWouldBlock(
+    _In_ const SOCKET_OBJECT* SocketObject,
+    _In_ SHORT Events
+)
+{
+    const auto EventMask = SocketObject->Context->EventMask;
+
+    if (!NT_SUCCESS(WSKEnableSocketEvents(SocketObject)))
+    {
+        return FALSE;
+    }
+
+    if (SocketObject->Context->EventMask != EventMask)
+    {
+        return FALSE;
+    }
+
+    return WSKPollSocketContext(SocketObject->Context, Events) == 0;
+}
+
+// The buffers are gathered into one copy, as much of them as the send buffer has room for.
+// Whole takes all of them or none, an empty send buffer takes them even past its size.
+static NTSTATUS WSKAPI WSKSendNonBlocking(
+    _In_ const SOCKET_OBJECT* SocketObject,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG      BufferCount,
+    _Out_opt_ SIZE_T* NumberOfBytesSent,
+    _In_ ULONG      Flags,
+    _In_ BOOLEAN    Whole
+)
+{
+    NTSTATUS Status  = STATUS_SUCCESS;
+    SIZE_T   Length  = 0u;
+    SIZE_T   BufferLength = 0u;
+    auto     Context = SocketObject->Context;
+
+    do
+    {
+        for (ULONG Index = 0; Index < BufferCount; ++Index)
+        {
+            if (Buffers[Index].Length && Buffers[Index].Buffer == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            BufferLength += Buffers[Index].Length;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            if (Context->State & WSK_SOCKET_STATE_ABORTED)
+            {
+                Status = STATUS_CONNECTION_ABORTED;
+            }
+            else if ((Context->State & WSK_SOCKET_STATE_CONNECTING) ||
+                (Context->SendBuffered >= WSK_NONBLOCKING_SEND_BUFFER) ||
+                (Whole && Context->SendBuffered && BufferLength > WSK_NONBLOCKING_SEND_BUFFER - Context->SendBuffered))
+            {
+                Status = STATUS_DEVICE_NOT_READY;
+            }
+            else
+            {
+                Length = Whole ? BufferLength : min(BufferLength, WSK_NONBLOCKING_SEND_BUFFER - Context->SendBuffered);
+                Context->SendBuffered += Length;
+            }
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        auto Request = WSKAllocNonBlockingRequest(Context, Length);
+        if (Request == nullptr)
+        {
+            KeAcquireSpinLock(&Context->Lock, &Irql);
+            {
+                Context->SendBuffered -= Length;
+            }
+            KeReleaseSpinLock(&Context->Lock, Irql);
+
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        SIZE_T Copied = 0u;
+
+        for (ULONG Index = 0; Index < BufferCount && Copied < Length; ++Index)
+        {
+            const auto Piece = min(Buffers[Index].Length, Length - Copied);
+
+            RtlCopyMemory(static_cast<PUCHAR>(Request->Data) + Copied, Buffers[Index].Buffer, Piece);
+            Copied += Piece;
+        }
+
+        Status = SocketObject->Kind->Send(SocketObject->Socket, Request->Data, Length,
+            nullptr, Flags, WSK_INFINITE_WAIT, &Request->Overlapped, WSKNonBlockingCompletion, Context);
+
+        WSKFinishNonBlockingRequest(Request, Status);
+
+        if (Status == STATUS_PENDING)
+        {
+            Status = STATUS_SUCCESS;
+        }
+
+    } while (false);
+
+    if (NumberOfBytesSent)
+    {
+        *NumberOfBytesSent = NT_SUCCESS(Status) ? Length : 0u;
+    }
+
+    return Status;
+}
+
+// Recorded on the table entry, a later connect then skips the implicit bind.
+static VOID WSKAPI WSKSetSocketBound(
+    _In_ SOCKET Socket
+)
+{
+    SOCKET_OBJECT SocketObject{};
+
+    if (WSKSocketsAVLTableFind(Socket, &SocketObject) && !SocketObject.Bound)
+    {
+        SocketObject.Bound = TRUE;
+
+        WSKSocketsAVLTableUpdate(Socket, &SocketObject);
+    }
+}
+
+static NTSTATUS WSKAPI WSKConnectNonBlocking(
+    _In_ const SOCKET_OBJECT* SocketObject,
+    _In_ PSOCKADDR  RemoteAddress,
+    _In_ SIZE_T     RemoteAddressLength,
+    _Inout_ PBOOLEAN Bound
+)
+{
+    NTSTATUS Status  = STATUS_SUCCESS;
+    auto     Context = SocketObject->Context;
+
+    do
+    {
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            if (Context->State & WSK_SOCKET_STATE_CONNECTING)
+            {
+                Status = STATUS_DEVICE_NOT_READY;
+            }
+            else
+            {
+                Context->State |= WSK_SOCKET_STATE_CONNECTING;
+            }
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        auto Request = WSKAllocNonBlockingRequest(Context, 0u);
+        if (Request == nullptr)
+        {
+            WSKSetSocketState(Context, 0, WSK_SOCKET_STATE_CONNECTING);
+
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Request->Connect = TRUE;
+
+        Status = WSKConnectUnsafe(SocketObject->Socket, SocketObject->SocketType, RemoteAddress, RemoteAddressLength,
+            Bound, &Request->Overlapped, WSKNonBlockingCompletion, Context);
+
+        WSKFinishNonBlockingRequest(Request, Status);
+
+        // Same as WSAEWOULDBLOCK, completion is reported as writable by WSKPoll.
+        if (Status == STATUS_PENDING)
+        {
+            Status = STATUS_DEVICE_NOT_READY;
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+// IoCancelIrp may complete the request inline, so it is called without the socket lock
+// and with a reference that keeps the IRP alive.
+static ULONG WSKAPI WSKCancelSocketRequests(
+    _In_ PSOCKET_CONTEXT Context,
+    _In_opt_ WSKOVERLAPPED* Overlapped
+)
+{
+    ULONG Cancelled = 0u;
+
+    for (;;)
+    {
+        WSK_CONTEXT_IRP* WSKContext = nullptr;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Context->Lock, &Irql);
+        {
+            for (auto Entry = Context->Requests.Flink; Entry != &Context->Requests; Entry = Entry->Flink)
+            {
+                auto Request = CONTAINING_RECORD(Entry, WSK_CONTEXT_IRP, Link);
+
+                if (Request->Cancelled || (Overlapped && Request->Context != Overlapped))
+                {
+                    continue;
+                }
+
+                // A request whose last reference is gone is being unlinked, leave it.
+                LONG RefCount = Request->RefCount;
+                while (RefCount != 0)
+                {
+                    const LONG Previous = InterlockedCompareExchange(&Request->RefCount, RefCount + 1, RefCount);
+                    if (Previous == RefCount)
+                    {
+                        break;
+                    }
+
+                    RefCount = Previous;
+                }
+
+                if (RefCount == 0)
+                {
+                    continue;
+                }
+
+                Request->Cancelled = TRUE;
+
+                WSKContext = Request;
+                break;
+            }
+        }
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        if (WSKContext == nullptr)
+        {
+            break;
+        }
+
+        IoCancelIrp(WSKContext->Irp);
+        WSKFreeContextIRP(WSKContext);
+
+        Cancelled += 1;
+    }
+
+    return Cancelled;
+}
+
+// A WSKSOCKETDISPATCH holds the provider socket without the table, the call is guarded instead.
+static BOOLEAN WSKAPI WSKAcquireSocketRundown(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context == nullptr)
+    {
+        return TRUE;
+    }
+
+    if (!ExAcquireRundownProtection(&Context->Rundown))
+    {
+        return FALSE;
+    }
+
+    if (Context->State & WSK_SOCKET_STATE_CLOSED)
+    {
+        ExReleaseRundownProtection(&Context->Rundown);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static VOID WSKAPI WSKReleaseSocketRundown(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context)
+    {
+        ExReleaseRundownProtection(&Context->Rundown);
+    }
+}
+
+// Before the provider socket is closed: blocked requests are cancelled, then the dispatch
+// calls still inside the provider are waited for. PASSIVE_LEVEL.
+static VOID WSKAPI WSKRundownSocketContext(
+    _In_opt_ PSOCKET_CONTEXT Context
+)
+{
+    if (Context)
+    {
+        WSKSetSocketState(Context, WSK_SOCKET_STATE_CLOSED, 0);
+        WSKCancelSocketRequests(Context, nullptr);
+
+        ExWaitForRundownProtectionRelease(&Context->Rundown);
+    }
+}
+
+static NTSTATUS WSKAPI WSKCreateSocketUnsafe(
+    _Out_ PWSK_SOCKET*      Socket,
+    _Out_ ULONG*            WskSocketType,
+    _Out_ PSOCKET_CONTEXT*  Context,
+    _In_  ADDRESS_FAMILY    AddressFamily,
+    _In_  USHORT            SocketType,
+    _In_  ULONG             Protocol,
+    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        *Socket  = nullptr;
+        *Context = nullptr;
+
+        ULONG WSKSocketType = WSK_FLAG_BASIC_SOCKET;
+
+        switch (SocketType)
+        {
+        case SOCK_STREAM:
+            WSKSocketType = WSK_FLAG_STREAM_SOCKET;
+            break;
+        case SOCK_DGRAM:
+            WSKSocketType = WSK_FLAG_DATAGRAM_SOCKET;
+            break;
+        case SOCK_RAW:
+            WSKSocketType = WSK_FLAG_DATAGRAM_SOCKET;
+            break;
+        default:
+            break;
+        }
+
+        auto Context_ = WSKAllocSocketContext();
+        if (Context_ == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (WSKSocketType == WSK_FLAG_DATAGRAM_SOCKET)
+        {
+            Context_->State = WSK_SOCKET_STATE_DATAGRAM;
+        }
+
+        Status = WSKSocketUnsafe(Socket, AddressFamily, SocketType, Protocol, WSKSocketType, SecurityDescriptor, Context_);
+        if (!NT_SUCCESS(Status))
+        {
+            WSKReleaseSocketContext(Context_);
+            break;
+        }
+
+        *WskSocketType = WSKSocketType;
+        *Context       = Context_;
+
+    } while (false);
+
+    return Status;
+}
+
+static VOID WSKAPI WSKCloseReservedSockets(
+    _Inout_ LIST_ENTRY* List
+)
+{
+    while (!IsListEmpty(List))
+    {
+        auto Reserved = CONTAINING_RECORD(RemoveHeadList(List), WSK_RESERVED_SOCKET, Link);
+
+        WSKCloseSocketUnsafe(Reserved->Socket, Reserved->WskSocketType);
+        WSKReleaseSocketContext(Reserved->Context);
+
+        ExFreePoolWithTag(Reserved, WSK_POOL_TAG);
+    }
+}
+
+// Runs on the worker thread, creates sockets until the reserve is back at its target.
+static VOID WSKAPI WSKRefillSocketReserve(
+    _In_ PVOID Context
+)
+{
+    auto Reserve = static_cast<WSK_SOCKET_RESERVE*>(Context);
+
+    for (;;)
+    {
+        BOOLEAN Full = FALSE;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&WSKSocketReserveLock, &Irql);
+        {
+            Full = (Reserve->Count >= Reserve->Target);
+            if (Full)
+            {
+                Reserve->Busy = FALSE;
+            }
+        }
+        KeReleaseSpinLock(&WSKSocketReserveLock, Irql);
+
+        if (Full)
+        {
+            break;
+        }
+
+        auto Reserved = static_cast<WSK_RESERVED_SOCKET*>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(WSK_RESERVED_SOCKET), WSK_POOL_TAG));
+        if (Reserved)
+        {
+            const NTSTATUS Status = WSKCreateSocketUnsafe(&Reserved->Socket, &Reserved->WskSocketType, &Reserved->Context,
+                Reserve->AddressFamily, Reserve->SocketType, Reserve->Protocol, nullptr);
+            if (!NT_SUCCESS(Status))
+            {
+                ExFreePoolWithTag(Reserved, WSK_POOL_TAG);
+                Reserved = nullptr;
+            }
+        }
+
+        // Retried by the next WSKSocket that empties the reserve further.
+        if (Reserved == nullptr)
+        {
+            KeAcquireSpinLock(&WSKSocketReserveLock, &Irql);
+            {
+                Reserve->Busy = FALSE;
+            }
+            KeReleaseSpinLock(&WSKSocketReserveLock, Irql);
+            break;
+        }
+
+        KeAcquireSpinLock(&WSKSocketReserveLock, &Irql);
+        {
+            InsertTailList(&Reserve->Sockets, &Reserved->Link);
+            Reserve->Count += 1;
+        }
+        KeReleaseSpinLock(&WSKSocketReserveLock, Irql);
+    }
+}
+
+// The reserve lock must be held.
+static WSK_SOCKET_RESERVE* WSKAPI WSKFindSocketReserve(
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_ USHORT         SocketType,
+    _In_ ULONG          Protocol
+)
+{
+    for (auto& Reserve : WSKSocketReserves)
+    {
+        if ((Reserve.Target || Reserve.Count || Reserve.Busy) &&
+            Reserve.AddressFamily == AddressFamily &&
+            Reserve.SocketType    == SocketType &&
+            Reserve.Protocol      == Protocol)
+        {
+            return &Reserve;
+        }
+    }
+
+    return nullptr;
+}
+
+// Pops a pre-created socket and queues the refill, FALSE if the reserve is empty.
+static BOOLEAN WSKAPI WSKTakeReservedSocket(
+    _In_  ADDRESS_FAMILY    AddressFamily,
+    _In_  USHORT            SocketType,
+    _In_  ULONG             Protocol,
+    _Out_ PWSK_SOCKET*      Socket,
+    _Out_ ULONG*            WskSocketType,
+    _Out_ PSOCKET_CONTEXT*  Context
+)
+{
+    WSK_RESERVED_SOCKET* Reserved = nullptr;
+    WSK_SOCKET_RESERVE*  Refill   = nullptr;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&WSKSocketReserveLock, &Irql);
+    {
+        auto Reserve = WSKFindSocketReserve(AddressFamily, SocketType, Protocol);
+        if (Reserve)
+        {
+            if (!IsListEmpty(&Reserve->Sockets))
+            {
+                Reserved = CONTAINING_RECORD(RemoveHeadList(&Reserve->Sockets), WSK_RESERVED_SOCKET, Link);
+                Reserve->Count -= 1;
+            }
+
+            if (!Reserve->Busy && Reserve->Count < Reserve->Target)
+            {
+                Reserve->Busy = TRUE;
+                Refill = Reserve;
+            }
+        }
+    }
+    KeReleaseSpinLock(&WSKSocketReserveLock, Irql);
+
+    if (Refill)
+    {
+        WSKWorkQueue(&Refill->Refill);
+    }
+
+    if (Reserved == nullptr)
+    {
+        return FALSE;
+    }
+
+    *Socket        = Reserved->Socket;
+    *WskSocketType = Reserved->WskSocketType;
+    *Context       = Reserved->Context;
+
+    ExFreePoolWithTag(Reserved, WSK_POOL_TAG);
+
+    return TRUE;
+}
+
+static VOID WSKAPI WSKAdjustPendingCloses(
+    _In_ LONG Delta
+)
+{
+    KIRQL Irql;
+    KeAcquireSpinLock(&WSKPendingCloseLock, &Irql);
+    {
+        WSKPendingCloseCount += Delta;
+
+        if (WSKPendingCloseCount == 0)
+        {
+            KeSetEvent(&WSKPendingCloseIdle, IO_NO_INCREMENT, FALSE);
+        }
+        else
+        {
+            KeClearEvent(&WSKPendingCloseIdle);
+        }
+    }
+    KeReleaseSpinLock(&WSKPendingCloseLock, Irql);
+}
+
+// Runs on the worker, once the lingering disconnect is over.
+static VOID WSKAPI WSKFinishPendingClose(
+    _In_ PVOID Context
+)
+{
+    auto Pending = static_cast<WSK_PENDING_CLOSE*>(Context);
+
+    // Calls that got in before the socket left the table are still running.
+    WSKRundownSocketContext(Pending->Context);
+
+    WSKCloseSocketUnsafe(Pending->Socket, Pending->WskSocketType);
+
+    if (Pending->Context)
+    {
+        if (Pending->Context->SourcePortEntry)
+        {
+            WSKPortRelease(Pending->Context->SourcePortEntry, Pending->Context->SourcePort, FALSE);
+            Pending->Context->SourcePortEntry = nullptr;
+        }
+
+        WSKReleaseSocketContext(Pending->Context);
+    }
+
+    ExFreePoolWithTag(Pending, WSK_POOL_TAG);
+
+    WSKAdjustPendingCloses(-1);
+}
+
+static VOID WSKAPI WSKPendingCloseDisconnected(
+    _In_ NTSTATUS       Status,
+    _In_ ULONG_PTR      Bytes,
+    _In_ WSKOVERLAPPED* Overlapped
+)
+{
+    UNREFERENCED_PARAMETER(Status);
+    UNREFERENCED_PARAMETER(Bytes);
+
+    WSKWorkQueue(&CONTAINING_RECORD(Overlapped, WSK_PENDING_CLOSE, Overlapped)->Close);
+}
+
+// Returns FALSE if there is nothing to linger on, the close is queued at once then.
+// A disconnect still pending when the linger time is up is cancelled, the close aborts the connection.
+static BOOLEAN WSKAPI WSKLingerPendingClose(
+    _In_ WSK_PENDING_CLOSE* Pending,
+    _In_ ULONG LingerMilliseconds
+)
+{
+    if (LingerMilliseconds == 0 || Pending->Context == nullptr ||
+        (Pending->Context->State & (WSK_SOCKET_STATE_CONNECTED | WSK_SOCKET_STATE_ABORTED)) != WSK_SOCKET_STATE_CONNECTED)
+    {
+        return FALSE;
+    }
+
+    PWSK_SOCKET Connected = nullptr;
+
+    const auto Disconnect = WSKResolveDisconnect(Pending->Socket, Pending->WskSocketType, &Connected);
+    if (Disconnect == nullptr)
+    {
+        return FALSE;
+    }
+
+    auto WSKContext = WSKAllocContextIRP((PVOID)&WSKPendingCloseDisconnected, &Pending->Overlapped);
+    if (WSKContext == nullptr)
+    {
+        return FALSE;
+    }
+
+    WSKArmContextIRP(WSKContext, LingerMilliseconds);
+
+    // The provider completes the IRP in any case, the completion queues the close.
+    Disconnect(Connected, nullptr, 0u, WSKContext->Irp);
+
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public  Function
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+VOID WSKAPI WSKSetLastError(
+    _In_ NTSTATUS Status
+)
+{
+    _LastNtStatus = Status;
+}
+
+NTSTATUS WSKAPI WSKGetLastError()
+{
+    return _LastNtStatus;
+}
+
+NTSTATUS WSKAPI WSKStartup(_In_ UINT16 Version, _Out_ WSKDATA* WSKData)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do 
+    {
+        *WSKData = {};
+
+        if (InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            WSK_PROVIDER_CHARACTERISTICS Caps;
+            Status = WskQueryProviderCharacteristics(&WSKRegistration, &Caps);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            WSKData->HighestVersion = Caps.HighestVersion;
+            WSKData->LowestVersion  = Caps.LowestVersion;
+
+            break;
+        }
+
+        ExInitializeDriverRuntime(DrvRtPoolNxOptIn);
+
+        WSKSocketsAVLTableInitialize();
+        ExInitializeRundownProtection(&WSKTeardownRundown);
+        WSKTimerWheelInitialize();
+        WSKPortAllocatorInitialize();
+
+        KeInitializeSpinLock(&WSKSocketReserveLock);
+        for (auto& Reserve : WSKSocketReserves)
+        {
+            Reserve = {};
+            InitializeListHead(&Reserve.Sockets);
+            WSKWorkInitialize(&Reserve.Refill, &WSKRefillSocketReserve, &Reserve);
+        }
+
+        KeInitializeSpinLock(&WSKPendingCloseLock);
+        KeInitializeEvent(&WSKPendingCloseIdle, NotificationEvent, TRUE);
+        WSKPendingCloseCount = 0u;
+
+        KeInitializeSpinLock(&WSKAddrInfoLock);
+        InitializeListHead(&WSKAddrInfoFlights);
+        for (auto& Bucket : WSKAddrInfoShared)
+        {
+            InitializeListHead(&Bucket);
+        }
+        InitializeListHead(&WSKAddrInfoOrphans);
+
+        WSK_CLIENT_NPI NPIClient{};
+        NPIClient.ClientContext = nullptr;
+        NPIClient.Dispatch = &WSKClientDispatch;
+
+        WSKClientDispatch.Version = Version;
+
+        Status = WskRegister(&NPIClient, &WSKRegistration);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSK_PROVIDER_CHARACTERISTICS Caps;
+        Status = WskQueryProviderCharacteristics(&WSKRegistration, &Caps);
+        if (!NT_SUCCESS(Status))
+        {
+            WskDeregister(&WSKRegistration);
+            break;
+        }
+
+        WSKData->HighestVersion = Caps.HighestVersion;
+        WSKData->LowestVersion  = Caps.LowestVersion;
+
+        Status = WskCaptureProviderNPI(&WSKRegistration, WSK_INFINITE_WAIT, &WSKNPIProvider);
+        if (!NT_SUCCESS(Status))
+        {
+            WskDeregister(&WSKRegistration);
+            break;
+        }
+
+        // Last, nothing above has to stop the thread when it fails.
+        Status = WSKWorkerInitialize();
+        if (!NT_SUCCESS(Status))
+        {
+            WskReleaseProviderNPI(&WSKRegistration);
+            WskDeregister(&WSKRegistration);
+            WSKNPIProvider = {};
+            break;
+        }
+
+        WSKCreateEvent(&WSKEmptyOverlapped.Event);
+
+        InterlockedCompareExchange(&_Initialized, true, false);
+
+    } while (false);
+
+    return Status;
+}
+
+VOID WSKAPI WSKCleanup()
+{
+    // Queued work, pending closes and the reserved sockets still need the provider.
+    if (InterlockedCompareExchange(&_Initialized, true, true))
+    {
+        KeWaitForSingleObject(&WSKPendingCloseIdle, Executive, KernelMode, FALSE, nullptr);
+
+        WSKWorkerCleanup();
+
+        for (auto& Reserve : WSKSocketReserves)
+        {
+            WSKCloseReservedSockets(&Reserve.Sockets);
+
+            Reserve.Target = 0u;
+            Reserve.Count  = 0u;
+        }
+    }
+
+    if (InterlockedCompareExchange(&_Initialized, false, true))
+    {
+        WSKSocketsAVLTableCleanup();
+        WSKTimerWheelCleanup();
+        ExWaitForRundownProtectionRelease(&WSKTeardownRundown);
+        WSKPortAllocatorCleanup();
+
+        WSKFreeAddrInfoList(&WSKAddrInfoOrphans);
+        for (auto& Bucket : WSKAddrInfoShared)
+        {
+            WSKFreeAddrInfoList(&Bucket);
+        }
+
+        WskReleaseProviderNPI(&WSKRegistration);
+        WskDeregister(&WSKRegistration);
+
+        WSKNPIProvider = {};
+    }
+}
+
+VOID WSKAPI WSKCreateEvent(_Out_ KEVENT* Event)
+{
+    KeInitializeEvent(Event, NotificationEvent, FALSE);
+}
+
+NTSTATUS WSKAPI WSKGetOverlappedResult(
+    _In_  SOCKET         Socket,
+    _In_  WSKOVERLAPPED* Overlapped,
+    _Out_opt_ SIZE_T*    TransferBytes,
+    _In_  BOOLEAN        Wait
+)
+{
+    UNREFERENCED_PARAMETER(Socket);
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do 
+    {
+        if (TransferBytes)
+        {
+            *TransferBytes = 0u;
+        }
+
+        if (Overlapped->Internal == STATUS_PENDING)
+        {
+            if (!Wait)
+            {
+                Status = STATUS_TIMEOUT;
+                break;
+            }
+
+            Status = KeWaitForSingleObject(&Overlapped->Event, Executive, KernelMode, FALSE, nullptr);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (TransferBytes)
+        {
+            /* Return bytes transferred */
+            *TransferBytes = Overlapped->InternalHigh;
+        }
+
+        /* Check for failure during I/O */
+        if (!NT_SUCCESS(Overlapped->Internal))
+        {
+            /* Set the error and fail */
+            Status = static_cast<NTSTATUS>(Overlapped->Internal);
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKCancelIo(
+    _In_ SOCKET Socket
+)
+{
+    return WSKCancelIoEx(Socket, nullptr);
+}
+
+NTSTATUS WSKAPI WSKCancelIoEx(
+    _In_ SOCKET Socket,
+    _In_opt_ WSKOVERLAPPED* Overlapped
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableReference(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.Context == nullptr)
+        {
+            Status = STATUS_NOT_FOUND;
+            break;
+        }
+
+        if (WSKCancelSocketRequests(SocketObject.Context, Overlapped) == 0)
+        {
+            Status = STATUS_NOT_FOUND;
+        }
+
+        WSKReleaseSocketContext(SocketObject.Context);
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKGetAddrInfo(
+    _In_opt_ LPCWSTR        NodeName,
+    _In_opt_ LPCWSTR        ServiceName,
+    _In_     UINT32         Namespace,
+    _In_opt_ GUID*          Provider,
+    _In_opt_ PADDRINFOEXW   Hints,
+    _Outptr_result_maybenull_ PADDRINFOEXW* Result,
+    _In_opt_ UINT32         TimeoutMilliseconds,
+    _In_opt_ WSKOVERLAPPED* Overlapped,
+    _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    WSK_ADDRINFO_FLIGHT* Flight    = nullptr;
+    WSK_ADDRINFO_FLIGHT* Candidate = nullptr;
+    WSK_ADDRINFO_WAITER* Waiter    = nullptr;
+
+    do
+    {
+        *Result = nullptr;
+
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        WSKFreeAddrInfoList(&WSKAddrInfoOrphans);
+
+        PADDRINFOEXW Numeric = nullptr;
+
+        Status = WSKGetAddrInfoNumeric(NodeName, ServiceName, Namespace, Provider, Hints, &Numeric);
+        if (Status != STATUS_NOT_SUPPORTED)
+        {
+            if (Overlapped == nullptr)
+            {
+                *Result = Numeric;
+                break;
+            }
+
+            Overlapped->Pointer      = Numeric;
+            Overlapped->InternalHigh = 0u;
+            Overlapped->Internal     = Status;
+
+            if (CompletionRoutine)
+            {
+                __try
+                {
+                    CompletionRoutine(Status, 0u, Overlapped);
+                }
+                __except (EXCEPTION_EXECUTE_HANDLER)
+                {
+                    __nop();
+                }
+            }
+
+            KeSetEvent(&Overlapped->Event, IO_NO_INCREMENT, FALSE);
+            break;
+        }
+
+        Status = STATUS_SUCCESS;
+
+        Candidate = WSKAllocAddrInfoFlight(NodeName, ServiceName, Namespace, Provider, Hints);
+        if (Candidate == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (Overlapped != nullptr)
+        {
+            Waiter = static_cast<WSK_ADDRINFO_WAITER*>(ExAllocatePoolZero(NonPagedPool,
+                sizeof(WSK_ADDRINFO_WAITER), WSK_POOL_TAG));
+            if (Waiter == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            Waiter->Overlapped        = Overlapped;
+            Waiter->CompletionRoutine = CompletionRoutine;
+
+            Overlapped->Pointer       = nullptr;
+            Overlapped->InternalHigh  = 0u;
+            Overlapped->Internal      = STATUS_PENDING;
+        }
+
+        // Concurrent lookups with the same key share a single provider request.
+
+        BOOLEAN Leader = FALSE;
+
+        KIRQL Irql = PASSIVE_LEVEL;
+        KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+        {
+            for (auto Entry = WSKAddrInfoFlights.Flink; Entry != &WSKAddrInfoFlights; Entry = Entry->Flink)
+            {
+                auto Pending = CONTAINING_RECORD(Entry, WSK_ADDRINFO_FLIGHT, Link);
+                if (WSKAddrInfoFlightEqual(Pending, Candidate))
+                {
+                    Flight = Pending;
+                    break;
+                }
+            }
+
+            if (Flight == nullptr)
+            {
+                Flight    = Candidate;
+                Candidate = nullptr;
+                Leader    = TRUE;
+
+                InsertTailList(&WSKAddrInfoFlights, &Flight->Link);
+            }
+
+            Flight->Waiters += 1;
+
+            if (Waiter)
+            {
+                InsertTailList(&Flight->OverlappedWaiters, &Waiter->Link);
+                Waiter = nullptr;
+            }
+            else
+            {
+                InterlockedIncrement(&Flight->RefCount);
+            }
+        }
+        KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+        if (Leader)
+        {
+            auto WSKContext = WSKAllocContextIRP(nullptr, Flight);
+            auto Shared     = static_cast<WSK_ADDRINFO_SHARED*>(ExAllocatePoolZero(NonPagedPool,
+                sizeof(WSK_ADDRINFO_SHARED), WSK_POOL_TAG));
+
+            KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+            {
+                Flight->WSKContext = WSKContext;
+                Flight->Shared     = Shared;
+            }
+            KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+            if (WSKContext == nullptr || Shared == nullptr)
+            {
+                WSKCompleteAddrInfoFlight(Flight, STATUS_INSUFFICIENT_RESOURCES);
+            }
+            else
+            {
+                IoSetCompletionRoutine(WSKContext->Irp, WSKAddrInfoFlightCompletionRoutine, Flight, TRUE, TRUE, TRUE);
+
+                WSKNPIProvider.Dispatch->WskGetAddressInfo(
+                    WSKNPIProvider.Client,
+                    Flight->NodeName.Buffer    ? &Flight->NodeName    : nullptr,
+                    Flight->ServiceName.Buffer ? &Flight->ServiceName : nullptr,
+                    Namespace,
+                    Provider,
+                    Hints,
+                    &Flight->Result,
+                    nullptr,
+                    nullptr,
+                    WSKContext->Irp);
+            }
+        }
+
+        if (Overlapped != nullptr)
+        {
+            Status = STATUS_PENDING;
+            break;
+        }
+
+        LARGE_INTEGER Timeout{};
+
+        KeWaitForSingleObject(&Flight->Event, Executive, KernelMode,
+            FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
+
+        BOOLEAN Cancel = FALSE;
+
+        KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+        {
+            if (Flight->Completed)
+            {
+                Status  = Flight->Status;
+                *Result = Flight->Result;
+            }
+            else
+            {
+                Status = STATUS_TIMEOUT;
+
+                // The last caller to give up cancels the request.
+                if (--Flight->Waiters == 0)
+                {
+                    RemoveEntryList(&Flight->Link);
+                    InitializeListHead(&Flight->Link);
+
+                    Cancel = (Flight->WSKContext != nullptr);
+                }
+            }
+        }
+        KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+        if (Cancel)
+        {
+            IoCancelIrp(Flight->WSKContext->Irp);
+        }
+
+        WSKReleaseAddrInfoFlight(Flight);
+
+    } while (false);
+
+    if (Candidate)
+    {
+        WSKReleaseAddrInfoFlight(Candidate);
+    }
+
+    if (Waiter)
+    {
+        ExFreePoolWithTag(Waiter, WSK_POOL_TAG);
+    }
+
+    return Status;
+}
+
+VOID WSKAPI WSKFreeAddrInfo(
+    _In_ PADDRINFOEXW Data
+)
+{
+    if (!InterlockedCompareExchange(&_Initialized, true, true))
+    {
+        return;
+    }
+
+    if (Data)
+    {
+        BOOLEAN Release = TRUE;
+        WSK_ADDRINFO_SHARED* Shared = nullptr;
+
+        KIRQL Irql = PASSIVE_LEVEL;
+        KeAcquireSpinLock(&WSKAddrInfoLock, &Irql);
+        {
+            auto Bucket = WSKAddrInfoBucket(Data);
+
+            for (auto Entry = Bucket->Flink; Entry != Bucket; Entry = Entry->Flink)
+            {
+                auto Record = CONTAINING_RECORD(Entry, WSK_ADDRINFO_SHARED, Link);
+                if (Record->Result == Data)
+                {
+                    if (--Record->RefCount == 0)
+                    {
+                        RemoveEntryList(&Record->Link);
+                        Shared = Record;
+                    }
+                    else
+                    {
+                        Release = FALSE;
+                    }
+                    break;
+                }
+            }
+        }
+        KeReleaseSpinLock(&WSKAddrInfoLock, Irql);
+
+        if (Shared)
+        {
+            Release = !Shared->Local;
+
+            ExFreePoolWithTag(Shared, WSK_POOL_TAG);
+        }
+
+        if (Release)
+        {
+            WSKNPIProvider.Dispatch->WskFreeAddressInfo(
+                WSKNPIProvider.Client,
+                Data);
+        }
+    }
+}
+
+NTSTATUS WSKAPI WSKGetNameInfo(
+    _In_ const SOCKADDR* Address,
+    _In_ ULONG      AddressLength,
+    _Out_writes_opt_(NodeNameSize)      LPWSTR  NodeName,
+    _In_ ULONG      NodeNameSize,
+    _Out_writes_opt_(ServiceNameSize)   LPWSTR  ServiceName,
+    _In_ ULONG      ServiceNameSize,
+    _In_ ULONG      Flags
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    WSK_CONTEXT_IRP* WSKContext = nullptr;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (NodeName == nullptr && ServiceName == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        WSKContext = WSKAllocContextIRP(nullptr, nullptr);
+        if (WSKContext == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        UNICODE_STRING NodeNameS{};
+        UNICODE_STRING ServiceNameS{};
+
+        if (NodeName)
+        {
+            RtlInitEmptyUnicodeString(&NodeNameS, NodeName, static_cast<USHORT>(NodeNameSize));
+        }
+        if (ServiceName)
+        {
+            RtlInitEmptyUnicodeString(&ServiceNameS, ServiceName, static_cast<USHORT>(ServiceNameSize));
+        }
+
+        Status = WSKNPIProvider.Dispatch->WskGetNameInfo(
+            WSKNPIProvider.Client,
+            const_cast<PSOCKADDR>(Address),
+            AddressLength,
+            NodeName    ? &NodeNameS    : nullptr,
+            ServiceName ? &ServiceNameS : nullptr,
+            Flags,
+            nullptr,
+            nullptr,
+            WSKContext->Irp);
+
+        if (Status == STATUS_PENDING)
+        {
+            LARGE_INTEGER Timeout{};
+
+            Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
+                FALSE, WSKTimeoutToLargeInteger(WSK_INFINITE_WAIT, &Timeout));
+            if (Status == STATUS_SUCCESS)
+            {
+                Status = WSKContext->Irp->IoStatus.Status;
+            }
+        }
+
+        WSKFreeContextIRP(WSKContext);
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKAddressToString(
+    _In_reads_bytes_(AddressLength) SOCKADDR* SockAddress,
+    _In_     UINT32  AddressLength,
+    _Out_writes_to_(*AddressStringLength, *AddressStringLength) LPWSTR AddressString,
+    _Inout_  UINT32* AddressStringLength
+)
+{
+    NTSTATUS Status = STATUS_INVALID_PARAMETER;
+
+    do
+    {
+        auto Address = reinterpret_cast<SOCKADDR_INET*>(SockAddress);
+
+        if (Address == nullptr || AddressLength < sizeof ADDRESS_FAMILY)
+        {
+            break;
+        }
+
+        if (Address->si_family == AF_INET)
+        {
+            if (AddressLength < sizeof Address->Ipv4)
+            {
+                break;
+            }
+
+            Status = WSKIpv4AddressToStringEx(&Address->Ipv4.sin_addr, Address->Ipv4.sin_port,
+                AddressString, reinterpret_cast<ULONG*>(AddressStringLength));
+
+            break;
+        }
+
+        if (Address->si_family == AF_INET6)
+        {
+            if (AddressLength < sizeof Address->Ipv6)
+            {
+                break;
+            }
+
+            Status = WSKIpv6AddressToStringEx(&Address->Ipv6.sin6_addr, Address->Ipv6.sin6_scope_id,
+                Address->Ipv6.sin6_port, AddressString, reinterpret_cast<ULONG*>(AddressStringLength));
+
+            break;
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKStringToAddress(
+    _In_    PCWSTR      AddressString,
+    _Inout_ SOCKADDR*   SockAddress,
+    _Inout_ UINT32*     AddressLength
+)
+{
+    NTSTATUS Status = STATUS_INVALID_PARAMETER;
+
+    do
+    {
+        auto Address = reinterpret_cast<SOCKADDR_INET*>(SockAddress);
+
+        if (Address == nullptr || AddressLength == nullptr || *AddressLength < sizeof ADDRESS_FAMILY)
+        {
+            break;
+        }
+
+        if (Address->si_family == AF_INET)
+        {
+            if (*AddressLength < sizeof Address->Ipv4)
+            {
+                break;
+            }
+
+            Status = WSKIpv4StringToAddressEx(AddressString, TRUE,
+                &Address->Ipv4.sin_addr, &Address->Ipv4.sin_port);
+            if (!NT_SUCCESS(Status))
+            {
+                *AddressLength = 0u;
+                break;
+            }
+
+            *AddressLength = sizeof Address->Ipv4;
+            break;
+        }
+
+        if (Address->si_family == AF_INET6)
+        {
+            if (*AddressLength < sizeof Address->Ipv6)
+            {
+                break;
+            }
+
+            Status = WSKIpv6StringToAddressEx(AddressString, &Address->Ipv6.sin6_addr,
+                &Address->Ipv6.sin6_scope_id, &Address->Ipv6.sin6_port);
+            if (!NT_SUCCESS(Status))
+            {
+                *AddressLength = 0u;
+                break;
+            }
+
+            *AddressLength = sizeof Address->Ipv6;
+            break;
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKSocket(
+    _Out_ SOCKET*           Socket,
+    _In_  ADDRESS_FAMILY    AddressFamily,
+    _In_  USHORT            SocketType,
+    _In_  ULONG             Protocol,
+    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do 
+    {
+        *Socket = WSK_INVALID_SOCKET;
+
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        PWSK_SOCKET     Socket_       = nullptr;
+        ULONG           WSKSocketType = 0u;
+        PSOCKET_CONTEXT Context       = nullptr;
+
+        if (SecurityDescriptor == nullptr)
+        {
+            WSKTakeReservedSocket(AddressFamily, SocketType, Protocol, &Socket_, &WSKSocketType, &Context);
+        }
+
+        if (Socket_ == nullptr)
+        {
+            Status = WSKCreateSocketUnsafe(&Socket_, &WSKSocketType, &Context,
+                AddressFamily, SocketType, Protocol, SecurityDescriptor);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (!WSKSocketsAVLTableInsert(Socket, Socket_, static_cast<USHORT>(WSKSocketType), WSKSocketKind(WSKSocketType), Context))
+        {
+            WSKCloseSocketUnsafe(Socket_, WSKSocketType);
+            WSKReleaseSocketContext(Context);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKSetSocketReserve(
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_ USHORT         SocketType,
+    _In_ ULONG          Protocol,
+    _In_ ULONG          Count
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    LIST_ENTRY Surplus;
+    InitializeListHead(&Surplus);
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        WSK_SOCKET_RESERVE* Refill = nullptr;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&WSKSocketReserveLock, &Irql);
+        do
+        {
+            auto Reserve = WSKFindSocketReserve(AddressFamily, SocketType, Protocol);
+
+            if (Reserve == nullptr && Count)
+            {
+                for (auto& Free : WSKSocketReserves)
+                {
+                    if (!Free.Target && !Free.Count && !Free.Busy)
+                    {
+                        Reserve = &Free;
+
+                        Reserve->AddressFamily = AddressFamily;
+                        Reserve->SocketType    = SocketType;
+                        Reserve->Protocol      = Protocol;
+                        break;
+                    }
+                }
+
+                if (Reserve == nullptr)
+                {
+                    Status = STATUS_QUOTA_EXCEEDED;
+                    break;
+                }
+            }
+
+            if (Reserve == nullptr)
+            {
+                break;
+            }
+
+            Reserve->Target = Count;
+
+            while (Reserve->Count > Reserve->Target)
+            {
+                InsertTailList(&Surplus, RemoveTailList(&Reserve->Sockets));
+                Reserve->Count -= 1;
+            }
+
+            if (!Reserve->Busy && Reserve->Count < Reserve->Target)
+            {
+                Reserve->Busy = TRUE;
+                Refill = Reserve;
+            }
+
+        } while (false);
+        KeReleaseSpinLock(&WSKSocketReserveLock, Irql);
+
+        if (Refill)
+        {
+            WSKWorkQueue(&Refill->Refill);
+        }
+
+    } while (false);
+
+    WSKCloseReservedSockets(&Surplus);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKCloseSocket(
+    _In_ SOCKET Socket
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        WSKRundownSocketContext(SocketObject.Context);
+
+        Status = WSKCloseSocketUnsafe(SocketObject.Socket, SocketObject.SocketType);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKSocketsAVLTableDelete(Socket);
+
+        if (SocketObject.Context)
+        {
+            if (SocketObject.Context->SourcePortEntry)
+            {
+                WSKPortRelease(SocketObject.Context->SourcePortEntry, SocketObject.Context->SourcePort, FALSE);
+                SocketObject.Context->SourcePortEntry = nullptr;
+            }
+
+            WSKCancelSocketIdle(SocketObject.Context);
+            WSKReleaseSocketContext(SocketObject.Context);
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKCloseSocketAsync(
+    _In_ SOCKET Socket,
+    _In_ ULONG  LingerMilliseconds
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        auto Pending = static_cast<WSK_PENDING_CLOSE*>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(WSK_PENDING_CLOSE), WSK_POOL_TAG));
+        if (Pending == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        WSKCreateEvent(&Pending->Overlapped.Event);
+        WSKWorkInitialize(&Pending->Close, &WSKFinishPendingClose, Pending);
+
+        Pending->Socket        = SocketObject.Socket;
+        Pending->WskSocketType = SocketObject.SocketType;
+        Pending->Context       = SocketObject.Context;  // The table reference moves over
+
+        WSKSocketsAVLTableDelete(Socket);
+
+        if (SocketObject.Context)
+        {
+            WSKSetSocketState(SocketObject.Context, WSK_SOCKET_STATE_CLOSED, 0);
+            WSKCancelSocketIdle(SocketObject.Context);
+        }
+
+        WSKAdjustPendingCloses(1);
+
+        if (!WSKLingerPendingClose(Pending, LingerMilliseconds))
+        {
+            WSKWorkQueue(&Pending->Close);
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+ULONG WSKAPI WSKGetPendingCloseCount()
+{
+    return WSKPendingCloseCount;
+}
+
+NTSTATUS WSKAPI WSKWaitForPendingCloses(
+    _In_ ULONG TimeoutMilliseconds
+)
+{
+    if (!InterlockedCompareExchange(&_Initialized, true, true))
+    {
+        return STATUS_NDIS_ADAPTER_NOT_READY;
+    }
+
+    LARGE_INTEGER Timeout{};
+
+    const NTSTATUS Status = KeWaitForSingleObject(&WSKPendingCloseIdle, Executive, KernelMode,
+        FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
+
+    return Status == STATUS_SUCCESS ? STATUS_SUCCESS : STATUS_TIMEOUT;
+}
+
+NTSTATUS WSKAPI WSKIoctl(
+    _In_ SOCKET         Socket,
+    _In_ ULONG          ControlCode,
+    _In_reads_bytes_opt_(InputSize)     PVOID InputBuffer,
+    _In_ SIZE_T         InputSize,
+    _Out_writes_bytes_opt_(OutputSize)  PVOID OutputBuffer,
+    _In_ SIZE_T         OutputSize,
+    _Out_opt_ SIZE_T*   OutputSizeReturned,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (OutputSizeReturned)
+        {
+            *OutputSizeReturned = 0u;
+        }
+
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (ControlCode == FIONBIO)
+        {
+            if (InputSize != sizeof(ULONG) || InputBuffer == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            SocketObject.NonBlocking = (*static_cast<ULONG*>(InputBuffer) != 0);
+
+            if (!WSKSocketsAVLTableUpdate(Socket, &SocketObject))
+            {
+                Status = STATUS_UNSUCCESSFUL;
+                break;
+            }
+
+            // Start collecting readiness before the first nonblocking call.
+            if (SocketObject.NonBlocking && SocketObject.Context)
+            {
+                WSKEnableSocketEvents(&SocketObject);
+            }
+
+            break;
+        }
+
+        if (ControlCode == SIO_WSK_SET_REMOTE_ADDRESS ||
+            ControlCode == SIO_WSK_SET_SENDTO_ADDRESS)
+        {
+            if (SocketObject.SocketType != WSK_FLAG_DATAGRAM_SOCKET)
+            {
+                Status = STATUS_INVALID_DEVICE_REQUEST;
+                break;
+            }
+
+            auto RemoteAddress = static_cast<PSOCKADDR>(InputBuffer);
+            if (RemoteAddress == nullptr || InputSize < sizeof SOCKADDR)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            if (!SocketObject.Bound)
+            {
+                Status = WSKAutoBindUnsafe(SocketObject.Socket, SocketObject.SocketType, RemoteAddress, SocketObject.Context);
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                WSKSetSocketBound(Socket);
+            }
+        }
+
+        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskIoctl, ControlCode, 0,
+            InputBuffer, InputSize, OutputBuffer, OutputSize, OutputSizeReturned, Overlapped, CompletionRoutine);
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKSetSocketOpt(
+    _In_ SOCKET         Socket,
+    _In_ ULONG          OptionLevel,
+    _In_ ULONG          OptionName,
+    _In_reads_bytes_(InputSize) PVOID InputBuffer,
+    _In_ SIZE_T         InputSize
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && (OptionName == SO_SNDTIMEO || OptionName == SO_RCVTIMEO))
+        {
+            if (InputSize != sizeof(ULONG) || InputBuffer == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            ULONG* Timeout = nullptr;
+
+            if (OptionName == SO_SNDTIMEO)
+            {
+                Timeout = &SocketObject.SendTimeout;
+            }
+            if (OptionName == SO_RCVTIMEO)
+            {
+                Timeout = &SocketObject.RecvTimeout;
+            }
+
+            *Timeout = *static_cast<ULONG*>(InputBuffer);
+
+            if (!WSKSocketsAVLTableUpdate(Socket, &SocketObject))
+            {
+                Status = STATUS_UNSUCCESSFUL;
+            }
+
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_IDLE_TIMEOUT)
+        {
+            if (InputSize != sizeof(ULONG) || InputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            SocketObject.Context->IdleTimeout = *static_cast<ULONG*>(InputBuffer);
+
+            if (SocketObject.Context->IdleTimeout == 0)
+            {
+                WSKCancelSocketIdle(SocketObject.Context);
+                break;
+            }
+
+            // Incoming data resets the deadline through the receive event.
+            WSKEnableSocketEvents(&SocketObject);
+            WSKTouchSocketContext(SocketObject.Context);
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_SHARE_SOURCE_PORT)
+        {
+            if (InputSize != sizeof(ULONG) || InputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            if (SocketObject.SocketType == WSK_FLAG_DATAGRAM_SOCKET)
+            {
+                Status = STATUS_INVALID_DEVICE_REQUEST;
+                break;
+            }
+
+            SocketObject.Context->SourcePortShared = (*static_cast<ULONG*>(InputBuffer) != 0);
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_CONNECT_SOURCE)
+        {
+            if (InputSize != sizeof(WSKCONNECTSOURCE) || InputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            const auto Source = static_cast<WSKCONNECTSOURCE*>(InputBuffer);
+
+            if ((Source->Address.si_family != AF_UNSPEC &&
+                 Source->Address.si_family != AF_INET   &&
+                 Source->Address.si_family != AF_INET6) ||
+                (Source->PortLow == 0u && Source->PortHigh != 0u) ||
+                (Source->PortHigh < Source->PortLow))
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            SOCKADDR_STORAGE SourceAddress{};
+            RtlCopyMemory(&SourceAddress, &Source->Address, sizeof Source->Address);
+
+            // The port comes from the range.
+            reinterpret_cast<PSOCKADDR_IN>(&SourceAddress)->sin_port = 0u;
+
+            KIRQL Irql;
+            KeAcquireSpinLock(&SocketObject.Context->Lock, &Irql);
+            {
+                SocketObject.Context->SourceAddress  = SourceAddress;
+                SocketObject.Context->SourcePortLow  = Source->PortLow;
+                SocketObject.Context->SourcePortHigh = Source->PortHigh;
+            }
+            KeReleaseSpinLock(&SocketObject.Context->Lock, Irql);
+
+            break;
+        }
+
+        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskSetOption,
+            OptionName, OptionLevel, InputBuffer, InputSize, nullptr, 0, nullptr, nullptr, nullptr);
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKGetSocketOpt(
+    _In_ SOCKET         Socket,
+    _In_ ULONG          OptionLevel,
+    _In_ ULONG          OptionName,
+    _Out_writes_bytes_(*OutputSize) PVOID OutputBuffer,
+    _Inout_ SIZE_T* OutputSize
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && (OptionName == SO_SNDTIMEO || OptionName == SO_RCVTIMEO))
+        {
+            if (*OutputSize != sizeof(ULONG) || OutputBuffer == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            if (OptionName == SO_SNDTIMEO)
+            {
+                *static_cast<ULONG*>(OutputBuffer) = SocketObject.SendTimeout;
+            }
+            if (OptionName == SO_RCVTIMEO)
+            {
+                *static_cast<ULONG*>(OutputBuffer) = SocketObject.RecvTimeout;
+            }
+
+            *OutputSize = sizeof ULONG;
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_IDLE_TIMEOUT)
+        {
+            if (*OutputSize != sizeof(ULONG) || OutputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            *static_cast<ULONG*>(OutputBuffer) = SocketObject.Context->IdleTimeout;
+
+            *OutputSize = sizeof ULONG;
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_SHARE_SOURCE_PORT)
+        {
+            if (*OutputSize != sizeof(ULONG) || OutputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            *static_cast<ULONG*>(OutputBuffer) = SocketObject.Context->SourcePortShared;
+
+            *OutputSize = sizeof ULONG;
+            break;
+        }
+
+        if (OptionLevel == SOL_SOCKET && OptionName == WSK_SO_CONNECT_SOURCE)
+        {
+            if (*OutputSize != sizeof(WSKCONNECTSOURCE) || OutputBuffer == nullptr || SocketObject.Context == nullptr)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            const auto Source = static_cast<WSKCONNECTSOURCE*>(OutputBuffer);
+
+            KIRQL Irql;
+            KeAcquireSpinLock(&SocketObject.Context->Lock, &Irql);
+            {
+                RtlCopyMemory(&Source->Address, &SocketObject.Context->SourceAddress, sizeof Source->Address);
+
+                Source->PortLow  = SocketObject.Context->SourcePortLow;
+                Source->PortHigh = SocketObject.Context->SourcePortHigh;
+            }
+            KeReleaseSpinLock(&SocketObject.Context->Lock, Irql);
+
+            *OutputSize = sizeof(WSKCONNECTSOURCE);
+            break;
+        }
+
+        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskGetOption,
+            OptionName, OptionLevel, nullptr, 0, OutputBuffer, *OutputSize, OutputSize, nullptr, nullptr);
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKBind(
+    _In_ SOCKET         Socket,
+    _In_ PSOCKADDR      LocalAddress,
+    _In_ SIZE_T         LocalAddressLength
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        Status = WSKBindUnsafe(SocketObject.Socket, SocketObject.SocketType, LocalAddress, LocalAddressLength);
+        if (NT_SUCCESS(Status))
+        {
+            WSKSetSocketBound(Socket);
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKAccept(
+    _In_  SOCKET        Socket,
+    _Out_ SOCKET*       SocketClient,
+    _Out_opt_ PSOCKADDR LocalAddress,
+    _In_ SIZE_T         LocalAddressLength,
+    _Out_opt_ PSOCKADDR RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (SocketObject.Kind->Accept == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        PWSK_SOCKET     SocketClient_  = nullptr;
+        PSOCKET_CONTEXT ClientContext  = nullptr;
+
+        auto Entry = WSKRemoveAcceptEntry(SocketObject.Context);
+        if (Entry)
+        {
+            SocketClient_ = Entry->Socket;
+            ClientContext = Entry->Context;
+
+            if (LocalAddress)
+            {
+                RtlCopyMemory(LocalAddress, &Entry->LocalAddress, min(LocalAddressLength, sizeof Entry->LocalAddress));
+            }
+
+            if (RemoteAddress)
+            {
+                RtlCopyMemory(RemoteAddress, &Entry->RemoteAddress, min(RemoteAddressLength, sizeof Entry->RemoteAddress));
+            }
+
+            ExFreePoolWithTag(Entry, WSK_POOL_TAG);
+        }
+        else if (SocketObject.NonBlocking && SocketObject.Context)
+        {
+            // Connections are queued by WSKAcceptEvent, none is waiting.
+            WSKEnableSocketEvents(&SocketObject);
+
+            Status = STATUS_DEVICE_NOT_READY;
+            break;
+        }
+        else
+        {
+            ClientContext = WSKAllocSocketContext();
+            if (ClientContext == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            ClientContext->State = WSK_SOCKET_STATE_CONNECTED;
+
+            Status = SocketObject.Kind->Accept(SocketObject.Socket, &SocketClient_,
+                LocalAddress, LocalAddressLength, RemoteAddress, RemoteAddressLength, ClientContext);
+            if (!NT_SUCCESS(Status))
+            {
+                WSKReleaseSocketContext(ClientContext);
+                break;
+            }
+        }
+
+        if (!WSKSocketsAVLTableInsert(SocketClient, SocketClient_, static_cast<USHORT>(WSK_FLAG_CONNECTION_SOCKET), &WSKConnectionKind, ClientContext))
+        {
+            WSKCloseSocketUnsafe(SocketClient_, WSK_FLAG_CONNECTION_SOCKET);
+            WSKReleaseSocketContext(ClientContext);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKListen(
+    _In_ SOCKET         Socket,
+    _In_ INT            BackLog
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            break;
+        }
+
+        if (Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
             break;
         }
 
-        WSKContext = WSKAllocContextIRP((PVOID)CompletionRoutine, Overlapped);
-        if (WSKContext == nullptr)
+        if (SocketObject.Kind->Listen == nullptr)
         {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        // The Context is query result. if block mode.
-        auto QueryResult = reinterpret_cast<PADDRINFOEXW*>(&WSKContext->Pointer);
-        if (Overlapped != nullptr)
+        Status = SocketObject.Kind->Listen(SocketObject.Socket);
+        if (!NT_SUCCESS(Status))
         {
-            QueryResult = reinterpret_cast<PADDRINFOEXW*>(&Overlapped->Pointer);
+            break;
         }
 
-        UNICODE_STRING NodeNameS{};
-        UNICODE_STRING ServiceNameS{};
-
-        RtlInitUnicodeString(&NodeNameS, NodeName);
-        RtlInitUnicodeString(&ServiceNameS, ServiceName);
-
-        Status = WSKNPIProvider.Dispatch->WskGetAddressInfo(
-            WSKNPIProvider.Client,
-            NodeName    ? &NodeNameS    : nullptr,
-            ServiceName ? &ServiceNameS : nullptr,
-            Namespace,
-            Provider,
-            Hints,
-            QueryResult,
-            nullptr,
-            nullptr,
-            WSKContext->Irp);
-
-        if (Overlapped == nullptr)
+        if (SocketObject.Context)
         {
-            if (Status == STATUS_PENDING)
-            {
-                LARGE_INTEGER Timeout{};
-
-                Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                    FALSE, WSKTimeoutToLargeInteger(TimeoutMilliseconds, &Timeout));
-
-                if (Status == STATUS_TIMEOUT)
-                {
-                    IoCancelIrp(WSKContext->Irp);
-                    KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode, FALSE, nullptr);
-                }
-
-                if (Status == STATUS_SUCCESS)
-                {
-                    Status = WSKContext->Irp->IoStatus.Status;
-                }
-            }
-
-            *Result = static_cast<PADDRINFOEXW>(WSKContext->Pointer);
+            SocketObject.Context->Backlog = (BackLog > 0 && static_cast<ULONG>(BackLog) < WSK_MAX_BACKLOG) ?
+                static_cast<ULONG>(BackLog) : WSK_MAX_BACKLOG;
 
-            WSKFreeContextIRP(WSKContext);
+            WSKSetSocketState(SocketObject.Context, WSK_SOCKET_STATE_LISTENING, 0);
         }
 
     } while (false);
@@ -2008,35 +6893,13 @@ NTSTATUS WSKAPI WSKGetAddrInfo(
     return Status;
 }
 
-VOID WSKAPI WSKFreeAddrInfo(
-    _In_ PADDRINFOEXW Data
-)
-{
-    if (!InterlockedCompareExchange(&_Initialized, true, true))
-    {
-        return;
-    }
-
-    if (Data)
-    {
-        WSKNPIProvider.Dispatch->WskFreeAddressInfo(
-            WSKNPIProvider.Client,
-            Data);
-    }
-}
-
-NTSTATUS WSKAPI WSKGetNameInfo(
-    _In_ const SOCKADDR* Address,
-    _In_ ULONG      AddressLength,
-    _Out_writes_opt_(NodeNameSize)      LPWSTR  NodeName,
-    _In_ ULONG      NodeNameSize,
-    _Out_writes_opt_(ServiceNameSize)   LPWSTR  ServiceName,
-    _In_ ULONG      ServiceNameSize,
-    _In_ ULONG      Flags
+NTSTATUS WSKAPI WSKConnect(
+    _In_ SOCKET         Socket,
+    _In_ PSOCKADDR      RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    WSK_CONTEXT_IRP* WSKContext = nullptr;
 
     do
     {
@@ -2046,228 +6909,388 @@ NTSTATUS WSKAPI WSKGetNameInfo(
             break;
         }
 
-        if (NodeName == nullptr && ServiceName == nullptr)
+        if (Socket == WSK_INVALID_SOCKET)
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        WSKContext = WSKAllocContextIRP(nullptr, nullptr);
-        if (WSKContext == nullptr)
+        SOCKET_OBJECT SocketObject{};
+
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
         {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        UNICODE_STRING NodeNameS{};
-        UNICODE_STRING ServiceNameS{};
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        {
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
 
-        if (NodeName)
+        BOOLEAN Bound = SocketObject.Bound;
+
+        if (SocketObject.NonBlocking && SocketObject.Context)
         {
-            RtlInitEmptyUnicodeString(&NodeNameS, NodeName, static_cast<USHORT>(NodeNameSize));
+            Status = WSKConnectNonBlocking(&SocketObject, RemoteAddress, RemoteAddressLength, &Bound);
         }
-        if (ServiceName)
+        else
         {
-            RtlInitEmptyUnicodeString(&ServiceNameS, ServiceName, static_cast<USHORT>(ServiceNameSize));
+            Status = WSKConnectUnsafe(SocketObject.Socket, SocketObject.SocketType, RemoteAddress, RemoteAddressLength,
+                &Bound, nullptr, nullptr, SocketObject.Context);
         }
 
-        Status = WSKNPIProvider.Dispatch->WskGetNameInfo(
-            WSKNPIProvider.Client,
-            const_cast<PSOCKADDR>(Address),
-            AddressLength,
-            NodeName    ? &NodeNameS    : nullptr,
-            ServiceName ? &ServiceNameS : nullptr,
-            Flags,
-            nullptr,
-            nullptr,
-            WSKContext->Irp);
-
-        if (Status == STATUS_PENDING)
+        if (Bound && !SocketObject.Bound)
         {
-            LARGE_INTEGER Timeout{};
+            WSKSetSocketBound(Socket);
+        }
 
-            Status = KeWaitForSingleObject(&WSKContext->Event, Executive, KernelMode,
-                FALSE, WSKTimeoutToLargeInteger(WSK_INFINITE_WAIT, &Timeout));
-            if (Status == STATUS_SUCCESS)
-            {
-                Status = WSKContext->Irp->IoStatus.Status;
-            }
+        if (!NT_SUCCESS(Status) || (SocketObject.NonBlocking && SocketObject.Context))
+        {
+            break;
         }
 
-        WSKFreeContextIRP(WSKContext);
+        if (SocketObject.Context)
+        {
+            WSKSetSocketState(SocketObject.Context, WSK_SOCKET_STATE_CONNECTED, 0);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKAddressToString(
-    _In_reads_bytes_(AddressLength) SOCKADDR* SockAddress,
-    _In_     UINT32  AddressLength,
-    _Out_writes_to_(*AddressStringLength, *AddressStringLength) LPWSTR AddressString,
-    _Inout_  UINT32* AddressStringLength
+NTSTATUS WSKAPI WSKGetSourcePortStatistics(
+    _Out_ WSKSOURCEPORTSTATS* Statistics
 )
 {
-    NTSTATUS Status = STATUS_INVALID_PARAMETER;
+    NTSTATUS Status = STATUS_SUCCESS;
 
     do
     {
-        auto Address = reinterpret_cast<SOCKADDR_INET*>(SockAddress);
-
-        if (Address == nullptr || AddressLength < sizeof ADDRESS_FAMILY)
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Address->si_family == AF_INET)
+        if (Statistics == nullptr)
         {
-            if (AddressLength < sizeof Address->Ipv4)
-            {
-                break;
-            }
-
-            Status = RtlIpv4AddressToStringEx(&Address->Ipv4.sin_addr, Address->Ipv4.sin_port,
-                AddressString, reinterpret_cast<ULONG*>(AddressStringLength));
-
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (Address->si_family == AF_INET6)
-        {
-            if (AddressLength < sizeof Address->Ipv6)
-            {
-                break;
-            }
-
-            Status = RtlIpv6AddressToStringEx(&Address->Ipv6.sin6_addr, Address->Ipv6.sin6_scope_id,
-                Address->Ipv6.sin6_port, AddressString, reinterpret_cast<ULONG*>(AddressStringLength));
-
-            break;
-        }
+        WSKPortAllocatorQuery(Statistics);
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKStringToAddress(
-    _In_    PCWSTR      AddressString,
-    _Inout_ SOCKADDR*   SockAddress,
-    _Inout_ UINT32*     AddressLength
+NTSTATUS WSKAPI WSKConnectByName(
+    _Out_ SOCKET*       Socket,
+    _In_  LPCWSTR       NodeName,
+    _In_  LPCWSTR       ServiceName,
+    _Out_writes_bytes_opt_(RemoteAddressLength) PSOCKADDR RemoteAddress,
+    _In_  SIZE_T        RemoteAddressLength,
+    _In_opt_ UINT32     TimeoutMilliseconds
 )
 {
-    NTSTATUS Status = STATUS_INVALID_PARAMETER;
+    NTSTATUS     Status   = STATUS_SUCCESS;
+    PADDRINFOEXW AddrInfo = nullptr;
+
+    WSK_CONNECT_ATTEMPT* Attempts   = nullptr;
+    PVOID*               Objects    = nullptr;
+    PKWAIT_BLOCK         WaitBlocks = nullptr;
+    ULONG                Count      = 0u;
+    ULONG                Started    = 0u;
+    WSK_CONNECT_ATTEMPT* Winner     = nullptr;
 
     do
     {
-        auto Address = reinterpret_cast<SOCKADDR_INET*>(SockAddress);
+        *Socket = WSK_INVALID_SOCKET;
 
-        if (Address == nullptr || AddressLength == nullptr || *AddressLength < sizeof ADDRESS_FAMILY)
+        if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
+            Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Address->si_family == AF_INET)
+        if (NodeName == nullptr || ServiceName == nullptr ||
+            (RemoteAddress && RemoteAddressLength < sizeof SOCKADDR))
         {
-            if (*AddressLength < sizeof Address->Ipv4)
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        const ULONG64 Deadline = (TimeoutMilliseconds == WSK_INFINITE_WAIT) ? MAXULONG64 :
+            KeQueryInterruptTime() + static_cast<ULONG64>(TimeoutMilliseconds) * 10000u;
+
+        ADDRINFOEXW Hints{};
+        Hints.ai_family   = AF_UNSPEC;
+        Hints.ai_socktype = SOCK_STREAM;
+        Hints.ai_protocol = IPPROTO_TCP;
+
+        Status = WSKGetAddrInfo(NodeName, ServiceName, NS_ALL, nullptr, &Hints, &AddrInfo,
+            TimeoutMilliseconds, nullptr, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        for (auto Info = AddrInfo; Info && Count < MAXIMUM_WAIT_OBJECTS; Info = Info->ai_next)
+        {
+            if (Info->ai_addr && (Info->ai_family == AF_INET || Info->ai_family == AF_INET6))
             {
-                break;
+                Count += 1;
             }
+        }
 
-            Status = RtlIpv4StringToAddressEx(AddressString, TRUE,
-                &Address->Ipv4.sin_addr, &Address->Ipv4.sin_port);
-            if (!NT_SUCCESS(Status))
+        if (Count == 0)
+        {
+            Status = STATUS_NOT_FOUND;
+            break;
+        }
+
+        Attempts   = static_cast<WSK_CONNECT_ATTEMPT*>(ExAllocatePoolZero(NonPagedPool,
+            Count * sizeof(WSK_CONNECT_ATTEMPT), WSK_POOL_TAG));
+        Objects    = static_cast<PVOID*>(ExAllocatePoolZero(NonPagedPool,
+            Count * sizeof(PVOID), WSK_POOL_TAG));
+        WaitBlocks = static_cast<PKWAIT_BLOCK>(ExAllocatePoolZero(NonPagedPool,
+            Count * sizeof(KWAIT_BLOCK), WSK_POOL_TAG));
+
+        if (Attempts == nullptr || Objects == nullptr || WaitBlocks == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        // RFC 8305 section 4: interleave the address families, IPv6 first,
+        // each family in the order the resolver returned it.
+
+        auto NextAddress = [](PADDRINFOEXW Info, bool Preferred) -> PADDRINFOEXW
+        {
+            while (Info && !(Info->ai_addr && (Info->ai_family == AF_INET || Info->ai_family == AF_INET6) &&
+                ((Info->ai_family == AF_INET6) == Preferred)))
             {
-                *AddressLength = 0u;
-                break;
+                Info = Info->ai_next;
             }
+            return Info;
+        };
 
-            *AddressLength = sizeof Address->Ipv4;
-            break;
+        auto Preferred = NextAddress(AddrInfo, true);
+        auto Fallback  = NextAddress(AddrInfo, false);
+
+        for (ULONG Idx = 0; Idx < Count; ++Idx)
+        {
+            if (Preferred && (Fallback == nullptr || Idx % 2 == 0))
+            {
+                Attempts[Idx].Address = Preferred;
+                Preferred = NextAddress(Preferred->ai_next, true);
+            }
+            else
+            {
+                Attempts[Idx].Address = Fallback;
+                Fallback = NextAddress(Fallback->ai_next, false);
+            }
         }
 
-        if (Address->si_family == AF_INET6)
+        // Start an attempt, then start the next one when it fails or when the
+        // Connection Attempt Delay expires. The first connection to succeed wins.
+
+        NTSTATUS LastStatus = STATUS_CONNECTION_REFUSED;
+        BOOLEAN  StartNext  = TRUE;
+
+        while (Winner == nullptr)
         {
-            if (*AddressLength < sizeof Address->Ipv6)
+            if (KeQueryInterruptTime() >= Deadline)
             {
+                LastStatus = STATUS_TIMEOUT;
                 break;
             }
 
-            Status = RtlIpv6StringToAddressEx(AddressString, &Address->Ipv6.sin6_addr,
-                &Address->Ipv6.sin6_scope_id, &Address->Ipv6.sin6_port);
-            if (!NT_SUCCESS(Status))
+            if (StartNext && Started < Count)
             {
-                *AddressLength = 0u;
-                break;
+                auto Attempt = &Attempts[Started++];
+                StartNext = FALSE;
+
+                LastStatus = WSKStartConnectAttempt(Attempt);
+                if (!NT_SUCCESS(LastStatus))
+                {
+                    WSKFinishConnectAttempt(Attempt, TRUE);
+                    StartNext = TRUE;
+                    continue;
+                }
             }
 
-            *AddressLength = sizeof Address->Ipv6;
+            ULONG Pending = 0u;
+            ULONG Indexes[MAXIMUM_WAIT_OBJECTS];
+
+            for (ULONG Idx = 0; Idx < Started; ++Idx)
+            {
+                if (!Attempts[Idx].Done)
+                {
+                    Indexes[Pending] = Idx;
+                    Objects[Pending] = &Attempts[Idx].WSKContext->Event;
+                    Pending += 1;
+                }
+            }
+
+            if (Pending == 0)
+            {
+                if (Started == Count)
+                {
+                    break;
+                }
+
+                StartNext = TRUE;
+                continue;
+            }
+
+            const ULONG64 Now = KeQueryInterruptTime();
+
+            ULONG64 Wait = (Deadline > Now) ? Deadline - Now : 0u;
+            if (Started < Count && Wait > WSK_CONNECTION_ATTEMPT_DELAY)
+            {
+                Wait = WSK_CONNECTION_ATTEMPT_DELAY;
+            }
+
+            LARGE_INTEGER Timeout{};
+            Timeout.QuadPart = -static_cast<LONGLONG>(Wait);
+
+            Status = KeWaitForMultipleObjects(Pending, Objects, WaitAny, Executive, KernelMode,
+                FALSE, (Deadline == MAXULONG64 && Started == Count) ? nullptr : &Timeout, WaitBlocks);
+
+            if (Status == STATUS_TIMEOUT)
+            {
+                StartNext = TRUE;
+                continue;
+            }
+
+            if (Status >= STATUS_WAIT_0 && static_cast<ULONG>(Status - STATUS_WAIT_0) < Pending)
+            {
+                auto Attempt = &Attempts[Indexes[Status - STATUS_WAIT_0]];
+                Attempt->Done = TRUE;
+
+                LastStatus = Attempt->WSKContext->Irp->IoStatus.Status;
+                if (NT_SUCCESS(LastStatus))
+                {
+                    Winner = Attempt;
+                    break;
+                }
+
+                WSKFinishConnectAttempt(Attempt, TRUE);
+                StartNext = TRUE;
+                continue;
+            }
+
+            LastStatus = Status;
             break;
         }
 
-    } while (false);
+        Status = (Winner != nullptr) ? STATUS_SUCCESS : LastStatus;
+
+    } while (false);
+
+    if (Attempts)
+    {
+        for (ULONG Idx = 0; Idx < Started; ++Idx)
+        {
+            WSKFinishConnectAttempt(&Attempts[Idx], &Attempts[Idx] != Winner);
+        }
+    }
+
+    if (Winner)
+    {
+        if (RemoteAddress)
+        {
+            RtlCopyMemory(RemoteAddress, Winner->Address->ai_addr,
+                min(RemoteAddressLength, Winner->Address->ai_addrlen));
+        }
+
+        Winner->Context->State = WSK_SOCKET_STATE_CONNECTED;
+
+        if (!WSKSocketsAVLTableInsert(Socket, Winner->Socket, static_cast<USHORT>(WSK_FLAG_CONNECTION_SOCKET), &WSKConnectionKind, Winner->Context))
+        {
+            WSKCloseSocketUnsafe(Winner->Socket, WSK_FLAG_CONNECTION_SOCKET);
+            WSKReleaseSocketContext(Winner->Context);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (WaitBlocks)
+    {
+        ExFreePoolWithTag(WaitBlocks, WSK_POOL_TAG);
+    }
+
+    if (Objects)
+    {
+        ExFreePoolWithTag(Objects, WSK_POOL_TAG);
+    }
+
+    if (Attempts)
+    {
+        ExFreePoolWithTag(Attempts, WSK_POOL_TAG);
+    }
+
+    WSKFreeAddrInfo(AddrInfo);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSocket(
-    _Out_ SOCKET*           Socket,
-    _In_  ADDRESS_FAMILY    AddressFamily,
-    _In_  USHORT            SocketType,
-    _In_  ULONG             Protocol,
-    _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
+NTSTATUS WSKAPI WSKDisconnect(
+    _In_ SOCKET         Socket,
+    _In_ ULONG          Flags
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
 
-    do 
+    do
     {
-        *Socket = WSK_INVALID_SOCKET;
-
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        ULONG WSKSocketType = WSK_FLAG_BASIC_SOCKET;
-
-        switch (SocketType)
+        if (Socket == WSK_INVALID_SOCKET)
         {
-        case SOCK_STREAM:
-            WSKSocketType = WSK_FLAG_STREAM_SOCKET;
-            break;
-        case SOCK_DGRAM:
-            WSKSocketType = WSK_FLAG_DATAGRAM_SOCKET;
-            break;
-        case SOCK_RAW:
-            WSKSocketType = WSK_FLAG_DATAGRAM_SOCKET;
-            break;
-        default:
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        PWSK_SOCKET Socket_ = nullptr;
+        SOCKET_OBJECT SocketObject{};
 
-        Status = WSKSocketUnsafe(&Socket_, AddressFamily, SocketType, Protocol, WSKSocketType, SecurityDescriptor);
-        if (!NT_SUCCESS(Status))
+        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
         {
+            Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (!WSKSocketsAVLTableInsert(Socket, Socket_, static_cast<USHORT>(WSKSocketType)))
+        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
         {
-            WSKCloseSocketUnsafe(Socket_, WSKSocketType);
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (SocketObject.Kind->Disconnect == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
         }
 
+        Status = SocketObject.Kind->Disconnect(SocketObject.Socket, nullptr, 0u, nullptr,
+            Flags, WSK_INFINITE_WAIT, nullptr, nullptr, SocketObject.Context);
+
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKCloseSocket(
-    _In_ SOCKET Socket
+NTSTATUS WSKAPI WSKShutdown(
+    _In_ SOCKET         Socket,
+    _In_ INT            How
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -2280,7 +7303,7 @@ NTSTATUS WSKAPI WSKCloseSocket(
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Socket == WSK_INVALID_SOCKET || (How != WSK_SD_RECEIVE && How != WSK_SD_SEND && How != WSK_SD_BOTH))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
@@ -2300,27 +7323,34 @@ NTSTATUS WSKAPI WSKCloseSocket(
             break;
         }
 
-        Status = WSKCloseSocketUnsafe(SocketObject.Socket, SocketObject.SocketType);
-        if (!NT_SUCCESS(Status))
+        if (How != WSK_SD_RECEIVE && SocketObject.Kind->Disconnect == nullptr)
         {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        WSKSocketsAVLTableDelete(Socket);
+        // The provider has no receive shutdown, later receives are failed here instead.
+        if (How != WSK_SD_SEND && SocketObject.Context)
+        {
+            WSKSetSocketState(SocketObject.Context, WSK_SOCKET_STATE_RECVSHUT, 0);
+        }
+
+        if (How != WSK_SD_RECEIVE)
+        {
+            Status = SocketObject.Kind->Disconnect(SocketObject.Socket, nullptr, 0u, nullptr,
+                0u, WSK_INFINITE_WAIT, nullptr, nullptr, SocketObject.Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKIoctl(
-    _In_ SOCKET         Socket,
-    _In_ ULONG          ControlCode,
-    _In_reads_bytes_opt_(InputSize)     PVOID InputBuffer,
-    _In_ SIZE_T         InputSize,
-    _Out_writes_bytes_opt_(OutputSize)  PVOID OutputBuffer,
-    _In_ SIZE_T         OutputSize,
-    _Out_opt_ SIZE_T*   OutputSizeReturned,
+NTSTATUS WSKAPI WSKSendAndDisconnect(
+    _In_ SOCKET Socket,
+    _In_reads_bytes_opt_(BufferLength) PVOID Buffer,
+    _In_ SIZE_T BufferLength,
+    _Out_opt_ SIZE_T* NumberOfBytesSent,
     _In_opt_  WSKOVERLAPPED* Overlapped,
     _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
@@ -2329,11 +7359,6 @@ NTSTATUS WSKAPI WSKIoctl(
 
     do
     {
-        if (OutputSizeReturned)
-        {
-            *OutputSizeReturned = 0u;
-        }
-
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
@@ -2360,33 +7385,56 @@ NTSTATUS WSKAPI WSKIoctl(
             break;
         }
 
-        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskIoctl, ControlCode, 0,
-            InputBuffer, InputSize, OutputBuffer, OutputSize, OutputSizeReturned, Overlapped, CompletionRoutine);
+        if (SocketObject.Kind->Disconnect == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
+
+        Status = SocketObject.Kind->Disconnect(SocketObject.Socket, Buffer, BufferLength,
+            NumberOfBytesSent, 0u, SocketObject.SendTimeout, Overlapped, CompletionRoutine, SocketObject.Context);
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSetSocketOpt(
+NTSTATUS WSKAPI WSKTransmitFile(
     _In_ SOCKET         Socket,
-    _In_ ULONG          OptionLevel,
-    _In_ ULONG          OptionName,
-    _In_reads_bytes_(InputSize) PVOID InputBuffer,
-    _In_ SIZE_T         InputSize
+    _In_opt_ HANDLE     FileHandle,
+    _In_opt_ PFILE_OBJECT FileObject,
+    _In_ ULONG64        Offset,
+    _In_ ULONG64        Length,
+    _Out_opt_ ULONG64*  NumberOfBytesSent,
+    _In_ ULONG          Flags
 )
 {
+    PAGED_CODE();
+
     NTSTATUS Status = STATUS_SUCCESS;
+    PFILE_OBJECT File = nullptr;
 
     do
     {
+        if (NumberOfBytesSent)
+        {
+            *NumberOfBytesSent = 0u;
+        }
+
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Socket == WSK_INVALID_SOCKET || (FileHandle == nullptr) == (FileObject == nullptr) ||
+            (Flags & ~WSK_TF_DISCONNECT))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
@@ -2406,114 +7454,128 @@ NTSTATUS WSKAPI WSKSetSocketOpt(
             break;
         }
 
-        if (OptionLevel == SOL_SOCKET && (OptionName == SO_SNDTIMEO || OptionName == SO_RCVTIMEO))
+        if (WSKSocketIdleExpired(SocketObject.Context))
         {
-            if (InputSize != sizeof(ULONG) || InputBuffer == nullptr)
-            {
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
-
-            ULONG* Timeout = nullptr;
-
-            if (OptionName == SO_SNDTIMEO)
-            {
-                Timeout = &SocketObject.SendTimeout;
-            }
-            if (OptionName == SO_RCVTIMEO)
-            {
-                Timeout = &SocketObject.RecvTimeout;
-            }
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
 
-            *Timeout = *static_cast<ULONG*>(InputBuffer);
+        if (SocketObject.Kind->TransmitFile == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
 
-            if (!WSKSocketsAVLTableUpdate(Socket, &SocketObject))
+        if (FileHandle)
+        {
+            Status = ObReferenceObjectByHandle(FileHandle, FILE_READ_DATA, *IoFileObjectType, KernelMode,
+                reinterpret_cast<PVOID*>(&File), nullptr);
+            if (!NT_SUCCESS(Status))
             {
-                Status = STATUS_UNSUCCESSFUL;
+                break;
             }
+        }
+        else
+        {
+            ObReferenceObject(FileObject);
+            File = FileObject;
+        }
 
+        Status = SocketObject.Kind->TransmitFile(SocketObject.Socket, File, Offset, Length,
+            NumberOfBytesSent, SocketObject.SendTimeout, SocketObject.Context);
+        if (!NT_SUCCESS(Status))
+        {
             break;
         }
 
-        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskSetOption,
-            OptionName, OptionLevel, InputBuffer, InputSize, nullptr, 0, nullptr, nullptr, nullptr);
+        WSKTouchSocketContext(SocketObject.Context);
+
+        if (Flags & WSK_TF_DISCONNECT)
+        {
+            Status = SocketObject.Kind->Disconnect(SocketObject.Socket, nullptr, 0u, nullptr,
+                0u, SocketObject.SendTimeout, nullptr, nullptr, SocketObject.Context);
+        }
 
     } while (false);
 
+    if (File)
+    {
+        ObDereferenceObject(File);
+    }
+
     return Status;
 }
 
-NTSTATUS WSKAPI WSKGetSocketOpt(
-    _In_ SOCKET         Socket,
-    _In_ ULONG          OptionLevel,
-    _In_ ULONG          OptionName,
-    _Out_writes_bytes_(*OutputSize) PVOID OutputBuffer,
-    _Inout_ SIZE_T* OutputSize
+NTSTATUS WSKAPI WSKSplice(
+    _In_ SOCKET         Source,
+    _In_ SOCKET         Destination,
+    _In_opt_ const WSKSPLICEOPTIONS* Options,
+    _Out_opt_ WSKSPLICESTATS* Statistics
 )
 {
+    PAGED_CODE();
+
     NTSTATUS Status = STATUS_SUCCESS;
 
     do
     {
+        if (Statistics)
+        {
+            *Statistics = {};
+        }
+
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Source == WSK_INVALID_SOCKET || Destination == WSK_INVALID_SOCKET || Source == Destination)
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        SOCKET_OBJECT SocketObject{};
+        SOCKET_OBJECT SourceObject{};
+        SOCKET_OBJECT DestinationObject{};
 
-        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        if (!WSKSocketsAVLTableFind(Source, &SourceObject) ||
+            !WSKSocketsAVLTableFind(Destination, &DestinationObject))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        if (SourceObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET) ||
+            DestinationObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
         {
             Status = STATUS_NOT_SUPPORTED;
             break;
         }
 
-        if (OptionLevel == SOL_SOCKET && (OptionName == SO_SNDTIMEO || OptionName == SO_RCVTIMEO))
+        if (SourceObject.Kind->Resolve == nullptr || DestinationObject.Kind->Resolve == nullptr)
         {
-            if (*OutputSize != sizeof(ULONG) || OutputBuffer == nullptr)
-            {
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
-
-            if (OptionName == SO_SNDTIMEO)
-            {
-                *static_cast<ULONG*>(OutputBuffer) = SocketObject.SendTimeout;
-            }
-            if (OptionName == SO_RCVTIMEO)
-            {
-                *static_cast<ULONG*>(OutputBuffer) = SocketObject.RecvTimeout;
-            }
-
-            *OutputSize = sizeof ULONG;
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        Status = WSKControlSocketUnsafe(SocketObject.Socket, SocketObject.SocketType, WskGetOption,
-            OptionName, OptionLevel, nullptr, 0, OutputBuffer, *OutputSize, OutputSize, nullptr, nullptr);
+        const WSKSPLICEOPTIONS DefaultOptions{};
+
+        Status = WSKSpliceUnsafe(&SourceObject, &DestinationObject, Options ? Options : &DefaultOptions, Statistics);
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKBind(
-    _In_ SOCKET         Socket,
-    _In_ PSOCKADDR      LocalAddress,
-    _In_ SIZE_T         LocalAddressLength
+NTSTATUS WSKAPI WSKSend(
+    _In_ SOCKET Socket,
+    _In_ PVOID  Buffer,
+    _In_ SIZE_T BufferLength,
+    _Out_opt_ SIZE_T* NumberOfBytesSent,
+    _In_ ULONG  Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -2546,26 +7608,59 @@ NTSTATUS WSKAPI WSKBind(
             break;
         }
 
-        Status = WSKBindUnsafe(SocketObject.Socket, SocketObject.SocketType, LocalAddress, LocalAddressLength);
+        if (SocketObject.Kind->Send == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
+
+        if (SocketObject.NonBlocking && SocketObject.Context && Overlapped == nullptr)
+        {
+            const WSKBUF Piece{ BufferLength, Buffer };
+
+            Status = WSKSendNonBlocking(&SocketObject, &Piece, 1u, NumberOfBytesSent, Flags, FALSE);
+        }
+        else
+        {
+            Status = SocketObject.Kind->Send(SocketObject.Socket, Buffer, BufferLength,
+                NumberOfBytesSent, Flags, SocketObject.SendTimeout, Overlapped, CompletionRoutine, SocketObject.Context);
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(SocketObject.Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKAccept(
-    _In_  SOCKET        Socket,
-    _Out_ SOCKET*       SocketClient,
-    _Out_opt_ PSOCKADDR LocalAddress,
-    _In_ SIZE_T         LocalAddressLength,
-    _Out_opt_ PSOCKADDR RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength
+NTSTATUS WSKAPI WSKSendBuffers(
+    _In_ SOCKET         Socket,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG          BufferCount,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _In_ ULONG          Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
 
     do
     {
+        if (NumberOfBytesSent)
+        {
+            *NumberOfBytesSent = 0u;
+        }
+
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
@@ -2592,19 +7687,32 @@ NTSTATUS WSKAPI WSKAccept(
             break;
         }
 
-        PWSK_SOCKET SocketClient_ = nullptr;
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
 
-        Status = WSKAcceptUnsafe(SocketObject.Socket, SocketObject.SocketType, &SocketClient_,
-            LocalAddress, LocalAddressLength, RemoteAddress, RemoteAddressLength);
-        if (!NT_SUCCESS(Status))
+        if (SocketObject.Kind->SendBuffers == nullptr)
         {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        if (!WSKSocketsAVLTableInsert(SocketClient, SocketClient_, static_cast<USHORT>(WSK_FLAG_CONNECTION_SOCKET)))
+        if (SocketObject.NonBlocking && SocketObject.Context && Overlapped == nullptr)
         {
-            WSKCloseSocketUnsafe(SocketClient_, WSK_FLAG_CONNECTION_SOCKET);
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+            Status = WSKSendNonBlocking(&SocketObject, Buffers, BufferCount, NumberOfBytesSent,
+                Flags & ~WSK_SB_WHOLE, (Flags & WSK_SB_WHOLE) != 0);
+        }
+        else
+        {
+            Status = SocketObject.Kind->SendBuffers(SocketObject.Socket, Buffers, BufferCount, NumberOfBytesSent,
+                Flags & ~WSK_SB_WHOLE, SocketObject.SendTimeout, Overlapped, CompletionRoutine, SocketObject.Context);
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(SocketObject.Context);
         }
 
     } while (false);
@@ -2612,13 +7720,18 @@ NTSTATUS WSKAPI WSKAccept(
     return Status;
 }
 
-NTSTATUS WSKAPI WSKListen(
+NTSTATUS WSKAPI WSKSendTo(
     _In_ SOCKET         Socket,
-    _In_ INT            BackLog
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _Reserved_ ULONG    Flags,
+    _In_opt_ PSOCKADDR  RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
 {
-    UNREFERENCED_PARAMETER(BackLog);
-
     NTSTATUS Status = STATUS_SUCCESS;
 
     do
@@ -2649,17 +7762,40 @@ NTSTATUS WSKAPI WSKListen(
             break;
         }
 
-        Status = WSKListenUnsafe(SocketObject.Socket, SocketObject.SocketType);
+        if (SocketObject.Kind->SendTo == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
+
+        Status = SocketObject.Kind->SendTo(SocketObject.Socket, Buffer, BufferLength,
+            NumberOfBytesSent, Flags, RemoteAddress, RemoteAddressLength, SocketObject.SendTimeout,
+            Overlapped, CompletionRoutine, SocketObject.Context);
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(SocketObject.Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKConnect(
+NTSTATUS WSKAPI WSKReceive(
     _In_ SOCKET         Socket,
-    _In_ PSOCKADDR      RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _In_ ULONG          Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -2692,16 +7828,78 @@ NTSTATUS WSKAPI WSKConnect(
             break;
         }
 
-        Status = WSKConnectUnsafe(SocketObject.Socket, SocketObject.SocketType, RemoteAddress, RemoteAddressLength);
+        if (SocketObject.Kind->Receive == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
+
+        if (WSKSocketReceiveShut(SocketObject.Context))
+        {
+            Status = STATUS_PIPE_DISCONNECTED;
+            break;
+        }
+
+        SIZE_T  BytesRecvd  = 0u;
+        ULONG   RecvTimeout = SocketObject.RecvTimeout;
+        BOOLEAN NonBlocking = SocketObject.NonBlocking && SocketObject.Context && Overlapped == nullptr;
+
+        if (NonBlocking)
+        {
+            if (NumberOfBytesRecvd)
+            {
+                *NumberOfBytesRecvd = 0u;
+            }
+
+            if (WSKSocketWouldBlock(&SocketObject, WSK_POLLIN))
+            {
+                Status = STATUS_DEVICE_NOT_READY;
+                break;
+            }
+
+            // The data should already be with the provider, do not wait for more.
+            RecvTimeout = 0u;
+        }
+
+        Status = SocketObject.Kind->Receive(SocketObject.Socket, Buffer, BufferLength,
+            &BytesRecvd, Flags, RecvTimeout, Overlapped, CompletionRoutine, SocketObject.Context);
+
+        if (NonBlocking && Status == STATUS_TIMEOUT)
+        {
+            Status = BytesRecvd ? STATUS_SUCCESS : STATUS_DEVICE_NOT_READY;
+        }
+
+        if (NumberOfBytesRecvd)
+        {
+            *NumberOfBytesRecvd = BytesRecvd;
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(SocketObject.Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKDisconnect(
+NTSTATUS WSKAPI WSKReceiveFrom(
     _In_ SOCKET         Socket,
-    _In_ ULONG          Flags
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _Reserved_ ULONG    Flags,
+    _Out_opt_ PSOCKADDR RemoteAddress,
+    _In_ SIZE_T         RemoteAddressLength,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -2734,27 +7932,68 @@ NTSTATUS WSKAPI WSKDisconnect(
             break;
         }
 
-        Status = WSKDisconnectUnsafe(SocketObject.Socket, SocketObject.SocketType, nullptr, Flags);
+        if (SocketObject.Kind->ReceiveFrom == nullptr)
+        {
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+        }
+
+        if (WSKSocketIdleExpired(SocketObject.Context))
+        {
+            Status = STATUS_IO_TIMEOUT;
+            break;
+        }
+
+        ULONG   RecvTimeout = SocketObject.RecvTimeout;
+        BOOLEAN NonBlocking = SocketObject.NonBlocking && SocketObject.Context && Overlapped == nullptr;
+
+        if (NonBlocking)
+        {
+            if (NumberOfBytesRecvd)
+            {
+                *NumberOfBytesRecvd = 0u;
+            }
+
+            if (WSKSocketWouldBlock(&SocketObject, WSK_POLLIN))
+            {
+                Status = STATUS_DEVICE_NOT_READY;
+                break;
+            }
+
+            RecvTimeout = 0u;
+        }
+
+        Status = SocketObject.Kind->ReceiveFrom(SocketObject.Socket, Buffer, BufferLength,
+            NumberOfBytesRecvd, Flags, RemoteAddress, RemoteAddressLength, RecvTimeout,
+            Overlapped, CompletionRoutine, SocketObject.Context);
+
+        // The datagram may have arrived just before the receive was cancelled.
+        if (NonBlocking && Status == STATUS_TIMEOUT)
+        {
+            Status = (NumberOfBytesRecvd && *NumberOfBytesRecvd) ? STATUS_SUCCESS : STATUS_DEVICE_NOT_READY;
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(SocketObject.Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSend(
-    _In_ SOCKET Socket,
-    _In_ PVOID  Buffer,
-    _In_ SIZE_T BufferLength,
-    _Out_opt_ SIZE_T* NumberOfBytesSent,
-    _In_ ULONG  Flags,
-    _In_opt_  WSKOVERLAPPED* Overlapped,
-    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+NTSTATUS WSKAPI WSKReferenceSocketDispatch(
+    _In_  SOCKET             Socket,
+    _Out_ WSKSOCKETDISPATCH* Dispatch
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
 
     do
     {
+        RtlZeroMemory(Dispatch, sizeof(*Dispatch));
+
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
@@ -2769,7 +8008,7 @@ NTSTATUS WSKAPI WSKSend(
 
         SOCKET_OBJECT SocketObject{};
 
-        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        if (!WSKSocketsAVLTableReference(Socket, &SocketObject))
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
@@ -2777,26 +8016,44 @@ NTSTATUS WSKAPI WSKSend(
 
         if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
         {
+            WSKReleaseSocketContext(SocketObject.Context);
+
             Status = STATUS_NOT_SUPPORTED;
             break;
         }
 
-        Status = WSKSendUnsafe(SocketObject.Socket, SocketObject.SocketType, Buffer, BufferLength,
-            NumberOfBytesSent, Flags, SocketObject.SendTimeout, Overlapped, CompletionRoutine);
+        // Not connected yet, or not a connection at all, leaves the routines empty.
+        if (SocketObject.Kind->Resolve)
+        {
+            SocketObject.Kind->Resolve(SocketObject.Socket, Dispatch);
+        }
+
+        Dispatch->Handle      = Socket;
+        Dispatch->Context     = SocketObject.Context;
+        Dispatch->SendTimeout = SocketObject.SendTimeout;
+        Dispatch->RecvTimeout = SocketObject.RecvTimeout;
+        Dispatch->NonBlocking = SocketObject.NonBlocking;
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKSendTo(
-    _In_ SOCKET         Socket,
+VOID WSKAPI WSKDereferenceSocketDispatch(
+    _Inout_ WSKSOCKETDISPATCH* Dispatch
+)
+{
+    WSKReleaseSocketContext(static_cast<PSOCKET_CONTEXT>(Dispatch->Context));
+
+    RtlZeroMemory(Dispatch, sizeof(*Dispatch));
+}
+
+NTSTATUS WSKAPI WSKSendDispatch(
+    _In_ const WSKSOCKETDISPATCH* Dispatch,
     _In_ PVOID          Buffer,
     _In_ SIZE_T         BufferLength,
     _Out_opt_ SIZE_T*   NumberOfBytesSent,
-    _Reserved_ ULONG    Flags,
-    _In_opt_ PSOCKADDR  RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength,
+    _In_ ULONG          Flags,
     _In_opt_  WSKOVERLAPPED* Overlapped,
     _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 )
@@ -2805,43 +8062,51 @@ NTSTATUS WSKAPI WSKSendTo(
 
     do
     {
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        // Nonblocking sends keep their bookkeeping in the table path.
+        if (Dispatch->NonBlocking && Overlapped == nullptr)
         {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            Status = WSKSend(Dispatch->Handle, Buffer, BufferLength, NumberOfBytesSent, Flags,
+                Overlapped, CompletionRoutine);
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Dispatch->Send == nullptr)
         {
-            Status = STATUS_INVALID_PARAMETER;
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        SOCKET_OBJECT SocketObject{};
+        const auto Context = static_cast<PSOCKET_CONTEXT>(Dispatch->Context);
 
-        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        if (WSKSocketIdleExpired(Context))
         {
-            Status = STATUS_INVALID_PARAMETER;
+            Status = STATUS_IO_TIMEOUT;
             break;
         }
 
-        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        if (!WSKAcquireSocketRundown(Context))
         {
-            Status = STATUS_NOT_SUPPORTED;
+            Status = STATUS_INVALID_HANDLE;
             break;
         }
 
-        Status = WSKSendToUnsafe(SocketObject.Socket, SocketObject.SocketType, Buffer, BufferLength,
-            NumberOfBytesSent, Flags, RemoteAddress, RemoteAddressLength, SocketObject.SendTimeout,
-            Overlapped, CompletionRoutine);
+        Status = WSKSendDirect(Dispatch->Send, Dispatch->Socket, Buffer, BufferLength, NumberOfBytesSent,
+            Flags, Dispatch->SendTimeout, Overlapped, CompletionRoutine, Context);
+
+        WSKReleaseSocketRundown(Context);
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKReceive(
-    _In_ SOCKET         Socket,
+NTSTATUS WSKAPI WSKReceiveDispatch(
+    _In_ const WSKSOCKETDISPATCH* Dispatch,
     _In_ PVOID          Buffer,
     _In_ SIZE_T         BufferLength,
     _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
@@ -2854,88 +8119,224 @@ NTSTATUS WSKAPI WSKReceive(
 
     do
     {
-        if (!InterlockedCompareExchange(&_Initialized, true, true))
+        if (Dispatch->NonBlocking && Overlapped == nullptr)
         {
-            Status = STATUS_NDIS_ADAPTER_NOT_READY;
+            Status = WSKReceive(Dispatch->Handle, Buffer, BufferLength, NumberOfBytesRecvd, Flags,
+                Overlapped, CompletionRoutine);
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Dispatch->Receive == nullptr)
         {
-            Status = STATUS_INVALID_PARAMETER;
+            Status = STATUS_INVALID_DEVICE_REQUEST;
             break;
         }
 
-        SOCKET_OBJECT SocketObject{};
+        const auto Context = static_cast<PSOCKET_CONTEXT>(Dispatch->Context);
 
-        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+        if (WSKSocketIdleExpired(Context))
         {
-            Status = STATUS_INVALID_PARAMETER;
+            Status = STATUS_IO_TIMEOUT;
             break;
         }
 
-        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        if (WSKSocketReceiveShut(Context))
         {
-            Status = STATUS_NOT_SUPPORTED;
+            Status = STATUS_PIPE_DISCONNECTED;
+            break;
+        }
+
+        SIZE_T BytesRecvd = 0u;
+
+        if (!WSKAcquireSocketRundown(Context))
+        {
+            Status = STATUS_INVALID_HANDLE;
             break;
         }
 
-        Status = WSKReceiveUnsafe(SocketObject.Socket, SocketObject.SocketType, Buffer, BufferLength,
-            NumberOfBytesRecvd, Flags, SocketObject.RecvTimeout, Overlapped, CompletionRoutine);
+        Status = WSKReceiveDirect(Dispatch->Receive, Dispatch->Socket, Buffer, BufferLength, &BytesRecvd,
+            Flags, Dispatch->RecvTimeout, Overlapped, CompletionRoutine, Context);
+
+        WSKReleaseSocketRundown(Context);
+
+        if (NumberOfBytesRecvd)
+        {
+            *NumberOfBytesRecvd = BytesRecvd;
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            WSKTouchSocketContext(Context);
+        }
 
     } while (false);
 
     return Status;
 }
 
-NTSTATUS WSKAPI WSKReceiveFrom(
-    _In_ SOCKET         Socket,
-    _In_ PVOID          Buffer,
-    _In_ SIZE_T         BufferLength,
-    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
-    _Reserved_ ULONG    Flags,
-    _Out_opt_ PSOCKADDR RemoteAddress,
-    _In_ SIZE_T         RemoteAddressLength,
-    _In_opt_  WSKOVERLAPPED* Overlapped,
-    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+NTSTATUS WSKAPI WSKPoll(
+    _Inout_updates_(SocketCount) WSKPOLLFD* Sockets,
+    _In_ UINT32         SocketCount,
+    _In_ UINT32         TimeoutMilliseconds,
+    _Out_opt_ UINT32*   ReadyCount
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
+    UINT32   Ready  = 0u;
+
+    SOCKET_OBJECT*   Objects = nullptr;
+    WSK_POLL_WAITER* Waiters = nullptr;
+
+    KEVENT Event;
+    KeInitializeEvent(&Event, SynchronizationEvent, FALSE);
 
     do
     {
+        if (ReadyCount)
+        {
+            *ReadyCount = 0u;
+        }
+
         if (!InterlockedCompareExchange(&_Initialized, true, true))
         {
             Status = STATUS_NDIS_ADAPTER_NOT_READY;
             break;
         }
 
-        if (Socket == WSK_INVALID_SOCKET)
+        if (Sockets == nullptr && SocketCount != 0)
         {
             Status = STATUS_INVALID_PARAMETER;
             break;
         }
 
-        SOCKET_OBJECT SocketObject{};
+        if (SocketCount)
+        {
+            Objects = static_cast<SOCKET_OBJECT*>(ExAllocatePoolZero(NonPagedPool,
+                SocketCount * sizeof(SOCKET_OBJECT), WSK_POOL_TAG));
+            Waiters = static_cast<WSK_POLL_WAITER*>(ExAllocatePoolZero(NonPagedPool,
+                SocketCount * sizeof(WSK_POLL_WAITER), WSK_POOL_TAG));
 
-        if (!WSKSocketsAVLTableFind(Socket, &SocketObject))
+            if (Objects == nullptr || Waiters == nullptr)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+        // Register on every socket before the first scan, so no indication is missed.
+
+        for (UINT32 Idx = 0; Idx < SocketCount; ++Idx)
         {
-            Status = STATUS_INVALID_PARAMETER;
-            break;
+            Sockets[Idx].ReturnedEvents = 0;
+
+            if (Sockets[Idx].Socket == WSK_INVALID_SOCKET)
+            {
+                continue;
+            }
+
+            if (!WSKSocketsAVLTableReference(Sockets[Idx].Socket, &Objects[Idx]))
+            {
+                Sockets[Idx].ReturnedEvents = WSK_POLLNVAL;
+                continue;
+            }
+
+            auto Context = Objects[Idx].Context;
+            if (Context)
+            {
+                Waiters[Idx].Event = &Event;
+
+                KIRQL Irql;
+                KeAcquireSpinLock(&Context->Lock, &Irql);
+                {
+                    InsertTailList(&Context->Waiters, &Waiters[Idx].Link);
+                }
+                KeReleaseSpinLock(&Context->Lock, Irql);
+            }
         }
 
-        if (SocketObject.SocketType == static_cast<USHORT>(WSK_FLAG_INVALID_SOCKET))
+        const ULONG64 Deadline = (TimeoutMilliseconds == WSK_INFINITE_WAIT) ? MAXULONG64 :
+            KeQueryInterruptTime() + static_cast<ULONG64>(TimeoutMilliseconds) * 10000u;
+
+        for (;;)
         {
-            Status = STATUS_NOT_SUPPORTED;
-            break;
+            Ready = 0u;
+
+            for (UINT32 Idx = 0; Idx < SocketCount; ++Idx)
+            {
+                if (Objects[Idx].Context)
+                {
+                    WSKEnableSocketEvents(&Objects[Idx]);
+
+                    Sockets[Idx].ReturnedEvents = WSKPollSocketContext(Objects[Idx].Context, Sockets[Idx].Events);
+                }
+
+                if (Sockets[Idx].ReturnedEvents)
+                {
+                    Ready += 1;
+                }
+            }
+
+            const ULONG64 Now = KeQueryInterruptTime();
+            if (Ready || Now >= Deadline)
+            {
+                break;
+            }
+
+            LARGE_INTEGER Timeout{};
+            Timeout.QuadPart = -static_cast<LONGLONG>(Deadline - Now);
+
+            Status = KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE,
+                (Deadline == MAXULONG64) ? nullptr : &Timeout);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            Status = Ready ? STATUS_SUCCESS : STATUS_TIMEOUT;
         }
 
-        Status = WSKReceiveFromUnsafe(SocketObject.Socket, SocketObject.SocketType, Buffer, BufferLength,
-            NumberOfBytesRecvd, Flags, RemoteAddress, RemoteAddressLength, SocketObject.RecvTimeout,
-            Overlapped, CompletionRoutine);
+        if (ReadyCount)
+        {
+            *ReadyCount = Ready;
+        }
 
     } while (false);
 
+    if (Objects && Waiters)
+    {
+        for (UINT32 Idx = 0; Idx < SocketCount; ++Idx)
+        {
+            auto Context = Objects[Idx].Context;
+            if (Context)
+            {
+                if (Waiters[Idx].Event)
+                {
+                    KIRQL Irql;
+                    KeAcquireSpinLock(&Context->Lock, &Irql);
+                    {
+                        RemoveEntryList(&Waiters[Idx].Link);
+                    }
+                    KeReleaseSpinLock(&Context->Lock, Irql);
+                }
+
+                WSKReleaseSocketContext(Context);
+            }
+        }
+    }
+
+    if (Waiters)
+    {
+        ExFreePoolWithTag(Waiters, WSK_POOL_TAG);
+    }
+
+    if (Objects)
+    {
+        ExFreePoolWithTag(Objects, WSK_POOL_TAG);
+    }
+
     return Status;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <wsk.h>
+#include <ws2ipdef.h>
 
 typedef UINT_PTR SOCKET;
 
@@ -37,6 +38,153 @@ typedef VOID(WSKAPI* LPWSKOVERLAPPED_COMPLETION_ROUTINE)(
     _In_ WSKOVERLAPPED* Overlapped
     );
 
+#define WSK_POLLRDNORM  0x0100
+#define WSK_POLLRDBAND  0x0200
+#define WSK_POLLIN      (WSK_POLLRDNORM | WSK_POLLRDBAND)
+#define WSK_POLLPRI     0x0400
+
+#define WSK_POLLWRNORM  0x0010
+#define WSK_POLLOUT     (WSK_POLLWRNORM)
+#define WSK_POLLWRBAND  0x0020
+
+#define WSK_POLLERR     0x0001
+#define WSK_POLLHUP     0x0002
+#define WSK_POLLNVAL    0x0004
+
+// WSKShutdown
+#define WSK_SD_RECEIVE  0x00
+#define WSK_SD_SEND     0x01
+#define WSK_SD_BOTH     0x02
+
+// WSKTransmitFile
+#define WSK_TF_DISCONNECT   0x01    // Graceful disconnect once the file is sent
+
+// WSKSendBuffers
+#define WSK_SB_WHOLE        0x80000000  // Nonblocking: all of the buffers or STATUS_DEVICE_NOT_READY, never a part
+
+// WSKSplice
+#define WSK_SPLICE_ONE_WAY  0x01    // Only Source to Destination
+
+typedef struct _WSKSPLICEOPTIONS
+{
+    ULONG   BufferSize;     // 0 for 64KB
+    ULONG   BufferCount;    // Per direction, 0 for 4, at most 16
+    ULONG   Flags;          // WSK_SPLICE_xxx
+    PKEVENT CancelEvent;    // Optional, signaled to stop the splice
+}WSKSPLICEOPTIONS, *PWSKSPLICEOPTIONS;
+
+typedef struct _WSKSPLICESTATS
+{
+    ULONG64 SourceToDestination;
+    ULONG64 DestinationToSource;
+}WSKSPLICESTATS, *PWSKSPLICESTATS;
+
+// One piece of a WSKSendBuffers gather list or of a received frame.
+typedef struct _WSKBUF
+{
+    SIZE_T  Length;
+    PVOID   Buffer;
+}WSKBUF, *PWSKBUF;
+
+// WSKCreateFramer length prefix, optionally with WSK_FRAME_CRC32C
+#define WSK_FRAME_U16BE     0x01    // 2 bytes, big endian
+#define WSK_FRAME_U32BE     0x02    // 4 bytes, big endian
+#define WSK_FRAME_VARINT    0x03    // 1 to 5 bytes of 7 bits, low group first, high bit set if more follow
+#define WSK_FRAME_CRC32C    0x100   // A big endian CRC32C of the payload follows the length
+
+#define WSK_FRAME_MAX_BUFFERS 15    // Payload pieces per WSKFramerSend
+
+// A message from WSKFramerReceive, valid until the next call on the framer.
+// It is left where it was received, in two segments if it wraps around the end of the ring.
+typedef struct _WSKFRAME
+{
+    SIZE_T  Length;         // Payload bytes
+    ULONG   SegmentCount;   // 0 for an empty payload
+    WSKBUF  Segments[2];
+}WSKFRAME, *PWSKFRAME;
+
+// WSKSetSocketOpt(SOL_SOCKET) option, ULONG milliseconds, 0 disables.
+// A connection without traffic for that long is aborted, reported as POLLHUP | POLLERR
+// and failed with STATUS_IO_TIMEOUT.
+#define WSK_SO_IDLE_TIMEOUT 0x7100
+
+// WSKSetSocketOpt(SOL_SOCKET) option, WSKCONNECTSOURCE.
+// Used when WSKConnect or SIO_WSK_SET_REMOTE_ADDRESS binds a socket that was not bound by WSKBind.
+// With a port range, ports are tried from a random one until a bind succeeds.
+#define WSK_SO_CONNECT_SOURCE 0x7101
+
+typedef struct _WSKCONNECTSOURCE
+{
+    SOCKADDR_INET   Address;    // Port is ignored, AF_UNSPEC for the wildcard address
+    USHORT          PortLow;    // Host order, 0 lets the stack choose
+    USHORT          PortHigh;
+}WSKCONNECTSOURCE, *PWSKCONNECTSOURCE;
+
+// WSKSetSocketOpt(SOL_SOCKET) option, ULONG, nonzero enables. Stream sockets only.
+// The implicit bind takes its port from a library allocator keyed by (local address,
+// remote address, remote port) and binds with SO_REUSEADDR, so connections to different
+// destinations share local ports. The range is the WSK_SO_CONNECT_SOURCE one, 49152-65535 if not set.
+#define WSK_SO_SHARE_SOURCE_PORT 0x7102
+
+typedef struct _WSKSOURCEPORTSTATS
+{
+    ULONG   Destinations;   // Keys with a port reserved or marked
+    ULONG   PortsInUse;     // Reservations over all keys
+    ULONG   PortsMarked;    // Refused by the stack, skipped until the mark ages out
+    ULONG64 Allocations;
+    ULONG64 Conflicts;      // Port held outside the allocator, the next one was tried
+    ULONG64 Exhausted;      // No free port left in the range for that destination
+}WSKSOURCEPORTSTATS, *PWSKSOURCEPORTSTATS;
+
+// A socket resolved once by WSKReferenceSocketDispatch.
+// WSKSendDispatch and WSKReceiveDispatch go straight to the cached provider routines,
+// without the socket table lookup and the per-call switch on the socket kind.
+// Resolve again after WSKConnect, WSKAccept or a socket option change, and before WSKCloseSocket.
+// A close on another thread waits for the calls already in the provider, later ones fail with STATUS_INVALID_HANDLE.
+typedef struct _WSKSOCKETDISPATCH
+{
+    SOCKET          Handle;
+    PWSK_SOCKET     Socket;     // Connected provider socket
+    PFN_WSK_SEND    Send;       // nullptr if the socket cannot send yet
+    PFN_WSK_RECEIVE Receive;
+    PVOID           Context;    // Referenced
+    ULONG           SendTimeout;
+    ULONG           RecvTimeout;
+    BOOLEAN         NonBlocking;
+}WSKSOCKETDISPATCH, *PWSKSOCKETDISPATCH;
+
+typedef struct _WSKPOLLFD
+{
+    SOCKET  Socket;
+    SHORT   Events;
+    SHORT   ReturnedEvents;
+}WSKPOLLFD, *PWSKPOLLFD;
+
+// Idle connected stream sockets kept per destination by WSKConnectionPoolAcquire/Release.
+typedef struct _WSKCONNECTIONPOOL* PWSKCONNECTIONPOOL;
+
+typedef struct _WSKCONNECTIONPOOLCONFIG
+{
+    ULONG   MaxIdle;        // Idle sockets kept per destination
+    ULONG   MaxIdleTime;    // Milliseconds an idle socket is kept, 0 for no limit
+    ULONG   MaxAge;         // Milliseconds after connect a socket is no longer reused, 0 for no limit
+}WSKCONNECTIONPOOLCONFIG, *PWSKCONNECTIONPOOLCONFIG;
+
+// Filled by WSKConnectionPoolAcquire, handed back to WSKConnectionPoolRelease.
+typedef struct _WSKPOOLEDSOCKET
+{
+    SOCKET  Socket;
+    BOOLEAN Reused;         // Taken from the idle list, not connected by this call
+    ULONG64 ConnectTime;    // KeQueryInterruptTime
+    PVOID   Destination;
+}WSKPOOLEDSOCKET, *PWSKPOOLEDSOCKET;
+
+// Buffered reads over a connected stream socket, see WSKCreateReader.
+typedef struct _WSKREADER* PWSKREADER;
+
+// Length-prefixed messages over a connected stream socket, see WSKCreateFramer.
+typedef struct _WSKFRAMER* PWSKFRAMER;
+
 /* WSK Socket function prototypes */
 
 #ifdef __cplusplus
@@ -74,6 +222,16 @@ NTSTATUS WSKAPI WSKGetOverlappedResult(
     _In_  BOOLEAN        Wait
 );
 
+// Cancels every outstanding send, receive and connect of the socket.
+NTSTATUS WSKAPI WSKCancelIo(
+    _In_ SOCKET         Socket
+);
+
+NTSTATUS WSKAPI WSKCancelIoEx(
+    _In_ SOCKET         Socket,
+    _In_opt_ WSKOVERLAPPED* Overlapped  // nullptr cancels all, same as WSKCancelIo
+);
+
 NTSTATUS WSKAPI WSKGetAddrInfo(
     _In_opt_ LPCWSTR        NodeName,
     _In_opt_ LPCWSTR        ServiceName,
@@ -115,6 +273,22 @@ NTSTATUS WSKAPI WSKStringToAddress(
     _Inout_ UINT32*     AddressLength
 );
 
+NTSTATUS WSKAPI WSKAddressToStringBatch(
+    _In_reads_(AddressCount) const SOCKADDR_INET* Addresses,
+    _In_    UINT32  AddressCount,
+    _Out_writes_to_opt_(*AddressStringsLength, *AddressStringsLength) LPWSTR AddressStrings, // packed, NUL separated
+    _Inout_ UINT32* AddressStringsLength,
+    _Out_writes_opt_(AddressCount) UINT32* AddressStringOffsets
+);
+
+NTSTATUS WSKAPI WSKStringToAddressBatch(
+    _In_reads_(AddressStringsLength) PCWSTR AddressStrings,                                  // packed, NUL separated
+    _In_    UINT32  AddressStringsLength,
+    _Out_writes_(AddressCount) SOCKADDR_INET* Addresses,
+    _In_    UINT32  AddressCount,
+    _Out_opt_ UINT32* AddressesConverted
+);
+
 NTSTATUS WSKAPI WSKSocket(
     _Out_ SOCKET*           Socket,
     _In_  ADDRESS_FAMILY    AddressFamily,
@@ -123,10 +297,35 @@ NTSTATUS WSKAPI WSKSocket(
     _In_opt_ PSECURITY_DESCRIPTOR SecurityDescriptor
 );
 
+// Keeps Count sockets of the kind created ahead by a background thread, 0 drops the reserve.
+// WSKSocket without a security descriptor takes one of them instead of calling the provider.
+NTSTATUS WSKAPI WSKSetSocketReserve(
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_ USHORT         SocketType,
+    _In_ ULONG          Protocol,
+    _In_ ULONG          Count
+);
+
 NTSTATUS WSKAPI WSKCloseSocket(
     _In_ SOCKET Socket
 );
 
+// The handle is invalid once this returns, the provider close runs on a background thread.
+// A connected stream is first disconnected gracefully for up to LingerMilliseconds and aborted
+// after that, 0 closes at once.
+NTSTATUS WSKAPI WSKCloseSocketAsync(
+    _In_ SOCKET Socket,
+    _In_ ULONG  LingerMilliseconds
+);
+
+// Closes started by WSKCloseSocketAsync that have not finished yet.
+ULONG WSKAPI WSKGetPendingCloseCount();
+
+// Returns STATUS_TIMEOUT if closes are still pending after TimeoutMilliseconds.
+NTSTATUS WSKAPI WSKWaitForPendingCloses(
+    _In_ ULONG TimeoutMilliseconds
+);
+
 NTSTATUS WSKAPI WSKIoctl(
     _In_ SOCKET         Socket,
     _In_ ULONG          ControlCode,
@@ -181,11 +380,66 @@ NTSTATUS WSKAPI WSKConnect(
     _In_ SIZE_T         RemoteAddressLength
 );
 
+NTSTATUS WSKAPI WSKGetSourcePortStatistics(
+    _Out_ WSKSOURCEPORTSTATS* Statistics
+);
+
+NTSTATUS WSKAPI WSKConnectByName(
+    _Out_ SOCKET*       Socket,
+    _In_  LPCWSTR       NodeName,
+    _In_  LPCWSTR       ServiceName,
+    _Out_writes_bytes_opt_(RemoteAddressLength) PSOCKADDR RemoteAddress,
+    _In_  SIZE_T        RemoteAddressLength,
+    _In_opt_ UINT32     TimeoutMilliseconds
+);
+
 NTSTATUS WSKAPI WSKDisconnect(
     _In_ SOCKET         Socket,
     _In_ ULONG          Flags
 );
 
+// SD_SEND sends the FIN and leaves receiving open. SD_RECEIVE fails later receives
+// with STATUS_PIPE_DISCONNECTED, the provider keeps accepting data.
+NTSTATUS WSKAPI WSKShutdown(
+    _In_ SOCKET         Socket,
+    _In_ INT            How     // WSK_SD_xxx
+);
+
+// Sends the last buffer and the FIN in one request, a graceful WSKDisconnect with data.
+NTSTATUS WSKAPI WSKSendAndDisconnect(
+    _In_ SOCKET Socket,
+    _In_reads_bytes_opt_(BufferLength) PVOID Buffer,
+    _In_ SIZE_T BufferLength,
+    _Out_opt_ SIZE_T* NumberOfBytesSent,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+);
+
+// Sends a file range without copying it, the pages come from the cache manager (MDL read)
+// or from a mapped view of the file. Exactly one of FileHandle and FileObject is given,
+// a Length of 0 sends up to the end of the file.
+NTSTATUS WSKAPI WSKTransmitFile(
+    _In_ SOCKET         Socket,
+    _In_opt_ HANDLE     FileHandle,
+    _In_opt_ PFILE_OBJECT FileObject,
+    _In_ ULONG64        Offset,
+    _In_ ULONG64        Length,
+    _Out_opt_ ULONG64*  NumberOfBytesSent,
+    _In_ ULONG          Flags
+);
+
+// Relays two connected sockets in both directions until each side has sent its FIN,
+// which is passed on to the other side. A direction keeps at most BufferCount receives
+// and sends outstanding, so a slow receiver holds the sender back through its TCP window.
+// Returns the first error, or STATUS_CANCELLED once the CancelEvent is signaled.
+// The sockets must not be closed while the call runs, signal the CancelEvent instead.
+NTSTATUS WSKAPI WSKSplice(
+    _In_ SOCKET         Source,
+    _In_ SOCKET         Destination,
+    _In_opt_ const WSKSPLICEOPTIONS* Options,
+    _Out_opt_ WSKSPLICESTATS* Statistics
+);
+
 NTSTATUS WSKAPI WSKSend(
     _In_ SOCKET         Socket,
     _In_ PVOID          Buffer,
@@ -196,6 +450,18 @@ NTSTATUS WSKAPI WSKSend(
     _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 );
 
+// Sends the buffers in order as one request, like WSASend with several WSABUF.
+// A nonblocking socket copies what fits in its send buffer, as WSKSend does, or all of it with WSK_SB_WHOLE.
+NTSTATUS WSKAPI WSKSendBuffers(
+    _In_ SOCKET         Socket,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG          BufferCount,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _In_ ULONG          Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+);
+
 NTSTATUS WSKAPI WSKSendTo(
     _In_ SOCKET         Socket,
     _In_ PVOID          Buffer,
@@ -230,6 +496,139 @@ NTSTATUS WSKAPI WSKReceiveFrom(
     _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
 );
 
+NTSTATUS WSKAPI WSKReferenceSocketDispatch(
+    _In_  SOCKET        Socket,
+    _Out_ WSKSOCKETDISPATCH* Dispatch
+);
+
+VOID WSKAPI WSKDereferenceSocketDispatch(
+    _Inout_ WSKSOCKETDISPATCH* Dispatch
+);
+
+NTSTATUS WSKAPI WSKSendDispatch(
+    _In_ const WSKSOCKETDISPATCH* Dispatch,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesSent,
+    _In_ ULONG          Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+);
+
+NTSTATUS WSKAPI WSKReceiveDispatch(
+    _In_ const WSKSOCKETDISPATCH* Dispatch,
+    _In_ PVOID          Buffer,
+    _In_ SIZE_T         BufferLength,
+    _Out_opt_ SIZE_T*   NumberOfBytesRecvd,
+    _In_ ULONG          Flags,
+    _In_opt_  WSKOVERLAPPED* Overlapped,
+    _In_opt_  LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine
+);
+
+NTSTATUS WSKAPI WSKCreateConnectionPool(
+    _Out_ PWSKCONNECTIONPOOL* Pool,
+    _In_  const WSKCONNECTIONPOOLCONFIG* Config
+);
+
+// Closes the idle sockets. Sockets still checked out are closed when released.
+VOID WSKAPI WSKDeleteConnectionPool(
+    _In_ PWSKCONNECTIONPOOL Pool
+);
+
+// Takes a healthy idle socket connected to RemoteAddress, or connects a new one.
+NTSTATUS WSKAPI WSKConnectionPoolAcquire(
+    _In_  PWSKCONNECTIONPOOL Pool,
+    _In_  PSOCKADDR     RemoteAddress,
+    _In_  SIZE_T        RemoteAddressLength,
+    _Out_ WSKPOOLEDSOCKET* Pooled
+);
+
+// Reusable is FALSE if the socket is in an unknown protocol state, it is closed then.
+VOID WSKAPI WSKConnectionPoolRelease(
+    _In_ PWSKCONNECTIONPOOL Pool,
+    _In_ WSKPOOLEDSOCKET*   Pooled,
+    _In_ BOOLEAN            Reusable
+);
+
+// Fills a ring buffer of Capacity bytes (0 for 16KB, rounded up to a power of two) with
+// receives as large as the free space, so small reads do not cost a request each.
+// The socket stays owned by the caller and must outlive the reader. Not thread safe.
+NTSTATUS WSKAPI WSKCreateReader(
+    _Out_ PWSKREADER* Reader,
+    _In_  SOCKET      Socket,
+    _In_  SIZE_T      Capacity
+);
+
+VOID WSKAPI WSKDeleteReader(
+    _In_ PWSKREADER Reader
+);
+
+// Reads up to and including the delimiter.
+// STATUS_BUFFER_TOO_SMALL leaves the data buffered, BytesRead is the size needed then.
+// STATUS_BUFFER_OVERFLOW if the ring fills up without a delimiter, STATUS_END_OF_FILE if the peer closed first.
+NTSTATUS WSKAPI WSKReaderReadUntil(
+    _In_ PWSKREADER Reader,
+    _In_reads_bytes_(DelimiterLength) const VOID* Delimiter,
+    _In_ SIZE_T     DelimiterLength,
+    _Out_writes_bytes_to_(BufferLength, *BytesRead) PVOID Buffer,
+    _In_ SIZE_T     BufferLength,
+    _Out_ SIZE_T*   BytesRead
+);
+
+// Longer reads than the ring take the buffered bytes and receive the rest in place.
+NTSTATUS WSKAPI WSKReaderReadExact(
+    _In_ PWSKREADER Reader,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ SIZE_T     Length
+);
+
+// Copies buffered bytes without consuming them, receives once if nothing is buffered.
+NTSTATUS WSKAPI WSKReaderPeek(
+    _In_ PWSKREADER Reader,
+    _Out_writes_bytes_to_(BufferLength, *BytesPeeked) PVOID Buffer,
+    _In_ SIZE_T     BufferLength,
+    _Out_ SIZE_T*   BytesPeeked
+);
+
+// Format is a WSK_FRAME_xxx prefix. Messages longer than MaximumLength (0 for 16KB) are refused,
+// the ring is sized so the longest one fits and is never copied out.
+// The socket stays owned by the caller and must outlive the framer. Not thread safe.
+NTSTATUS WSKAPI WSKCreateFramer(
+    _Out_ PWSKFRAMER* Framer,
+    _In_  SOCKET      Socket,
+    _In_  ULONG       Format,
+    _In_  ULONG       MaximumLength
+);
+
+VOID WSKAPI WSKDeleteFramer(
+    _In_ PWSKFRAMER Framer
+);
+
+// Waits for the next complete message and releases the previous one.
+// STATUS_CRC_ERROR drops a corrupted message, STATUS_INVALID_NETWORK_RESPONSE for a length over
+// the maximum is returned from then on. STATUS_END_OF_FILE if the peer closed.
+NTSTATUS WSKAPI WSKFramerReceive(
+    _In_  PWSKFRAMER Framer,
+    _Out_ WSKFRAME*  Frame
+);
+
+// The prefix and the payload pieces go out in one request, NumberOfBytesSent includes the prefix.
+// A received frame can be forwarded as is with its Segments. On a nonblocking socket a frame
+// goes out whole, STATUS_DEVICE_NOT_READY until the send buffer has room for it.
+NTSTATUS WSKAPI WSKFramerSend(
+    _In_ PWSKFRAMER Framer,
+    _In_reads_(BufferCount) const WSKBUF* Buffers,
+    _In_ ULONG      BufferCount,
+    _Out_opt_ SIZE_T* NumberOfBytesSent
+);
+
+NTSTATUS WSKAPI WSKPoll(
+    _Inout_updates_(SocketCount) WSKPOLLFD* Sockets,
+    _In_ UINT32         SocketCount,
+    _In_ UINT32         TimeoutMilliseconds,    // WSK_INFINITE_WAIT
+    _Out_opt_ UINT32*   ReadyCount              // STATUS_TIMEOUT if nothing is ready
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,512 @@
+﻿#include "libwsk.h"
+#include "timer.h"
+#include "worker.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+struct WSK_POOL_CONNECTION
+{
+    LIST_ENTRY  Link;
+    SOCKET      Socket;
+    ULONG64     ConnectTime;    // KeQueryInterruptTime
+    ULONG64     IdleTime;
+};
+
+// Kept until the pool is freed, a pool talks to a handful of backends.
+struct WSK_POOL_DESTINATION
+{
+    LIST_ENTRY          Link;
+    SOCKADDR_STORAGE    Address;
+    SIZE_T              AddressLength;
+    LIST_ENTRY          Idle;       // WSK_POOL_CONNECTION, most recently released first
+    ULONG               IdleCount;
+};
+
+struct _WSKCONNECTIONPOOL
+{
+    volatile LONG           RefCount;   // Creator, checked out sockets, armed reaper, queued reaper
+    KSPIN_LOCK              Lock;
+    WSKCONNECTIONPOOLCONFIG Config;
+    ULONG                   ReapInterval;   // Milliseconds, 0 if nothing expires
+    ULONG                   IdleCount;
+    BOOLEAN                 Deleted;
+    LIST_ENTRY              Destinations;   // WSK_POOL_DESTINATION
+    WSK_TIMER_ENTRY         Timer;
+    WSK_WORK_ITEM           Reaper;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+static VOID WSKAPI WSKReleaseConnectionPool(
+    _In_ PWSKCONNECTIONPOOL Pool
+)
+{
+    if (InterlockedDecrement(&Pool->RefCount) != 0)
+    {
+        return;
+    }
+
+    while (!IsListEmpty(&Pool->Destinations))
+    {
+        ExFreePoolWithTag(CONTAINING_RECORD(RemoveHeadList(&Pool->Destinations), WSK_POOL_DESTINATION, Link), WSK_POOL_TAG);
+    }
+
+    ExFreePoolWithTag(Pool, WSK_POOL_TAG);
+}
+
+static BOOLEAN WSKAPI WSKPoolConnectionExpired(
+    _In_ PWSKCONNECTIONPOOL         Pool,
+    _In_ const WSK_POOL_CONNECTION* Connection,
+    _In_ ULONG64                    Now
+)
+{
+    const auto& Config = Pool->Config;
+
+    if (Config.MaxIdleTime && Now - Connection->IdleTime >= Config.MaxIdleTime * 10000ull)
+    {
+        return TRUE;
+    }
+
+    if (Config.MaxAge && Now - Connection->ConnectTime >= Config.MaxAge * 10000ull)
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Nothing pending to read and no FIN or reset seen. A reply left over from the last user,
+// or one the peer sent on its own, leaves the socket in an unknown state as well.
+static BOOLEAN WSKAPI WSKPoolSocketHealthy(
+    _In_ SOCKET Socket
+)
+{
+    WSKPOLLFD PollFd{};
+    PollFd.Socket = Socket;
+    PollFd.Events = WSK_POLLIN;
+
+    const NTSTATUS Status = WSKPoll(&PollFd, 1u, 0u, nullptr);
+
+    return NT_SUCCESS(Status) && PollFd.ReturnedEvents == 0;
+}
+
+static VOID WSKAPI WSKClosePoolConnections(
+    _Inout_ LIST_ENTRY* List
+)
+{
+    while (!IsListEmpty(List))
+    {
+        auto Connection = CONTAINING_RECORD(RemoveHeadList(List), WSK_POOL_CONNECTION, Link);
+
+        WSKCloseSocketAsync(Connection->Socket, 0u);
+        ExFreePoolWithTag(Connection, WSK_POOL_TAG);
+    }
+}
+
+// The pool lock must be held.
+static WSK_POOL_DESTINATION* WSKAPI WSKFindPoolDestination(
+    _In_ PWSKCONNECTIONPOOL Pool,
+    _In_ PSOCKADDR          RemoteAddress,
+    _In_ SIZE_T             RemoteAddressLength
+)
+{
+    for (auto Entry = Pool->Destinations.Flink; Entry != &Pool->Destinations; Entry = Entry->Flink)
+    {
+        auto Destination = CONTAINING_RECORD(Entry, WSK_POOL_DESTINATION, Link);
+
+        if (Destination->AddressLength == RemoteAddressLength &&
+            RtlEqualMemory(&Destination->Address, RemoteAddress, RemoteAddressLength))
+        {
+            return Destination;
+        }
+    }
+
+    auto Destination = static_cast<WSK_POOL_DESTINATION*>(ExAllocatePoolZero(NonPagedPool,
+        sizeof(WSK_POOL_DESTINATION), WSK_POOL_TAG));
+    if (Destination)
+    {
+        RtlCopyMemory(&Destination->Address, RemoteAddress, RemoteAddressLength);
+        Destination->AddressLength = RemoteAddressLength;
+
+        InitializeListHead(&Destination->Idle);
+        InsertTailList(&Pool->Destinations, &Destination->Link);
+    }
+
+    return Destination;
+}
+
+static VOID WSKAPI WSKArmPoolReaper(
+    _In_ PWSKCONNECTIONPOOL Pool
+)
+{
+    InterlockedIncrement(&Pool->RefCount);
+
+    if (WSKTimerArm(&Pool->Timer, Pool->ReapInterval))
+    {
+        WSKReleaseConnectionPool(Pool);
+    }
+}
+
+// DISPATCH_LEVEL, closing has to wait for the worker.
+static VOID WSKAPI WSKPoolReaperTimeout(
+    _In_ PVOID Context
+)
+{
+    auto Pool = static_cast<PWSKCONNECTIONPOOL>(Context);
+
+    // The timer reference moves to the work item.
+    if (!WSKWorkQueue(&Pool->Reaper))
+    {
+        WSKReleaseConnectionPool(Pool);
+    }
+}
+
+static VOID WSKAPI WSKPoolReaperRoutine(
+    _In_ PVOID Context
+)
+{
+    auto Pool = static_cast<PWSKCONNECTIONPOOL>(Context);
+
+    LIST_ENTRY Expired;
+    InitializeListHead(&Expired);
+
+    BOOLEAN Rearm = FALSE;
+
+    const ULONG64 Now = KeQueryInterruptTime();
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+    {
+        for (auto Entry = Pool->Destinations.Flink; Entry != &Pool->Destinations; Entry = Entry->Flink)
+        {
+            auto Destination = CONTAINING_RECORD(Entry, WSK_POOL_DESTINATION, Link);
+
+            // The oldest are at the tail.
+            while (!IsListEmpty(&Destination->Idle))
+            {
+                auto Connection = CONTAINING_RECORD(Destination->Idle.Blink, WSK_POOL_CONNECTION, Link);
+                if (!WSKPoolConnectionExpired(Pool, Connection, Now))
+                {
+                    break;
+                }
+
+                RemoveEntryList(&Connection->Link);
+                InsertTailList(&Expired, &Connection->Link);
+
+                Destination->IdleCount -= 1;
+                Pool->IdleCount        -= 1;
+            }
+        }
+
+        Rearm = Pool->IdleCount && !Pool->Deleted;
+    }
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    WSKClosePoolConnections(&Expired);
+
+    if (Rearm)
+    {
+        WSKArmPoolReaper(Pool);
+    }
+
+    WSKReleaseConnectionPool(Pool);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+NTSTATUS WSKAPI WSKCreateConnectionPool(
+    _Out_ PWSKCONNECTIONPOOL* Pool,
+    _In_  const WSKCONNECTIONPOOLCONFIG* Config
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (Pool == nullptr || Config == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        *Pool = nullptr;
+
+        auto Pool_ = static_cast<PWSKCONNECTIONPOOL>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(_WSKCONNECTIONPOOL), WSK_POOL_TAG));
+        if (Pool_ == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Pool_->RefCount = 1;
+        Pool_->Config   = *Config;
+
+        KeInitializeSpinLock(&Pool_->Lock);
+        InitializeListHead(&Pool_->Destinations);
+
+        WSKTimerInitialize(&Pool_->Timer, &WSKPoolReaperTimeout, Pool_);
+        WSKWorkInitialize(&Pool_->Reaper, &WSKPoolReaperRoutine, Pool_);
+
+        // Expired sockets are closed within half a limit of expiring.
+        ULONG Limit = Config->MaxIdleTime;
+        if (Limit == 0 || (Config->MaxAge && Config->MaxAge < Limit))
+        {
+            Limit = Config->MaxAge;
+        }
+
+        Pool_->ReapInterval = (Limit > 1u) ? (Limit / 2u) : Limit;
+
+        *Pool = Pool_;
+
+    } while (false);
+
+    return Status;
+}
+
+VOID WSKAPI WSKDeleteConnectionPool(
+    _In_ PWSKCONNECTIONPOOL Pool
+)
+{
+    if (Pool == nullptr)
+    {
+        return;
+    }
+
+    LIST_ENTRY Idle;
+    InitializeListHead(&Idle);
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+    {
+        Pool->Deleted = TRUE;
+
+        for (auto Entry = Pool->Destinations.Flink; Entry != &Pool->Destinations; Entry = Entry->Flink)
+        {
+            auto Destination = CONTAINING_RECORD(Entry, WSK_POOL_DESTINATION, Link);
+
+            while (!IsListEmpty(&Destination->Idle))
+            {
+                InsertTailList(&Idle, RemoveHeadList(&Destination->Idle));
+            }
+
+            Destination->IdleCount = 0u;
+        }
+
+        Pool->IdleCount = 0u;
+    }
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    if (WSKTimerCancel(&Pool->Timer))
+    {
+        WSKReleaseConnectionPool(Pool);
+    }
+
+    WSKClosePoolConnections(&Idle);
+
+    WSKReleaseConnectionPool(Pool);
+}
+
+NTSTATUS WSKAPI WSKConnectionPoolAcquire(
+    _In_  PWSKCONNECTIONPOOL Pool,
+    _In_  PSOCKADDR     RemoteAddress,
+    _In_  SIZE_T        RemoteAddressLength,
+    _Out_ WSKPOOLEDSOCKET* Pooled
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    SOCKET   Socket = WSK_INVALID_SOCKET;
+
+    do
+    {
+        if (Pool == nullptr || Pooled == nullptr || RemoteAddress == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        *Pooled = {};
+        Pooled->Socket = WSK_INVALID_SOCKET;
+
+        if ((RemoteAddress->sa_family == AF_INET  && RemoteAddressLength != sizeof SOCKADDR_IN) ||
+            (RemoteAddress->sa_family == AF_INET6 && RemoteAddressLength != sizeof SOCKADDR_IN6) ||
+            (RemoteAddress->sa_family != AF_INET  && RemoteAddress->sa_family != AF_INET6))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        WSK_POOL_DESTINATION* Destination = nullptr;
+
+        for (;;)
+        {
+            WSK_POOL_CONNECTION* Connection = nullptr;
+
+            KIRQL Irql;
+            KeAcquireSpinLock(&Pool->Lock, &Irql);
+            {
+                if (!Pool->Deleted)
+                {
+                    Destination = WSKFindPoolDestination(Pool, RemoteAddress, RemoteAddressLength);
+                }
+
+                if (Destination && !IsListEmpty(&Destination->Idle))
+                {
+                    Connection = CONTAINING_RECORD(RemoveHeadList(&Destination->Idle), WSK_POOL_CONNECTION, Link);
+
+                    Destination->IdleCount -= 1;
+                    Pool->IdleCount        -= 1;
+                }
+            }
+            KeReleaseSpinLock(&Pool->Lock, Irql);
+
+            if (Destination == nullptr)
+            {
+                Status = Pool->Deleted ? STATUS_INVALID_DEVICE_STATE : STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            if (Connection == nullptr)
+            {
+                break;
+            }
+
+            if (!WSKPoolConnectionExpired(Pool, Connection, KeQueryInterruptTime()) &&
+                WSKPoolSocketHealthy(Connection->Socket))
+            {
+                Pooled->Socket      = Connection->Socket;
+                Pooled->Reused      = TRUE;
+                Pooled->ConnectTime = Connection->ConnectTime;
+
+                ExFreePoolWithTag(Connection, WSK_POOL_TAG);
+                break;
+            }
+
+            WSKCloseSocketAsync(Connection->Socket, 0u);
+            ExFreePoolWithTag(Connection, WSK_POOL_TAG);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        if (Pooled->Socket == WSK_INVALID_SOCKET)
+        {
+            Status = WSKSocket(&Socket, RemoteAddress->sa_family, SOCK_STREAM, IPPROTO_TCP, nullptr);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            Status = WSKConnect(Socket, RemoteAddress, RemoteAddressLength);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            Pooled->Socket      = Socket;
+            Pooled->ConnectTime = KeQueryInterruptTime();
+
+            Socket = WSK_INVALID_SOCKET;
+        }
+
+        Pooled->Destination = Destination;
+
+        InterlockedIncrement(&Pool->RefCount);
+
+    } while (false);
+
+    if (Socket != WSK_INVALID_SOCKET)
+    {
+        WSKCloseSocket(Socket);
+    }
+
+    return Status;
+}
+
+VOID WSKAPI WSKConnectionPoolRelease(
+    _In_ PWSKCONNECTIONPOOL Pool,
+    _In_ WSKPOOLEDSOCKET*   Pooled,
+    _In_ BOOLEAN            Reusable
+)
+{
+    if (Pool == nullptr || Pooled == nullptr || Pooled->Socket == WSK_INVALID_SOCKET)
+    {
+        return;
+    }
+
+    const ULONG64 Now = KeQueryInterruptTime();
+
+    WSK_POOL_CONNECTION* Connection = nullptr;
+
+    BOOLEAN Parked = FALSE;
+    BOOLEAN Arm    = FALSE;
+
+    do
+    {
+        if (!Reusable)
+        {
+            break;
+        }
+
+        Connection = static_cast<WSK_POOL_CONNECTION*>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(WSK_POOL_CONNECTION), WSK_POOL_TAG));
+        if (Connection == nullptr)
+        {
+            break;
+        }
+
+        Connection->Socket      = Pooled->Socket;
+        Connection->ConnectTime = Pooled->ConnectTime;
+        Connection->IdleTime    = Now;
+
+        // Polling also turns on the receive and disconnect events, so a peer close while idle is seen.
+        if (WSKPoolConnectionExpired(Pool, Connection, Now) || !WSKPoolSocketHealthy(Connection->Socket))
+        {
+            break;
+        }
+
+        auto Destination = static_cast<WSK_POOL_DESTINATION*>(Pooled->Destination);
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Pool->Lock, &Irql);
+        {
+            if (!Pool->Deleted && Destination->IdleCount < Pool->Config.MaxIdle)
+            {
+                InsertHeadList(&Destination->Idle, &Connection->Link);
+
+                Destination->IdleCount += 1;
+                Pool->IdleCount        += 1;
+
+                Parked = TRUE;
+                Arm    = (Pool->IdleCount == 1) && Pool->ReapInterval;
+            }
+        }
+        KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    } while (false);
+
+    if (!Parked)
+    {
+        WSKCloseSocketAsync(Pooled->Socket, 0u);
+
+        if (Connection)
+        {
+            ExFreePoolWithTag(Connection, WSK_POOL_TAG);
+        }
+    }
+
+    if (Arm)
+    {
+        WSKArmPoolReaper(Pool);
+    }
+
+    Pooled->Socket = WSK_INVALID_SOCKET;
+
+    WSKReleaseConnectionPool(Pool);
+}
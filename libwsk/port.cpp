@@ -0,0 +1,415 @@
+﻿#include "libwsk.h"
+#include "port.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+struct WSK_PORT_KEY
+{
+    ADDRESS_FAMILY  Family;
+    USHORT          RemotePort;         // Network order
+    UCHAR           LocalAddress[16];   // IN_ADDR or IN6_ADDR, zero padded
+    UCHAR           RemoteAddress[16];
+};
+
+// Node of the allocator table, the bitmaps cover every port.
+// A port the stack refused is marked in the newer conflict generation. The generations shift
+// every WSK_PORT_CONFLICT_AGE, so a mark is skipped for one to two of those and then dropped.
+struct WSK_PORT_ENTRY
+{
+    WSK_PORT_KEY    Key;
+    ULONG           Count;          // Ports reserved
+    ULONG           Next;           // Where the next search starts
+    LONG*           Bits;
+    LONG*           Conflicts;      // Newer then older generation, nullptr while nothing is marked
+    ULONG           Marked[2];      // Ports marked in each generation
+    ULONGLONG       ConflictTime;   // Interrupt time the newer generation started
+};
+
+static const ULONG     WSK_PORT_BITMAP_SIZE  = 0x10000u / 32u;
+static const ULONGLONG WSK_PORT_CONFLICT_AGE = 30ull * 1000 * 1000 * 10; // 30s, 100ns units
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+static RTL_AVL_TABLE        WSKPortAVLTable;
+static FAST_MUTEX           WSKPortAVLTableMutex;
+static WSKSOURCEPORTSTATS   WSKPortStatistics;
+static ULONGLONG            WSKPortSweepTime;   // Last time entries kept only for their marks were aged
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+RTL_GENERIC_COMPARE_RESULTS NTAPI WSKPortAVLNodeCompare(
+    _In_ RTL_AVL_TABLE* Table,
+    _In_ PVOID FirstStruct,
+    _In_ PVOID SecondStruct
+)
+{
+    UNREFERENCED_PARAMETER(Table);
+
+    const int Result = memcmp(
+        &static_cast<WSK_PORT_ENTRY*>(FirstStruct)->Key,
+        &static_cast<WSK_PORT_ENTRY*>(SecondStruct)->Key, sizeof WSK_PORT_KEY);
+
+    return (Result < 0) ? GenericLessThan : (Result > 0) ? GenericGreaterThan : GenericEqual;
+}
+
+PVOID NTAPI WSKPortAVLNodeAllocate(
+    _In_ RTL_AVL_TABLE* Table,
+    _In_ CLONG ByteSize
+)
+{
+    UNREFERENCED_PARAMETER(Table);
+
+    return ExAllocatePoolZero(PagedPool, ByteSize, WSK_POOL_TAG);
+}
+
+VOID NTAPI WSKPortAVLNodeFree(
+    _In_ RTL_AVL_TABLE* Table,
+    _In_ __drv_freesMem(Mem) _Post_invalid_ PVOID Buffer
+)
+{
+    UNREFERENCED_PARAMETER(Table);
+
+    return ExFreePoolWithTag(Buffer, WSK_POOL_TAG);
+}
+
+static VOID WSKAPI WSKPortMakeKey(
+    _Out_ WSK_PORT_KEY*   Key,
+    _In_  const SOCKADDR* LocalAddress,
+    _In_  const SOCKADDR* RemoteAddress
+)
+{
+    RtlZeroMemory(Key, sizeof *Key);
+
+    Key->Family = RemoteAddress->sa_family;
+
+    if (Key->Family == AF_INET)
+    {
+        const auto Local  = reinterpret_cast<const SOCKADDR_IN*>(LocalAddress);
+        const auto Remote = reinterpret_cast<const SOCKADDR_IN*>(RemoteAddress);
+
+        Key->RemotePort = Remote->sin_port;
+        RtlCopyMemory(Key->LocalAddress,  &Local->sin_addr,  sizeof IN_ADDR);
+        RtlCopyMemory(Key->RemoteAddress, &Remote->sin_addr, sizeof IN_ADDR);
+    }
+    else
+    {
+        const auto Local  = reinterpret_cast<const SOCKADDR_IN6*>(LocalAddress);
+        const auto Remote = reinterpret_cast<const SOCKADDR_IN6*>(RemoteAddress);
+
+        Key->RemotePort = Remote->sin6_port;
+        RtlCopyMemory(Key->LocalAddress,  &Local->sin6_addr,  sizeof IN6_ADDR);
+        RtlCopyMemory(Key->RemoteAddress, &Remote->sin6_addr, sizeof IN6_ADDR);
+    }
+}
+
+// The table mutex must be held.
+static VOID WSKAPI WSKPortDropConflicts(
+    _In_ WSK_PORT_ENTRY* Entry
+)
+{
+    if (Entry->Conflicts)
+    {
+        ExFreePoolWithTag(Entry->Conflicts, WSK_POOL_TAG);
+        Entry->Conflicts = nullptr;
+    }
+
+    WSKPortStatistics.PortsMarked -= Entry->Marked[0] + Entry->Marked[1];
+
+    Entry->Marked[0] = 0u;
+    Entry->Marked[1] = 0u;
+}
+
+// The table mutex must be held.
+static VOID WSKAPI WSKPortAgeConflicts(
+    _In_ WSK_PORT_ENTRY* Entry,
+    _In_ ULONGLONG       Now
+)
+{
+    if (Entry->Conflicts == nullptr)
+    {
+        return;
+    }
+
+    const ULONGLONG Elapsed = Now - Entry->ConflictTime;
+
+    if (Elapsed >= 2 * WSK_PORT_CONFLICT_AGE || (Elapsed >= WSK_PORT_CONFLICT_AGE && Entry->Marked[0] == 0u))
+    {
+        WSKPortDropConflicts(Entry);
+    }
+    else if (Elapsed >= WSK_PORT_CONFLICT_AGE)
+    {
+        RtlCopyMemory(&Entry->Conflicts[WSK_PORT_BITMAP_SIZE], Entry->Conflicts, WSK_PORT_BITMAP_SIZE * sizeof(LONG));
+        RtlZeroMemory(Entry->Conflicts, WSK_PORT_BITMAP_SIZE * sizeof(LONG));
+
+        WSKPortStatistics.PortsMarked -= Entry->Marked[1];
+
+        Entry->Marked[1]    = Entry->Marked[0];
+        Entry->Marked[0]    = 0u;
+        Entry->ConflictTime = Now;
+    }
+}
+
+// Reserved or marked ports of one bitmap word.
+static LONG WSKAPI WSKPortBusyWord(
+    _In_ const WSK_PORT_ENTRY* Entry,
+    _In_ ULONG                 Word
+)
+{
+    LONG Busy = Entry->Bits[Word];
+
+    if (Entry->Conflicts)
+    {
+        Busy |= Entry->Conflicts[Word] | Entry->Conflicts[WSK_PORT_BITMAP_SIZE + Word];
+    }
+
+    return Busy;
+}
+
+// The table mutex must be held.
+static VOID WSKAPI WSKPortDeleteEntry(
+    _In_ WSK_PORT_ENTRY* Entry
+)
+{
+    WSKPortDropConflicts(Entry);
+
+    ExFreePoolWithTag(Entry->Bits, WSK_POOL_TAG);
+
+    WSKPortStatistics.Destinations -= 1;
+
+    RtlDeleteElementGenericTableAvl(&WSKPortAVLTable, Entry);
+}
+
+// An entry with nothing reserved lives on only while it has marks.
+// The table mutex must be held.
+static VOID WSKAPI WSKPortSweep(
+    _In_ ULONGLONG Now
+)
+{
+    if (Now - WSKPortSweepTime < WSK_PORT_CONFLICT_AGE)
+    {
+        return;
+    }
+
+    WSKPortSweepTime = Now;
+
+    for (ULONG Index = 0u; ; )
+    {
+        auto Entry = static_cast<WSK_PORT_ENTRY*>(RtlGetElementGenericTableAvl(&WSKPortAVLTable, Index));
+        if (Entry == nullptr)
+        {
+            break;
+        }
+
+        WSKPortAgeConflicts(Entry, Now);
+
+        if (Entry->Count == 0 && Entry->Conflicts == nullptr)
+        {
+            WSKPortDeleteEntry(Entry);
+            continue;
+        }
+
+        Index += 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+VOID WSKAPI WSKPortAllocatorInitialize()
+{
+    ExInitializeFastMutex(&WSKPortAVLTableMutex);
+
+    RtlInitializeGenericTableAvl(&WSKPortAVLTable, &WSKPortAVLNodeCompare,
+        &WSKPortAVLNodeAllocate, &WSKPortAVLNodeFree, nullptr);
+
+    WSKPortStatistics = {};
+    WSKPortSweepTime  = KeQueryInterruptTime();
+}
+
+VOID WSKAPI WSKPortAllocatorCleanup()
+{
+    auto Entry = static_cast<WSK_PORT_ENTRY*>(RtlGetElementGenericTableAvl(&WSKPortAVLTable, 0));
+
+    while (Entry)
+    {
+        WSKPortDeleteEntry(Entry);
+
+        Entry = static_cast<WSK_PORT_ENTRY*>(RtlGetElementGenericTableAvl(&WSKPortAVLTable, 0));
+    }
+}
+
+NTSTATUS WSKAPI WSKPortAllocate(
+    _In_  const SOCKADDR*  LocalAddress,
+    _In_  const SOCKADDR*  RemoteAddress,
+    _In_  USHORT           PortLow,
+    _In_  USHORT           PortHigh,
+    _Out_ WSK_PORT_ENTRY** Entry,
+    _Out_ USHORT*          Port
+)
+{
+    PAGED_CODE();
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *Entry = nullptr;
+    *Port  = 0u;
+
+    WSK_PORT_ENTRY Template{};
+    WSKPortMakeKey(&Template.Key, LocalAddress, RemoteAddress);
+
+    const ULONGLONG Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&WSKPortAVLTableMutex);
+    do
+    {
+        WSKPortSweep(Now);
+
+        BOOLEAN Inserted = FALSE;
+
+        auto Node = static_cast<WSK_PORT_ENTRY*>(RtlInsertElementGenericTableAvl(
+            &WSKPortAVLTable, &Template, sizeof Template, &Inserted));
+        if (Node == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (Inserted)
+        {
+            Node->Bits = static_cast<LONG*>(ExAllocatePoolZero(PagedPool, WSK_PORT_BITMAP_SIZE * sizeof(LONG), WSK_POOL_TAG));
+            if (Node->Bits == nullptr)
+            {
+                RtlDeleteElementGenericTableAvl(&WSKPortAVLTable, Node);
+
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            // A random start keeps a destination seen again from getting the ports in TIME_WAIT.
+            ULONG Seed = static_cast<ULONG>(KeQueryInterruptTime());
+            Node->Next = RtlRandomEx(&Seed);
+
+            WSKPortStatistics.Destinations += 1;
+        }
+
+        WSKPortAgeConflicts(Node, Now);
+
+        // A whole word is skipped at once while it is full.
+        const ULONG Range = static_cast<ULONG>(PortHigh - PortLow) + 1u;
+        ULONG       Index = Node->Next % Range;
+
+        Status = STATUS_TOO_MANY_ADDRESSES;
+
+        for (ULONG Count = 0u; Count < Range; )
+        {
+            const ULONG Value = PortLow + Index;
+            const LONG  Busy  = WSKPortBusyWord(Node, Value / 32u);
+
+            if ((Value & 31u) == 0u && Busy == -1 && Range - Count >= 32u && Range - Index >= 32u)
+            {
+                Count += 32u;
+                Index  = (Index + 32u) % Range;
+                continue;
+            }
+
+            if (!_bittest(&Busy, Value & 31u))
+            {
+                _bittestandset(&Node->Bits[Value / 32u], Value & 31u);
+
+                Node->Count += 1;
+                Node->Next   = Index + 1u;
+
+                *Entry = Node;
+                *Port  = static_cast<USHORT>(Value);
+
+                Status = STATUS_SUCCESS;
+                break;
+            }
+
+            Count += 1u;
+            Index  = (Index + 1u) % Range;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            WSKPortStatistics.Exhausted += 1;
+
+            if (Node->Count == 0 && Node->Conflicts == nullptr)
+            {
+                WSKPortDeleteEntry(Node);
+            }
+            break;
+        }
+
+        WSKPortStatistics.PortsInUse  += 1;
+        WSKPortStatistics.Allocations += 1;
+
+    } while (false);
+    ExReleaseFastMutex(&WSKPortAVLTableMutex);
+
+    return Status;
+}
+
+VOID WSKAPI WSKPortRelease(
+    _In_ WSK_PORT_ENTRY* Entry,
+    _In_ USHORT          Port,
+    _In_ BOOLEAN         Conflict
+)
+{
+    PAGED_CODE();
+
+    const ULONGLONG Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&WSKPortAVLTableMutex);
+    {
+        _bittestandreset(&Entry->Bits[Port / 32u], Port & 31u);
+
+        WSKPortStatistics.PortsInUse -= 1;
+
+        WSKPortAgeConflicts(Entry, Now);
+
+        if (Conflict)
+        {
+            WSKPortStatistics.Conflicts += 1;
+
+            if (Entry->Conflicts == nullptr)
+            {
+                // Without the marks the port is only tried again later, nothing else depends on them.
+                Entry->Conflicts = static_cast<LONG*>(ExAllocatePoolZero(PagedPool,
+                    2 * WSK_PORT_BITMAP_SIZE * sizeof(LONG), WSK_POOL_TAG));
+                Entry->ConflictTime = Now;
+            }
+
+            if (Entry->Conflicts && !_bittestandset(&Entry->Conflicts[Port / 32u], Port & 31u))
+            {
+                Entry->Marked[0] += 1;
+
+                WSKPortStatistics.PortsMarked += 1;
+            }
+        }
+
+        Entry->Count -= 1;
+        if (Entry->Count == 0 && Entry->Conflicts == nullptr)
+        {
+            WSKPortDeleteEntry(Entry);
+        }
+    }
+    ExReleaseFastMutex(&WSKPortAVLTableMutex);
+}
+
+VOID WSKAPI WSKPortAllocatorQuery(
+    _Out_ WSKSOURCEPORTSTATS* Statistics
+)
+{
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&WSKPortAVLTableMutex);
+    {
+        *Statistics = WSKPortStatistics;
+    }
+    ExReleaseFastMutex(&WSKPortAVLTableMutex);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Source ports handed out per destination for WSK_SO_SHARE_SOURCE_PORT.
+// A port only has to be unique towards one (local address, remote address, remote port),
+// so connections to different destinations reuse the same local ports.
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+struct WSK_PORT_ENTRY;
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+VOID WSKAPI WSKPortAllocatorInitialize();
+
+VOID WSKAPI WSKPortAllocatorCleanup();
+
+// Reserves a port in [PortLow, PortHigh] not yet reserved towards RemoteAddress.
+// Returns STATUS_TOO_MANY_ADDRESSES if the range is used up for that destination.
+NTSTATUS WSKAPI WSKPortAllocate(
+    _In_  const SOCKADDR*  LocalAddress,
+    _In_  const SOCKADDR*  RemoteAddress,
+    _In_  USHORT           PortLow,
+    _In_  USHORT           PortHigh,
+    _Out_ WSK_PORT_ENTRY** Entry,
+    _Out_ USHORT*          Port
+);
+
+// Conflict is TRUE if the bind failed because something outside the allocator holds the port.
+// The port is then marked, and allocations for the same destination skip it until the mark ages out.
+VOID WSKAPI WSKPortRelease(
+    _In_ WSK_PORT_ENTRY* Entry,
+    _In_ USHORT          Port,
+    _In_ BOOLEAN         Conflict
+);
+
+VOID WSKAPI WSKPortAllocatorQuery(
+    _Out_ WSKSOURCEPORTSTATS* Statistics
+);
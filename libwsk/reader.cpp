@@ -0,0 +1,456 @@
+﻿#include "libwsk.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+// Indices run freely, the mask picks the byte in the ring.
+struct _WSKREADER
+{
+    SOCKET  Socket;
+    PUCHAR  Buffer;
+    SIZE_T  Capacity;   // Power of two
+    SIZE_T  Head;       // Next byte to read
+    SIZE_T  Tail;       // Next byte to receive into
+    BOOLEAN Eof;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+static const SIZE_T WSK_READER_DEFAULT_CAPACITY = 16u * 1024u;
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+// Offset of the first Value in Data, Length if there is none.
+static SIZE_T WSKAPI WSKFindByte(
+    _In_reads_(Length) const UCHAR* Data,
+    _In_ SIZE_T Length,
+    _In_ UCHAR  Value
+)
+{
+    SIZE_T Index = 0;
+
+#if defined(_M_X64) || defined(_M_IX86)
+    const auto Pattern = _mm_set1_epi8(static_cast<char>(Value));
+
+    for (; Index + 16 <= Length; Index += 16)
+    {
+        const auto Block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&Data[Index]));
+        const auto Mask  = static_cast<ULONG>(_mm_movemask_epi8(_mm_cmpeq_epi8(Block, Pattern)));
+
+        if (Mask)
+        {
+            ULONG Bit;
+            _BitScanForward(&Bit, Mask);
+
+            return Index + Bit;
+        }
+    }
+#elif defined(_M_ARM64)
+    const auto Pattern = vdupq_n_u8(Value);
+
+    for (; Index + 16 <= Length; Index += 16)
+    {
+        const auto Equal = vceqq_u8(vld1q_u8(&Data[Index]), Pattern);
+
+        // Four bits per byte, the first set nibble is the first match.
+        const auto Mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(Equal), 4)), 0);
+
+        if (Mask)
+        {
+            ULONG Bit;
+            _BitScanForward64(&Bit, Mask);
+
+            return Index + Bit / 4;
+        }
+    }
+#endif
+
+    for (; Index < Length; ++Index)
+    {
+        if (Data[Index] == Value)
+        {
+            return Index;
+        }
+    }
+
+    return Length;
+}
+
+static SIZE_T WSKAPI WSKReaderCount(
+    _In_ const _WSKREADER* Reader
+)
+{
+    return Reader->Tail - Reader->Head;
+}
+
+static UCHAR WSKAPI WSKReaderByte(
+    _In_ const _WSKREADER* Reader,
+    _In_ SIZE_T Offset  // From Head
+)
+{
+    return Reader->Buffer[(Reader->Head + Offset) & (Reader->Capacity - 1)];
+}
+
+// Copies out Length buffered bytes starting at Offset, in at most two pieces.
+static VOID WSKAPI WSKReaderCopy(
+    _In_ const _WSKREADER* Reader,
+    _In_ SIZE_T Offset,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ SIZE_T Length
+)
+{
+    const SIZE_T Start = (Reader->Head + Offset) & (Reader->Capacity - 1);
+    const SIZE_T First = min(Length, Reader->Capacity - Start);
+
+    RtlCopyMemory(Buffer, &Reader->Buffer[Start], First);
+    RtlCopyMemory(static_cast<PUCHAR>(Buffer) + First, Reader->Buffer, Length - First);
+}
+
+// One receive into the free space that follows Tail without wrapping.
+static NTSTATUS WSKAPI WSKReaderFill(
+    _In_ _WSKREADER* Reader
+)
+{
+    if (Reader->Eof)
+    {
+        return STATUS_END_OF_FILE;
+    }
+
+    // Starting over at the front of the ring gives the receive the whole buffer.
+    if (Reader->Head == Reader->Tail)
+    {
+        Reader->Head = 0u;
+        Reader->Tail = 0u;
+    }
+
+    const SIZE_T Start = Reader->Tail & (Reader->Capacity - 1);
+    const SIZE_T Free  = min(Reader->Capacity - WSKReaderCount(Reader), Reader->Capacity - Start);
+
+    if (Free == 0)
+    {
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    SIZE_T Received = 0u;
+
+    const NTSTATUS Status = WSKReceive(Reader->Socket, &Reader->Buffer[Start], Free, &Received, 0u, nullptr, nullptr);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    if (Received == 0)
+    {
+        Reader->Eof = TRUE;
+        return STATUS_END_OF_FILE;
+    }
+
+    Reader->Tail += Received;
+
+    return STATUS_SUCCESS;
+}
+
+// Offset of the first delimiter at or after From, the buffered count if there is none.
+// The ring is searched as up to two contiguous pieces, a candidate is then compared in full.
+static SIZE_T WSKAPI WSKReaderFind(
+    _In_ const _WSKREADER* Reader,
+    _In_ SIZE_T From,
+    _In_reads_bytes_(DelimiterLength) const UCHAR* Delimiter,
+    _In_ SIZE_T DelimiterLength
+)
+{
+    const SIZE_T Count = WSKReaderCount(Reader);
+
+    while (From + DelimiterLength <= Count)
+    {
+        const SIZE_T Start  = (Reader->Head + From) & (Reader->Capacity - 1);
+        const SIZE_T Length = min(Count - From, Reader->Capacity - Start);
+
+        const SIZE_T Found = WSKFindByte(&Reader->Buffer[Start], Length, Delimiter[0]);
+
+        From += Found;
+
+        if (Found == Length)
+        {
+            continue;
+        }
+
+        if (From + DelimiterLength > Count)
+        {
+            break;
+        }
+
+        SIZE_T Matched = 1u;
+        while (Matched < DelimiterLength && WSKReaderByte(Reader, From + Matched) == Delimiter[Matched])
+        {
+            Matched += 1;
+        }
+
+        if (Matched == DelimiterLength)
+        {
+            return From;
+        }
+
+        From += 1;
+    }
+
+    return Count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public  Function
+
+NTSTATUS WSKAPI WSKCreateReader(
+    _Out_ PWSKREADER* Reader,
+    _In_  SOCKET      Socket,
+    _In_  SIZE_T      Capacity
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (Reader == nullptr || Socket == WSK_INVALID_SOCKET)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        *Reader = nullptr;
+
+        SIZE_T Size = WSK_READER_DEFAULT_CAPACITY;
+        if (Capacity)
+        {
+            Size = 16u;
+            while (Size < Capacity && Size <= (MAXSIZE_T >> 1))
+            {
+                Size <<= 1;
+            }
+        }
+
+        auto Reader_ = static_cast<PWSKREADER>(ExAllocatePoolZero(NonPagedPool,
+            sizeof(_WSKREADER), WSK_POOL_TAG));
+        if (Reader_ == nullptr)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Reader_->Buffer = static_cast<PUCHAR>(ExAllocatePoolZero(NonPagedPool, Size, WSK_POOL_TAG));
+        if (Reader_->Buffer == nullptr)
+        {
+            ExFreePoolWithTag(Reader_, WSK_POOL_TAG);
+
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        Reader_->Socket   = Socket;
+        Reader_->Capacity = Size;
+
+        *Reader = Reader_;
+
+    } while (false);
+
+    return Status;
+}
+
+VOID WSKAPI WSKDeleteReader(
+    _In_ PWSKREADER Reader
+)
+{
+    if (Reader)
+    {
+        ExFreePoolWithTag(Reader->Buffer, WSK_POOL_TAG);
+        ExFreePoolWithTag(Reader, WSK_POOL_TAG);
+    }
+}
+
+NTSTATUS WSKAPI WSKReaderReadUntil(
+    _In_ PWSKREADER Reader,
+    _In_reads_bytes_(DelimiterLength) const VOID* Delimiter,
+    _In_ SIZE_T     DelimiterLength,
+    _Out_writes_bytes_to_(BufferLength, *BytesRead) PVOID Buffer,
+    _In_ SIZE_T     BufferLength,
+    _Out_ SIZE_T*   BytesRead
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (BytesRead)
+        {
+            *BytesRead = 0u;
+        }
+
+        if (Reader == nullptr || Delimiter == nullptr || DelimiterLength == 0 ||
+            DelimiterLength > Reader->Capacity || BytesRead == nullptr)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        const auto Pattern = static_cast<const UCHAR*>(Delimiter);
+
+        // Bytes already searched are not searched again after a receive.
+        SIZE_T From  = 0u;
+        SIZE_T Found = 0u;
+
+        for (;;)
+        {
+            const SIZE_T Count = WSKReaderCount(Reader);
+
+            Found = WSKReaderFind(Reader, From, Pattern, DelimiterLength);
+            if (Found != Count)
+            {
+                break;
+            }
+
+            From = (Count >= DelimiterLength) ? (Count - DelimiterLength + 1) : 0u;
+
+            Status = WSKReaderFill(Reader);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        const SIZE_T Length = Found + DelimiterLength;
+
+        // The line stays buffered, the caller may retry with a larger buffer.
+        if (Length > BufferLength || Buffer == nullptr)
+        {
+            *BytesRead = Length;
+
+            Status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        WSKReaderCopy(Reader, 0u, Buffer, Length);
+
+        Reader->Head += Length;
+        *BytesRead    = Length;
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKReaderReadExact(
+    _In_ PWSKREADER Reader,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ SIZE_T     Length
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (Reader == nullptr || (Buffer == nullptr && Length))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        // What does not fit the ring is received into the caller's buffer directly.
+        if (Length > Reader->Capacity)
+        {
+            SIZE_T Copied = WSKReaderCount(Reader);
+
+            WSKReaderCopy(Reader, 0u, Buffer, Copied);
+            Reader->Head = Reader->Tail;
+
+            while (Copied < Length)
+            {
+                SIZE_T Received = 0u;
+
+                Status = Reader->Eof ? STATUS_END_OF_FILE : WSKReceive(Reader->Socket,
+                    static_cast<PUCHAR>(Buffer) + Copied, Length - Copied, &Received, 0u, nullptr, nullptr);
+                if (NT_SUCCESS(Status) && Received == 0)
+                {
+                    Reader->Eof = TRUE;
+                    Status = STATUS_END_OF_FILE;
+                }
+
+                if (!NT_SUCCESS(Status))
+                {
+                    break;
+                }
+
+                Copied += Received;
+            }
+
+            break;
+        }
+
+        while (WSKReaderCount(Reader) < Length)
+        {
+            Status = WSKReaderFill(Reader);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WSKReaderCopy(Reader, 0u, Buffer, Length);
+        Reader->Head += Length;
+
+    } while (false);
+
+    return Status;
+}
+
+NTSTATUS WSKAPI WSKReaderPeek(
+    _In_ PWSKREADER Reader,
+    _Out_writes_bytes_to_(BufferLength, *BytesPeeked) PVOID Buffer,
+    _In_ SIZE_T     BufferLength,
+    _Out_ SIZE_T*   BytesPeeked
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    do
+    {
+        if (BytesPeeked)
+        {
+            *BytesPeeked = 0u;
+        }
+
+        if (Reader == nullptr || BytesPeeked == nullptr || (Buffer == nullptr && BufferLength))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (WSKReaderCount(Reader) == 0)
+        {
+            Status = WSKReaderFill(Reader);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+
+        const SIZE_T Length = min(BufferLength, WSKReaderCount(Reader));
+
+        WSKReaderCopy(Reader, 0u, Buffer, Length);
+        *BytesPeeked = Length;
+
+    } while (false);
+
+    return Status;
+}
@@ -84,7 +84,9 @@ VOID WSKAPI WSKSocketsAVLTableCleanup()
 BOOLEAN WSKAPI WSKSocketsAVLTableInsert(
     _Out_ SOCKET*       SocketFD,
     _In_  PWSK_SOCKET   Socket,
-    _In_  USHORT        SocketType
+    _In_  USHORT        SocketType,
+    _In_  const WSK_SOCKET_KIND* Kind,
+    _In_opt_ PSOCKET_CONTEXT Context
 )
 {
     PAGED_CODE();
@@ -94,8 +96,10 @@ BOOLEAN WSKAPI WSKSocketsAVLTableInsert(
     SOCKET_OBJECT SockObject{};
     SockObject.Socket       = Socket;
     SockObject.SocketType   = SocketType;
+    SockObject.Kind         = Kind;
     SockObject.SendTimeout  = WSK_INFINITE_WAIT;
     SockObject.RecvTimeout  = WSK_INFINITE_WAIT;
+    SockObject.Context      = Context;
 
     BOOLEAN Inserted = FALSE;
 
@@ -172,6 +176,37 @@ BOOLEAN WSKAPI WSKSocketsAVLTableFind(
     return Found;
 }
 
+BOOLEAN WSKAPI WSKSocketsAVLTableReference(
+    _In_  SOCKET         SocketFD,
+    _Out_ SOCKET_OBJECT* SocketObject
+)
+{
+    PAGED_CODE();
+
+    BOOLEAN Found = FALSE;
+
+    SocketObject->FileDescriptor = static_cast<USHORT>(SocketFD);
+
+    ExAcquireFastMutex(&WSKSocketsAVLTableMutex);
+    {
+        auto Node = static_cast<SOCKET_OBJECT*>(RtlLookupElementGenericTableAvl(&WSKSocketsAVLTable, SocketObject));
+        if (Node != nullptr)
+        {
+            Found = TRUE;
+
+            if (Node->Context)
+            {
+                InterlockedIncrement(&Node->Context->RefCount);
+            }
+
+            *SocketObject = *Node;
+        }
+    }
+    ExReleaseFastMutex(&WSKSocketsAVLTableMutex);
+
+    return Found;
+}
+
 BOOLEAN WSKAPI WSKSocketsAVLTableUpdate(
     _In_  SOCKET         SocketFD,
     _In_  SOCKET_OBJECT* SocketObject
@@ -192,6 +227,8 @@ BOOLEAN WSKAPI WSKSocketsAVLTableUpdate(
 
             Node->SendTimeout = SocketObject->SendTimeout;
             Node->RecvTimeout = SocketObject->RecvTimeout;
+            Node->NonBlocking = SocketObject->NonBlocking;
+            Node->Bound       = SocketObject->Bound;
         }
     }
     ExReleaseFastMutex(&WSKSocketsAVLTableMutex);
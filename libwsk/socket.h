@@ -1,4 +1,5 @@
 #pragma once
+#include "timer.h"
 
 using SOCKET = UINT_PTR;
 
@@ -10,19 +11,66 @@ using SOCKET = UINT_PTR;
 #  define WSK_FLAG_INVALID_SOCKET 0xffffffff
 #endif
 
+#define WSK_SOCKET_STATE_LISTENING  0x0001
+#define WSK_SOCKET_STATE_CONNECTED  0x0002
+#define WSK_SOCKET_STATE_DATAGRAM   0x0004
+#define WSK_SOCKET_STATE_CONNECTING 0x0008
+#define WSK_SOCKET_STATE_READABLE   0x0010
+#define WSK_SOCKET_STATE_PEERCLOSED 0x0020
+#define WSK_SOCKET_STATE_ABORTED    0x0040
+#define WSK_SOCKET_STATE_CLOSED     0x0080
+#define WSK_SOCKET_STATE_IDLE       0x0100
+#define WSK_SOCKET_STATE_RECVSHUT   0x0200  // shutdown(SD_RECEIVE)
+
 //////////////////////////////////////////////////////////////////////////
 // Private Struct
 
+struct WSK_PORT_ENTRY;
+
+// Nonpaged, shared with the provider event callbacks.
+struct SOCKET_CONTEXT
+{
+    volatile LONG   RefCount;
+    KSPIN_LOCK      Lock;
+    EX_RUNDOWN_REF  Rundown;        // Cached dispatch calls on the provider socket, waited for by close
+
+    ULONG           State;          // WSK_SOCKET_STATE_xxx
+    ULONG           EventMask;      // WSK_EVENT_xxx enabled on the provider socket
+    ULONG           Datagrams;      // Indicated and not yet received
+    ULONG           Indications;    // Receive indications so far, see WSKReceivedContextIRP
+    ULONG           Backlog;
+    ULONG           AcceptCount;
+    SIZE_T          SendBuffered;   // Nonblocking sends not yet completed
+    ULONG           IdleTimeout;    // WSK_SO_IDLE_TIMEOUT, milliseconds
+    WSK_TIMER_ENTRY IdleTimer;      // Holds a reference while armed
+    SOCKADDR_STORAGE SourceAddress; // WSK_SO_CONNECT_SOURCE, ss_family 0 if not set
+    USHORT          SourcePortLow;  // Host order, 0 lets the stack choose
+    USHORT          SourcePortHigh;
+    BOOLEAN         SourcePortShared; // WSK_SO_SHARE_SOURCE_PORT
+    USHORT          SourcePort;     // Reserved from SourcePortEntry until close
+    WSK_PORT_ENTRY* SourcePortEntry;
+    LIST_ENTRY      AcceptQueue;    // WSK_ACCEPT_ENTRY
+    LIST_ENTRY      Waiters;        // WSK_POLL_WAITER
+    WORK_QUEUE_ITEM Teardown;       // Final release above PASSIVE_LEVEL
+    LIST_ENTRY      Requests;       // WSK_CONTEXT_IRP, outstanding
+};
+using PSOCKET_CONTEXT = SOCKET_CONTEXT*;
+
+struct WSK_SOCKET_KIND;
+
 struct SOCKET_OBJECT
 {
     PWSK_SOCKET Socket;
     USHORT      SocketType;     // WSK_FLAG_xxxxxx_SOCKET
+    const WSK_SOCKET_KIND* Kind; // Operations of SocketType, resolved when inserted
     USHORT      FileDescriptor; // SOCKET FD
 
     ULONG       SendTimeout;
     ULONG       RecvTimeout;
+    BOOLEAN     NonBlocking;    // FIONBIO
+    BOOLEAN     Bound;          // WSKBind, or the implicit bind of connect
 
-    PVOID       Context;
+    PSOCKET_CONTEXT Context;
 };
 using PSOCKET_OBJECT = SOCKET_OBJECT*;
 
@@ -36,7 +84,9 @@ VOID WSKAPI WSKSocketsAVLTableCleanup();
 BOOLEAN WSKAPI WSKSocketsAVLTableInsert(
     _Out_ SOCKET*        SocketFD,
     _In_  PWSK_SOCKET    Socket,
-    _In_  USHORT         SocketType
+    _In_  USHORT         SocketType,
+    _In_  const WSK_SOCKET_KIND* Kind,
+    _In_opt_ PSOCKET_CONTEXT Context
 );
 
 BOOLEAN WSKAPI WSKSocketsAVLTableDelete(
@@ -48,6 +98,12 @@ BOOLEAN WSKAPI WSKSocketsAVLTableFind(
     _Out_ SOCKET_OBJECT* SocketObject
 );
 
+// Same as Find, also takes a reference on SocketObject->Context.
+BOOLEAN WSKAPI WSKSocketsAVLTableReference(
+    _In_  SOCKET         SocketFD,
+    _Out_ SOCKET_OBJECT* SocketObject
+);
+
 BOOLEAN WSKAPI WSKSocketsAVLTableUpdate(
     _In_  SOCKET         SocketFD,
     _In_  SOCKET_OBJECT* SocketObject
@@ -0,0 +1,303 @@
+﻿#include "timer.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+static const ULONG WSK_TIMER_TICK   = 10u;  // Milliseconds
+static const ULONG WSK_TIMER_BITS   = 6u;
+static const ULONG WSK_TIMER_SLOTS  = 1u << WSK_TIMER_BITS;
+static const ULONG WSK_TIMER_LEVELS = 4u;
+
+// Level n holds the entries expiring within 64^(n+1) ticks, about 46 hours in total.
+static const ULONG64 WSK_TIMER_MAX_TICKS = (1ull << (WSK_TIMER_BITS * WSK_TIMER_LEVELS)) - 1u;
+
+struct WSK_TIMER_WHEEL
+{
+    KSPIN_LOCK  Lock;
+    ULONG64     Now;        // Next tick to run
+    ULONG       Count;      // Armed entries
+    BOOLEAN     Running;
+
+    KTIMER      Timer;
+    KDPC        Dpc;
+
+    LIST_ENTRY  Slots[WSK_TIMER_LEVELS][WSK_TIMER_SLOTS];
+    LIST_ENTRY  Expired;    // Still armed, the routine has not been called yet
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+static WSK_TIMER_WHEEL WSKTimerWheel;
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+static ULONG64 WSKAPI WSKTimerCurrentTick()
+{
+    return KeQueryInterruptTime() / (WSK_TIMER_TICK * 10000u);
+}
+
+// The wheel lock must be held.
+static VOID WSKAPI WSKTimerInsert(
+    _In_ WSK_TIMER_ENTRY* Timer
+)
+{
+    auto Wheel = &WSKTimerWheel;
+
+    if (Timer->Expires < Wheel->Now)
+    {
+        Timer->Expires = Wheel->Now;
+    }
+
+    const ULONG64 Delta = Timer->Expires - Wheel->Now;
+
+    ULONG Level = 0u;
+    while (Level + 1 < WSK_TIMER_LEVELS && Delta >= (1ull << (WSK_TIMER_BITS * (Level + 1))))
+    {
+        Level += 1;
+    }
+
+    const ULONG Slot = static_cast<ULONG>(Timer->Expires >> (WSK_TIMER_BITS * Level)) & (WSK_TIMER_SLOTS - 1);
+
+    InsertTailList(&Wheel->Slots[Level][Slot], &Timer->Link);
+}
+
+// Moves the entries of an upper slot down once the lower level wraps around.
+static ULONG WSKAPI WSKTimerCascade(
+    _In_ ULONG Level
+)
+{
+    auto Wheel = &WSKTimerWheel;
+
+    const ULONG Slot = static_cast<ULONG>(Wheel->Now >> (WSK_TIMER_BITS * Level)) & (WSK_TIMER_SLOTS - 1);
+
+    LIST_ENTRY List;
+    InitializeListHead(&List);
+
+    while (!IsListEmpty(&Wheel->Slots[Level][Slot]))
+    {
+        InsertTailList(&List, RemoveHeadList(&Wheel->Slots[Level][Slot]));
+    }
+
+    while (!IsListEmpty(&List))
+    {
+        WSKTimerInsert(CONTAINING_RECORD(RemoveHeadList(&List), WSK_TIMER_ENTRY, Link));
+    }
+
+    return Slot;
+}
+
+static VOID NTAPI WSKTimerDpcRoutine(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2
+)
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(DeferredContext);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    auto Wheel = &WSKTimerWheel;
+
+    KeAcquireSpinLockAtDpcLevel(&Wheel->Lock);
+    {
+        const ULONG64 Current = WSKTimerCurrentTick();
+
+        while (Wheel->Now <= Current && Wheel->Count)
+        {
+            const ULONG Slot = static_cast<ULONG>(Wheel->Now) & (WSK_TIMER_SLOTS - 1);
+
+            if (Slot == 0)
+            {
+                for (ULONG Level = 1; Level < WSK_TIMER_LEVELS; ++Level)
+                {
+                    if (WSKTimerCascade(Level) != 0)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            while (!IsListEmpty(&Wheel->Slots[0][Slot]))
+            {
+                InsertTailList(&Wheel->Expired, RemoveHeadList(&Wheel->Slots[0][Slot]));
+            }
+
+            Wheel->Now += 1;
+        }
+    }
+    KeReleaseSpinLockFromDpcLevel(&Wheel->Lock);
+
+    // Routines run unlocked, one entry at a time, they may arm or cancel any entry.
+    for (;;)
+    {
+        WSK_TIMER_ROUTINE Routine = nullptr;
+        PVOID             Context = nullptr;
+
+        KeAcquireSpinLockAtDpcLevel(&Wheel->Lock);
+        {
+            if (!IsListEmpty(&Wheel->Expired))
+            {
+                auto Timer = CONTAINING_RECORD(RemoveHeadList(&Wheel->Expired), WSK_TIMER_ENTRY, Link);
+                InitializeListHead(&Timer->Link);
+
+                Timer->Armed = FALSE;
+                Wheel->Count -= 1;
+
+                Routine = Timer->Routine;
+                Context = Timer->Context;
+            }
+            else if (Wheel->Count == 0 && Wheel->Running)
+            {
+                KeCancelTimer(&Wheel->Timer);
+                Wheel->Running = FALSE;
+            }
+        }
+        KeReleaseSpinLockFromDpcLevel(&Wheel->Lock);
+
+        if (Routine == nullptr)
+        {
+            break;
+        }
+
+        Routine(Context);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+VOID WSKAPI WSKTimerWheelInitialize()
+{
+    auto Wheel = &WSKTimerWheel;
+
+    KeInitializeSpinLock(&Wheel->Lock);
+    KeInitializeTimerEx(&Wheel->Timer, NotificationTimer);
+    KeInitializeDpc(&Wheel->Dpc, &WSKTimerDpcRoutine, nullptr);
+
+    for (ULONG Level = 0; Level < WSK_TIMER_LEVELS; ++Level)
+    {
+        for (ULONG Slot = 0; Slot < WSK_TIMER_SLOTS; ++Slot)
+        {
+            InitializeListHead(&Wheel->Slots[Level][Slot]);
+        }
+    }
+
+    InitializeListHead(&Wheel->Expired);
+
+    Wheel->Now     = WSKTimerCurrentTick();
+    Wheel->Count   = 0u;
+    Wheel->Running = FALSE;
+}
+
+VOID WSKAPI WSKTimerWheelCleanup()
+{
+    auto Wheel = &WSKTimerWheel;
+
+    KeCancelTimer(&Wheel->Timer);
+    KeFlushQueuedDpcs();
+
+    Wheel->Running = FALSE;
+}
+
+VOID WSKAPI WSKTimerInitialize(
+    _Out_ WSK_TIMER_ENTRY*  Timer,
+    _In_  WSK_TIMER_ROUTINE Routine,
+    _In_opt_ PVOID          Context
+)
+{
+    InitializeListHead(&Timer->Link);
+
+    Timer->Expires = 0u;
+    Timer->Routine = Routine;
+    Timer->Context = Context;
+    Timer->Armed   = FALSE;
+}
+
+BOOLEAN WSKAPI WSKTimerArm(
+    _Inout_ WSK_TIMER_ENTRY* Timer,
+    _In_    ULONG            Milliseconds
+)
+{
+    auto Wheel = &WSKTimerWheel;
+
+    ULONG64 Ticks = (static_cast<ULONG64>(Milliseconds) + WSK_TIMER_TICK - 1) / WSK_TIMER_TICK;
+    if (Ticks == 0)
+    {
+        Ticks = 1;
+    }
+    if (Ticks > WSK_TIMER_MAX_TICKS)
+    {
+        Ticks = WSK_TIMER_MAX_TICKS;
+    }
+
+    BOOLEAN Armed = FALSE;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Wheel->Lock, &Irql);
+    {
+        const ULONG64 Current = WSKTimerCurrentTick();
+
+        Armed = Timer->Armed;
+
+        if (Armed)
+        {
+            RemoveEntryList(&Timer->Link);
+        }
+        else
+        {
+            Timer->Armed = TRUE;
+            Wheel->Count += 1;
+        }
+
+        // The wheel stays idle while nothing is armed.
+        if (!Wheel->Running)
+        {
+            LARGE_INTEGER DueTime{};
+            DueTime.QuadPart = Int32x32To64(WSK_TIMER_TICK, -10000);
+
+            Wheel->Now     = Current;
+            Wheel->Running = TRUE;
+
+            KeSetTimerEx(&Wheel->Timer, DueTime, WSK_TIMER_TICK, &Wheel->Dpc);
+        }
+
+        Timer->Expires = Current + Ticks;
+
+        WSKTimerInsert(Timer);
+    }
+    KeReleaseSpinLock(&Wheel->Lock, Irql);
+
+    return Armed;
+}
+
+BOOLEAN WSKAPI WSKTimerCancel(
+    _Inout_ WSK_TIMER_ENTRY* Timer
+)
+{
+    auto Wheel = &WSKTimerWheel;
+
+    BOOLEAN Armed = FALSE;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Wheel->Lock, &Irql);
+    {
+        Armed = Timer->Armed;
+
+        if (Armed)
+        {
+            RemoveEntryList(&Timer->Link);
+            InitializeListHead(&Timer->Link);
+
+            Timer->Armed = FALSE;
+            Wheel->Count -= 1;
+        }
+    }
+    KeReleaseSpinLock(&Wheel->Lock, Irql);
+
+    return Armed;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Hierarchical timer wheel shared by all sockets.
+// Arming and cancelling are O(1), one kernel timer drives every entry.
+
+using WSK_TIMER_ROUTINE = VOID(WSKAPI*)(
+    _In_ PVOID Context
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+// Embedded in its owner, nonpaged.
+struct WSK_TIMER_ENTRY
+{
+    LIST_ENTRY          Link;
+    ULONG64             Expires;    // In ticks
+    WSK_TIMER_ROUTINE   Routine;
+    PVOID               Context;
+    BOOLEAN             Armed;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+VOID WSKAPI WSKTimerWheelInitialize();
+
+VOID WSKAPI WSKTimerWheelCleanup();
+
+VOID WSKAPI WSKTimerInitialize(
+    _Out_ WSK_TIMER_ENTRY*  Timer,
+    _In_  WSK_TIMER_ROUTINE Routine,
+    _In_opt_ PVOID          Context
+);
+
+// Returns TRUE if the timer was already armed, it is moved to the new deadline.
+// The routine runs at DISPATCH_LEVEL.
+BOOLEAN WSKAPI WSKTimerArm(
+    _Inout_ WSK_TIMER_ENTRY* Timer,
+    _In_    ULONG            Milliseconds
+);
+
+// Returns TRUE if the timer was armed, its routine will not run.
+BOOLEAN WSKAPI WSKTimerCancel(
+    _Inout_ WSK_TIMER_ENTRY* Timer
+);
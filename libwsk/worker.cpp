@@ -0,0 +1,182 @@
+﻿#include "worker.h"
+
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+struct WSK_WORKER
+{
+    KSPIN_LOCK  Lock;
+    LIST_ENTRY  Queue;
+    KEVENT      Wakeup;
+    PKTHREAD    Thread;
+    BOOLEAN     Stopping;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Global  Data
+
+static WSK_WORKER WSKWorker;
+
+//////////////////////////////////////////////////////////////////////////
+// Private Function
+
+static VOID WSKAPI WSKWorkerDrain()
+{
+    auto Worker = &WSKWorker;
+
+    for (;;)
+    {
+        WSK_WORK_ROUTINE Routine = nullptr;
+        PVOID            Context = nullptr;
+
+        KIRQL Irql;
+        KeAcquireSpinLock(&Worker->Lock, &Irql);
+        {
+            if (!IsListEmpty(&Worker->Queue))
+            {
+                auto Item = CONTAINING_RECORD(RemoveHeadList(&Worker->Queue), WSK_WORK_ITEM, Link);
+                InitializeListHead(&Item->Link);
+
+                Item->Queued = FALSE;
+
+                Routine = Item->Routine;
+                Context = Item->Context;
+            }
+        }
+        KeReleaseSpinLock(&Worker->Lock, Irql);
+
+        if (Routine == nullptr)
+        {
+            break;
+        }
+
+        Routine(Context);
+    }
+}
+
+static VOID NTAPI WSKWorkerThread(
+    _In_ PVOID StartContext
+)
+{
+    UNREFERENCED_PARAMETER(StartContext);
+
+    auto Worker = &WSKWorker;
+
+    for (;;)
+    {
+        KeWaitForSingleObject(&Worker->Wakeup, Executive, KernelMode, FALSE, nullptr);
+
+        WSKWorkerDrain();
+
+        if (Worker->Stopping)
+        {
+            break;
+        }
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+NTSTATUS WSKAPI WSKWorkerInitialize()
+{
+    PAGED_CODE();
+
+    NTSTATUS Status = STATUS_SUCCESS;
+    auto     Worker = &WSKWorker;
+
+    do
+    {
+        KeInitializeSpinLock(&Worker->Lock);
+        KeInitializeEvent(&Worker->Wakeup, SynchronizationEvent, FALSE);
+        InitializeListHead(&Worker->Queue);
+
+        Worker->Thread   = nullptr;
+        Worker->Stopping = FALSE;
+
+        OBJECT_ATTRIBUTES ObjectAttributes{};
+        InitializeObjectAttributes(&ObjectAttributes, nullptr, OBJ_KERNEL_HANDLE, nullptr, nullptr);
+
+        HANDLE ThreadHandle = nullptr;
+
+        Status = PsCreateSystemThread(&ThreadHandle, THREAD_ALL_ACCESS, &ObjectAttributes,
+            nullptr, nullptr, &WSKWorkerThread, nullptr);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = ObReferenceObjectByHandle(ThreadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode,
+            reinterpret_cast<PVOID*>(&Worker->Thread), nullptr);
+
+        ZwClose(ThreadHandle);
+
+    } while (false);
+
+    return Status;
+}
+
+VOID WSKAPI WSKWorkerCleanup()
+{
+    PAGED_CODE();
+
+    auto Worker = &WSKWorker;
+
+    if (Worker->Thread == nullptr)
+    {
+        return;
+    }
+
+    Worker->Stopping = TRUE;
+    KeSetEvent(&Worker->Wakeup, IO_NO_INCREMENT, FALSE);
+
+    KeWaitForSingleObject(Worker->Thread, Executive, KernelMode, FALSE, nullptr);
+
+    ObDereferenceObject(Worker->Thread);
+    Worker->Thread = nullptr;
+}
+
+VOID WSKAPI WSKWorkInitialize(
+    _Out_ WSK_WORK_ITEM*   Item,
+    _In_  WSK_WORK_ROUTINE Routine,
+    _In_opt_ PVOID         Context
+)
+{
+    InitializeListHead(&Item->Link);
+
+    Item->Routine = Routine;
+    Item->Context = Context;
+    Item->Queued  = FALSE;
+}
+
+BOOLEAN WSKAPI WSKWorkQueue(
+    _Inout_ WSK_WORK_ITEM* Item
+)
+{
+    auto Worker = &WSKWorker;
+
+    BOOLEAN Queued = FALSE;
+
+    KIRQL Irql;
+    KeAcquireSpinLock(&Worker->Lock, &Irql);
+    {
+        if (!Item->Queued)
+        {
+            Item->Queued = TRUE;
+            InsertTailList(&Worker->Queue, &Item->Link);
+
+            Queued = TRUE;
+        }
+    }
+    KeReleaseSpinLock(&Worker->Lock, Irql);
+
+    if (Queued)
+    {
+        KeSetEvent(&Worker->Wakeup, IO_NO_INCREMENT, FALSE);
+    }
+
+    return Queued;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// One system thread shared by the library for work that has to run at PASSIVE_LEVEL,
+// queued from timer routines and completion routines.
+
+using WSK_WORK_ROUTINE = VOID(WSKAPI*)(
+    _In_ PVOID Context
+    );
+
+//////////////////////////////////////////////////////////////////////////
+// Private Struct
+
+// Embedded in its owner, nonpaged.
+struct WSK_WORK_ITEM
+{
+    LIST_ENTRY          Link;
+    WSK_WORK_ROUTINE    Routine;
+    PVOID               Context;
+    BOOLEAN             Queued;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Public Function
+
+NTSTATUS WSKAPI WSKWorkerInitialize();
+
+// Runs what is still queued, then stops the thread.
+VOID WSKAPI WSKWorkerCleanup();
+
+VOID WSKAPI WSKWorkInitialize(
+    _Out_ WSK_WORK_ITEM*   Item,
+    _In_  WSK_WORK_ROUTINE Routine,
+    _In_opt_ PVOID         Context
+);
+
+// Returns FALSE if the item is queued already, it runs once.
+// Callable at DISPATCH_LEVEL. Once the routine has started, the item may be queued again.
+BOOLEAN WSKAPI WSKWorkQueue(
+    _Inout_ WSK_WORK_ITEM* Item
+);
@@ -0,0 +1,454 @@
+#pragma once
+#include "libwsk.h"
+
+// Move-only C++ owner of a SOCKET, header only.
+// The socket object and its provider routines are resolved once, send and receive
+// then go through WSKSendDispatch and WSKReceiveDispatch without the table lookup.
+//
+//     wsk::stream_socket Socket;
+//     Status = wsk::stream_socket::create(Socket, AF_INET, IPPROTO_TCP);
+//     Status = Socket.connect(Address, sizeof(SOCKADDR_IN));
+//     Status = Socket.send(Request, &Sent);
+//
+// stream_socket and datagram_socket only offer the operations of their kind,
+// so a send() on a datagram socket does not compile. wsk::socket takes any kind.
+
+#if defined(__cplusplus) && __has_include(<span>)
+
+#include <span>
+
+#if defined(__cpp_lib_span)
+
+namespace wsk
+{
+    struct any_kind
+    {
+        static constexpr USHORT type      = 0u;
+        static constexpr bool   stream    = true;
+        static constexpr bool   datagram  = true;
+    };
+
+    struct stream_kind
+    {
+        static constexpr USHORT type      = SOCK_STREAM;
+        static constexpr bool   stream    = true;
+        static constexpr bool   datagram  = false;
+    };
+
+    struct datagram_kind
+    {
+        static constexpr USHORT type      = SOCK_DGRAM;
+        static constexpr bool   stream    = false;
+        static constexpr bool   datagram  = true;
+    };
+
+    template<typename Kind>
+    class basic_socket
+    {
+        SOCKET            Handle = WSK_INVALID_SOCKET;
+        WSKSOCKETDISPATCH Dispatch{};
+
+    public:
+        basic_socket() noexcept = default;
+
+        // Takes ownership of Handle.
+        explicit basic_socket(_In_ SOCKET Handle) noexcept
+            : Handle(Handle)
+        {
+            resolve();
+        }
+
+        basic_socket(basic_socket&& Other) noexcept
+            : Handle(Other.Handle), Dispatch(Other.Dispatch)
+        {
+            Other.Handle   = WSK_INVALID_SOCKET;
+            Other.Dispatch = {};
+        }
+
+        basic_socket& operator=(basic_socket&& Other) noexcept
+        {
+            if (this != &Other)
+            {
+                close();
+
+                Handle   = Other.Handle;
+                Dispatch = Other.Dispatch;
+
+                Other.Handle   = WSK_INVALID_SOCKET;
+                Other.Dispatch = {};
+            }
+            return *this;
+        }
+
+        basic_socket(const basic_socket&) = delete;
+        basic_socket& operator=(const basic_socket&) = delete;
+
+        ~basic_socket()
+        {
+            close();
+        }
+
+        static NTSTATUS create(
+            _Out_ basic_socket&  Socket,
+            _In_  ADDRESS_FAMILY AddressFamily,
+            _In_  ULONG          Protocol
+        ) noexcept requires (Kind::type != 0u)
+        {
+            return create(Socket, AddressFamily, Kind::type, Protocol);
+        }
+
+        static NTSTATUS create(
+            _Out_ basic_socket&  Socket,
+            _In_  ADDRESS_FAMILY AddressFamily,
+            _In_  USHORT         SocketType,
+            _In_  ULONG          Protocol
+        ) noexcept
+        {
+            if (Kind::type != 0u && SocketType != Kind::type)
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            SOCKET Handle = WSK_INVALID_SOCKET;
+
+            const NTSTATUS Status = WSKSocket(&Handle, AddressFamily, SocketType, Protocol, nullptr);
+            if (NT_SUCCESS(Status))
+            {
+                Socket = basic_socket(Handle);
+            }
+            return Status;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return Handle != WSK_INVALID_SOCKET;
+        }
+
+        SOCKET native_handle() const noexcept
+        {
+            return Handle;
+        }
+
+        // Gives up ownership, the caller closes the handle.
+        SOCKET release() noexcept
+        {
+            WSKDereferenceSocketDispatch(&Dispatch);
+
+            const SOCKET Released = Handle;
+            Handle = WSK_INVALID_SOCKET;
+
+            return Released;
+        }
+
+        NTSTATUS close() noexcept
+        {
+            if (Handle == WSK_INVALID_SOCKET)
+            {
+                return STATUS_SUCCESS;
+            }
+
+            return WSKCloseSocket(release());
+        }
+
+        // Returns at once, see WSKCloseSocketAsync.
+        NTSTATUS close_async(_In_ ULONG LingerMilliseconds = 0u) noexcept
+        {
+            if (Handle == WSK_INVALID_SOCKET)
+            {
+                return STATUS_SUCCESS;
+            }
+
+            return WSKCloseSocketAsync(release(), LingerMilliseconds);
+        }
+
+        // Picks up a new connection state or changed socket options.
+        NTSTATUS resolve() noexcept
+        {
+            WSKDereferenceSocketDispatch(&Dispatch);
+
+            return WSKReferenceSocketDispatch(Handle, &Dispatch);
+        }
+
+        NTSTATUS bind(_In_ PSOCKADDR LocalAddress, _In_ SIZE_T LocalAddressLength) noexcept
+        {
+            return WSKBind(Handle, LocalAddress, LocalAddressLength);
+        }
+
+        NTSTATUS listen(_In_ INT BackLog) noexcept requires Kind::stream
+        {
+            return WSKListen(Handle, BackLog);
+        }
+
+        NTSTATUS connect(_In_ PSOCKADDR RemoteAddress, _In_ SIZE_T RemoteAddressLength) noexcept
+        {
+            const NTSTATUS Status = WSKConnect(Handle, RemoteAddress, RemoteAddressLength);
+            if (NT_SUCCESS(Status))
+            {
+                resolve();
+            }
+            return Status;
+        }
+
+        NTSTATUS accept(
+            _Out_ basic_socket& Client,
+            _Out_opt_ PSOCKADDR RemoteAddress = nullptr,
+            _In_ SIZE_T         RemoteAddressLength = 0u
+        ) noexcept requires Kind::stream
+        {
+            SOCKET ClientHandle = WSK_INVALID_SOCKET;
+
+            const NTSTATUS Status = WSKAccept(Handle, &ClientHandle, nullptr, 0u, RemoteAddress, RemoteAddressLength);
+            if (NT_SUCCESS(Status))
+            {
+                Client = basic_socket(ClientHandle);
+            }
+            return Status;
+        }
+
+        NTSTATUS disconnect(_In_ ULONG Flags = 0u) noexcept requires Kind::stream
+        {
+            return WSKDisconnect(Handle, Flags);
+        }
+
+        NTSTATUS shutdown(_In_ INT How) noexcept requires Kind::stream
+        {
+            return WSKShutdown(Handle, How);
+        }
+
+        // Sends the last data with the FIN, the socket must not send afterwards.
+        NTSTATUS send_and_disconnect(
+            _In_ std::span<const UCHAR> Buffer,
+            _Out_opt_ SIZE_T* NumberOfBytesSent = nullptr
+        ) noexcept requires Kind::stream
+        {
+            return WSKSendAndDisconnect(Handle, const_cast<UCHAR*>(Buffer.data()), Buffer.size(),
+                NumberOfBytesSent, nullptr, nullptr);
+        }
+
+        NTSTATUS set_option(
+            _In_ ULONG  OptionLevel,
+            _In_ ULONG  OptionName,
+            _In_reads_bytes_(InputSize) PVOID InputBuffer,
+            _In_ SIZE_T InputSize
+        ) noexcept
+        {
+            const NTSTATUS Status = WSKSetSocketOpt(Handle, OptionLevel, OptionName, InputBuffer, InputSize);
+            if (NT_SUCCESS(Status))
+            {
+                resolve();
+            }
+            return Status;
+        }
+
+        NTSTATUS send(
+            _In_ std::span<const UCHAR> Buffer,
+            _Out_opt_ SIZE_T*  NumberOfBytesSent = nullptr,
+            _In_ ULONG         Flags = 0u,
+            _In_opt_ WSKOVERLAPPED* Overlapped = nullptr,
+            _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine = nullptr
+        ) noexcept requires Kind::stream
+        {
+            return WSKSendDispatch(&Dispatch, const_cast<UCHAR*>(Buffer.data()), Buffer.size(),
+                NumberOfBytesSent, Flags, Overlapped, CompletionRoutine);
+        }
+
+        // The buffers go out in order as one request.
+        NTSTATUS send_buffers(
+            _In_ std::span<const WSKBUF> Buffers,
+            _Out_opt_ SIZE_T*  NumberOfBytesSent = nullptr,
+            _In_ ULONG         Flags = 0u
+        ) noexcept requires Kind::stream
+        {
+            return WSKSendBuffers(Handle, Buffers.data(), static_cast<ULONG>(Buffers.size()),
+                NumberOfBytesSent, Flags, nullptr, nullptr);
+        }
+
+        NTSTATUS receive(
+            _In_ std::span<UCHAR> Buffer,
+            _Out_opt_ SIZE_T*  NumberOfBytesRecvd = nullptr,
+            _In_ ULONG         Flags = 0u,
+            _In_opt_ WSKOVERLAPPED* Overlapped = nullptr,
+            _In_opt_ LPWSKOVERLAPPED_COMPLETION_ROUTINE CompletionRoutine = nullptr
+        ) noexcept requires Kind::stream
+        {
+            return WSKReceiveDispatch(&Dispatch, Buffer.data(), Buffer.size(),
+                NumberOfBytesRecvd, Flags, Overlapped, CompletionRoutine);
+        }
+
+        NTSTATUS send_to(
+            _In_ std::span<const UCHAR> Buffer,
+            _In_opt_ PSOCKADDR RemoteAddress,
+            _In_ SIZE_T        RemoteAddressLength,
+            _Out_opt_ SIZE_T*  NumberOfBytesSent = nullptr
+        ) noexcept requires Kind::datagram
+        {
+            return WSKSendTo(Handle, const_cast<UCHAR*>(Buffer.data()), Buffer.size(), NumberOfBytesSent, 0u,
+                RemoteAddress, RemoteAddressLength, nullptr, nullptr);
+        }
+
+        NTSTATUS receive_from(
+            _In_ std::span<UCHAR> Buffer,
+            _Out_opt_ PSOCKADDR RemoteAddress,
+            _In_ SIZE_T         RemoteAddressLength,
+            _Out_opt_ SIZE_T*   NumberOfBytesRecvd = nullptr
+        ) noexcept requires Kind::datagram
+        {
+            return WSKReceiveFrom(Handle, Buffer.data(), Buffer.size(), NumberOfBytesRecvd, 0u,
+                RemoteAddress, RemoteAddressLength, nullptr, nullptr);
+        }
+    };
+
+    using socket          = basic_socket<any_kind>;
+    using stream_socket   = basic_socket<stream_kind>;
+    using datagram_socket = basic_socket<datagram_kind>;
+
+    // Owner of a WSKCreateReader reader, the socket must outlive it.
+    //
+    //     wsk::reader Reader;
+    //     Status = wsk::reader::create(Reader, Socket.native_handle());
+    //     Status = Reader.read_until(std::span(Crlf), Line, &Length);
+    class reader
+    {
+        PWSKREADER Handle = nullptr;
+
+    public:
+        reader() noexcept = default;
+
+        reader(reader&& Other) noexcept
+            : Handle(Other.Handle)
+        {
+            Other.Handle = nullptr;
+        }
+
+        reader& operator=(reader&& Other) noexcept
+        {
+            if (this != &Other)
+            {
+                WSKDeleteReader(Handle);
+
+                Handle = Other.Handle;
+                Other.Handle = nullptr;
+            }
+            return *this;
+        }
+
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+
+        ~reader()
+        {
+            WSKDeleteReader(Handle);
+        }
+
+        static NTSTATUS create(
+            _Out_ reader& Reader,
+            _In_  SOCKET  Socket,
+            _In_  SIZE_T  Capacity = 0u
+        ) noexcept
+        {
+            PWSKREADER Handle = nullptr;
+
+            const NTSTATUS Status = WSKCreateReader(&Handle, Socket, Capacity);
+            if (NT_SUCCESS(Status))
+            {
+                WSKDeleteReader(Reader.Handle);
+                Reader.Handle = Handle;
+            }
+            return Status;
+        }
+
+        NTSTATUS read_until(
+            _In_ std::span<const UCHAR> Delimiter,
+            _In_ std::span<UCHAR>       Buffer,
+            _Out_ SIZE_T*               BytesRead
+        ) noexcept
+        {
+            return WSKReaderReadUntil(Handle, Delimiter.data(), Delimiter.size(), Buffer.data(), Buffer.size(), BytesRead);
+        }
+
+        NTSTATUS read_exact(_In_ std::span<UCHAR> Buffer) noexcept
+        {
+            return WSKReaderReadExact(Handle, Buffer.data(), Buffer.size());
+        }
+
+        NTSTATUS peek(_In_ std::span<UCHAR> Buffer, _Out_ SIZE_T* BytesPeeked) noexcept
+        {
+            return WSKReaderPeek(Handle, Buffer.data(), Buffer.size(), BytesPeeked);
+        }
+    };
+
+    // Owner of a WSKCreateFramer framer, the socket must outlive it.
+    //
+    //     wsk::framer Framer;
+    //     Status = wsk::framer::create(Framer, Socket.native_handle(), WSK_FRAME_VARINT | WSK_FRAME_CRC32C);
+    //     Status = Framer.receive(Frame);
+    //     Status = Framer.send(std::span(Frame.Segments, Frame.SegmentCount));
+    class framer
+    {
+        PWSKFRAMER Handle = nullptr;
+
+    public:
+        framer() noexcept = default;
+
+        framer(framer&& Other) noexcept
+            : Handle(Other.Handle)
+        {
+            Other.Handle = nullptr;
+        }
+
+        framer& operator=(framer&& Other) noexcept
+        {
+            if (this != &Other)
+            {
+                WSKDeleteFramer(Handle);
+
+                Handle = Other.Handle;
+                Other.Handle = nullptr;
+            }
+            return *this;
+        }
+
+        framer(const framer&) = delete;
+        framer& operator=(const framer&) = delete;
+
+        ~framer()
+        {
+            WSKDeleteFramer(Handle);
+        }
+
+        static NTSTATUS create(
+            _Out_ framer& Framer,
+            _In_  SOCKET  Socket,
+            _In_  ULONG   Format,
+            _In_  ULONG   MaximumLength = 0u
+        ) noexcept
+        {
+            PWSKFRAMER Handle = nullptr;
+
+            const NTSTATUS Status = WSKCreateFramer(&Handle, Socket, Format, MaximumLength);
+            if (NT_SUCCESS(Status))
+            {
+                WSKDeleteFramer(Framer.Handle);
+                Framer.Handle = Handle;
+            }
+            return Status;
+        }
+
+        // The frame stays valid until the next receive.
+        NTSTATUS receive(_Out_ WSKFRAME& Frame) noexcept
+        {
+            return WSKFramerReceive(Handle, &Frame);
+        }
+
+        NTSTATUS send(
+            _In_ std::span<const WSKBUF> Buffers,
+            _Out_opt_ SIZE_T* NumberOfBytesSent = nullptr
+        ) noexcept
+        {
+            return WSKFramerSend(Handle, Buffers.data(), static_cast<ULONG>(Buffers.size()), NumberOfBytesSent);
+        }
+    };
+}
+
+#endif // #if defined(__cpp_lib_span)
+#endif // #if defined(__cplusplus) && __has_include(<span>)